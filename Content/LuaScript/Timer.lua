@@ -1,5 +1,6 @@
 
 
+--named timers on top of the native timer wheel(Unreal.Timer), nothing is done per frame in lua
 local Class = require("Class")
 local Timer = Timer or Class()
 
@@ -11,51 +12,56 @@ function Timer:new(InName)
 	return Obj
 end
 
+--InComplete(InName) after InTotalTime seconds, InUpdate(InName) every InInterval seconds before that
 function Timer:SetTimer(InName, InTotalTime, InInterval, InComplete, InUpdate)
 
+    self:ClearTimer(InName)
+
     local NewTimer = {}
 
     NewTimer.TotalTime = InTotalTime
-    NewTimer.RemainTime = InTotalTime
-    NewTimer.LastUpdate = InTotalTime
     NewTimer.Interval = InInterval
     NewTimer.Complete = InComplete or nil
     NewTimer.Update = InUpdate or nil
 
+    NewTimer.Handle = Unreal.Timer.Set(InTotalTime, 0, function()
+        self:ClearTimer(InName)
+        if(NewTimer.Complete) then
+            NewTimer.Complete(InName)
+        end
+    end)
+
+    if(NewTimer.Update and InInterval and InInterval > 0) then
+        NewTimer.UpdateHandle = Unreal.Timer.Set(InInterval, InInterval, function()
+            NewTimer.Update(InName)
+        end)
+    end
+
     self.TimerList[InName] = NewTimer
 
 end
 
 function Timer:ClearTimer(InName)
+    local OldTimer = self.TimerList[InName]
+    if(OldTimer) then
+        Unreal.Timer.Clear(OldTimer.Handle)
+        if(OldTimer.UpdateHandle) then
+            Unreal.Timer.Clear(OldTimer.UpdateHandle)
+        end
+    end
     self.TimerList[InName] = nil
 end
 
 function Timer:FindTimer(InName)
-   return self.TimerList[InName]
+    local FoundTimer = self.TimerList[InName]
+    if(FoundTimer) then
+        FoundTimer.RemainTime = Unreal.Timer.GetRemaining(FoundTimer.Handle)
+    end
+    return FoundTimer
 end
 
+--timers are fired by the native wheel in lua tick, kept for old callers
 function Timer:Tick(InDeltaTime)
-
-    for k, v in pairs(self.TimerList) do
-        v.RemainTime = v.RemainTime - InDeltaTime
-
-        if(v.RemainTime <= 0) then
-            if(v.Complete) then
-                v.Complete(k)
-            end
-
-            self.TimerList[k] = nil
-        else
-            if(v.LastUpdate - v.RemainTime >= v.Interval) then
-                v.LastUpdate = v.RemainTime
-                if(v.Update) then
-                    v.Update(k)
-                end
-            end
-        end
-
-    end
-
 end
 
-return Timer
\ No newline at end of file
+return Timer
@@ -35,6 +35,7 @@ public class FastLuaScript : ModuleRules
 				"Engine",
 				"Slate",
 				"SlateCore",
+				"DeveloperSettings",
 				// ... add private dependencies that you statically link with here ...
             }
 			);
@@ -42,6 +43,7 @@ public class FastLuaScript : ModuleRules
         if (Target.Type == TargetType.Editor)
         {
             PublicDependencyModuleNames.AddRange(new string[] { "UnrealEd", "EditorStyle" });
+            PrivateDependencyModuleNames.Add("DirectoryWatcher");
         }
 
         DynamicallyLoadedModuleNames.AddRange(
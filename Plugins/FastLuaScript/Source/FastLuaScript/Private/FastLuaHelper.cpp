@@ -16,7 +16,13 @@
 #include "FastLuaUnrealWrapper.h"
 #include "FastLuaScript.h"
 #include "LuaFunctionWrapper.h"
+#include "LuaLatentActionCallback.h"
+#include "LuaCoroutineWait.h"
 #include "FastLuaStat.h"
+#include "LuaTrace.h"
+#include "LuaBindingStats.h"
+#include "LuaSessionRecorder.h"
+#include "LuaHitchDetector.h"
 #include "lua.hpp"
 
 
@@ -288,7 +294,6 @@ void FastLuaHelper::FetchProperty(lua_State* InL, const FProperty* InProp, void*
 
 int32 FastLuaHelper::CallUnrealFunction(lua_State* InL)
 {
-	SCOPE_CYCLE_COUNTER(STAT_CallUnrealFunction);
 	UFunction* Func = (UFunction*)lua_touserdata(InL, lua_upvalueindex(1));
 	FLuaObjectWrapper* Wrapper = (FLuaObjectWrapper*)lua_touserdata(InL, 1);
 	UObject* Obj = nullptr;
@@ -297,16 +302,44 @@ int32 FastLuaHelper::CallUnrealFunction(lua_State* InL)
 	{
 		Obj = Wrapper->GetObject();
 	}
-	int32 StackTop = 2;
 	if (Obj == nullptr)
 	{
 		lua_pushnil(InL);
 		return 1;
 	}
 
+	//latent function in a coroutine: suspend until the action finishes, outside coroutines it is fire and forget as before
+	if (lua_isyieldable(InL))
+	{
+		if (FStructProperty* LatentInfoProp = ULuaLatentActionCallback::FindLatentInfoProperty(Func))
+		{
+			int32 ReturnNum = 0;
+			if (ULuaLatentActionCallback::Start(InL, Obj, Func, LatentInfoProp, ReturnNum))
+			{
+				//lua_yield longjmps(no exceptions in lua), nothing with a destructor may be alive in this frame
+				return FLuaCoroutineWait::Yield(InL);
+			}
+
+			return ReturnNum;
+		}
+	}
+
+	SCOPE_CYCLE_COUNTER(STAT_CallUnrealFunction);
+	int32 StackTop = 2;
+
+	const uint64 StatsStartCycles = FLuaBindingStats::Begin();
+	const uint64 HitchStartCycles = FLuaHitchDetector::BeginFunction(InL);
+
 	if (Func->NumParms < 1)
 	{
+		FLuaSessionRecorder::RecordCall(InL, Obj, Func, nullptr);
+
+		const bool bTraced = FLuaTrace::BeginFunction(Func);
 		Obj->ProcessEvent(Func, nullptr);
+		FLuaTrace::EndFunction(bTraced);
+
+		FLuaBindingStats::EndFunction(Func, StatsStartCycles);
+		FLuaHitchDetector::EndFunction(Func, HitchStartCycles);
 		return 0;
 	}
 	else
@@ -328,7 +361,11 @@ int32 FastLuaHelper::CallUnrealFunction(lua_State* InL)
 			}
 		}
 
+		FLuaSessionRecorder::RecordCall(InL, Obj, Func, FuncParam.GetStructMemory());
+
+		const bool bTraced = FLuaTrace::BeginFunction(Func);
 		Obj->ProcessEvent(Func, FuncParam.GetStructMemory());
+		FLuaTrace::EndFunction(bTraced);
 
 		int32 ReturnNum = 0;
 		if (ReturnProp)
@@ -350,6 +387,9 @@ int32 FastLuaHelper::CallUnrealFunction(lua_State* InL)
 			}
 		}
 
+		FLuaBindingStats::EndFunction(Func, StatsStartCycles);
+		FLuaHitchDetector::EndFunction(Func, HitchStartCycles);
+
 		return ReturnNum;
 	}
 
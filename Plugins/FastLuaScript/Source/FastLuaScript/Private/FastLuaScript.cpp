@@ -1,18 +1,37 @@
 // Copyright 1998-2019 Epic Games, Inc. All Rights Reserved.
 
 #include "FastLuaScript.h"
+#include "FastLuaUnrealWrapper.h"
+#include "LuaAsyncJobs.h"
+#include "LuaScriptBundle.h"
+#include "LuaHotReload.h"
+#include "LuaHitchDetector.h"
+#include "LuaProfiler.h"
 
 #define LOCTEXT_NAMESPACE "FFastLuaScriptModule"
 
 
 void FFastLuaScriptModule::StartupModule()
 {
-
+	//editor only, reload changed scripts in the running states
+	FLuaHotReload::StartWatching();
 }
 
 void FFastLuaScriptModule::ShutdownModule()
 {
+	FLuaHotReload::StopWatching();
+
+	//close the states while UObjects are still alive
+	FastLuaUnrealWrapper::ReleaseAllInstances();
+
+	FLuaWorkerPool::Get().Shutdown();
+
+	FLuaHitchDetector::Get().Shutdown();
+
+	//a lua.profile session still running: the states are detached above, stop the ticker thread and write what was sampled
+	FLuaProfiler::Get().Stop();
 
+	FLuaScriptBundle::Get().Unmount();
 }
 
 
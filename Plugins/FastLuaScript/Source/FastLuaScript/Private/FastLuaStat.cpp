@@ -8,7 +8,38 @@ DEFINE_STAT(STAT_PushToLua);
 DEFINE_STAT(STAT_FetchFromLua);
 
 DEFINE_STAT(STAT_CallUnrealFunction);
+DEFINE_STAT(STAT_LuaLatentResume);
 
 DEFINE_STAT(STAT_DelegateCallLua);
+DEFINE_STAT(STAT_DelegateQueueFlush);
+DEFINE_STAT(STAT_DelegateEventsQueued);
+DEFINE_STAT(STAT_LuaLoadChunk);
+DEFINE_STAT(STAT_LuaPrecompile);
+DEFINE_STAT(STAT_LuaHotReload);
+DEFINE_STAT(STAT_LuaProfilerSample);
+DEFINE_STAT(STAT_LuaBytecodeHits);
+DEFINE_STAT(STAT_LuaBytecodeMisses);
 DEFINE_STAT(STAT_LuaTick);
-DEFINE_STAT(STAT_LuaMemory);
\ No newline at end of file
+DEFINE_STAT(STAT_LuaTickGroup);
+DEFINE_STAT(STAT_LuaBackgroundResume);
+DEFINE_STAT(STAT_LuaBackgroundSlices);
+DEFINE_STAT(STAT_LuaTimerTick);
+DEFINE_STAT(STAT_LuaTimersFired);
+DEFINE_STAT(STAT_LuaGCStep);
+DEFINE_STAT(STAT_LuaGCCycles);
+
+DEFINE_STAT(STAT_LuaGCPauseMs);
+DEFINE_STAT(STAT_LuaGCSteps);
+DEFINE_STAT(STAT_LuaGCMarked);
+DEFINE_STAT(STAT_LuaGCSwept);
+DEFINE_STAT(STAT_LuaGCFreed);
+DEFINE_STAT(STAT_LuaGCFinalizers);
+DEFINE_STAT(STAT_LuaGCMinorCollections);
+DEFINE_STAT(STAT_LuaGCMajorCollections);
+DEFINE_STAT(STAT_LuaGCIncCycles);
+DEFINE_STAT(STAT_LuaAllocKBPerFrame);
+DEFINE_STAT(STAT_LuaAsyncRun);
+DEFINE_STAT(STAT_LuaAsyncResume);
+DEFINE_STAT(STAT_LuaAsyncJobs);
+DEFINE_STAT(STAT_LuaMemory);
+DEFINE_STAT(STAT_LuaAllocs);
\ No newline at end of file
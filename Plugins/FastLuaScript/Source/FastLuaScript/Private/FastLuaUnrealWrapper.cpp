@@ -13,6 +13,26 @@
 
 #include "LuaDelegateWrapper.h"
 #include "LuaObjectWrapper.h"
+#include "LuaAllocator.h"
+#include "LuaGCScheduler.h"
+#include "LuaGCTelemetry.h"
+#include "LuaObjectRef.h"
+#include "LuaAsyncJobs.h"
+#include "LuaTimerWheel.h"
+#include "LuaTickRegistry.h"
+#include "LuaCoroutineScheduler.h"
+#include "LuaBytecodeCache.h"
+#include "LuaModuleIndex.h"
+#include "LuaScriptBundle.h"
+#include "LuaPrecompiler.h"
+#include "LuaStandbyState.h"
+#include "LuaProfiler.h"
+#include "LuaTrace.h"
+#include "LuaHitchDetector.h"
+#include "LuaSessionRecorder.h"
+#include "LuaLatentActionCallback.h"
+#include "FastLuaSettings.h"
+#include "HAL/IConsoleManager.h"
 
 
 #include "lua.hpp"
@@ -21,6 +41,42 @@
 FastLuaUnrealWrapper::FOnLuaEventNoParam FastLuaUnrealWrapper::OnLuaUnrealReset;
 FastLuaUnrealWrapper::FOnLuaEventNoParam FastLuaUnrealWrapper::OnLuaLoadThirdPartyLib;
 
+TArray<FastLuaUnrealWrapper*> FastLuaUnrealWrapper::AllWrappers;
+TMap<TWeakObjectPtr<const UGameInstance>, TSharedPtr<FastLuaUnrealWrapper>> FastLuaUnrealWrapper::Instances;
+
+static FAutoConsoleCommandWithOutputDevice LuaMemStatsCommand(
+	TEXT("lua.memstats"),
+	TEXT("Dump memory of each lua state by size class"),
+	FConsoleCommandWithOutputDeviceDelegate::CreateStatic([](FOutputDevice& Ar)
+	{
+		for (FastLuaUnrealWrapper* Wrapper : FastLuaUnrealWrapper::GetAllWrappers())
+		{
+			if (const FLuaAllocator* Allocator = Wrapper->GetAllocator())
+			{
+				Allocator->DumpStats(Ar);
+			}
+		}
+	}));
+
+static FAutoConsoleCommandWithOutputDevice LuaStatesCommand(
+	TEXT("lua.states"),
+	TEXT("List the lua states and the GameInstance owning each one"),
+	FConsoleCommandWithOutputDeviceDelegate::CreateStatic([](FOutputDevice& Ar)
+	{
+		for (FastLuaUnrealWrapper* Wrapper : FastLuaUnrealWrapper::GetAllWrappers())
+		{
+			const UGameInstance* GameInstance = Wrapper->GetGameInstance();
+			Ar.Logf(TEXT("%p %s: %.2f KB, %s"), Wrapper->GetLuaState(), GameInstance ? *GameInstance->GetPathName() : TEXT("(default)"),
+				Wrapper->LuaMemory / 1024.0, Wrapper->GetLuaState() ? TEXT("running") : TEXT("closed"));
+		}
+	}));
+
+int32 FastLuaUnrealWrapper::LuaPanic(lua_State* InL)
+{
+	UE_LOG(LogFastLuaScript, Error, TEXT("PANIC: unprotected error in call to Lua API (%s)"), UTF8_TO_TCHAR(lua_tostring(InL, -1)));
+	return 0;
+}
+
 static int StopNewIndex(lua_State* InL)
 {
 	UE_LOG(LogTemp, Warning, TEXT("The lua table _G['Unreal'] is read only!"));
@@ -37,10 +93,17 @@ static int InitUnrealLib(lua_State* InL)
 
 		{"PrintLog", FastLuaHelper::PrintLog},
 
+		{"Async", FLuaAsyncJobs::LuaAsync},
+
 		{nullptr, nullptr}
 	};
 
 	luaL_newlib(InL, funcs);
+
+	FLuaTimerWheel::RegisterLib(InL);
+	FLuaTickRegistry::RegisterLib(InL);
+	FLuaCoroutineScheduler::RegisterLib(InL);
+
 	{
 		lua_newtable(InL);
 		{
@@ -60,29 +123,28 @@ static int RequireFromUFS(lua_State* InL)
 	const char* RawFilwName = lua_tostring(InL, -1);
 	FString FileName = UTF8_TO_TCHAR(RawFilwName);
 
-	FileName.ReplaceInline(*FString("."), *FString("/"));
-
-	TArray<FString> PathList;
+	//packaged scripts, loaded in place from the mapped bundle, no bytecode cache: the chunks are bytecode already
+	//or the sources were bundled on purpose, the cache would only add file system access
+	const uint8* BundleData = nullptr;
+	int32 BundleDataSize = 0;
+	FString ChunkName;
+	if (FLuaScriptBundle::Get().Find(FileName, BundleData, BundleDataSize, ChunkName))
 	{
-		FString LuaPath = FPaths::ProjectDir() / FString("Content/LuaScript/?.lua");
-		PathList.Add(LuaPath);
-#if PLATFORM_WINDOWS
-		FString LuaPath2 = FPaths::ProjectDir() / FString("Content/LuaScript/?.dll");
-		PathList.Add(LuaPath2);
-#else
-		FString LuaPath2 = FPaths::ProjectDir() / FString("Content/LuaScript/?.so");
-		PathList.Add(LuaPath2);
-#endif
-	}
+		int ret = luaL_loadbuffer(InL, (const char*)BundleData, BundleDataSize, TCHAR_TO_UTF8(*ChunkName));
+		lua_pushstring(InL, TCHAR_TO_UTF8(*ChunkName.RightChop(1)));
+		if (ret != LUA_OK)
+		{
+			UE_LOG(LogFastLuaScript, Warning, TEXT("%s"), UTF8_TO_TCHAR(lua_tostring(InL, -2)));
+		}
 
-	IPlatformFile& PhysicalPlatformFile = IPlatformFile::GetPlatformPhysical();
+		return 2;
+	}
 
-	for (int32 i = 0; i < PathList.Num(); ++i)
+	//one map lookup, names not found are remembered by the index
+	FString FullFilePath;
+	if (FLuaModuleIndex::Get().Find(FileName, FullFilePath))
 	{
-		FString FullFilePath = PathList[i].Replace(TEXT("?"), *FileName);
-		FullFilePath = FullFilePath.Replace(TEXT("\\"), TEXT("/"));
-
-		FPaths::NormalizeFilename(FullFilePath);
+		IPlatformFile& PhysicalPlatformFile = IPlatformFile::GetPlatformPhysical();
 
 		IFileHandle* LuaFile = PhysicalPlatformFile.OpenRead(*FullFilePath, false);
 
@@ -100,11 +162,11 @@ static int RequireFromUFS(lua_State* InL)
 		{
 			TArray<uint8> FileData;
 			FileData.Init(0, LuaFile->Size());
-			if (FileData.Num() < 1)
+			if (FileData.Num() > 0)
 			{
-				continue;
+				LuaFile->Read(FileData.GetData(), FileData.Num());
 			}
-			LuaFile->Read(FileData.GetData(), FileData.Num());
+			delete LuaFile;
 
 			int32 BomLen = 0;
 			if (FileData.Num() > 2 &&
@@ -116,15 +178,14 @@ static int RequireFromUFS(lua_State* InL)
 			}
 
 			FString RetPath = FString("@") + FullFilePath;
-			int ret = luaL_loadbuffer(InL, (const char*)FileData.GetData() + BomLen, FileData.Num() - BomLen, TCHAR_TO_UTF8(*RetPath));
+			int ret = FLuaBytecodeCache::Get().LoadBuffer(InL, FileData.GetData() + BomLen, FileData.Num() - BomLen, RetPath);
 			//return full file path as 2nd value, useful for some debug tool 
 			lua_pushstring(InL, TCHAR_TO_UTF8(*FullFilePath));
 			if (ret != LUA_OK)
 			{
-				UE_LOG(LogTemp, Warning, TEXT("%s"), UTF8_TO_TCHAR(lua_tostring(InL, -1)));
+				UE_LOG(LogTemp, Warning, TEXT("%s"), UTF8_TO_TCHAR(lua_tostring(InL, -2)));
 			}
 
-			delete LuaFile;
 			return 2;
 		}
 	}
@@ -140,20 +201,27 @@ static int RequireFromUFS(lua_State* InL)
 
 FastLuaUnrealWrapper::FastLuaUnrealWrapper()
 {
-
+	AllWrappers.Add(this);
 }
 
 FastLuaUnrealWrapper::~FastLuaUnrealWrapper()
 {
 	Reset();
+
+	Standby.Reset();
+
+	AllWrappers.Remove(this);
 }
 
-TSharedPtr<FastLuaUnrealWrapper> FastLuaUnrealWrapper::GetDefault(const UGameInstance* InGameInstnce)
+TSharedPtr<FastLuaUnrealWrapper> FastLuaUnrealWrapper::GetDefault(const UGameInstance* InGameInstance)
 {
-	static TSharedPtr<FastLuaUnrealWrapper> Inst = nullptr;
+	ReleaseStaleInstances();
+
+	TSharedPtr<FastLuaUnrealWrapper>& Inst = Instances.FindOrAdd(InGameInstance);
 	if (Inst.IsValid() == false)
 	{
 		Inst = MakeShareable((new FastLuaUnrealWrapper()));
+		Inst->OwnerGameInstance = InGameInstance;
 	}
 
 	if (Inst->GetLuaState() == nullptr)
@@ -164,6 +232,55 @@ TSharedPtr<FastLuaUnrealWrapper> FastLuaUnrealWrapper::GetDefault(const UGameIns
 	return Inst;
 }
 
+TSharedPtr<FastLuaUnrealWrapper> FastLuaUnrealWrapper::FindInstance(const UGameInstance* InGameInstance)
+{
+	const TSharedPtr<FastLuaUnrealWrapper>* Inst = Instances.Find(InGameInstance);
+	return Inst ? *Inst : nullptr;
+}
+
+void FastLuaUnrealWrapper::ReleaseInstance(const UGameInstance* InGameInstance)
+{
+	TSharedPtr<FastLuaUnrealWrapper> Inst;
+	if (Instances.RemoveAndCopyValue(InGameInstance, Inst) && Inst.IsValid())
+	{
+		//holders of the shared ptr keep a closed wrapper
+		Inst->Reset();
+		Inst->DiscardStandby();
+	}
+}
+
+void FastLuaUnrealWrapper::ReleaseAllInstances()
+{
+	TArray<TSharedPtr<FastLuaUnrealWrapper>> ToRelease;
+	Instances.GenerateValueArray(ToRelease);
+	Instances.Empty();
+
+	for (TSharedPtr<FastLuaUnrealWrapper>& Inst : ToRelease)
+	{
+		Inst->Reset();
+		Inst->DiscardStandby();
+	}
+}
+
+void FastLuaUnrealWrapper::ReleaseStaleInstances()
+{
+	for (auto It = Instances.CreateIterator(); It; ++It)
+	{
+		if (It.Key().IsStale())
+		{
+			UE_LOG(LogFastLuaScript, Warning, TEXT("Lua state of a destroyed GameInstance is released, call ReleaseInstance on Shutdown"));
+			It.Value()->Reset();
+			It.Value()->DiscardStandby();
+			It.RemoveCurrent();
+		}
+	}
+}
+
+FastLuaUnrealWrapper* FastLuaUnrealWrapper::GetFromLuaState(lua_State* InL)
+{
+	return InL ? *(FastLuaUnrealWrapper**)lua_getextraspace(InL) : nullptr;
+}
+
 void FastLuaUnrealWrapper::Init()
 {
 	if (L != nullptr)
@@ -171,30 +288,98 @@ void FastLuaUnrealWrapper::Init()
 		return;
 	}
 
+#if WITH_EDITOR
+	//scripts can be added between two PIE sessions
+	FLuaModuleIndex::Get().Invalidate();
+#endif
 
-	L = luaL_newstate();
-	luaL_openlibs(L);
+	//the core part made on a worker thread since the last Init
+	TUniquePtr<FLuaCoreState> Core = Standby.IsValid() ? Standby->Take() : nullptr;
+	if (Core.IsValid())
+	{
+		Allocator = MoveTemp(Core->Allocator);
+		L = Core->L;
+		Core->L = nullptr;
+	}
+	else
+	{
+		Allocator = MakeUnique<FLuaAllocator>();
+		L = lua_newstate(FLuaAllocator::LuaAlloc, Allocator.Get());
+		InitCoreLibs(L);
+
+		//parse all modules in parallel off the game thread, require then loads the cached chunks
+		FLuaPrecompiler::PrecompileAsync();
+	}
 
-	luaL_requiref(L, "Unreal", InitUnrealLib, 1);
+	//threads created later copy the extra space of the main thread
+	*(FastLuaUnrealWrapper**)lua_getextraspace(L) = this;
+	GCTelemetry = MakeUnique<FLuaGCTelemetry>(L, Allocator.Get());
+	ObjectRef = MakeUnique<FLuaObjectRef>();
 
-	FLuaDelegateWrapper::InitWrapperMetatable(L);
+	AsyncJobs = MakeUnique<FLuaAsyncJobs>();
+	TimerWheel = MakeUnique<FLuaTimerWheel>();
+	TickRegistry = MakeUnique<FLuaTickRegistry>(L);
+	CoroutineScheduler = MakeUnique<FLuaCoroutineScheduler>(L);
 
-	//add searcher
+	OnLuaLoadThirdPartyLib.Broadcast(L);
+
+	GCScheduler = MakeUnique<FLuaGCScheduler>(L, Allocator.Get());
+	//automatic collector until RunMainFunction registers the lua tick
+	GCScheduler->ApplySettings(false);
+
+	//lua.profile is running
+	FLuaProfiler::Get().AttachState(L);
+
+	//for the next Reset
+	const UFastLuaSettings* Settings = GetDefault<UFastLuaSettings>();
+	if (Settings->bPrepareStandbyState)
 	{
-		int32 tp = lua_gettop(L);
-		int32 ret = lua_getglobal(L, "package");
-		lua_getfield(L, -1, "searchers");
-		int32 FunctionNum = luaL_len(L, -1);
-		lua_pushcfunction(L, RequireFromUFS);
-		lua_rawseti(L, -2, FunctionNum + 1);
-		lua_settop(L, tp);
+		if (!Standby.IsValid())
+		{
+			Standby = MakeUnique<FLuaStandbyState>();
+		}
+		Standby->Prepare(Settings->StandbyModules);
 	}
+}
 
-	OnLuaLoadThirdPartyLib.Broadcast(L);
+void FastLuaUnrealWrapper::InitCoreLibs(lua_State* InL)
+{
+	lua_atpanic(InL, LuaPanic);
+	luaL_openlibs(InL);
+
+	luaL_requiref(InL, "Unreal", InitUnrealLib, 1);
+	lua_pop(InL, 1);
+
+	FLuaDelegateWrapper::InitWrapperMetatable(InL);
+
+	InitSearchers(InL);
+}
+
+void FastLuaUnrealWrapper::DiscardStandby()
+{
+	if (Standby.IsValid())
+	{
+		Standby->Discard();
+	}
+}
+
+void FastLuaUnrealWrapper::InitSearchers(lua_State* InL)
+{
+	int32 tp = lua_gettop(InL);
+	int32 ret = lua_getglobal(InL, "package");
+	lua_getfield(InL, -1, "searchers");
+	int32 FunctionNum = luaL_len(InL, -1);
+	lua_pushcfunction(InL, RequireFromUFS);
+	lua_rawseti(InL, -2, FunctionNum + 1);
+	lua_settop(InL, tp);
 }
 
 void FastLuaUnrealWrapper::Reset()
 {
+	FLuaSessionRecorder::Detach(this);
+
+	DelegateEventQueue.Reset();
+
 	OnLuaUnrealReset.Broadcast(L);
 
 	if (LuaTickerHandle.IsValid())
@@ -203,38 +388,119 @@ void FastLuaUnrealWrapper::Reset()
 		LuaTickerHandle.Reset();
 	}
 
+	//running jobs finish in the workers, their results are dropped
+	AsyncJobs.Reset();
+
+	//the refs of the timers go with the state
+	TimerWheel.Reset();
+	TickRegistry.Reset();
+	ProgramTickId = 0;
+	CoroutineScheduler.Reset();
+
+	GCScheduler.Reset();
+	GCTelemetry.Reset();
+
 	if (L)
 	{
+		FLuaProfiler::Get().DetachState(L);
+		FLuaTrace::Get().Detach(L);
+		if (Allocator)
+		{
+			//the sites read the stack of L
+			Allocator->SetTracker(nullptr);
+		}
 		lua_close(L);
 		L = nullptr;
 	}
 
-	LuaMemory = 0;
+	//userdata are collected by lua_close, nothing refs the objects now
+	ObjectRef.Reset();
+
+	//release all pages of the closed state
+	Allocator.Reset();
+
+	UpdateMemoryStats();
 }
 
-bool FastLuaUnrealWrapper::HandleLuaTick(float InDeltaTime)
+void FastLuaUnrealWrapper::UpdateMemoryStats()
 {
-	SCOPE_CYCLE_COUNTER(STAT_LuaTick);
-	if (!bTickError && L)
+	LuaMemory = Allocator.IsValid() ? (int32)Allocator->GetLiveBytes() : 0;
+
+	if (bStatMemory)
 	{
-		int32 tp = lua_gettop(L);
-		int32 ret = lua_getglobal(L, ProgramTableName);
-		ret = ret == LUA_TTABLE ? lua_getfield(L, -1, "LuaTick") : LUA_TNIL;
-		if (lua_isfunction(L, -1))
+		//the stats are process wide, sum all states
+		int64 TotalBytes = 0;
+		int32 TotalAllocs = 0;
+		for (const FastLuaUnrealWrapper* Wrapper : AllWrappers)
 		{
-			lua_pushnumber(L, InDeltaTime);
-			int32 Ret = lua_pcall(L, 1, 0, 0);
-			if (Ret)
+			if (const FLuaAllocator* StateAllocator = Wrapper->GetAllocator())
 			{
-				bTickError = true;
-				UE_LOG(LogTemp, Warning, TEXT("%s"), UTF8_TO_TCHAR(lua_tostring(L, -1)));
-				UE_LOG(LogTemp, Warning, TEXT("Lua stopped tick!"));
+				TotalBytes += StateAllocator->GetLiveBytes();
+				TotalAllocs += StateAllocator->GetLiveAllocs();
 			}
-				
 		}
 
-		lua_settop(L, tp);
+		SET_MEMORY_STAT(STAT_LuaMemory, TotalBytes);
+		SET_DWORD_STAT(STAT_LuaAllocs, TotalAllocs);
 	}
+}
+
+bool FastLuaUnrealWrapper::HandleLuaTick(float InDeltaTime)
+{
+	SCOPE_CYCLE_COUNTER(STAT_LuaTick);
+
+	//follow the Lua trace channel, before the hitch scope may set its hook
+	FLuaTrace::Get().Update(L);
+
+	//the lua calls below are the candidates of a hitch
+	FLuaHitchDetector::Get().BeginScope(L);
+
+	FLuaSessionRecorder::RecordFrame(this, InDeltaTime);
+
+	DelegateEventQueue.Flush(L);
+
+	if (AsyncJobs.IsValid())
+	{
+		AsyncJobs->ResumeFinished(L);
+	}
+
+	ULuaLatentActionCallback::ReleaseDropped(L);
+
+	if (TimerWheel.IsValid())
+	{
+		const UGameInstance* GameInstance = OwnerGameInstance.Get();
+		TimerWheel->Tick(L, InDeltaTime, GameInstance ? GameInstance->GetWorld() : nullptr);
+	}
+
+	UpdateMemoryStats();
+
+	if (TickRegistry.IsValid())
+	{
+		const UGameInstance* GameInstance = OwnerGameInstance.Get();
+		TickRegistry->SyncWorld(GameInstance ? GameInstance->GetWorld() : nullptr);
+		TickRegistry->TickDefault(InDeltaTime);
+	}
+
+	//after the frame work, in what is left of the background budget
+	if (CoroutineScheduler.IsValid())
+	{
+		CoroutineScheduler->Tick();
+	}
+
+	if (GCScheduler.IsValid())
+	{
+		GCScheduler->Tick();
+	}
+
+	if (GCTelemetry.IsValid())
+	{
+		GCTelemetry->EndFrame();
+	}
+
+	//scopes left open by errors of the protected calls without their own unwind(hot reload)
+	FLuaTrace::Get().UnwindFrames(L);
+
+	FLuaHitchDetector::Get().EndScope(L, TEXT("LuaTick"), LUA_NOREF);
 
 	return true;
 }
@@ -245,6 +511,7 @@ int32 FastLuaUnrealWrapper::RunMainFunction(UGameInstance* InGameInstance)
 	lua_getglobal(L, "require");
 	lua_pushstring(L, ProgramTableName);
 	int32 Ret = lua_pcall(L, 1, 1, 0);
+	FLuaTrace::Get().UnwindFrames(L);
 	if (Ret != LUA_OK || !lua_istable(L, -1))
 	{
 		FString RetString = UTF8_TO_TCHAR(lua_tostring(L, -1));
@@ -257,6 +524,7 @@ int32 FastLuaUnrealWrapper::RunMainFunction(UGameInstance* InGameInstance)
 	{
 		FLuaObjectWrapper::PushObject(L, InGameInstance);
 		Ret = lua_pcall(L, 1, 0, 0);
+		FLuaTrace::Get().UnwindFrames(L);
 	}
 	else
 	{
@@ -269,9 +537,26 @@ int32 FastLuaUnrealWrapper::RunMainFunction(UGameInstance* InGameInstance)
 		UE_LOG(LogTemp, Warning, TEXT("%s"), *RetString);
 	}
 
+	//Program.LuaTick is looked up once, a tick error stops only this entry
+	if (ProgramTickId == 0 && TickRegistry.IsValid())
+	{
+		int32 tp = lua_gettop(L);
+		if (lua_getglobal(L, ProgramTableName) == LUA_TTABLE && lua_getfield(L, -1, "LuaTick") == LUA_TFUNCTION)
+		{
+			ProgramTickId = TickRegistry->Register(luaL_ref(L, LUA_REGISTRYINDEX), 0, ELuaTickGroup::Default, 0, 0.f);
+		}
+		lua_settop(L, tp);
+	}
+
 	if (LuaTickerHandle.IsValid() == false)
 	{
 		LuaTickerHandle = FTicker::GetCoreTicker().AddTicker(FTickerDelegate::CreateRaw(this, &FastLuaUnrealWrapper::HandleLuaTick));
+
+		//the collector steps now run in lua tick
+		if (GCScheduler.IsValid())
+		{
+			GCScheduler->ApplySettings(true);
+		}
 	}
 
 	return Ret;
@@ -280,5 +565,6 @@ int32 FastLuaUnrealWrapper::RunMainFunction(UGameInstance* InGameInstance)
 FString FastLuaUnrealWrapper::DoLuaCode(const FString& InCode)
 {
 	luaL_dostring(GetLuaState(), TCHAR_TO_UTF8(*InCode));
+	FLuaTrace::Get().UnwindFrames(L);
 	return UTF8_TO_TCHAR(lua_tostring(L, -1));
 }
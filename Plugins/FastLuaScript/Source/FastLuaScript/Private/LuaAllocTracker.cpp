@@ -0,0 +1,125 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "LuaAllocTracker.h"
+#include "Misc/OutputDevice.h"
+#include "Hash/CityHash.h"
+
+#include "lua.hpp"
+
+
+namespace LuaAllocTracker
+{
+	//C frames(table.insert, string.format) are skipped up to this level
+	static const int32 MaxLevel = 8;
+}
+
+FLuaAllocTracker::FLuaAllocTracker(lua_State* InL, int32 InSampleBytes)
+	: L(InL)
+	, SampleBytes(FMath::Max(InSampleBytes, 0))
+	, BytesUntilSample(FMath::Max(InSampleBytes, 0))
+{
+
+}
+
+void FLuaAllocTracker::OnRealloc(void* InPtr, size_t InOldSize, void* InNewPtr, size_t InNewSize)
+{
+	//failed, lua keeps the old block
+	if (InNewPtr == nullptr && InNewSize > 0)
+	{
+		return;
+	}
+
+	if (InPtr)
+	{
+		FSample Sample;
+		if (LiveSamples.RemoveAndCopyValue(InPtr, Sample))
+		{
+			FSite& Site = Sites[Sample.SiteId];
+			if (InNewPtr)
+			{
+				//grown or moved, same site
+				const int64 Weight = FMath::Max<int64>(InNewSize, SampleBytes);
+				Site.LiveBytes += Weight - Sample.Weight;
+				Sample.Weight = Weight;
+				LiveSamples.Add(InNewPtr, Sample);
+			}
+			else
+			{
+				Site.LiveBytes -= Sample.Weight;
+				--Site.LiveCount;
+			}
+		}
+
+		return;
+	}
+
+	BytesUntilSample -= InNewSize;
+	if (BytesUntilSample > 0)
+	{
+		return;
+	}
+	BytesUntilSample = SampleBytes;
+
+	const int32 SiteId = FindOrAddSite();
+	if (SiteId == INDEX_NONE)
+	{
+		return;
+	}
+
+	FSample& Sample = LiveSamples.Add(InNewPtr);
+	Sample.SiteId = SiteId;
+	Sample.Weight = FMath::Max<int64>(InNewSize, SampleBytes);
+
+	FSite& Site = Sites[SiteId];
+	Site.LiveBytes += Sample.Weight;
+	++Site.LiveCount;
+	Site.TotalBytes += Sample.Weight;
+	++Site.TotalCount;
+}
+
+int32 FLuaAllocTracker::FindOrAddSite()
+{
+	//"Sl" reads the call infos and protos, nothing is allocated
+	lua_Debug Ar;
+	for (int32 Level = 0; Level < LuaAllocTracker::MaxLevel && lua_getstack(L, Level, &Ar); ++Level)
+	{
+		lua_getinfo(L, "Sl", &Ar);
+		if (Ar.currentline < 0)
+		{
+			continue;
+		}
+
+		const uint64 Key = CityHash64WithSeed(Ar.source, FCStringAnsi::Strlen(Ar.source), (uint64)Ar.currentline);
+		if (const int32* SiteId = SiteIds.Find(Key))
+		{
+			return *SiteId;
+		}
+
+		const int32 SiteId = Sites.Num();
+		SiteIds.Add(Key, SiteId);
+		Sites.AddDefaulted_GetRef().Name = FString::Printf(TEXT("%s:%d"), UTF8_TO_TCHAR(Ar.short_src), Ar.currentline);
+		return SiteId;
+	}
+
+	//no lua running: Init, the collector from C++ or lua_close
+	return INDEX_NONE;
+}
+
+void FLuaAllocTracker::DumpSites(FOutputDevice& Ar, int32 InNum) const
+{
+	TArray<const FSite*> SortedSites;
+	for (const FSite& Site : Sites)
+	{
+		SortedSites.Add(&Site);
+	}
+	SortedSites.Sort([](const FSite& A, const FSite& B) { return A.LiveBytes > B.LiveBytes; });
+
+	Ar.Logf(TEXT("LuaAllocTracker|%d sites, 1 sample per %d bytes"), Sites.Num(), SampleBytes);
+	Ar.Logf(TEXT("LuaAllocTracker|   live KB  live  total KB  total  site"));
+	for (int32 i = 0; i < SortedSites.Num() && i < InNum; ++i)
+	{
+		const FSite& Site = *SortedSites[i];
+		Ar.Logf(TEXT("LuaAllocTracker| %9.1f %5d %9.1f %6d  %s"), Site.LiveBytes / 1024.0, Site.LiveCount, Site.TotalBytes / 1024.0, Site.TotalCount, *Site.Name);
+	}
+}
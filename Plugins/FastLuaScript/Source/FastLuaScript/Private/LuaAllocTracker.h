@@ -0,0 +1,63 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+struct lua_State;
+class FOutputDevice;
+
+/**
+ * allocation sites of one state, set on its FLuaAllocator by lua.heap track
+ * one new block every InSampleBytes bytes is tagged with the source:line of the innermost lua frame of the main thread
+ * (allocations in coroutines land on the resume call), grown blocks keep their site, freed ones leave it,
+ * a sample stands for max(size, InSampleBytes) bytes so the live bytes of a site are an estimate
+ * the stack is read only for new blocks: a realloc may be moving the lua stack itself
+ */
+class FLuaAllocTracker
+{
+public:
+
+	FLuaAllocTracker(lua_State* InL, int32 InSampleBytes);
+
+	//after the allocator did the work, same params as lua_Alloc plus the result
+	void OnRealloc(void* InPtr, size_t InOldSize, void* InNewPtr, size_t InNewSize);
+
+	struct FSite
+	{
+		//"AI/PathCost.lua:42"
+		FString Name;
+
+		int64 LiveBytes = 0;
+		int32 LiveCount = 0;
+		int64 TotalBytes = 0;
+		int32 TotalCount = 0;
+	};
+
+	const TArray<FSite>& GetSites() const
+	{
+		return Sites;
+	}
+
+	void DumpSites(FOutputDevice& Ar, int32 InNum) const;
+
+protected:
+
+	int32 FindOrAddSite();
+
+	struct FSample
+	{
+		int32 SiteId = 0;
+		int64 Weight = 0;
+	};
+
+	lua_State* L = nullptr;
+
+	int32 SampleBytes = 0;
+	int64 BytesUntilSample = 0;
+
+	TMap<void*, FSample> LiveSamples;
+
+	TMap<uint64, int32> SiteIds;
+	TArray<FSite> Sites;
+};
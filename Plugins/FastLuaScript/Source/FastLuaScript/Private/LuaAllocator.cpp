@@ -0,0 +1,217 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "LuaAllocator.h"
+#include "Misc/OutputDevice.h"
+#include "LuaAllocTracker.h"
+
+
+FLuaAllocator::FLuaAllocator()
+{
+	FMemory::Memzero(FreeLists);
+	FMemory::Memzero(PageCursor);
+	FMemory::Memzero(PageEnd);
+}
+
+FLuaAllocator::~FLuaAllocator()
+{
+	for (void* Page : Pages)
+	{
+		FMemory::Free(Page);
+	}
+
+	Pages.Empty();
+}
+
+void* FLuaAllocator::LuaAlloc(void* InUserData, void* InPtr, size_t InOldSize, size_t InNewSize)
+{
+	FLuaAllocator* Allocator = (FLuaAllocator*)InUserData;
+	void* NewPtr = Allocator->Realloc(InPtr, InOldSize, InNewSize);
+
+	if (Allocator->Tracker.IsValid())
+	{
+		Allocator->Tracker->OnRealloc(InPtr, InOldSize, NewPtr, InNewSize);
+	}
+
+	return NewPtr;
+}
+
+void FLuaAllocator::SetTracker(TUniquePtr<FLuaAllocTracker> InTracker)
+{
+	Tracker = MoveTemp(InTracker);
+}
+
+void* FLuaAllocator::Realloc(void* InPtr, size_t InOldSize, size_t InNewSize)
+{
+	//when InPtr is null, InOldSize is the type of the new lua object, not a size
+	const size_t OldSize = InPtr ? InOldSize : 0;
+
+	if (InNewSize == 0)
+	{
+		if (InPtr)
+		{
+			if (OldSize <= MaxSmallSize)
+			{
+				FreeSmall(InPtr, GetSizeClass(OldSize), OldSize);
+			}
+			else
+			{
+				FreeLarge(InPtr, OldSize);
+			}
+		}
+
+		return nullptr;
+	}
+
+	if (InPtr == nullptr)
+	{
+		return InNewSize <= MaxSmallSize ? AllocSmall(GetSizeClass(InNewSize), InNewSize) : AllocLarge(InNewSize);
+	}
+
+	const bool bOldSmall = OldSize <= MaxSmallSize;
+	const bool bNewSmall = InNewSize <= MaxSmallSize;
+
+	if (bOldSmall && bNewSmall && GetSizeClass(OldSize) == GetSizeClass(InNewSize))
+	{
+		FSizeClassStats& Stats = ClassStats[GetSizeClass(OldSize)];
+		const int64 Delta = (int64)InNewSize - (int64)OldSize;
+		Stats.LiveBytes += Delta;
+		SmallStats.LiveBytes += Delta;
+		AllocatedBytes += FMath::Max<int64>(Delta, 0);
+		return InPtr;
+	}
+
+	if (!bOldSmall && !bNewSmall)
+	{
+		void* NewPtr = FMemory::Realloc(InPtr, InNewSize);
+		if (NewPtr)
+		{
+			LargeStats.LiveBytes += (int64)InNewSize - (int64)OldSize;
+			++LargeStats.TotalAllocs;
+			AllocatedBytes += InNewSize > OldSize ? InNewSize - OldSize : 0;
+		}
+
+		return NewPtr;
+	}
+
+	//moving between small and large, or between size classes
+	void* NewPtr = bNewSmall ? AllocSmall(GetSizeClass(InNewSize), InNewSize) : AllocLarge(InNewSize);
+	if (NewPtr == nullptr)
+	{
+		//lua keeps the old block when realloc fails
+		return nullptr;
+	}
+
+	FMemory::Memcpy(NewPtr, InPtr, FMath::Min(OldSize, InNewSize));
+
+	if (bOldSmall)
+	{
+		FreeSmall(InPtr, GetSizeClass(OldSize), OldSize);
+	}
+	else
+	{
+		FreeLarge(InPtr, OldSize);
+	}
+
+	return NewPtr;
+}
+
+void* FLuaAllocator::AllocSmall(int32 InSizeClass, size_t InSize)
+{
+	void* Block = nullptr;
+
+	if (FreeLists[InSizeClass])
+	{
+		FFreeBlock* FreeBlock = FreeLists[InSizeClass];
+		FreeLists[InSizeClass] = FreeBlock->Next;
+		Block = FreeBlock;
+	}
+	else
+	{
+		const int32 BlockSize = (InSizeClass + 1) * SizeClassGranularity;
+		if (PageCursor[InSizeClass] + BlockSize > PageEnd[InSizeClass])
+		{
+			//the tail of the old page(less than one block) is dropped
+			uint8* NewPage = (uint8*)FMemory::Malloc(PageSize, SizeClassGranularity);
+			if (NewPage == nullptr)
+			{
+				return nullptr;
+			}
+
+			Pages.Add(NewPage);
+			PageCursor[InSizeClass] = NewPage;
+			PageEnd[InSizeClass] = NewPage + PageSize;
+		}
+
+		Block = PageCursor[InSizeClass];
+		PageCursor[InSizeClass] += BlockSize;
+	}
+
+	FSizeClassStats& Stats = ClassStats[InSizeClass];
+	Stats.LiveBytes += InSize;
+	++Stats.LiveAllocs;
+	++Stats.TotalAllocs;
+
+	SmallStats.LiveBytes += InSize;
+	++SmallStats.LiveAllocs;
+	++SmallStats.TotalAllocs;
+
+	AllocatedBytes += InSize;
+
+	return Block;
+}
+
+void FLuaAllocator::FreeSmall(void* InPtr, int32 InSizeClass, size_t InSize)
+{
+	FFreeBlock* FreeBlock = (FFreeBlock*)InPtr;
+	FreeBlock->Next = FreeLists[InSizeClass];
+	FreeLists[InSizeClass] = FreeBlock;
+
+	FSizeClassStats& Stats = ClassStats[InSizeClass];
+	Stats.LiveBytes -= InSize;
+	--Stats.LiveAllocs;
+
+	SmallStats.LiveBytes -= InSize;
+	--SmallStats.LiveAllocs;
+}
+
+void* FLuaAllocator::AllocLarge(size_t InSize)
+{
+	void* Block = FMemory::Malloc(InSize);
+	if (Block)
+	{
+		LargeStats.LiveBytes += InSize;
+		++LargeStats.LiveAllocs;
+		++LargeStats.TotalAllocs;
+
+		AllocatedBytes += InSize;
+	}
+
+	return Block;
+}
+
+void FLuaAllocator::FreeLarge(void* InPtr, size_t InSize)
+{
+	FMemory::Free(InPtr);
+
+	LargeStats.LiveBytes -= InSize;
+	--LargeStats.LiveAllocs;
+}
+
+void FLuaAllocator::DumpStats(FOutputDevice& Ar) const
+{
+	Ar.Logf(TEXT("Lua memory: live %.2f KB in %d allocs, reserved %.2f KB(%d pages), total allocs %llu"),
+		GetLiveBytes() / 1024.0, GetLiveAllocs(), GetReservedBytes() / 1024.0, Pages.Num(), GetTotalAllocs());
+
+	Ar.Logf(TEXT("%10s %12s %10s %14s"), TEXT("SizeClass"), TEXT("LiveKB"), TEXT("LiveAllocs"), TEXT("TotalAllocs"));
+	for (int32 i = 0; i < NumSizeClasses; ++i)
+	{
+		const FSizeClassStats& Stats = ClassStats[i];
+		if (Stats.TotalAllocs > 0)
+		{
+			Ar.Logf(TEXT("%10d %12.2f %10d %14llu"), (i + 1) * SizeClassGranularity, Stats.LiveBytes / 1024.0, Stats.LiveAllocs, Stats.TotalAllocs);
+		}
+	}
+
+	Ar.Logf(TEXT("%10s %12.2f %10d %14llu"), TEXT(">256"), LargeStats.LiveBytes / 1024.0, LargeStats.LiveAllocs, LargeStats.TotalAllocs);
+}
@@ -0,0 +1,116 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+class FLuaAllocTracker;
+
+/**
+ * the lua_Alloc of one lua_State
+ * small blocks(most lua objects are 16~64 bytes) come from per size class free lists carved out of 64KB pages,
+ * big blocks go to FMemory, all pages are released when the allocator is destroyed(after lua_close)
+ * not thread safe, same as the lua_State using it
+ */
+class FLuaAllocator
+{
+public:
+
+	//size classes are multiple of 8: 8, 16, 24 ... 256
+	static constexpr int32 SizeClassGranularity = 8;
+	static constexpr int32 MaxSmallSize = 256;
+	static constexpr int32 NumSizeClasses = MaxSmallSize / SizeClassGranularity;
+	static constexpr int32 PageSize = 64 * 1024;
+
+	struct FSizeClassStats
+	{
+		//bytes requested by lua
+		int64 LiveBytes = 0;
+		int32 LiveAllocs = 0;
+		uint64 TotalAllocs = 0;
+	};
+
+	FLuaAllocator();
+	~FLuaAllocator();
+
+	FLuaAllocator(const FLuaAllocator&) = delete;
+	FLuaAllocator& operator=(const FLuaAllocator&) = delete;
+
+	//the lua_Alloc function, InUserData is the FLuaAllocator
+	static void* LuaAlloc(void* InUserData, void* InPtr, size_t InOldSize, size_t InNewSize);
+
+	void* Realloc(void* InPtr, size_t InOldSize, size_t InNewSize);
+
+	//bytes in use by lua, small and large
+	int64 GetLiveBytes() const
+	{
+		return SmallStats.LiveBytes + LargeStats.LiveBytes;
+	}
+
+	int32 GetLiveAllocs() const
+	{
+		return SmallStats.LiveAllocs + LargeStats.LiveAllocs;
+	}
+
+	//allocations since the allocator was created
+	uint64 GetTotalAllocs() const
+	{
+		return SmallStats.TotalAllocs + LargeStats.TotalAllocs;
+	}
+
+	//bytes allocated since the allocator was created, for the allocation rate
+	uint64 GetAllocatedBytes() const
+	{
+		return AllocatedBytes;
+	}
+
+	//bytes reserved from the system: pages + large blocks
+	int64 GetReservedBytes() const
+	{
+		return (int64)Pages.Num() * PageSize + LargeStats.LiveBytes;
+	}
+
+	void DumpStats(FOutputDevice& Ar) const;
+
+	//tag the allocations with their lua site, nullptr to stop, see lua.heap track
+	void SetTracker(TUniquePtr<FLuaAllocTracker> InTracker);
+
+	const FLuaAllocTracker* GetTracker() const
+	{
+		return Tracker.Get();
+	}
+
+protected:
+
+	struct FFreeBlock
+	{
+		FFreeBlock* Next;
+	};
+
+	static int32 GetSizeClass(size_t InSize)
+	{
+		return (int32)((InSize + SizeClassGranularity - 1) / SizeClassGranularity) - 1;
+	}
+
+	void* AllocSmall(int32 InSizeClass, size_t InSize);
+	void FreeSmall(void* InPtr, int32 InSizeClass, size_t InSize);
+
+	void* AllocLarge(size_t InSize);
+	void FreeLarge(void* InPtr, size_t InSize);
+
+	FFreeBlock* FreeLists[NumSizeClasses];
+
+	//bump range of the page currently carved by each size class
+	uint8* PageCursor[NumSizeClasses];
+	uint8* PageEnd[NumSizeClasses];
+
+	TArray<void*> Pages;
+
+	FSizeClassStats ClassStats[NumSizeClasses];
+	FSizeClassStats SmallStats;
+	FSizeClassStats LargeStats;
+
+	uint64 AllocatedBytes = 0;
+
+	TUniquePtr<FLuaAllocTracker> Tracker;
+};
@@ -0,0 +1,339 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "LuaAsyncJobs.h"
+#include "Async/Async.h"
+#include "HAL/IConsoleManager.h"
+
+#include "FastLuaUnrealWrapper.h"
+#include "FastLuaScript.h"
+#include "FastLuaStat.h"
+#include "LuaAllocator.h"
+#include "LuaCoroutineWait.h"
+#include "LuaValueSerializer.h"
+
+#include "lua.hpp"
+
+
+static int32 GLuaAsyncMaxIdleWorkers = 4;
+static FAutoConsoleVariableRef CVarLuaAsyncMaxIdleWorkers(
+	TEXT("lua.Async.MaxIdleWorkers"),
+	GLuaAsyncMaxIdleWorkers,
+	TEXT("Max idle worker lua states kept for Unreal.Async jobs"));
+
+static int32 GLuaAsyncMaxWorkerMemoryMB = 64;
+static FAutoConsoleVariableRef CVarLuaAsyncMaxWorkerMemoryMB(
+	TEXT("lua.Async.MaxWorkerMemoryMB"),
+	GLuaAsyncMaxWorkerMemoryMB,
+	TEXT("A worker lua state using more memory after a job is closed instead of pooled"));
+
+namespace LuaAsyncJobs
+{
+	struct FReadArgs
+	{
+		const TArray<uint8>* Data = nullptr;
+		int32 Num = -1;
+	};
+
+	static int ReadValues(lua_State* InL)
+	{
+		FReadArgs* Args = (FReadArgs*)lua_touserdata(InL, 1);
+		lua_pop(InL, 1);
+
+		Args->Num = FLuaValueSerializer::Read(InL, *Args->Data);
+		return FMath::Max(Args->Num, 0);
+	}
+
+	//FLuaValueSerializer::Read in a protected call: it makes strings and tables, a memory error is returned with its message on the stack
+	//InL must be able to call(not a suspended coroutine), OutNum values are pushed on success, -1 for broken data
+	static int32 ProtectedRead(lua_State* InL, const TArray<uint8>& InData, int32& OutNum)
+	{
+		FReadArgs Args;
+		Args.Data = &InData;
+
+		lua_pushcfunction(InL, ReadValues);
+		lua_pushlightuserdata(InL, &Args);
+		const int32 Ret = lua_pcall(InL, 1, LUA_MULTRET, 0);
+
+		OutNum = Ret == LUA_OK ? Args.Num : -1;
+		return Ret;
+	}
+}
+
+
+FLuaWorkerPool& FLuaWorkerPool::Get()
+{
+	static FLuaWorkerPool Inst;
+	return Inst;
+}
+
+FLuaWorkerState* FLuaWorkerPool::Acquire()
+{
+	{
+		FScopeLock ScopeLock(&Lock);
+		if (IdleWorkers.Num() > 0)
+		{
+			return IdleWorkers.Pop(false);
+		}
+	}
+
+	return CreateWorker();
+}
+
+void FLuaWorkerPool::Release(FLuaWorkerState* InWorker)
+{
+	if (InWorker == nullptr)
+	{
+		return;
+	}
+
+	const bool bTooBig = (int64)lua_gc(InWorker->L, LUA_GCCOUNT) > (int64)GLuaAsyncMaxWorkerMemoryMB * 1024;
+
+	{
+		FScopeLock ScopeLock(&Lock);
+		if (!bShutdown && !bTooBig && IdleWorkers.Num() < GLuaAsyncMaxIdleWorkers)
+		{
+			IdleWorkers.Add(InWorker);
+			return;
+		}
+	}
+
+	DestroyWorker(InWorker);
+}
+
+void FLuaWorkerPool::Flush()
+{
+	TArray<FLuaWorkerState*> ToDestroy;
+	{
+		FScopeLock ScopeLock(&Lock);
+		ToDestroy = MoveTemp(IdleWorkers);
+	}
+
+	for (FLuaWorkerState* Worker : ToDestroy)
+	{
+		DestroyWorker(Worker);
+	}
+}
+
+void FLuaWorkerPool::Shutdown()
+{
+	{
+		FScopeLock ScopeLock(&Lock);
+		bShutdown = true;
+	}
+
+	Flush();
+}
+
+FLuaWorkerState* FLuaWorkerPool::CreateWorker()
+{
+	FLuaWorkerState* Worker = new FLuaWorkerState();
+	Worker->Allocator = MakeUnique<FLuaAllocator>();
+	Worker->L = lua_newstate(FLuaAllocator::LuaAlloc, Worker->Allocator.Get());
+	lua_atpanic(Worker->L, FastLuaUnrealWrapper::LuaPanic);
+
+	//no owning wrapper: FastLuaUnrealWrapper::GetFromLuaState returns nullptr in workers
+	*(FastLuaUnrealWrapper**)lua_getextraspace(Worker->L) = nullptr;
+
+	luaL_openlibs(Worker->L);
+	FastLuaUnrealWrapper::InitSearchers(Worker->L);
+
+	return Worker;
+}
+
+void FLuaWorkerPool::DestroyWorker(FLuaWorkerState* InWorker)
+{
+	lua_close(InWorker->L);
+	delete InWorker;
+}
+
+
+FLuaAsyncJobs::FLuaAsyncJobs()
+	: Completion(MakeShared<FCompletion, ESPMode::ThreadSafe>())
+{
+
+}
+
+int32 FLuaAsyncJobs::LuaAsync(lua_State* InL)
+{
+	FastLuaUnrealWrapper* Owner = FastLuaUnrealWrapper::GetFromLuaState(InL);
+	FLuaAsyncJobs* AsyncJobs = Owner ? Owner->GetAsyncJobs() : nullptr;
+	if (AsyncJobs == nullptr)
+	{
+		return luaL_error(InL, "Unreal.Async is not available in this state");
+	}
+
+	if (!lua_isyieldable(InL))
+	{
+		return luaL_error(InL, "Unreal.Async must be called in a coroutine");
+	}
+
+	luaL_checkstring(InL, 1);
+	luaL_checkstring(InL, 2);
+
+	//no lua error while UE objects are alive, lua is built without exceptions
+	bool bParamsOK = false;
+	{
+		FJobPtr Job = MakeShared<FJob, ESPMode::ThreadSafe>();
+		Job->ModuleName = UTF8_TO_TCHAR(lua_tostring(InL, 1));
+		Job->FunctionName = UTF8_TO_TCHAR(lua_tostring(InL, 2));
+
+		FString Error;
+		bParamsOK = FLuaValueSerializer::Write(InL, 3, lua_gettop(InL), Job->Params, Error);
+		if (bParamsOK)
+		{
+			lua_pushthread(InL);
+			Job->ThreadRef = luaL_ref(InL, LUA_REGISTRYINDEX);
+			Job->WaitToken = FLuaCoroutineWait::Begin(InL);
+			AsyncJobs->Dispatch(Job);
+		}
+		else
+		{
+			lua_pushfstring(InL, "Unreal.Async(%s, %s): %s", lua_tostring(InL, 1), lua_tostring(InL, 2), TCHAR_TO_UTF8(*Error));
+		}
+	}
+
+	if (!bParamsOK)
+	{
+		return lua_error(InL);
+	}
+
+	return FLuaCoroutineWait::Yield(InL);
+}
+
+void FLuaAsyncJobs::Dispatch(const FJobPtr& InJob)
+{
+	Completion->InFlight.Increment();
+	INC_DWORD_STAT(STAT_LuaAsyncJobs);
+
+	TSharedRef<FCompletion, ESPMode::ThreadSafe> JobCompletion = Completion;
+	AsyncTask(ENamedThreads::AnyBackgroundThreadNormalTask, [InJob, JobCompletion]()
+	{
+		RunJob(*InJob);
+		JobCompletion->Finished.Enqueue(InJob);
+	});
+}
+
+void FLuaAsyncJobs::RunJob(FJob& InJob)
+{
+	SCOPE_CYCLE_COUNTER(STAT_LuaAsyncRun);
+
+	FLuaWorkerState* Worker = FLuaWorkerPool::Get().Acquire();
+	lua_State* L = Worker->L;
+	int32 tp = lua_gettop(L);
+
+	lua_getglobal(L, "require");
+	lua_pushstring(L, TCHAR_TO_UTF8(*InJob.ModuleName));
+	int32 Ret = lua_pcall(L, 1, 1, 0);
+	if (Ret == LUA_OK && !lua_istable(L, -1))
+	{
+		InJob.Error = FString::Printf(TEXT("module %s is not a table"), *InJob.ModuleName);
+	}
+	else if (Ret == LUA_OK && lua_getfield(L, -1, TCHAR_TO_UTF8(*InJob.FunctionName)) != LUA_TFUNCTION)
+	{
+		InJob.Error = FString::Printf(TEXT("%s.%s is not a function"), *InJob.ModuleName, *InJob.FunctionName);
+	}
+	else if (Ret == LUA_OK)
+	{
+		const int32 FunctionIndex = lua_gettop(L);
+		int32 ParamNum = -1;
+		if (LuaAsyncJobs::ProtectedRead(L, InJob.Params, ParamNum) != LUA_OK)
+		{
+			InJob.Error = UTF8_TO_TCHAR(lua_tostring(L, -1));
+		}
+		else if (ParamNum < 0)
+		{
+			InJob.Error = TEXT("corrupted params");
+		}
+		else if (lua_pcall(L, ParamNum, LUA_MULTRET, 0) == LUA_OK)
+		{
+			InJob.bSuccess = FLuaValueSerializer::Write(L, FunctionIndex, lua_gettop(L), InJob.Results, InJob.Error);
+		}
+		else
+		{
+			InJob.Error = UTF8_TO_TCHAR(lua_tostring(L, -1));
+		}
+	}
+	else
+	{
+		InJob.Error = UTF8_TO_TCHAR(lua_tostring(L, -1));
+	}
+
+	lua_settop(L, tp);
+
+	FLuaWorkerPool::Get().Release(Worker);
+}
+
+int32 FLuaAsyncJobs::ResumeFinished(lua_State* InL)
+{
+	if (InL == nullptr)
+	{
+		return 0;
+	}
+
+	SCOPE_CYCLE_COUNTER(STAT_LuaAsyncResume);
+
+	int32 Count = 0;
+	FJobPtr Job;
+	while (Completion->Finished.Dequeue(Job))
+	{
+		Completion->InFlight.Decrement();
+		++Count;
+
+		int32 tp = lua_gettop(InL);
+		lua_rawgeti(InL, LUA_REGISTRYINDEX, Job->ThreadRef);
+		lua_State* Co = lua_tothread(InL, -1);
+		luaL_unref(InL, LUA_REGISTRYINDEX, Job->ThreadRef);
+
+		//the coroutine may have been closed, or resumed by the scripts meanwhile and waiting on something else
+		if (FLuaCoroutineWait::IsWaiting(InL, Co, Job->WaitToken))
+		{
+			//read on InL, a suspended coroutine can not make the protected call, then moved to Co
+			int32 ResultNum = -1;
+			if (Job->bSuccess)
+			{
+				if (LuaAsyncJobs::ProtectedRead(InL, Job->Results, ResultNum) != LUA_OK)
+				{
+					Job->Error = UTF8_TO_TCHAR(lua_tostring(InL, -1));
+				}
+				else if (ResultNum < 0)
+				{
+					Job->Error = TEXT("corrupted results");
+				}
+				else if (!lua_checkstack(Co, ResultNum + 1))
+				{
+					ResultNum = -1;
+					Job->Error = TEXT("too many results");
+				}
+				else
+				{
+					lua_pushboolean(Co, 1);
+					lua_xmove(InL, Co, ResultNum);
+				}
+			}
+
+			int32 ArgNum = ResultNum + 1;
+			if (ResultNum < 0)
+			{
+				lua_pushboolean(Co, 0);
+				lua_pushstring(Co, TCHAR_TO_UTF8(*Job->Error));
+				ArgNum = 2;
+			}
+
+			int32 YieldNum = 0;
+			int32 Ret = lua_resume(Co, InL, ArgNum, &YieldNum);
+			if (Ret == LUA_OK || Ret == LUA_YIELD)
+			{
+				lua_pop(Co, YieldNum);
+			}
+			else
+			{
+				UE_LOG(LogFastLuaScript, Warning, TEXT("Unreal.Async(%s, %s) resume: %s"), *Job->ModuleName, *Job->FunctionName, UTF8_TO_TCHAR(lua_tostring(Co, -1)));
+			}
+		}
+
+		lua_settop(InL, tp);
+	}
+
+	return Count;
+}
@@ -0,0 +1,106 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Containers/Queue.h"
+#include "HAL/ThreadSafeCounter.h"
+
+struct lua_State;
+class FLuaAllocator;
+
+/**
+ * pure lua state for background jobs: standard libs and the lua script searcher, no Unreal lib
+ */
+struct FLuaWorkerState
+{
+	lua_State* L = nullptr;
+	TUniquePtr<FLuaAllocator> Allocator;
+};
+
+/**
+ * idle worker states, shared by all game states, a worker keeps its loaded modules between jobs
+ */
+class FLuaWorkerPool
+{
+public:
+
+	static FLuaWorkerPool& Get();
+
+	//an idle worker or a new one, any thread
+	FLuaWorkerState* Acquire();
+
+	//back to the pool, closed if the pool is full or the worker is too big
+	void Release(FLuaWorkerState* InWorker);
+
+	//close the idle workers(scripts changed), busy ones are closed when released after Shutdown
+	void Flush();
+
+	void Shutdown();
+
+protected:
+
+	static FLuaWorkerState* CreateWorker();
+	static void DestroyWorker(FLuaWorkerState* InWorker);
+
+	FCriticalSection Lock;
+	TArray<FLuaWorkerState*> IdleWorkers;
+	bool bShutdown = false;
+};
+
+/**
+ * local ok, ... = Unreal.Async(ModuleName, FunctionName, ...)
+ * runs require(ModuleName)[FunctionName](...) in a worker state on a task graph thread and suspends the calling coroutine,
+ * params and results are copied with FLuaValueSerializer, the coroutine is resumed in lua tick like pcall: true and the results, or false and the error
+ */
+class FLuaAsyncJobs
+{
+public:
+
+	FLuaAsyncJobs();
+
+	static int32 LuaAsync(lua_State* InL);
+
+	//resume the coroutines of finished jobs, game thread, return the number of jobs
+	int32 ResumeFinished(lua_State* InL);
+
+	int32 NumInFlight() const
+	{
+		return Completion->InFlight.GetValue();
+	}
+
+protected:
+
+	struct FJob
+	{
+		FString ModuleName;
+		FString FunctionName;
+
+		TArray<uint8> Params;
+		TArray<uint8> Results;
+
+		bool bSuccess = false;
+		FString Error;
+
+		//registry ref of the waiting coroutine
+		int32 ThreadRef = 0;
+
+		//FLuaCoroutineWait token of the coroutine for this job
+		uint32 WaitToken = 0;
+	};
+
+	typedef TSharedPtr<FJob, ESPMode::ThreadSafe> FJobPtr;
+
+	//outlives the game state while jobs are running
+	struct FCompletion
+	{
+		TQueue<FJobPtr, EQueueMode::Mpsc> Finished;
+		FThreadSafeCounter InFlight;
+	};
+
+	void Dispatch(const FJobPtr& InJob);
+
+	static void RunJob(FJob& InJob);
+
+	TSharedRef<FCompletion, ESPMode::ThreadSafe> Completion;
+};
@@ -0,0 +1,138 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "LuaBindingStats.h"
+
+#if LUA_BINDING_STATS
+
+#include "HAL/IConsoleManager.h"
+#include "Misc/OutputDevice.h"
+#include "UObject/Class.h"
+#include "UObject/UnrealType.h"
+
+
+static int32 GLuaBindingStats = 0;
+static FAutoConsoleVariableRef CVarLuaBindingStats(
+	TEXT("lua.BindingStats"),
+	GLuaBindingStats,
+	TEXT("Count the calls of UFunctions and the property gets/sets from lua with their time, see lua.bindingstats"));
+
+static FAutoConsoleCommand LuaBindingStatsCommand(
+	TEXT("lua.bindingstats"),
+	TEXT("Dump the lua binding counters sorted by total time: lua.bindingstats [Num], lua.bindingstats reset"),
+	FConsoleCommandWithArgsDelegate::CreateStatic([](const TArray<FString>& InArgs)
+	{
+		if (InArgs.Num() > 0 && InArgs[0] == TEXT("reset"))
+		{
+			FLuaBindingStats::Get().Reset();
+			return;
+		}
+
+		FLuaBindingStats::Get().Dump(*GLog, InArgs.Num() > 0 ? FCString::Atoi(*InArgs[0]) : 30);
+	}));
+
+
+FLuaBindingStats& FLuaBindingStats::Get()
+{
+	static FLuaBindingStats Inst;
+	return Inst;
+}
+
+bool FLuaBindingStats::IsEnabled()
+{
+	return GLuaBindingStats != 0;
+}
+
+void FLuaBindingStats::AddFunction(const UFunction* InFunction, uint64 InCycles)
+{
+	FFunctionStats* Stats = Functions.Find(InFunction);
+	if (Stats == nullptr)
+	{
+		Stats = &Functions.Add(InFunction);
+
+		const UObject* Outer = InFunction->GetOuter();
+		Stats->Name = FString::Printf(TEXT("%s::%s"), Outer ? *Outer->GetName() : TEXT("?"), *InFunction->GetName());
+		Stats->ParamNum = InFunction->NumParms;
+		Stats->ParamSize = InFunction->ParmsSize;
+	}
+
+	Stats->Calls++;
+	Stats->Cycles += InCycles;
+}
+
+void FLuaBindingStats::AddProperty(const FProperty* InProperty, bool bInSet, uint64 InCycles)
+{
+	FPropertyStats* Stats = Properties.Find(InProperty);
+	if (Stats == nullptr)
+	{
+		Stats = &Properties.Add(InProperty);
+
+		const UStruct* Owner = InProperty->GetOwnerStruct();
+		Stats->Name = FString::Printf(TEXT("%s.%s"), Owner ? *Owner->GetName() : TEXT("?"), *InProperty->GetName());
+		Stats->Size = InProperty->GetSize();
+	}
+
+	if (bInSet)
+	{
+		Stats->Sets++;
+		Stats->SetCycles += InCycles;
+	}
+	else
+	{
+		Stats->Gets++;
+		Stats->GetCycles += InCycles;
+	}
+}
+
+void FLuaBindingStats::Dump(FOutputDevice& Ar, int32 InNum) const
+{
+	if (!IsEnabled() && Functions.Num() < 1 && Properties.Num() < 1)
+	{
+		Ar.Logf(TEXT("LuaBindingStats|nothing counted, set lua.BindingStats 1"));
+		return;
+	}
+
+	TArray<const FFunctionStats*> SortedFunctions;
+	for (const auto& It : Functions)
+	{
+		SortedFunctions.Add(&It.Value);
+	}
+	SortedFunctions.Sort([](const FFunctionStats& A, const FFunctionStats& B) { return A.Cycles > B.Cycles; });
+
+	Ar.Logf(TEXT("LuaBindingStats|%d UFunctions called from lua"), SortedFunctions.Num());
+	Ar.Logf(TEXT("LuaBindingStats|     calls   total ms   avg us   params   bytes  function"));
+	for (int32 i = 0; i < SortedFunctions.Num() && i < InNum; ++i)
+	{
+		const FFunctionStats& Stats = *SortedFunctions[i];
+		const double TotalMs = FPlatformTime::ToMilliseconds64(Stats.Cycles);
+		Ar.Logf(TEXT("LuaBindingStats| %9lld %10.3f %8.3f %8d %7lld  %s"), Stats.Calls, TotalMs, TotalMs * 1000.0 / FMath::Max<int64>(Stats.Calls, 1),
+			Stats.ParamNum, Stats.Calls * Stats.ParamSize, *Stats.Name);
+	}
+
+	TArray<const FPropertyStats*> SortedProperties;
+	for (const auto& It : Properties)
+	{
+		SortedProperties.Add(&It.Value);
+	}
+	SortedProperties.Sort([](const FPropertyStats& A, const FPropertyStats& B) { return A.GetCycles + A.SetCycles > B.GetCycles + B.SetCycles; });
+
+	Ar.Logf(TEXT("LuaBindingStats|%d properties read or written from lua"), SortedProperties.Num());
+	Ar.Logf(TEXT("LuaBindingStats|      gets     sets   total ms  get us  set us    bytes  property"));
+	for (int32 i = 0; i < SortedProperties.Num() && i < InNum; ++i)
+	{
+		const FPropertyStats& Stats = *SortedProperties[i];
+		const double GetMs = FPlatformTime::ToMilliseconds64(Stats.GetCycles);
+		const double SetMs = FPlatformTime::ToMilliseconds64(Stats.SetCycles);
+		Ar.Logf(TEXT("LuaBindingStats| %9lld %8lld %10.3f %7.3f %7.3f %8lld  %s"), Stats.Gets, Stats.Sets, GetMs + SetMs,
+			GetMs * 1000.0 / FMath::Max<int64>(Stats.Gets, 1), SetMs * 1000.0 / FMath::Max<int64>(Stats.Sets, 1),
+			(Stats.Gets + Stats.Sets) * Stats.Size, *Stats.Name);
+	}
+}
+
+void FLuaBindingStats::Reset()
+{
+	Functions.Reset();
+	Properties.Reset();
+}
+
+#endif
@@ -0,0 +1,108 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+#define LUA_BINDING_STATS !UE_BUILD_SHIPPING
+
+class UFunction;
+class FProperty;
+class FOutputDevice;
+
+#if LUA_BINDING_STATS
+
+/**
+ * cost of the lua -> Unreal boundary per UFunction(CallUnrealFunction) and per property(Get/Set of objects and structs),
+ * off by default(lua.BindingStats 1), console: lua.bindingstats [Num] dumps sorted by total time, lua.bindingstats reset
+ * bytes are the param struct of a function and the value size of a property(containers count their header), game thread only
+ */
+class FLuaBindingStats
+{
+public:
+
+	static FLuaBindingStats& Get();
+
+	static bool IsEnabled();
+
+	//start cycles of a crossing, 0 if not enabled
+	static uint64 Begin()
+	{
+		return IsEnabled() ? FPlatformTime::Cycles64() : 0;
+	}
+
+	static void EndFunction(const UFunction* InFunction, uint64 InStartCycles)
+	{
+		if (InStartCycles != 0)
+		{
+			Get().AddFunction(InFunction, FPlatformTime::Cycles64() - InStartCycles);
+		}
+	}
+
+	static void EndProperty(const FProperty* InProperty, bool bInSet, uint64 InStartCycles)
+	{
+		if (InStartCycles != 0)
+		{
+			Get().AddProperty(InProperty, bInSet, FPlatformTime::Cycles64() - InStartCycles);
+		}
+	}
+
+	void Dump(FOutputDevice& Ar, int32 InNum) const;
+
+	void Reset();
+
+protected:
+
+	void AddFunction(const UFunction* InFunction, uint64 InCycles);
+	void AddProperty(const FProperty* InProperty, bool bInSet, uint64 InCycles);
+
+	struct FFunctionStats
+	{
+		//kept, the function may be gone when dumped
+		FString Name;
+		int32 ParamNum = 0;
+		int32 ParamSize = 0;
+
+		int64 Calls = 0;
+		uint64 Cycles = 0;
+	};
+
+	struct FPropertyStats
+	{
+		FString Name;
+		int32 Size = 0;
+
+		int64 Gets = 0;
+		int64 Sets = 0;
+		uint64 GetCycles = 0;
+		uint64 SetCycles = 0;
+	};
+
+	TMap<const UFunction*, FFunctionStats> Functions;
+	TMap<const FProperty*, FPropertyStats> Properties;
+};
+
+#else
+
+//shipping: the calls are compiled out
+class FLuaBindingStats
+{
+public:
+
+	static uint64 Begin()
+	{
+		return 0;
+	}
+
+	static void EndFunction(const UFunction* InFunction, uint64 InStartCycles)
+	{
+
+	}
+
+	static void EndProperty(const FProperty* InProperty, bool bInSet, uint64 InStartCycles)
+	{
+
+	}
+};
+
+#endif
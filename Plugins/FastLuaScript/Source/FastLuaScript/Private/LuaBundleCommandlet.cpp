@@ -0,0 +1,106 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "LuaBundleCommandlet.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+
+#include "FastLuaScript.h"
+#include "LuaModuleIndex.h"
+#include "LuaScriptBundle.h"
+
+#include "lua.hpp"
+
+
+namespace LuaBundleCommandlet
+{
+	static int DumpWriter(lua_State* InL, const void* InData, size_t InSize, void* InUserData)
+	{
+		((TArray<uint8>*)InUserData)->Append((const uint8*)InData, (int32)InSize);
+		return 0;
+	}
+}
+
+ULuaBundleCommandlet::ULuaBundleCommandlet()
+{
+	IsClient = false;
+	IsEditor = false;
+	IsServer = false;
+	LogToConsole = true;
+}
+
+int32 ULuaBundleCommandlet::Main(const FString& Params)
+{
+	FString OutputFile = FLuaScriptBundle::GetDefaultFile();
+	FParse::Value(*Params, TEXT("Output="), OutputFile);
+
+	const bool bSource = FParse::Param(*Params, TEXT("Source"));
+	const bool bStripDebug = FParse::Param(*Params, TEXT("StripDebug"));
+
+	TMap<FString, FString> Modules;
+	FLuaModuleIndex::Get().GetModules(Modules);
+	Modules.KeySort(TLess<FString>());
+
+	//chunk names relative to the script root, the bundle does not carry the paths of the build machine
+	const FString ScriptRoot = FLuaModuleIndex::GetScriptRoot() / TEXT("");
+
+	lua_State* L = luaL_newstate();
+	int32 ErrorNum = 0;
+
+	TArray<FLuaScriptBundle::FModule> BundleModules;
+	for (const TPair<FString, FString>& It : Modules)
+	{
+		TArray<uint8> FileData;
+		if (!FFileHelper::LoadFileToArray(FileData, *It.Value))
+		{
+			UE_LOG(LogFastLuaScript, Error, TEXT("LuaBundle|can not read %s"), *It.Value);
+			++ErrorNum;
+			continue;
+		}
+
+		if (FileData.Num() > 2 && FileData[0] == 0xEF && FileData[1] == 0xBB && FileData[2] == 0xBF)
+		{
+			FileData.RemoveAt(0, 3, false);
+		}
+
+		FLuaScriptBundle::FModule& Module = BundleModules.AddDefaulted_GetRef();
+		Module.Name = It.Key;
+		FString RelativePath = It.Value;
+		FPaths::MakePathRelativeTo(RelativePath, *ScriptRoot);
+		Module.ChunkName = FString("@") + RelativePath;
+
+		//compile the sources too, a broken script fails the bundle
+		int32 tp = lua_gettop(L);
+		if (luaL_loadbufferx(L, (const char*)FileData.GetData(), FileData.Num(), TCHAR_TO_UTF8(*Module.ChunkName), nullptr) != LUA_OK)
+		{
+			UE_LOG(LogFastLuaScript, Error, TEXT("LuaBundle|%s"), UTF8_TO_TCHAR(lua_tostring(L, -1)));
+			++ErrorNum;
+		}
+		else if (bSource)
+		{
+			Module.Data = MoveTemp(FileData);
+		}
+		else
+		{
+			lua_dump(L, LuaBundleCommandlet::DumpWriter, &Module.Data, bStripDebug ? 1 : 0);
+		}
+		lua_settop(L, tp);
+	}
+
+	lua_close(L);
+
+	if (ErrorNum > 0)
+	{
+		UE_LOG(LogFastLuaScript, Error, TEXT("LuaBundle|%d errors, %s is not written"), ErrorNum, *OutputFile);
+		return 1;
+	}
+
+	if (!FLuaScriptBundle::Write(OutputFile, BundleModules))
+	{
+		UE_LOG(LogFastLuaScript, Error, TEXT("LuaBundle|can not write %s"), *OutputFile);
+		return 1;
+	}
+
+	UE_LOG(LogFastLuaScript, Display, TEXT("LuaBundle|%d modules(%s) to %s"), BundleModules.Num(), bSource ? TEXT("source") : TEXT("bytecode"), *OutputFile);
+	return 0;
+}
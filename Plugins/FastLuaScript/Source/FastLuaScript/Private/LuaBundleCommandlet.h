@@ -0,0 +1,23 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "LuaBundleCommandlet.generated.h"
+
+/**
+ * pack Content/LuaScript into one bundle, see FLuaScriptBundle, run it before packaging
+ *	UE4Editor-Cmd.exe Project.uproject -run=LuaBundle [-Output=File] [-Source] [-StripDebug]
+ * modules are compiled to bytecode by default, -Source keeps the sources, -StripDebug drops the line info of the bytecode
+ */
+UCLASS()
+class ULuaBundleCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+public:
+
+	ULuaBundleCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+};
@@ -0,0 +1,219 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "LuaBytecodeCache.h"
+#include "HAL/IConsoleManager.h"
+#include "HAL/FileManager.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Misc/ScopeLock.h"
+#include "Hash/CityHash.h"
+
+#include "FastLuaScript.h"
+#include "FastLuaStat.h"
+
+#include "lua.hpp"
+
+
+static int32 GLuaBytecodeCache = 1;
+static FAutoConsoleVariableRef CVarLuaBytecodeCache(
+	TEXT("lua.BytecodeCache"),
+	GLuaBytecodeCache,
+	TEXT("Load lua scripts from precompiled chunks in Saved/LuaBytecode, 0 to parse the sources"));
+
+static FAutoConsoleCommand LuaBytecodeCacheClearCommand(
+	TEXT("lua.BytecodeCache.Clear"),
+	TEXT("Delete the precompiled lua chunks, they are made again on next require"),
+	FConsoleCommandDelegate::CreateStatic([]()
+	{
+		FLuaBytecodeCache::Get().Clear(true);
+	}));
+
+namespace LuaBytecodeCache
+{
+	//'LUBC'
+	static const uint32 FileMagic = 0x4342554C;
+
+	struct FFileHeader
+	{
+		uint32 Magic = FileMagic;
+		uint32 LuaVersion = LUA_VERSION_NUM;
+		uint64 SourceHash = 0;
+	};
+
+	static int DumpWriter(lua_State* InL, const void* InData, size_t InSize, void* InUserData)
+	{
+		((TArray<uint8>*)InUserData)->Append((const uint8*)InData, (int32)InSize);
+		return 0;
+	}
+}
+
+
+FLuaBytecodeCache& FLuaBytecodeCache::Get()
+{
+	static FLuaBytecodeCache Inst;
+	return Inst;
+}
+
+bool FLuaBytecodeCache::IsEnabled()
+{
+	return GLuaBytecodeCache != 0;
+}
+
+FString FLuaBytecodeCache::GetCacheDir()
+{
+	return FPaths::ProjectSavedDir() / TEXT("LuaBytecode");
+}
+
+FString FLuaBytecodeCache::GetCacheFile(const FString& InChunkName)
+{
+	//flat dir, the path hash keeps same named modules apart
+	const FTCHARToUTF8 ChunkName(*InChunkName);
+	const uint64 PathHash = CityHash64(ChunkName.Get(), ChunkName.Length());
+	return GetCacheDir() / FString::Printf(TEXT("%s_%016llx.luac"), *FPaths::GetBaseFilename(InChunkName), PathHash);
+}
+
+int32 FLuaBytecodeCache::LoadBuffer(lua_State* InL, const uint8* InSource, int32 InSize, const FString& InChunkName)
+{
+	SCOPE_CYCLE_COUNTER(STAT_LuaLoadChunk);
+
+	const FTCHARToUTF8 ChunkName(*InChunkName);
+
+	//already a binary chunk, nothing to cache
+	const bool bBinarySource = InSize > 0 && InSource[0] == LUA_SIGNATURE[0];
+	if (GLuaBytecodeCache == 0 || bBinarySource)
+	{
+		return luaL_loadbuffer(InL, (const char*)InSource, InSize, ChunkName.Get());
+	}
+
+	const uint64 SourceHash = CityHash64((const char*)InSource, InSize);
+
+	TArray<uint8> Bytecode;
+	if (FindBytecode(InChunkName, SourceHash, Bytecode))
+	{
+		if (luaL_loadbufferx(InL, (const char*)Bytecode.GetData(), Bytecode.Num(), ChunkName.Get(), "b") == LUA_OK)
+		{
+			INC_DWORD_STAT(STAT_LuaBytecodeHits);
+			return LUA_OK;
+		}
+
+		//made by another build of lua, parse the source again
+		lua_pop(InL, 1);
+	}
+
+	INC_DWORD_STAT(STAT_LuaBytecodeMisses);
+
+	int32 Ret = luaL_loadbufferx(InL, (const char*)InSource, InSize, ChunkName.Get(), "t");
+	if (Ret != LUA_OK)
+	{
+		return Ret;
+	}
+
+	//keep the debug info, errors show the lines of the source
+	Bytecode.Reset();
+	if (lua_dump(InL, LuaBytecodeCache::DumpWriter, &Bytecode, 0) == 0 && Bytecode.Num() > 0)
+	{
+		StoreBytecode(InChunkName, SourceHash, Bytecode);
+	}
+
+	return LUA_OK;
+}
+
+bool FLuaBytecodeCache::HasBytecode(const uint8* InSource, int32 InSize, const FString& InChunkName)
+{
+	if (GLuaBytecodeCache == 0 || InSize < 1 || InSource[0] == LUA_SIGNATURE[0])
+	{
+		return false;
+	}
+
+	TArray<uint8> Bytecode;
+	return FindBytecode(InChunkName, CityHash64((const char*)InSource, InSize), Bytecode);
+}
+
+bool FLuaBytecodeCache::FindBytecode(const FString& InChunkName, uint64 InSourceHash, TArray<uint8>& OutBytecode)
+{
+	{
+		FScopeLock ScopeLock(&Lock);
+		if (const FEntry* Entry = Entries.Find(InChunkName))
+		{
+			if (Entry->SourceHash != InSourceHash)
+			{
+				return false;
+			}
+
+			OutBytecode = Entry->Bytecode;
+			return true;
+		}
+	}
+
+	TArray<uint8> FileData;
+	const int32 HeaderSize = sizeof(LuaBytecodeCache::FFileHeader);
+	if (!FFileHelper::LoadFileToArray(FileData, *GetCacheFile(InChunkName), FILEREAD_Silent) || FileData.Num() <= HeaderSize)
+	{
+		return false;
+	}
+
+	LuaBytecodeCache::FFileHeader Header;
+	FMemory::Memcpy(&Header, FileData.GetData(), HeaderSize);
+	if (Header.Magic != LuaBytecodeCache::FileMagic || Header.LuaVersion != LUA_VERSION_NUM || Header.SourceHash != InSourceHash)
+	{
+		return false;
+	}
+
+	OutBytecode.Reset(FileData.Num() - HeaderSize);
+	OutBytecode.Append(FileData.GetData() + HeaderSize, FileData.Num() - HeaderSize);
+
+	FScopeLock ScopeLock(&Lock);
+	FEntry& Entry = Entries.FindOrAdd(InChunkName);
+	Entry.SourceHash = InSourceHash;
+	Entry.Bytecode = OutBytecode;
+
+	return true;
+}
+
+void FLuaBytecodeCache::StoreBytecode(const FString& InChunkName, uint64 InSourceHash, const TArray<uint8>& InBytecode)
+{
+	{
+		FScopeLock ScopeLock(&Lock);
+		FEntry& Entry = Entries.FindOrAdd(InChunkName);
+		Entry.SourceHash = InSourceHash;
+		Entry.Bytecode = InBytecode;
+	}
+
+	LuaBytecodeCache::FFileHeader Header;
+	Header.SourceHash = InSourceHash;
+
+	TArray<uint8> FileData;
+	FileData.Reserve(sizeof(Header) + InBytecode.Num());
+	FileData.Append((const uint8*)&Header, sizeof(Header));
+	FileData.Append(InBytecode);
+
+	//workers and the precompiler may store the same chunk at once: write a file of our own and move it into place,
+	//a reader sees the old file, no file(a miss) or the whole new one
+	const FString CacheFile = GetCacheFile(InChunkName);
+	const FString TempFile = FPaths::CreateTempFilename(*FPaths::GetPath(CacheFile), TEXT("Lua"), TEXT(".tmp"));
+	if (!FFileHelper::SaveArrayToFile(FileData, *TempFile))
+	{
+		UE_LOG(LogFastLuaScript, Verbose, TEXT("LuaBytecodeCache|can not write %s"), *TempFile);
+		return;
+	}
+
+	if (!IFileManager::Get().Move(*CacheFile, *TempFile, true, true, false, true))
+	{
+		UE_LOG(LogFastLuaScript, Verbose, TEXT("LuaBytecodeCache|can not move %s to %s"), *TempFile, *CacheFile);
+		IFileManager::Get().Delete(*TempFile, false, true, true);
+	}
+}
+
+void FLuaBytecodeCache::Clear(bool bDeleteFiles)
+{
+	{
+		FScopeLock ScopeLock(&Lock);
+		Entries.Reset();
+	}
+
+	if (bDeleteFiles)
+	{
+		IFileManager::Get().DeleteDirectory(*GetCacheDir(), false, true);
+	}
+}
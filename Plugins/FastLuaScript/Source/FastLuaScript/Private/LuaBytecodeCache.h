@@ -0,0 +1,52 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+struct lua_State;
+
+/**
+ * precompiled chunks of the lua scripts, shared by all states(game and worker)
+ * a chunk is dumped after its first parse to Saved/LuaBytecode and kept in memory for the next Reset,
+ * the file header holds the lua version and a hash of the source, a stale or broken file is parsed again and rewritten
+ * console: lua.BytecodeCache(0 to parse the sources), lua.BytecodeCache.Clear
+ */
+class FLuaBytecodeCache
+{
+public:
+
+	static FLuaBytecodeCache& Get();
+
+	//like luaL_loadbuffer, the chunk is loaded from the cache when it was made from the same source, any thread
+	int32 LoadBuffer(lua_State* InL, const uint8* InSource, int32 InSize, const FString& InChunkName);
+
+	//the cache has the chunk made from this source, read into memory for the next LoadBuffer, nothing is parsed, any thread
+	bool HasBytecode(const uint8* InSource, int32 InSize, const FString& InChunkName);
+
+	//drop the memory cache, and the cache files if bDeleteFiles
+	void Clear(bool bDeleteFiles);
+
+	static FString GetCacheDir();
+
+	static bool IsEnabled();
+
+protected:
+
+	struct FEntry
+	{
+		uint64 SourceHash = 0;
+		TArray<uint8> Bytecode;
+	};
+
+	bool FindBytecode(const FString& InChunkName, uint64 InSourceHash, TArray<uint8>& OutBytecode);
+
+	void StoreBytecode(const FString& InChunkName, uint64 InSourceHash, const TArray<uint8>& InBytecode);
+
+	static FString GetCacheFile(const FString& InChunkName);
+
+	FCriticalSection Lock;
+
+	//keyed by chunk name
+	TMap<FString, FEntry> Entries;
+};
@@ -0,0 +1,279 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "LuaCoroutineScheduler.h"
+#include "HAL/IConsoleManager.h"
+
+#include "FastLuaUnrealWrapper.h"
+#include "FastLuaScript.h"
+#include "FastLuaStat.h"
+#include "LuaProfiler.h"
+
+#include "lua.hpp"
+
+
+static int32 GLuaBackgroundHookInstructions = 1000;
+static FAutoConsoleVariableRef CVarLuaBackgroundHookInstructions(
+	TEXT("lua.Background.HookInstructions"),
+	GLuaBackgroundHookInstructions,
+	TEXT("Instructions between two slice checks of a background lua coroutine, for tasks started later"));
+
+static float GLuaBackgroundSliceMs = 1.0f;
+static FAutoConsoleVariableRef CVarLuaBackgroundSliceMs(
+	TEXT("lua.Background.SliceMs"),
+	GLuaBackgroundSliceMs,
+	TEXT("Time a background lua coroutine runs before it is preempted"));
+
+static float GLuaBackgroundFrameBudgetMs = 2.0f;
+static FAutoConsoleVariableRef CVarLuaBackgroundFrameBudgetMs(
+	TEXT("lua.Background.FrameBudgetMs"),
+	GLuaBackgroundFrameBudgetMs,
+	TEXT("Time per frame for background lua coroutines of one state"));
+
+
+FLuaCoroutineScheduler::FLuaCoroutineScheduler(lua_State* InL)
+	: L(InL)
+{
+
+}
+
+FLuaCoroutineScheduler* FLuaCoroutineScheduler::GetScheduler(lua_State* InL)
+{
+	FastLuaUnrealWrapper* Owner = FastLuaUnrealWrapper::GetFromLuaState(InL);
+	return Owner ? Owner->GetCoroutineScheduler() : nullptr;
+}
+
+FLuaCoroutineScheduler::FTask* FLuaCoroutineScheduler::FindTask(lua_State* InCoroutine)
+{
+	for (FTask& Task : Tasks)
+	{
+		if (Task.Coroutine == InCoroutine && !Task.bDone)
+		{
+			return &Task;
+		}
+	}
+
+	return nullptr;
+}
+
+FLuaCoroutineScheduler::FTask* FLuaCoroutineScheduler::FindTask(int32 InId)
+{
+	for (FTask& Task : Tasks)
+	{
+		if (Task.Id == InId && !Task.bDone)
+		{
+			return &Task;
+		}
+	}
+
+	return nullptr;
+}
+
+void FLuaCoroutineScheduler::BackgroundHook(lua_State* InL, lua_Debug* InDebug)
+{
+	//one hook per coroutine, the profiler samples the tasks from this one
+	FLuaProfiler::Get().CountHook(InL);
+
+	if (FLuaCoroutineScheduler* Scheduler = GetScheduler(InL))
+	{
+		Scheduler->OnHook(InL);
+	}
+}
+
+void FLuaCoroutineScheduler::OnHook(lua_State* InL)
+{
+	//coroutines created by a task inherit the hook, only the tasks yield
+	FTask* Task = FindTask(InL);
+	if (Task == nullptr || !lua_isyieldable(InL))
+	{
+		return;
+	}
+
+	const double SliceMs = FPlatformTime::ToMilliseconds64(FPlatformTime::Cycles64() - Task->SliceStartCycles);
+	if (SliceMs >= GLuaBackgroundSliceMs)
+	{
+		Task->bPreempted = true;
+
+		//a hook yields as its last call, without values
+		lua_yield(InL, 0);
+	}
+}
+
+int32 FLuaCoroutineScheduler::Tick()
+{
+	if (L == nullptr || Tasks.Num() < 1)
+	{
+		return 0;
+	}
+
+	SCOPE_CYCLE_COUNTER(STAT_LuaBackgroundResume);
+
+	const uint64 StartCycles = FPlatformTime::Cycles64();
+	const int32 TaskNum = Tasks.Num();
+	int32 SliceNum = 0;
+
+	for (int32 i = 0; i < TaskNum; ++i)
+	{
+		if (FPlatformTime::ToMilliseconds64(FPlatformTime::Cycles64() - StartCycles) >= GLuaBackgroundFrameBudgetMs)
+		{
+			break;
+		}
+
+		const int32 TaskIndex = (NextTaskIndex + i) % TaskNum;
+		NextTaskIndex = (TaskIndex + 1) % TaskNum;
+
+		if (Tasks[TaskIndex].bDone)
+		{
+			continue;
+		}
+
+		if (Tasks[TaskIndex].bPreempted)
+		{
+			++SliceNum;
+
+			//tasks started in the slice can grow the array, index it again after the resume
+			const bool bRunning = ResumeTask(Tasks[TaskIndex]);
+			Tasks[TaskIndex].bDone |= !bRunning;
+		}
+		else
+		{
+			//resumed to the end by someone else
+			lua_State* Co = Tasks[TaskIndex].Coroutine;
+			const int32 Status = lua_status(Co);
+			Tasks[TaskIndex].bDone = Status != LUA_YIELD && (Status != LUA_OK || lua_gettop(Co) == 0);
+		}
+	}
+
+	RemoveDone();
+
+	INC_DWORD_STAT_BY(STAT_LuaBackgroundSlices, SliceNum);
+
+	return SliceNum;
+}
+
+bool FLuaCoroutineScheduler::ResumeTask(FTask& InTask)
+{
+	const int32 TaskId = InTask.Id;
+	lua_State* Co = InTask.Coroutine;
+	const int32 ParamNum = InTask.StartParamNum;
+
+	InTask.StartParamNum = 0;
+	InTask.bPreempted = false;
+	InTask.SliceStartCycles = FPlatformTime::Cycles64();
+
+	int32 ResultNum = 0;
+	const int32 Ret = lua_resume(Co, L, ParamNum, &ResultNum);
+
+	//the task may have started others, InTask can be moved
+	if (Ret == LUA_YIELD)
+	{
+		lua_pop(Co, ResultNum);
+		return true;
+	}
+
+	if (Ret != LUA_OK)
+	{
+		UE_LOG(LogFastLuaScript, Warning, TEXT("Background task %d: %s"), TaskId, UTF8_TO_TCHAR(lua_tostring(Co, -1)));
+	}
+
+	return false;
+}
+
+void FLuaCoroutineScheduler::RemoveDone()
+{
+	for (int32 i = Tasks.Num() - 1; i >= 0; --i)
+	{
+		if (Tasks[i].bDone)
+		{
+			lua_sethook(Tasks[i].Coroutine, nullptr, 0, 0);
+			luaL_unref(L, LUA_REGISTRYINDEX, Tasks[i].ThreadRef);
+			Tasks.RemoveAt(i, 1, false);
+		}
+	}
+
+	if (NextTaskIndex >= Tasks.Num())
+	{
+		NextTaskIndex = 0;
+	}
+}
+
+void FLuaCoroutineScheduler::RegisterLib(lua_State* InL)
+{
+	lua_pushcfunction(InL, LuaRunBackground);
+	lua_setfield(InL, -2, "RunBackground");
+
+	lua_pushcfunction(InL, LuaYieldBackground);
+	lua_setfield(InL, -2, "YieldBackground");
+
+	lua_pushcfunction(InL, LuaCancelBackground);
+	lua_setfield(InL, -2, "CancelBackground");
+
+	lua_pushcfunction(InL, LuaIsBackgroundRunning);
+	lua_setfield(InL, -2, "IsBackgroundRunning");
+}
+
+//local Id = Unreal.RunBackground(fn, ...)
+int32 FLuaCoroutineScheduler::LuaRunBackground(lua_State* InL)
+{
+	FLuaCoroutineScheduler* Scheduler = GetScheduler(InL);
+	luaL_checktype(InL, 1, LUA_TFUNCTION);
+	if (Scheduler == nullptr)
+	{
+		return luaL_error(InL, "Unreal.RunBackground is not available in this state");
+	}
+
+	const int32 ParamNum = lua_gettop(InL);
+	lua_State* Co = lua_newthread(InL);
+	const int32 ThreadRef = luaL_ref(InL, LUA_REGISTRYINDEX);
+
+	//fn and params to the new coroutine
+	lua_xmove(InL, Co, ParamNum);
+
+	//only this coroutine(and the ones it creates) pays for the hook
+	lua_sethook(Co, BackgroundHook, LUA_MASKCOUNT, FMath::Max(GLuaBackgroundHookInstructions, 1));
+
+	FTask& Task = Scheduler->Tasks.AddDefaulted_GetRef();
+	Task.Id = ++Scheduler->NextId;
+	Task.Coroutine = Co;
+	Task.ThreadRef = ThreadRef;
+	Task.StartParamNum = ParamNum - 1;
+
+	lua_pushinteger(InL, Task.Id);
+	return 1;
+}
+
+int32 FLuaCoroutineScheduler::LuaYieldBackground(lua_State* InL)
+{
+	FLuaCoroutineScheduler* Scheduler = GetScheduler(InL);
+	FTask* Task = Scheduler ? Scheduler->FindTask(InL) : nullptr;
+	if (Task == nullptr)
+	{
+		return luaL_error(InL, "Unreal.YieldBackground must be called in a background task");
+	}
+
+	Task->bPreempted = true;
+	return lua_yield(InL, 0);
+}
+
+int32 FLuaCoroutineScheduler::LuaCancelBackground(lua_State* InL)
+{
+	FLuaCoroutineScheduler* Scheduler = GetScheduler(InL);
+	FTask* Task = Scheduler ? Scheduler->FindTask((int32)lua_tointeger(InL, 1)) : nullptr;
+
+	//a running task can not cancel itself
+	const bool bCancel = Task && Task->Coroutine != InL;
+	if (bCancel)
+	{
+		Task->bDone = true;
+	}
+
+	lua_pushboolean(InL, bCancel);
+	return 1;
+}
+
+int32 FLuaCoroutineScheduler::LuaIsBackgroundRunning(lua_State* InL)
+{
+	FLuaCoroutineScheduler* Scheduler = GetScheduler(InL);
+	lua_pushboolean(InL, Scheduler && Scheduler->FindTask((int32)lua_tointeger(InL, 1)) != nullptr);
+	return 1;
+}
@@ -0,0 +1,84 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+struct lua_State;
+struct lua_Debug;
+
+/**
+ * background coroutines of one lua state, time sliced by a count hook installed on those coroutines only
+ *	local Id = Unreal.RunBackground(fn, ...)
+ *	Unreal.YieldBackground()	--in the task, give up the rest of the slice
+ *	Unreal.CancelBackground(Id), Unreal.IsBackgroundRunning(Id)
+ * the hook yields the task every lua.Background.HookInstructions instructions once its slice(lua.Background.SliceMs) is used,
+ * preempted tasks are resumed round robin from lua tick until lua.Background.FrameBudgetMs,
+ * a task waiting on something else(Unreal.Async, latent functions, coroutine.yield) is left to whoever resumes it
+ */
+class FLuaCoroutineScheduler
+{
+public:
+
+	FLuaCoroutineScheduler(lua_State* InL);
+
+	FLuaCoroutineScheduler(const FLuaCoroutineScheduler&) = delete;
+	FLuaCoroutineScheduler& operator=(const FLuaCoroutineScheduler&) = delete;
+
+	//resume preempted tasks in the frame budget, return the number of slices run
+	int32 Tick();
+
+	int32 Num() const
+	{
+		return Tasks.Num();
+	}
+
+	//add Unreal.RunBackground and friends to the table at the top of InL
+	static void RegisterLib(lua_State* InL);
+
+protected:
+
+	static int32 LuaRunBackground(lua_State* InL);
+	static int32 LuaYieldBackground(lua_State* InL);
+	static int32 LuaCancelBackground(lua_State* InL);
+	static int32 LuaIsBackgroundRunning(lua_State* InL);
+
+	static FLuaCoroutineScheduler* GetScheduler(lua_State* InL);
+
+	static void BackgroundHook(lua_State* InL, lua_Debug* InDebug);
+
+	struct FTask
+	{
+		int32 Id = 0;
+		lua_State* Coroutine = nullptr;
+		int32 ThreadRef = 0;
+
+		//params waiting for the first resume
+		int32 StartParamNum = 0;
+
+		//yielded by the hook or YieldBackground: the scheduler resumes it
+		bool bPreempted = true;
+		bool bDone = false;
+
+		uint64 SliceStartCycles = 0;
+	};
+
+	FTask* FindTask(lua_State* InCoroutine);
+	FTask* FindTask(int32 InId);
+
+	void OnHook(lua_State* InL);
+
+	//false if the task is finished or failed
+	bool ResumeTask(FTask& InTask);
+
+	void RemoveDone();
+
+	lua_State* L = nullptr;
+
+	TArray<FTask> Tasks;
+
+	//round robin start of the next tick
+	int32 NextTaskIndex = 0;
+
+	int32 NextId = 0;
+};
@@ -0,0 +1,85 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "LuaCoroutineWait.h"
+
+uint32 FLuaCoroutineWait::NextToken = 0;
+
+//address as the registry key of the token table
+static const char WaitTokensKey = 0;
+
+
+void FLuaCoroutineWait::PushTokens(lua_State* InL)
+{
+	if (lua_rawgetp(InL, LUA_REGISTRYINDEX, &WaitTokensKey) == LUA_TTABLE)
+	{
+		return;
+	}
+
+	lua_pop(InL, 1);
+
+	//a collected coroutine drops its token
+	lua_newtable(InL);
+	lua_newtable(InL);
+	lua_pushstring(InL, "k");
+	lua_setfield(InL, -2, "__mode");
+	lua_setmetatable(InL, -2);
+
+	lua_pushvalue(InL, -1);
+	lua_rawsetp(InL, LUA_REGISTRYINDEX, &WaitTokensKey);
+}
+
+uint32 FLuaCoroutineWait::Begin(lua_State* InL)
+{
+	//0 is no wait
+	if (++NextToken == 0)
+	{
+		++NextToken;
+	}
+
+	PushTokens(InL);
+	lua_pushthread(InL);
+	lua_pushinteger(InL, NextToken);
+	lua_rawset(InL, -3);
+	lua_pop(InL, 1);
+
+	return NextToken;
+}
+
+int32 FLuaCoroutineWait::Yield(lua_State* InL)
+{
+	lua_settop(InL, 0);
+	return lua_yieldk(InL, 0, 0, &FLuaCoroutineWait::ContinueWait);
+}
+
+int32 FLuaCoroutineWait::ContinueWait(lua_State* InL, int32 InStatus, lua_KContext InContext)
+{
+	//resumed, by the waited resumer or not: the wait is over
+	const int32 ResumeNum = lua_gettop(InL);
+
+	PushTokens(InL);
+	lua_pushthread(InL);
+	lua_pushnil(InL);
+	lua_rawset(InL, -3);
+	lua_pop(InL, 1);
+
+	return ResumeNum;
+}
+
+bool FLuaCoroutineWait::IsWaiting(lua_State* InL, lua_State* InCo, uint32 InToken)
+{
+	if (InCo == nullptr || InToken == 0 || lua_status(InCo) != LUA_YIELD)
+	{
+		return false;
+	}
+
+	const int32 tp = lua_gettop(InL);
+	PushTokens(InL);
+	lua_pushthread(InCo);
+	lua_xmove(InCo, InL, 1);
+	lua_rawget(InL, -2);
+	const bool bWaiting = lua_tointeger(InL, -1) == (lua_Integer)InToken;
+	lua_settop(InL, tp);
+
+	return bWaiting;
+}
@@ -0,0 +1,35 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "lua.hpp"
+
+/**
+ * the wait of a coroutine suspended by a C++ call(Unreal.Async, latent functions) until its resumer has the results
+ * Begin gives the running coroutine a new token, Yield suspends it with a continuation clearing the token whoever resumes it,
+ * the resumer checks IsWaiting first: a coroutine resumed meanwhile by its own scheduler(Unreal.RunBackground, a timer, coroutine.resume)
+ * and yielded again for something else keeps waiting for that
+ */
+class FLuaCoroutineWait
+{
+public:
+
+	//new token of the running coroutine InL, game thread
+	static uint32 Begin(lua_State* InL);
+
+	//return it from the lua_CFunction, the stack of InL is dropped and the coroutine gets the values of lua_resume
+	static int32 Yield(lua_State* InL);
+
+	//InCo is yielded in the wait of InToken, InL is a thread of the same state
+	static bool IsWaiting(lua_State* InL, lua_State* InCo, uint32 InToken);
+
+protected:
+
+	static int32 ContinueWait(lua_State* InL, int32 InStatus, lua_KContext InContext);
+
+	//weak keyed table in the registry: coroutine -> token
+	static void PushTokens(lua_State* InL);
+
+	static uint32 NextToken;
+};
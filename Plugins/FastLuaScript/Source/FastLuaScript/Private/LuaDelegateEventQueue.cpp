@@ -0,0 +1,260 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "LuaDelegateEventQueue.h"
+#include "HAL/IConsoleManager.h"
+#include "UObject/Class.h"
+
+#include "LuaFunctionWrapper.h"
+#include "FastLuaHelper.h"
+#include "FastLuaScript.h"
+#include "FastLuaStat.h"
+#include "LuaHitchDetector.h"
+#include "LuaTrace.h"
+
+#include "lua.hpp"
+
+
+static int32 GLuaDelegateQueueMaxEventsPerFrame = 4096;
+static FAutoConsoleVariableRef CVarLuaDelegateQueueMaxEventsPerFrame(
+	TEXT("lua.DelegateQueue.MaxEventsPerFrame"),
+	GLuaDelegateQueueMaxEventsPerFrame,
+	TEXT("Max queued delegate events delivered to lua per frame, <= 0 means no limit."));
+
+static float GLuaDelegateQueueBudgetMs = 2.0f;
+static FAutoConsoleVariableRef CVarLuaDelegateQueueBudgetMs(
+	TEXT("lua.DelegateQueue.BudgetMs"),
+	GLuaDelegateQueueBudgetMs,
+	TEXT("Time budget(ms) for delivering queued delegate events per frame, checked between batches, <= 0 means no limit."));
+
+
+FLuaDelegateEventQueue::~FLuaDelegateEventQueue()
+{
+	Reset();
+}
+
+void FLuaDelegateEventQueue::Enqueue(ULuaFunctionWrapper* InWrapper, const UFunction* InSignature, void* InParms)
+{
+	FQueuedEvent& NewEvent = Events.AddDefaulted_GetRef();
+	NewEvent.Wrapper = InWrapper;
+	NewEvent.Signature = InSignature;
+
+	const int32 ParamsSize = InSignature->GetStructureSize();
+	if (ParamsSize < 1)
+	{
+		NewEvent.Offset = INDEX_NONE;
+		return;
+	}
+
+	NewEvent.Offset = Align(ParamBuffer.Num(), FMath::Max(InSignature->GetMinAlignment(), 8));
+	ParamBuffer.AddUninitialized(NewEvent.Offset + ParamsSize - ParamBuffer.Num());
+
+	uint8* EventParams = ParamBuffer.GetData() + NewEvent.Offset;
+	InSignature->InitializeStruct(EventParams);
+	if (InParms)
+	{
+		for (TFieldIterator<FProperty> It(InSignature); It && It->HasAnyPropertyFlags(CPF_Parm); ++It)
+		{
+			It->CopyCompleteValue_InContainer(EventParams, InParms);
+		}
+	}
+
+	INC_DWORD_STAT(STAT_DelegateEventsQueued);
+}
+
+int32 FLuaDelegateEventQueue::Flush(lua_State* InL)
+{
+	if (InL == nullptr || Events.Num() < 1 || bFlushing)
+	{
+		return 0;
+	}
+
+	SCOPE_CYCLE_COUNTER(STAT_DelegateQueueFlush);
+	TGuardValue<bool> FlushGuard(bFlushing, true);
+
+	const double StartTime = FPlatformTime::Seconds();
+	const double BudgetSeconds = GLuaDelegateQueueBudgetMs / 1000.0;
+
+	//events queued by the callbacks below wait for the next frame
+	int32 Candidates = Events.Num();
+	if (GLuaDelegateQueueMaxEventsPerFrame > 0)
+	{
+		Candidates = FMath::Min(Candidates, GLuaDelegateQueueMaxEventsPerFrame);
+	}
+
+	//group by binding, in the order of the first event of each binding
+	TArray<ULuaFunctionWrapper*, TInlineAllocator<16>> BatchWrappers;
+	TArray<TArray<int32>, TInlineAllocator<16>> BatchEvents;
+	TArray<bool> Consumed;
+	Consumed.Init(false, Events.Num());
+
+	for (int32 i = 0; i < Candidates; ++i)
+	{
+		ULuaFunctionWrapper* Wrapper = Events[i].Wrapper.Get();
+		if (Wrapper == nullptr || !Wrapper->IsBound())
+		{
+			//binding is gone, just drop the event
+			Consumed[i] = true;
+			continue;
+		}
+
+		int32 BatchIndex = BatchWrappers.Find(Wrapper);
+		if (BatchIndex == INDEX_NONE)
+		{
+			BatchIndex = BatchWrappers.Add(Wrapper);
+			BatchEvents.AddDefaulted();
+		}
+
+		BatchEvents[BatchIndex].Add(i);
+	}
+
+	int32 Delivered = 0;
+	for (int32 BatchIndex = 0; BatchIndex < BatchWrappers.Num(); ++BatchIndex)
+	{
+		if (BudgetSeconds > 0.0 && Delivered > 0 && FPlatformTime::Seconds() - StartTime > BudgetSeconds)
+		{
+			break;
+		}
+
+		DispatchBatch(InL, BatchWrappers[BatchIndex], BatchEvents[BatchIndex]);
+
+		for (int32 EventIndex : BatchEvents[BatchIndex])
+		{
+			Consumed[EventIndex] = true;
+		}
+
+		Delivered += BatchEvents[BatchIndex].Num();
+	}
+
+	//destroy delivered params, move the left events to the front
+	TArray<FQueuedEvent> LeftEvents;
+	TArray<uint8> LeftParams;
+	for (int32 i = 0; i < Events.Num(); ++i)
+	{
+		const FQueuedEvent& Event = Events[i];
+		if (i < Consumed.Num() && Consumed[i])
+		{
+			DestroyEventParams(Event);
+			continue;
+		}
+
+		FQueuedEvent& LeftEvent = LeftEvents.Add_GetRef(Event);
+		if (Event.Offset != INDEX_NONE)
+		{
+			const int32 ParamsSize = Event.Signature->GetStructureSize();
+			LeftEvent.Offset = Align(LeftParams.Num(), FMath::Max(Event.Signature->GetMinAlignment(), 8));
+			LeftParams.AddUninitialized(LeftEvent.Offset + ParamsSize - LeftParams.Num());
+			FMemory::Memcpy(LeftParams.GetData() + LeftEvent.Offset, ParamBuffer.GetData() + Event.Offset, ParamsSize);
+		}
+	}
+
+	if (LeftEvents.Num() > 0)
+	{
+		Events = MoveTemp(LeftEvents);
+		ParamBuffer = MoveTemp(LeftParams);
+	}
+	else
+	{
+		//keep the memory for the next frame
+		Events.Reset();
+		ParamBuffer.Reset();
+	}
+
+	SET_DWORD_STAT(STAT_DelegateEventsQueued, Events.Num());
+
+	return Delivered;
+}
+
+void FLuaDelegateEventQueue::Reset()
+{
+	for (const FQueuedEvent& Event : Events)
+	{
+		DestroyEventParams(Event);
+	}
+
+	Events.Reset();
+	ParamBuffer.Reset();
+
+	SET_DWORD_STAT(STAT_DelegateEventsQueued, 0);
+}
+
+void FLuaDelegateEventQueue::DestroyEventParams(const FQueuedEvent& InEvent)
+{
+	if (InEvent.Offset != INDEX_NONE && InEvent.Signature)
+	{
+		InEvent.Signature->DestroyStruct(ParamBuffer.GetData() + InEvent.Offset);
+	}
+}
+
+bool FLuaDelegateEventQueue::DispatchBatch(lua_State* InL, ULuaFunctionWrapper* InWrapper, const TArray<int32>& InEventIndices)
+{
+	SCOPE_CYCLE_COUNTER(STAT_DelegateCallLua);
+
+	const UFunction* Signature = Events[InEventIndices[0]].Signature;
+
+	int32 tp = lua_gettop(InL);
+
+	lua_rawgeti(InL, LUA_REGISTRYINDEX, InWrapper->LuaFunctionID);
+	int32 ParamsNum = 0;
+	if (InWrapper->LuaSelfID)
+	{
+		lua_rawgeti(InL, LUA_REGISTRYINDEX, InWrapper->LuaSelfID);
+		++ParamsNum;
+	}
+
+	int32 Stride = 0;
+	for (TFieldIterator<FProperty> It(Signature); It && It->HasAnyPropertyFlags(CPF_Parm); ++It)
+	{
+		if (!It->HasAnyPropertyFlags(CPF_ReturnParm))
+		{
+			++Stride;
+		}
+	}
+
+	lua_createtable(InL, InEventIndices.Num() * Stride, 0);
+	int32 Slot = 0;
+	for (int32 EventIndex : InEventIndices)
+	{
+		const FQueuedEvent& Event = Events[EventIndex];
+		uint8* EventParams = Event.Offset != INDEX_NONE ? ParamBuffer.GetData() + Event.Offset : nullptr;
+		if (EventParams == nullptr)
+		{
+			Slot += Stride;
+			continue;
+		}
+
+		for (TFieldIterator<FProperty> It(Signature); It && It->HasAnyPropertyFlags(CPF_Parm); ++It)
+		{
+			if (It->HasAnyPropertyFlags(CPF_ReturnParm))
+			{
+				continue;
+			}
+
+			++Slot;
+			const int32 BatchTop = lua_gettop(InL);
+			FastLuaHelper::PushProperty(InL, *It, EventParams);
+			if (lua_gettop(InL) > BatchTop)
+			{
+				lua_rawseti(InL, -2, Slot);
+			}
+		}
+	}
+	lua_pushinteger(InL, InEventIndices.Num());
+	lua_pushinteger(InL, Stride);
+	ParamsNum += 3;
+
+	//the callback may unbind InWrapper
+	const int32 FunctionID = InWrapper->LuaFunctionID;
+	FLuaHitchDetector::Get().BeginScope(InL);
+	int32 CallRet = lua_pcall(InL, ParamsNum, 0, 0);
+	FLuaTrace::Get().UnwindFrames(InL);
+	FLuaHitchDetector::Get().EndScope(InL, TEXT("QueuedDelegate"), InWrapper->LuaFunctionID == FunctionID ? FunctionID : LUA_NOREF);
+	if (CallRet)
+	{
+		UE_LOG(LogFastLuaScript, Warning, TEXT("%s"), UTF8_TO_TCHAR(lua_tostring(InL, -1)));
+	}
+
+	lua_settop(InL, tp);
+
+	return CallRet == LUA_OK;
+}
@@ -3,11 +3,13 @@
 
 #include "LuaDelegateWrapper.h"
 #include "LuaFunctionWrapper.h"
+#include "FastLuaScript.h"
 #include "FastLuaHelper.h"
 #include "LuaObjectWrapper.h"
 #include "UObject/ScriptDelegates.h"
 #include <UObject/WeakObjectPtr.h>
 #include <UObject/StructOnScope.h>
+#include "UObject/Package.h"
 
 #include "lua.hpp"
 
@@ -60,6 +62,7 @@ void FLuaDelegateWrapper::InitWrapperMetatable(lua_State* InL)
 	static const luaL_Reg GlueFuncs[] =
 	{
 		{"Bind", FLuaDelegateWrapper::LuaBindDelegate},
+		{"BindQueued", FLuaDelegateWrapper::LuaBindQueuedDelegate},
 		{"Unbind", FLuaDelegateWrapper::LuaUnbindDelegate},
 		{"Call", FLuaDelegateWrapper::LuaCallUnrealDelegate},
 		{"__gc", FLuaDelegateWrapper::UserDelegateGC},
@@ -139,7 +142,43 @@ int32 FLuaDelegateWrapper::LuaNewDelegate(lua_State* InL)
 	return 1;
 }
 
+//Delegate:Bind(LuaFunction, Self)
 int32 FLuaDelegateWrapper::LuaBindDelegate(lua_State* InL)
+{
+	return BindDelegate(InL, false);
+}
+
+//Delegate:BindQueued(LuaFunction, Self), see FLuaDelegateEventQueue, a delegate with a return value or out params is bound like Bind
+int32 FLuaDelegateWrapper::LuaBindQueuedDelegate(lua_State* InL)
+{
+	return BindDelegate(InL, true);
+}
+
+ULuaFunctionWrapper* FLuaDelegateWrapper::FindBoundLuaFunction(lua_State* InL, int32 InStackIndex)
+{
+	TArray<UObject*> BoundObjects;
+	if (bIsMulti)
+	{
+		BoundObjects = ((FMulticastScriptDelegate*)DelegateAddr)->GetAllObjects();
+	}
+	else if (UObject* BoundObject = ((FScriptDelegate*)DelegateAddr)->GetUObject())
+	{
+		BoundObjects.Add(BoundObject);
+	}
+
+	for (UObject* BoundObject : BoundObjects)
+	{
+		ULuaFunctionWrapper* LuaFunc = Cast<ULuaFunctionWrapper>(BoundObject);
+		if (LuaFunc && LuaFunc->IsBoundTo(InL, InStackIndex))
+		{
+			return LuaFunc;
+		}
+	}
+
+	return nullptr;
+}
+
+int32 FLuaDelegateWrapper::BindDelegate(lua_State* InL, bool InQueued)
 {
 	FLuaDelegateWrapper* Wrapper = (FLuaDelegateWrapper*)lua_touserdata(InL, 1);
 
@@ -148,7 +187,24 @@ int32 FLuaDelegateWrapper::LuaBindDelegate(lua_State* InL)
 		return 0;
 	}
 
-	ULuaFunctionWrapper* LuaFunc = Cast<ULuaFunctionWrapper>(FLuaObjectWrapper::FetchObject(InL, 2, false));
+	ULuaFunctionWrapper* LuaFunc = nullptr;
+	if (lua_isfunction(InL, 2))
+	{
+		LuaFunc = Wrapper->FindBoundLuaFunction(InL, 2);
+		if (LuaFunc == nullptr)
+		{
+			LuaFunc = NewObject<ULuaFunctionWrapper>(GetTransientPackage());
+			//released by Unbind or on lua reset, see ULuaFunctionWrapper::HandleLuaUnrealReset
+			LuaFunc->AddToRoot();
+			LuaFunc->bCreatedByBind = true;
+			LuaFunc->BindLuaFunction(InL, 2);
+		}
+	}
+	else
+	{
+		LuaFunc = Cast<ULuaFunctionWrapper>(FLuaObjectWrapper::FetchObject(InL, 2, false));
+	}
+
 	if (LuaFunc == nullptr)
 	{
 		return 0;
@@ -156,6 +212,15 @@ int32 FLuaDelegateWrapper::LuaBindDelegate(lua_State* InL)
 
 	LuaFunc->FunctionSignature = Wrapper->FunctionSignature;
 
+	//the return value and out params(bool& bHandled) can not wait for next tick
+	const bool bCanQueue = Wrapper->FunctionSignature && Wrapper->FunctionSignature->GetReturnProperty() == nullptr &&
+		!Wrapper->FunctionSignature->HasAnyFunctionFlags(FUNC_HasOutParms);
+	if (InQueued && !bCanQueue)
+	{
+		UE_LOG(LogFastLuaScript, Warning, TEXT("FLuaDelegateWrapper|BindQueued: delegate with return value or out params is bound immediate"));
+	}
+	LuaFunc->SetQueued(InQueued && bCanQueue);
+
 	if (Wrapper->bIsMulti)
 	{
 		FScriptDelegate TempDelegate;
@@ -187,7 +252,19 @@ int32 FLuaDelegateWrapper::LuaUnbindDelegate(lua_State* InL)
 		return 0;
 	}
 
-	ULuaFunctionWrapper* LuaFunc = Cast<ULuaFunctionWrapper>(FLuaObjectWrapper::FetchObject(InL, 2, false));
+	ULuaFunctionWrapper* LuaFunc = nullptr;
+	if (lua_isfunction(InL, 2))
+	{
+		LuaFunc = Wrapper->FindBoundLuaFunction(InL, 2);
+		if (LuaFunc == nullptr)
+		{
+			return 0;
+		}
+	}
+	else
+	{
+		LuaFunc = Cast<ULuaFunctionWrapper>(FLuaObjectWrapper::FetchObject(InL, 2, false));
+	}
 
 	if (Wrapper->bIsMulti)
 	{
@@ -200,6 +277,13 @@ int32 FLuaDelegateWrapper::LuaUnbindDelegate(lua_State* InL)
 		((FScriptDelegate*)Wrapper->DelegateAddr)->Clear();
 	}
 
+	//the wrapper made by Bind for a lua function belongs to this delegate only, queued events of it are dropped
+	if (LuaFunc && LuaFunc->bCreatedByBind)
+	{
+		LuaFunc->Unbind();
+		LuaFunc->RemoveFromRoot();
+	}
+
 	lua_pushinteger(InL, 1);
 
 	return 1;
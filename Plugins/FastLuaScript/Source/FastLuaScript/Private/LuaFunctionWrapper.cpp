@@ -7,6 +7,10 @@
 #include "FastLuaUnrealWrapper.h"
 #include "FastLuaStat.h"
 #include <LuaObjectWrapper.h>
+#include "LuaDelegateEventQueue.h"
+#include "LuaHitchDetector.h"
+#include "LuaTrace.h"
+#include "LuaSessionRecorder.h"
 
 FDelegateHandle ULuaFunctionWrapper::OnLuaResetHandle;
 
@@ -15,10 +19,12 @@ bool ULuaFunctionWrapper::BindLuaFunction(lua_State* InL, uint32 InStackIndex)
 {
 	if (!OnLuaResetHandle.IsValid())
 	{
-		OnLuaResetHandle = FastLuaUnrealWrapper::OnLuaUnrealReset.AddUObject(this, &ULuaFunctionWrapper::HandleLuaUnrealReset);
+		OnLuaResetHandle = FastLuaUnrealWrapper::OnLuaUnrealReset.AddStatic(&ULuaFunctionWrapper::HandleLuaUnrealReset);
 	}
 
-	LuaState = InL;
+	lua_rawgeti(InL, LUA_REGISTRYINDEX, LUA_RIDX_MAINTHREAD);
+	LuaState = lua_tothread(InL, -1);
+	lua_pop(InL, 1);
 	//ref function first
 	if (lua_isfunction(InL, InStackIndex))
 	{
@@ -40,6 +46,54 @@ bool ULuaFunctionWrapper::BindLuaFunction(lua_State* InL, uint32 InStackIndex)
 	}
 }
 
+void ULuaFunctionWrapper::HandleLuaUnrealReset(lua_State* InL)
+{
+	if (InL == nullptr)
+	{
+		return;
+	}
+
+	for (TObjectIterator<ULuaFunctionWrapper> It; It; ++It)
+	{
+		if (It->LuaState == InL)
+		{
+			It->Unbind();
+			It->RemoveFromRoot();
+			It->MarkPendingKill();
+		}
+	}
+}
+
+bool ULuaFunctionWrapper::IsBoundTo(lua_State* InL, int32 InStackIndex) const
+{
+	if (!IsBound() || !lua_isfunction(InL, InStackIndex))
+	{
+		return false;
+	}
+
+	InStackIndex = lua_absindex(InL, InStackIndex);
+
+	lua_rawgeti(InL, LUA_REGISTRYINDEX, LuaFunctionID);
+	bool bSame = lua_rawequal(InL, -1, InStackIndex) == 1;
+	lua_pop(InL, 1);
+
+	if (bSame)
+	{
+		if (LuaSelfID)
+		{
+			lua_rawgeti(InL, LUA_REGISTRYINDEX, LuaSelfID);
+			bSame = lua_rawequal(InL, -1, InStackIndex + 1) == 1;
+			lua_pop(InL, 1);
+		}
+		else
+		{
+			bSame = !lua_istable(InL, InStackIndex + 1);
+		}
+	}
+
+	return bSame;
+}
+
 int32 ULuaFunctionWrapper::Unbind()
 {
 	if (LuaState == nullptr)
@@ -79,6 +133,19 @@ void ULuaFunctionWrapper::ProcessEvent(UFunction* InFunction, void* Parms)
 	{
 		return;
 	}
+
+	//queued or not, the fire is recorded here
+	FLuaSessionRecorder::RecordDelegate(LuaState, LuaFunctionID, FunctionSignature, Parms);
+
+	if (bQueued && FunctionSignature)
+	{
+		if (FastLuaUnrealWrapper* Owner = FastLuaUnrealWrapper::GetFromLuaState(LuaState))
+		{
+			Owner->GetDelegateEventQueue().Enqueue(this, FunctionSignature, Parms);
+			return;
+		}
+	}
+
 	//get lua function in global registry
 	lua_rawgeti(LuaState, LUA_REGISTRYINDEX, LuaFunctionID);
 	int32 ParamsNum = 0;
@@ -108,16 +175,21 @@ void ULuaFunctionWrapper::ProcessEvent(UFunction* InFunction, void* Parms)
 		}
 	}
 	
-	//call lua function
-	int32 CallRet = lua_pcall(LuaState, ParamsNum, ReturnParam ? 1 : 0, 0);
+	//call lua function, it may unbind this wrapper(Delegate:Unbind in the callback)
+	lua_State* L = LuaState;
+	const int32 FunctionID = LuaFunctionID;
+	FLuaHitchDetector::Get().BeginScope(L);
+	int32 CallRet = lua_pcall(L, ParamsNum, ReturnParam ? 1 : 0, 0);
+	FLuaTrace::Get().UnwindFrames(L);
+	FLuaHitchDetector::Get().EndScope(L, TEXT("Delegate"), LuaFunctionID == FunctionID ? FunctionID : LUA_NOREF);
 	if (CallRet)
 	{
-		UE_LOG(LogTemp, Warning, TEXT("%s"), UTF8_TO_TCHAR(lua_tostring(LuaState, -1)));
+		UE_LOG(LogTemp, Warning, TEXT("%s"), UTF8_TO_TCHAR(lua_tostring(L, -1)));
 	}
 	
 	if (ReturnParam)
 	{
 		//get function return Value, in common
-		FastLuaHelper::FetchProperty(LuaState, ReturnParam, Parms, -1);
+		FastLuaHelper::FetchProperty(L, ReturnParam, Parms, -1);
 	}
 }
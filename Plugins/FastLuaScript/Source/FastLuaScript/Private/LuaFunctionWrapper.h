@@ -23,6 +23,20 @@ public:
 
 	bool BindLuaFunction(lua_State* InL, uint32 InStackIndex);
 
+	//queued: params are copied into FLuaDelegateEventQueue and delivered in batch on lua tick
+	void SetQueued(bool InQueued)
+	{
+		bQueued = InQueued;
+	}
+
+	bool IsQueued() const
+	{
+		return bQueued;
+	}
+
+	//is the lua function(and self) at InStackIndex the one bound to this wrapper
+	bool IsBoundTo(lua_State* InL, int32 InStackIndex) const;
+
 	int32 Unbind();
 
 	bool IsBound() const
@@ -35,19 +49,15 @@ public:
 		return FunctionSignature;
 	}
 
-	void HandleLuaUnrealReset(lua_State* InL)
+	//the params of ProcessEvent, set when bound to a delegate
+	void SetUFunction(const UFunction* InFunction)
 	{
-		if (InL == LuaState)
-		{
-			for (TObjectIterator<ULuaFunctionWrapper>It; It; ++It)
-			{
-				It->Unbind();
-				It->RemoveFromRoot();
-				It->MarkPendingKill();
-			}
-		}
+		FunctionSignature = InFunction;
 	}
 
+	//unbind and release the wrappers of the closing state only
+	static void HandleLuaUnrealReset(lua_State* InL);
+
 
 protected:
 
@@ -58,7 +68,7 @@ protected:
 
 	virtual void ProcessEvent(UFunction* InFunction, void* Parms) override;
 
-	//now, now conside One lua state for the plugin
+	//main thread of the owning state, a coroutine may be dead when the delegate fires
 	lua_State* LuaState = nullptr;
 
 	//Lua function index in lua global registry
@@ -66,6 +76,7 @@ protected:
 	int32 LuaSelfID = 0;
 
 	friend class FLuaDelegateWrapper;
+	friend class FLuaDelegateEventQueue;
 
 	//the UFunction bound to this Delegate
 	const UFunction* FunctionSignature = nullptr;
@@ -74,4 +85,9 @@ protected:
 
 	int32 RefCount = 0;
 
+	bool bQueued = false;
+
+	//made by Delegate:Bind(LuaFunction) and rooted, Delegate:Unbind releases it
+	bool bCreatedByBind = false;
+
 };
@@ -0,0 +1,156 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "LuaGCScheduler.h"
+#include "LuaAllocator.h"
+#include "FastLuaSettings.h"
+#include "FastLuaScript.h"
+#include "FastLuaStat.h"
+
+#include "lua.hpp"
+
+//same as LUAI_GCPAUSE and LUAI_GENMINORMUL in lgc.c
+static const int32 DefaultGCPause = 200;
+static const int32 DefaultGenMinorMul = 20;
+
+
+FLuaGCScheduler::FLuaGCScheduler(lua_State* InL, const FLuaAllocator* InAllocator)
+	: L(InL)
+	, Allocator(InAllocator)
+{
+	LastAllocatedBytes = Allocator ? Allocator->GetAllocatedBytes() : 0;
+}
+
+void FLuaGCScheduler::ApplySettings(bool bInTicked)
+{
+	const UFastLuaSettings* Settings = GetDefault<UFastLuaSettings>();
+
+	bGenerational = Settings->GCMode == EFastLuaGCMode::Generational;
+	if (bGenerational)
+	{
+		lua_gc(L, LUA_GCGEN, Settings->GCGenMinorMul, Settings->GCGenMajorMul);
+	}
+	else
+	{
+		lua_gc(L, LUA_GCINC, Settings->GCPause, Settings->GCStepMul, 0);
+	}
+
+	//the allocation rate comes from FLuaAllocator, the steps from lua tick
+	bFrameBudgeted = Settings->bFrameBudgetedGC && Allocator != nullptr && bInTicked;
+	lua_gc(L, bFrameBudgeted ? LUA_GCSTOP : LUA_GCRESTART);
+
+	bPaused = false;
+	AllocatedSinceCollect = 0;
+}
+
+void FLuaGCScheduler::Tick()
+{
+	if (L == nullptr)
+	{
+		return;
+	}
+
+	SCOPE_CYCLE_COUNTER(STAT_LuaGCStep);
+
+	const UFastLuaSettings* Settings = GetDefault<UFastLuaSettings>();
+
+	const int32 LiveKB = lua_gc(L, LUA_GCCOUNT);
+	const int32 EmergencyKB = Settings->EmergencyFullGCThresholdMB * 1024;
+	if (EmergencyKB > 0 && LiveKB > EmergencyKB && LiveKB > LastEmergencyKB + LastEmergencyKB / 10)
+	{
+		UE_LOG(LogFastLuaScript, Warning, TEXT("Lua memory %d KB is over %d MB, full collect"), LiveKB, Settings->EmergencyFullGCThresholdMB);
+		lua_gc(L, LUA_GCCOLLECT);
+		LastEmergencyKB = lua_gc(L, LUA_GCCOUNT);
+
+		bPaused = false;
+		AllocatedSinceCollect = 0;
+		LastAllocatedBytes = Allocator ? Allocator->GetAllocatedBytes() : 0;
+		return;
+	}
+
+	if (LiveKB < EmergencyKB)
+	{
+		LastEmergencyKB = 0;
+	}
+
+	if (!bFrameBudgeted)
+	{
+		return;
+	}
+
+	//the scripts may have restarted or changed the collector
+	if (lua_gc(L, LUA_GCISRUNNING))
+	{
+		return;
+	}
+
+	const uint64 AllocatedBytes = Allocator->GetAllocatedBytes();
+	const uint64 AllocatedSinceLastTick = AllocatedBytes - LastAllocatedBytes;
+	LastAllocatedBytes = AllocatedBytes;
+	AllocatedSinceCollect += AllocatedSinceLastTick;
+
+	const double BudgetSeconds = Settings->GCStepBudgetMs / 1000.0;
+	if (bGenerational)
+	{
+		StepGenerational(BudgetSeconds, AllocatedSinceLastTick);
+	}
+	else
+	{
+		StepIncremental(BudgetSeconds, AllocatedSinceLastTick);
+	}
+}
+
+void FLuaGCScheduler::StepIncremental(double InBudgetSeconds, uint64 InAllocatedSinceLastTick)
+{
+	const UFastLuaSettings* Settings = GetDefault<UFastLuaSettings>();
+
+	if (bPaused)
+	{
+		if (AllocatedSinceCollect < PauseBytes)
+		{
+			return;
+		}
+
+		bPaused = false;
+	}
+
+	//keep up with the allocation: work(KB) per frame follows the KB allocated in the last frame
+	const int32 StepKB = FMath::Max(Settings->GCMinStepKB, 1);
+	int64 WorkKB = FMath::Max<int64>(StepKB, (int64)(InAllocatedSinceLastTick / 1024 * Settings->GCStepAllocMultiplier));
+
+	const double StartTime = FPlatformTime::Seconds();
+	do
+	{
+		if (lua_gc(L, LUA_GCSTEP, StepKB))
+		{
+			//cycle finished, wait like the lua pause: until allocated (pause - 100)% of the live memory
+			const int32 GCPause = Settings->GCPause > 0 ? Settings->GCPause : DefaultGCPause;
+			const uint64 LiveBytes = (uint64)lua_gc(L, LUA_GCCOUNT) * 1024;
+			PauseBytes = LiveBytes * FMath::Max(GCPause - 100, 0) / 100;
+			AllocatedSinceCollect = 0;
+			bPaused = true;
+			INC_DWORD_STAT(STAT_LuaGCCycles);
+			break;
+		}
+
+		WorkKB -= StepKB;
+	} while (WorkKB > 0 && FPlatformTime::Seconds() - StartTime < InBudgetSeconds);
+}
+
+void FLuaGCScheduler::StepGenerational(double InBudgetSeconds, uint64 InAllocatedSinceLastTick)
+{
+	const UFastLuaSettings* Settings = GetDefault<UFastLuaSettings>();
+
+	//a minor collection can not be split, do one when the young generation is big enough, like genminormul
+	const int32 MinorMul = Settings->GCGenMinorMul > 0 ? Settings->GCGenMinorMul : DefaultGenMinorMul;
+	const uint64 LiveBytes = (uint64)lua_gc(L, LUA_GCCOUNT) * 1024;
+	if (AllocatedSinceCollect < LiveBytes / 100 * MinorMul)
+	{
+		return;
+	}
+
+	//LUA_GCSTEP with 0 does a minor collection(or a major one when lua decides the memory grows too much)
+	lua_gc(L, LUA_GCSTEP, 0);
+	AllocatedSinceCollect = 0;
+	INC_DWORD_STAT(STAT_LuaGCCycles);
+}
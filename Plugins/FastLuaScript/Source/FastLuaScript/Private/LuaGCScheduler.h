@@ -0,0 +1,55 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+struct lua_State;
+class FLuaAllocator;
+
+/**
+ * runs the lua collector from lua tick instead of inside random allocations
+ * the automatic collector is stopped(LUA_GCSTOP), each frame does LUA_GCSTEP until the time budget is used,
+ * the step size follows the allocation rate of the last frame, see UFastLuaSettings
+ * states without lua tick(commandlets, DoLuaCode, tests) keep the automatic collector
+ */
+class FLuaGCScheduler
+{
+public:
+
+	FLuaGCScheduler(lua_State* InL, const FLuaAllocator* InAllocator);
+
+	//apply UFastLuaSettings to the state: gc mode, params, stop the automatic collector if frame budgeted
+	//only a state ticked by HandleLuaTick(bInTicked, see RunMainFunction) is frame budgeted, the others keep the automatic collector
+	void ApplySettings(bool bInTicked);
+
+	void Tick();
+
+	bool IsFrameBudgeted() const
+	{
+		return bFrameBudgeted;
+	}
+
+protected:
+
+	void StepIncremental(double InBudgetSeconds, uint64 InAllocatedSinceLastTick);
+	void StepGenerational(double InBudgetSeconds, uint64 InAllocatedSinceLastTick);
+
+	lua_State* L = nullptr;
+	const FLuaAllocator* Allocator = nullptr;
+
+	bool bFrameBudgeted = false;
+	bool bGenerational = false;
+
+	uint64 LastAllocatedBytes = 0;
+
+	//incremental: a cycle ended, wait until enough garbage like the lua pause does
+	bool bPaused = false;
+	uint64 PauseBytes = 0;
+
+	//bytes allocated since the last finished cycle(incremental) or minor collection(generational)
+	uint64 AllocatedSinceCollect = 0;
+
+	//live KB after the last emergency collect, avoid collecting every frame when the memory can not go down
+	int32 LastEmergencyKB = 0;
+};
@@ -0,0 +1,178 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "LuaGCTelemetry.h"
+#include "HAL/IConsoleManager.h"
+#include "Misc/OutputDevice.h"
+#include "ProfilingDebugging/CsvProfiler.h"
+
+#include "FastLuaUnrealWrapper.h"
+#include "LuaAllocator.h"
+#include "FastLuaStat.h"
+
+
+CSV_DEFINE_CATEGORY(FastLuaGC, true);
+
+const double FLuaGCTelemetry::PauseBucketMs[FLuaGCTelemetry::NumPauseBuckets] = { 0.05, 0.1, 0.25, 0.5, 1.0, 2.0, 4.0, 8.0, 16.0, 0.0 };
+
+static FAutoConsoleCommandWithWorldArgsAndOutputDevice LuaGCStatsCommand(
+	TEXT("lua.gcstats"),
+	TEXT("Dump lua collector telemetry and the step pause histogram, 'lua.gcstats reset' clears the histogram"),
+	FConsoleCommandWithWorldArgsAndOutputDeviceDelegate::CreateStatic([](const TArray<FString>& InArgs, UWorld* InWorld, FOutputDevice& Ar)
+	{
+		const bool bReset = InArgs.Num() > 0 && InArgs[0] == TEXT("reset");
+		for (FastLuaUnrealWrapper* Wrapper : FastLuaUnrealWrapper::GetAllWrappers())
+		{
+			if (FLuaGCTelemetry* Telemetry = Wrapper->GetGCTelemetry())
+			{
+				Telemetry->Dump(Ar);
+				if (bReset)
+				{
+					Telemetry->ResetHistogram();
+				}
+			}
+		}
+	}));
+
+
+FLuaGCTelemetry::FLuaGCTelemetry(lua_State* InL, const FLuaAllocator* InAllocator)
+	: L(InL)
+	, Allocator(InAllocator)
+{
+	ResetHistogram();
+
+	lua_getgcstats(L, &LastFrameStats);
+	LastAllocatedBytes = Allocator ? Allocator->GetAllocatedBytes() : 0;
+
+	lua_setgcobserver(L, &FLuaGCTelemetry::OnGCEvent, this);
+}
+
+FLuaGCTelemetry::~FLuaGCTelemetry()
+{
+	lua_setgcobserver(L, nullptr, nullptr);
+}
+
+void FLuaGCTelemetry::OnGCEvent(lua_State* InL, int InEvent, void* InUserData)
+{
+	FLuaGCTelemetry* Telemetry = (FLuaGCTelemetry*)InUserData;
+
+	if (InEvent == LUA_GCEV_STEPBEGIN)
+	{
+		if (Telemetry->StepDepth++ == 0)
+		{
+			Telemetry->StepStartCycles = FPlatformTime::Cycles64();
+		}
+	}
+	else if (InEvent == LUA_GCEV_STEPEND && Telemetry->StepDepth > 0)
+	{
+		if (--Telemetry->StepDepth > 0)
+		{
+			return;
+		}
+
+		const double PauseMs = FPlatformTime::ToMilliseconds64(FPlatformTime::Cycles64() - Telemetry->StepStartCycles);
+
+		int32 Bucket = 0;
+		while (Bucket < NumPauseBuckets - 1 && PauseMs > PauseBucketMs[Bucket])
+		{
+			++Bucket;
+		}
+
+		++Telemetry->PauseHistogram[Bucket];
+		++Telemetry->TotalPauses;
+		Telemetry->TotalPauseMs += PauseMs;
+		Telemetry->MaxPauseMs = FMath::Max(Telemetry->MaxPauseMs, PauseMs);
+
+		Telemetry->FramePauseMs += PauseMs;
+		Telemetry->FrameMaxPauseMs = FMath::Max(Telemetry->FrameMaxPauseMs, PauseMs);
+	}
+}
+
+void FLuaGCTelemetry::EndFrame()
+{
+	lua_GCStats Stats;
+	lua_getgcstats(L, &Stats);
+
+	const uint64 AllocatedBytes = Allocator ? Allocator->GetAllocatedBytes() : 0;
+	const uint32 AllocKB = (uint32)((AllocatedBytes - LastAllocatedBytes) / 1024);
+	LastAllocatedBytes = AllocatedBytes;
+
+	const uint32 Steps = (uint32)(Stats.steps - LastFrameStats.steps);
+	const uint32 Marked = (uint32)(Stats.marked - LastFrameStats.marked);
+	const uint32 Swept = (uint32)(Stats.swept - LastFrameStats.swept);
+	const uint32 Freed = (uint32)(Stats.freed - LastFrameStats.freed);
+	const uint32 Finalizers = (uint32)(Stats.finalizers - LastFrameStats.finalizers);
+	const uint32 Minors = (uint32)(Stats.minors - LastFrameStats.minors);
+	const uint32 Majors = (uint32)(Stats.majors - LastFrameStats.majors);
+	const uint32 Cycles = (uint32)(Stats.cycles - LastFrameStats.cycles);
+
+	//several states add up in the same frame
+	INC_DWORD_STAT_BY(STAT_LuaGCSteps, Steps);
+	INC_DWORD_STAT_BY(STAT_LuaGCMarked, Marked);
+	INC_DWORD_STAT_BY(STAT_LuaGCSwept, Swept);
+	INC_DWORD_STAT_BY(STAT_LuaGCFreed, Freed);
+	INC_DWORD_STAT_BY(STAT_LuaGCFinalizers, Finalizers);
+	INC_DWORD_STAT_BY(STAT_LuaGCMinorCollections, Minors);
+	INC_DWORD_STAT_BY(STAT_LuaGCMajorCollections, Majors);
+	INC_DWORD_STAT_BY(STAT_LuaGCIncCycles, Cycles);
+	INC_DWORD_STAT_BY(STAT_LuaAllocKBPerFrame, AllocKB);
+	INC_FLOAT_STAT_BY(STAT_LuaGCPauseMs, (float)FramePauseMs);
+
+	CSV_CUSTOM_STAT(FastLuaGC, PauseMs, (float)FramePauseMs, ECsvCustomStatOp::Accumulate);
+	CSV_CUSTOM_STAT(FastLuaGC, MaxPauseMs, (float)FrameMaxPauseMs, ECsvCustomStatOp::Max);
+	CSV_CUSTOM_STAT(FastLuaGC, Steps, (int32)Steps, ECsvCustomStatOp::Accumulate);
+	CSV_CUSTOM_STAT(FastLuaGC, Marked, (int32)Marked, ECsvCustomStatOp::Accumulate);
+	CSV_CUSTOM_STAT(FastLuaGC, Freed, (int32)Freed, ECsvCustomStatOp::Accumulate);
+	CSV_CUSTOM_STAT(FastLuaGC, Finalizers, (int32)Finalizers, ECsvCustomStatOp::Accumulate);
+	CSV_CUSTOM_STAT(FastLuaGC, MinorCollections, (int32)Minors, ECsvCustomStatOp::Accumulate);
+	CSV_CUSTOM_STAT(FastLuaGC, MajorCollections, (int32)Majors, ECsvCustomStatOp::Accumulate);
+	CSV_CUSTOM_STAT(FastLuaGC, IncCycles, (int32)Cycles, ECsvCustomStatOp::Accumulate);
+	CSV_CUSTOM_STAT(FastLuaGC, AllocKB, (int32)AllocKB, ECsvCustomStatOp::Accumulate);
+
+	LastFrameStats = Stats;
+	FramePauseMs = 0.0;
+	FrameMaxPauseMs = 0.0;
+	++Frames;
+}
+
+void FLuaGCTelemetry::Dump(FOutputDevice& Ar) const
+{
+	lua_GCStats Stats;
+	lua_getgcstats(L, &Stats);
+
+	Ar.Logf(TEXT("Lua GC(%d KB, %s): %u frames, %llu steps, %llu full, %llu cycles, %llu minor, %llu major"),
+		lua_gc(L, LUA_GCCOUNT), lua_gc(L, LUA_GCISRUNNING) ? TEXT("auto") : TEXT("stepped by tick"), Frames,
+		(uint64)(Stats.steps - StatsAtHistogramReset.steps),
+		(uint64)(Stats.fullgcs - StatsAtHistogramReset.fullgcs),
+		(uint64)(Stats.cycles - StatsAtHistogramReset.cycles),
+		(uint64)(Stats.minors - StatsAtHistogramReset.minors),
+		(uint64)(Stats.majors - StatsAtHistogramReset.majors));
+
+	Ar.Logf(TEXT("  marked %llu, swept %llu, freed %llu, finalizers %llu, phase changes %llu"),
+		(uint64)(Stats.marked - StatsAtHistogramReset.marked),
+		(uint64)(Stats.swept - StatsAtHistogramReset.swept),
+		(uint64)(Stats.freed - StatsAtHistogramReset.freed),
+		(uint64)(Stats.finalizers - StatsAtHistogramReset.finalizers),
+		(uint64)(Stats.phases - StatsAtHistogramReset.phases));
+
+	Ar.Logf(TEXT("  pauses %llu, total %.3f ms, avg %.4f ms, max %.3f ms"),
+		TotalPauses, TotalPauseMs, TotalPauses > 0 ? TotalPauseMs / TotalPauses : 0.0, MaxPauseMs);
+
+	for (int32 i = 0; i < NumPauseBuckets; ++i)
+	{
+		const FString Range = i < NumPauseBuckets - 1 ? FString::Printf(TEXT("<= %6.2f ms"), PauseBucketMs[i]) : FString::Printf(TEXT(" > %6.2f ms"), PauseBucketMs[i - 1]);
+		const int32 BarLen = TotalPauses > 0 ? (int32)(PauseHistogram[i] * 50 / TotalPauses) : 0;
+		Ar.Logf(TEXT("  %s %10llu %s"), *Range, PauseHistogram[i], *FString::ChrN(BarLen, TEXT('#')));
+	}
+}
+
+void FLuaGCTelemetry::ResetHistogram()
+{
+	FMemory::Memzero(PauseHistogram);
+	TotalPauses = 0;
+	TotalPauseMs = 0.0;
+	MaxPauseMs = 0.0;
+	Frames = 0;
+
+	lua_getgcstats(L, &StatsAtHistogramReset);
+}
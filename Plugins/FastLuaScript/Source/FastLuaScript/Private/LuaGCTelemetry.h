@@ -0,0 +1,66 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "lua.hpp"
+
+class FLuaAllocator;
+
+/**
+ * collector telemetry of one lua_State, from the counters and observer added to lgc.c(lua_getgcstats/lua_setgcobserver)
+ * step pauses go to a histogram, per frame counts go to STATGROUP_FastLuaScript and the FastLuaGC csv category
+ * console: lua.gcstats [reset]
+ */
+class FLuaGCTelemetry
+{
+public:
+
+	static constexpr int32 NumPauseBuckets = 10;
+
+	FLuaGCTelemetry(lua_State* InL, const FLuaAllocator* InAllocator);
+	~FLuaGCTelemetry();
+
+	FLuaGCTelemetry(const FLuaGCTelemetry&) = delete;
+	FLuaGCTelemetry& operator=(const FLuaGCTelemetry&) = delete;
+
+	//publish the counters of the frame, called once per lua tick
+	void EndFrame();
+
+	void Dump(FOutputDevice& Ar) const;
+
+	void ResetHistogram();
+
+	//pause(ms) of the steps in the current frame
+	double GetFramePauseMs() const
+	{
+		return FramePauseMs;
+	}
+
+protected:
+
+	static void OnGCEvent(lua_State* InL, int InEvent, void* InUserData);
+
+	//upper bound(ms) of each bucket, the last one is unbounded
+	static const double PauseBucketMs[NumPauseBuckets];
+
+	lua_State* L = nullptr;
+	const FLuaAllocator* Allocator = nullptr;
+
+	//nested steps(collectgarbage in __gc) are part of the outer one
+	int32 StepDepth = 0;
+	uint64 StepStartCycles = 0;
+
+	uint64 PauseHistogram[NumPauseBuckets];
+	uint64 TotalPauses = 0;
+	double TotalPauseMs = 0.0;
+	double MaxPauseMs = 0.0;
+
+	double FramePauseMs = 0.0;
+	double FrameMaxPauseMs = 0.0;
+
+	lua_GCStats StatsAtHistogramReset;
+	lua_GCStats LastFrameStats;
+	uint64 LastAllocatedBytes = 0;
+	uint32 Frames = 0;
+};
@@ -0,0 +1,536 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "LuaHeapSnapshot.h"
+#include "HAL/IConsoleManager.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Misc/OutputDevice.h"
+
+#include "FastLuaUnrealWrapper.h"
+#include "FastLuaScript.h"
+#include "LuaAllocator.h"
+#include "LuaAllocTracker.h"
+
+#include "lua.hpp"
+
+//object sizes
+extern "C" {
+#include "lstate.h"
+#include "lobject.h"
+#include "lfunc.h"
+#include "lstring.h"
+#include "ltable.h"
+}
+
+
+static int32 GLuaHeapMaxDepth = 4;
+static FAutoConsoleVariableRef CVarLuaHeapMaxDepth(
+	TEXT("lua.Heap.MaxDepth"),
+	GLuaHeapMaxDepth,
+	TEXT("Path depth of the rows of lua.heap snapshot, deeper objects are counted in their ancestor"));
+
+static int32 GLuaHeapSampleBytes = 16 * 1024;
+static FAutoConsoleVariableRef CVarLuaHeapSampleBytes(
+	TEXT("lua.Heap.SampleBytes"),
+	GLuaHeapSampleBytes,
+	TEXT("Bytes between two tagged allocations of lua.heap track without a size, 0 tags all of them"));
+
+static FAutoConsoleCommand LuaHeapCommand(
+	TEXT("lua.heap"),
+	TEXT("Lua heap: lua.heap snapshot | diff Old.txt New.txt [Num] | track [SampleBytes] | track stop | sites [Num]"),
+	FConsoleCommandWithArgsDelegate::CreateStatic([](const TArray<FString>& InArgs)
+	{
+		const FString Action = InArgs.Num() > 0 ? InArgs[0] : FString();
+		if (Action == TEXT("snapshot"))
+		{
+			const FString BaseName = FPaths::ProfilingDir() / TEXT("Lua") / FString::Printf(TEXT("LuaHeap-%s"), *FDateTime::Now().ToString());
+			int32 StateIndex = 0;
+			for (FastLuaUnrealWrapper* Wrapper : FastLuaUnrealWrapper::GetAllWrappers())
+			{
+				if (lua_State* L = Wrapper->GetLuaState())
+				{
+					const FString File = StateIndex > 0 ? FString::Printf(TEXT("%s-%d.txt"), *BaseName, StateIndex) : BaseName + TEXT(".txt");
+					if (FLuaHeapSnapshot::Write(L, File))
+					{
+						UE_LOG(LogFastLuaScript, Display, TEXT("LuaHeapSnapshot|%s"), *File);
+					}
+					++StateIndex;
+				}
+			}
+		}
+		else if (Action == TEXT("diff") && InArgs.Num() > 2)
+		{
+			FLuaHeapSnapshot::Diff(InArgs[1], InArgs[2], *GLog, InArgs.Num() > 3 ? FCString::Atoi(*InArgs[3]) : 30);
+		}
+		else if (Action == TEXT("track"))
+		{
+			const bool bStop = InArgs.Num() > 1 && InArgs[1] == TEXT("stop");
+			const int32 SampleBytes = InArgs.Num() > 1 && !bStop ? FCString::Atoi(*InArgs[1]) : GLuaHeapSampleBytes;
+			for (FastLuaUnrealWrapper* Wrapper : FastLuaUnrealWrapper::GetAllWrappers())
+			{
+				FLuaAllocator* Allocator = Wrapper->GetAllocator();
+				if (Allocator && Wrapper->GetLuaState())
+				{
+					Allocator->SetTracker(bStop ? nullptr : MakeUnique<FLuaAllocTracker>(Wrapper->GetLuaState(), SampleBytes));
+				}
+			}
+		}
+		else if (Action == TEXT("sites"))
+		{
+			for (FastLuaUnrealWrapper* Wrapper : FastLuaUnrealWrapper::GetAllWrappers())
+			{
+				const FLuaAllocator* Allocator = Wrapper->GetAllocator();
+				if (Allocator && Allocator->GetTracker())
+				{
+					Allocator->GetTracker()->DumpSites(*GLog, InArgs.Num() > 1 ? FCString::Atoi(*InArgs[1]) : 30);
+				}
+			}
+		}
+		else
+		{
+			UE_LOG(LogFastLuaScript, Display, TEXT("LuaHeapSnapshot|lua.heap snapshot | diff Old.txt New.txt [Num] | track [SampleBytes] | track stop | sites [Num]"));
+		}
+	}));
+
+namespace LuaHeapSnapshot
+{
+	//a whole proto tree is counted with the first closure of one of its functions
+	static int64 GetProtoSize(const Proto* InProto, TSet<const void*>& InOutProtos)
+	{
+		bool bCounted = false;
+		InOutProtos.Add(InProto, &bCounted);
+		if (bCounted)
+		{
+			return 0;
+		}
+
+		int64 Size = sizeof(Proto) + InProto->sizecode * sizeof(Instruction) + InProto->sizek * sizeof(TValue) + InProto->sizep * sizeof(Proto*)
+			+ InProto->sizelineinfo * sizeof(ls_byte) + InProto->sizeabslineinfo * sizeof(AbsLineInfo)
+			+ InProto->sizelocvars * sizeof(LocVar) + InProto->sizeupvalues * sizeof(Upvaldesc);
+
+		for (int32 i = 0; i < InProto->sizep; ++i)
+		{
+			Size += GetProtoSize(InProto->p[i], InOutProtos);
+		}
+
+		return Size;
+	}
+
+	static int64 GetTableSize(const Table* InTable)
+	{
+		//luaH_realasize is not exported by the dll
+		const int64 ArraySize = isrealasize(InTable) ? InTable->alimit : FMath::RoundUpToPowerOfTwo(InTable->alimit);
+		return sizeof(Table) + (isdummy(InTable) ? 0 : sizenode(InTable) * sizeof(Node)) + ArraySize * sizeof(TValue);
+	}
+
+	//tabs and line breaks split the rows of the file
+	static FString ToCell(const char* InStr, int32 InMaxLen)
+	{
+		FString Cell = UTF8_TO_TCHAR(InStr);
+		if (Cell.Len() > InMaxLen)
+		{
+			Cell = Cell.Left(InMaxLen) + TEXT("...");
+		}
+
+		for (TCHAR& Ch : Cell)
+		{
+			if (Ch == TEXT('\t') || Ch == TEXT('\r') || Ch == TEXT('\n'))
+			{
+				Ch = TEXT(' ');
+			}
+		}
+
+		return Cell;
+	}
+}
+
+
+FString FLuaHeapSnapshot::GetKeyName(lua_State* InL, int32 InIdx)
+{
+	//no lua_tostring on numbers, it would change the key under lua_next
+	switch (lua_type(InL, InIdx))
+	{
+	case LUA_TSTRING:
+		return TEXT(".") + LuaHeapSnapshot::ToCell(lua_tostring(InL, InIdx), 48);
+	case LUA_TNUMBER:
+		return TEXT("[]");
+	case LUA_TBOOLEAN:
+		return lua_toboolean(InL, InIdx) ? TEXT("[true]") : TEXT("[false]");
+	default:
+		return FString::Printf(TEXT("[%s]"), UTF8_TO_TCHAR(luaL_typename(InL, InIdx)));
+	}
+}
+
+void FLuaHeapSnapshot::FWalker::Enqueue(int32 InIdx, int32 InParent, const TCHAR* InName)
+{
+	const int32 Type = lua_type(L, InIdx);
+	if (Type != LUA_TTABLE && Type != LUA_TFUNCTION && Type != LUA_TUSERDATA && Type != LUA_TSTRING && Type != LUA_TTHREAD)
+	{
+		return;
+	}
+
+	const void* Ptr = lua_topointer(L, InIdx);
+	if (Ptr == nullptr || Visited.Contains(Ptr))
+	{
+		return;
+	}
+
+	const int32 NodeId = Nodes.Num();
+	Visited.Add(Ptr, NodeId);
+
+	const int32 Depth = InParent == INDEX_NONE ? 0 : Nodes[InParent].Depth + 1;
+	int32 RowId = INDEX_NONE;
+	if (Depth <= MaxDepth)
+	{
+		const FString Path = InParent == INDEX_NONE ? FString(InName) : Rows[Nodes[InParent].Row].Path + InName;
+		if (const int32* FoundRowId = RowIds.Find(Path))
+		{
+			RowId = *FoundRowId;
+		}
+		else
+		{
+			RowId = Rows.Num();
+			RowIds.Add(Path, RowId);
+
+			FRow& Row = Rows.AddDefaulted_GetRef();
+			Row.Path = Path;
+			Row.Type = Type;
+		}
+	}
+
+	FNode& Node = Nodes.AddDefaulted_GetRef();
+	Node.Parent = InParent;
+	Node.Row = RowId;
+	Node.Depth = Depth;
+	Node.Type = Type;
+
+	//no children: sized now, not queued
+	if (Type == LUA_TSTRING)
+	{
+		size_t Len = 0;
+		lua_tolstring(L, InIdx, &Len);
+		Node.Self = sizelstring(Len);
+		return;
+	}
+
+	if (Type == LUA_TTHREAD)
+	{
+		const lua_State* Thread = lua_tothread(L, InIdx);
+		Node.Self = sizeof(lua_State) + (stacksize(Thread) + EXTRA_STACK) * sizeof(StackValue) + Thread->nci * sizeof(CallInfo);
+		return;
+	}
+
+	lua_pushvalue(L, InIdx);
+	lua_rawseti(L, QueueIdx, NodeId + 1);
+}
+
+int64 FLuaHeapSnapshot::FWalker::Visit(int32 InIdx, int32 InNodeId)
+{
+	int64 Size = 0;
+
+	switch (lua_type(L, InIdx))
+	{
+	case LUA_TTABLE:
+	{
+		Size = LuaHeapSnapshot::GetTableSize((const Table*)lua_topointer(L, InIdx));
+
+		bool bWeakKeys = false;
+		bool bWeakValues = false;
+		if (lua_getmetatable(L, InIdx))
+		{
+			const int32 MetatableIdx = lua_gettop(L);
+			lua_pushstring(L, "__mode");
+			if (lua_rawget(L, MetatableIdx) == LUA_TSTRING)
+			{
+				const char* Mode = lua_tostring(L, -1);
+				bWeakKeys = FCStringAnsi::Strchr(Mode, 'k') != nullptr;
+				bWeakValues = FCStringAnsi::Strchr(Mode, 'v') != nullptr;
+			}
+			lua_pop(L, 1);
+
+			Enqueue(MetatableIdx, InNodeId, TEXT("<mt>"));
+			lua_pop(L, 1);
+		}
+
+		//string keys are left out, most are constants of the protos
+		lua_pushnil(L);
+		while (lua_next(L, InIdx))
+		{
+			const int32 KeyIdx = lua_gettop(L) - 1;
+			const FString KeyName = GetKeyName(L, KeyIdx);
+
+			if (!bWeakValues)
+			{
+				Enqueue(KeyIdx + 1, InNodeId, *KeyName);
+			}
+
+			if (!bWeakKeys && lua_type(L, KeyIdx) != LUA_TSTRING)
+			{
+				Enqueue(KeyIdx, InNodeId, *(KeyName + TEXT("<key>")));
+			}
+
+			lua_pop(L, 1);
+		}
+		break;
+	}
+	case LUA_TFUNCTION:
+	{
+		int32 UpvalueNum = 0;
+		const bool bLuaFunction = !lua_iscfunction(L, InIdx);
+		while (const char* UpvalueName = lua_getupvalue(L, InIdx, UpvalueNum + 1))
+		{
+			const FString Name = bLuaFunction ? FString::Printf(TEXT("<upvalue:%s>"), *LuaHeapSnapshot::ToCell(*UpvalueName ? UpvalueName : "?", 32)) : FString(TEXT("<upvalue>"));
+			Enqueue(lua_gettop(L), InNodeId, *Name);
+			lua_pop(L, 1);
+			++UpvalueNum;
+		}
+
+		if (bLuaFunction)
+		{
+			const LClosure* Closure = (const LClosure*)lua_topointer(L, InIdx);
+			Size = sizeLclosure(UpvalueNum) + LuaHeapSnapshot::GetProtoSize(Closure->p, Protos);
+		}
+		else
+		{
+			//light C functions are not objects
+			Size = UpvalueNum > 0 ? sizeCclosure(UpvalueNum) : 0;
+		}
+		break;
+	}
+	case LUA_TUSERDATA:
+	{
+		int32 UservalueNum = 0;
+		while (lua_getiuservalue(L, InIdx, UservalueNum + 1) != LUA_TNONE)
+		{
+			Enqueue(lua_gettop(L), InNodeId, TEXT("<uv>"));
+			lua_pop(L, 1);
+			++UservalueNum;
+		}
+		lua_pop(L, 1);
+
+		if (lua_getmetatable(L, InIdx))
+		{
+			Enqueue(lua_gettop(L), InNodeId, TEXT("<mt>"));
+			lua_pop(L, 1);
+		}
+
+		Size = sizeudata(UservalueNum, lua_rawlen(L, InIdx));
+		break;
+	}
+	default:
+		break;
+	}
+
+	return Size;
+}
+
+bool FLuaHeapSnapshot::Write(lua_State* InL, const FString& InFile)
+{
+	if (InL == nullptr || !lua_checkstack(InL, 16))
+	{
+		return false;
+	}
+
+	const double StartTime = FPlatformTime::Seconds();
+
+	int32 tp = lua_gettop(InL);
+
+	FWalker Walker;
+	Walker.L = InL;
+	Walker.MaxDepth = FMath::Max(GLuaHeapMaxDepth, 1);
+
+	//keeps the values to visit, node i at i + 1
+	lua_newtable(InL);
+	Walker.QueueIdx = lua_gettop(InL);
+
+	//_G first, for the shorter paths
+	lua_pushglobaltable(InL);
+	Walker.Enqueue(lua_gettop(InL), INDEX_NONE, TEXT("_G"));
+	lua_pop(InL, 1);
+
+	lua_pushvalue(InL, LUA_REGISTRYINDEX);
+	Walker.Enqueue(lua_gettop(InL), INDEX_NONE, TEXT("registry"));
+	lua_pop(InL, 1);
+
+	for (int32 i = 0; i < Walker.Nodes.Num(); ++i)
+	{
+		const int32 Type = Walker.Nodes[i].Type;
+		if (Type == LUA_TSTRING || Type == LUA_TTHREAD)
+		{
+			continue;
+		}
+
+		lua_rawgeti(InL, Walker.QueueIdx, i + 1);
+		const int64 Size = Walker.Visit(lua_gettop(InL), i);
+		Walker.Nodes[i].Self = Size;
+		lua_settop(InL, Walker.QueueIdx);
+	}
+
+	lua_settop(InL, tp);
+
+	//children come after their parent
+	TArray<FNode>& Nodes = Walker.Nodes;
+	for (FNode& Node : Nodes)
+	{
+		Node.Retained = Node.Self;
+	}
+
+	for (int32 i = Nodes.Num() - 1; i >= 0; --i)
+	{
+		if (Nodes[i].Parent != INDEX_NONE)
+		{
+			Nodes[Nodes[i].Parent].Retained += Nodes[i].Retained;
+		}
+	}
+
+	int32 TypeCount[LUA_NUMTYPES] = { 0 };
+	int64 TypeBytes[LUA_NUMTYPES] = { 0 };
+	int64 TotalBytes = 0;
+	for (const FNode& Node : Nodes)
+	{
+		TypeCount[Node.Type]++;
+		TypeBytes[Node.Type] += Node.Self;
+		TotalBytes += Node.Self;
+
+		if (Node.Row != INDEX_NONE)
+		{
+			FRow& Row = Walker.Rows[Node.Row];
+			Row.Count++;
+			Row.Self += Node.Self;
+			Row.Retained += Node.Retained;
+		}
+	}
+
+	Walker.Rows.Sort([](const FRow& A, const FRow& B) { return A.Retained > B.Retained; });
+
+	FString Text = FString::Printf(TEXT("# LuaHeap %s, %d objects, %lld bytes reached, %d bytes in use\n"), *FDateTime::Now().ToString(), Nodes.Num(), TotalBytes, lua_gc(InL, LUA_GCCOUNT, 0) * 1024 + lua_gc(InL, LUA_GCCOUNTB, 0));
+
+	Text += TEXT("[types]\n");
+	for (int32 i = 0; i < LUA_NUMTYPES; ++i)
+	{
+		if (TypeCount[i] > 0)
+		{
+			Text += FString::Printf(TEXT("%s\t%d\t%lld\n"), UTF8_TO_TCHAR(lua_typename(InL, i)), TypeCount[i], TypeBytes[i]);
+		}
+	}
+
+	Text += TEXT("[paths]\n");
+	for (const FRow& Row : Walker.Rows)
+	{
+		Text += FString::Printf(TEXT("%s\t%s\t%d\t%lld\t%lld\n"), *Row.Path, UTF8_TO_TCHAR(lua_typename(InL, Row.Type)), Row.Count, Row.Self, Row.Retained);
+	}
+
+	const FastLuaUnrealWrapper* Wrapper = FastLuaUnrealWrapper::GetFromLuaState(InL);
+	const FLuaAllocator* Allocator = Wrapper ? Wrapper->GetAllocator() : nullptr;
+	if (const FLuaAllocTracker* Tracker = Allocator ? Allocator->GetTracker() : nullptr)
+	{
+		TArray<FLuaAllocTracker::FSite> Sites = Tracker->GetSites();
+		Sites.Sort([](const FLuaAllocTracker::FSite& A, const FLuaAllocTracker::FSite& B) { return A.LiveBytes > B.LiveBytes; });
+
+		Text += TEXT("[sites]\n");
+		for (const FLuaAllocTracker::FSite& Site : Sites)
+		{
+			if (Site.LiveCount > 0)
+			{
+				Text += FString::Printf(TEXT("%s\t%d\t%lld\n"), *Site.Name, Site.LiveCount, Site.LiveBytes);
+			}
+		}
+	}
+
+	if (!FFileHelper::SaveStringToFile(Text, *InFile, FFileHelper::EEncodingOptions::ForceUTF8WithoutBOM))
+	{
+		UE_LOG(LogFastLuaScript, Warning, TEXT("LuaHeapSnapshot|can not write %s"), *InFile);
+		return false;
+	}
+
+	UE_LOG(LogFastLuaScript, Log, TEXT("LuaHeapSnapshot|%d objects, %lld bytes, %d rows in %.2f ms"), Nodes.Num(), TotalBytes, Walker.Rows.Num(), (FPlatformTime::Seconds() - StartTime) * 1000.0);
+	return true;
+}
+
+void FLuaHeapSnapshot::Diff(const FString& InOldFile, const FString& InNewFile, FOutputDevice& Ar, int32 InNum)
+{
+	struct FValue
+	{
+		int64 Count = 0;
+		int64 Bytes = 0;
+	};
+
+	//"[paths] _G.Units[]" -> count, retained bytes
+	auto LoadRows = [](const FString& InFile, TMap<FString, FValue>& OutRows)
+	{
+		TArray<FString> Lines;
+		if (!FFileHelper::LoadFileToStringArray(Lines, *InFile))
+		{
+			return false;
+		}
+
+		FString Section;
+		for (const FString& Line : Lines)
+		{
+			if (Line.StartsWith(TEXT("#")))
+			{
+				continue;
+			}
+
+			if (Line.StartsWith(TEXT("[")) && !Line.Contains(TEXT("\t")))
+			{
+				Section = Line;
+				continue;
+			}
+
+			TArray<FString> Cells;
+			Line.ParseIntoArray(Cells, TEXT("\t"), false);
+
+			//[paths] has the type after the path, the bytes are the retained ones
+			const int32 CountCell = Section == TEXT("[paths]") ? 2 : 1;
+			const int32 BytesCell = Section == TEXT("[paths]") ? 4 : 2;
+			if (Cells.Num() > BytesCell)
+			{
+				FValue& Value = OutRows.FindOrAdd(Section + TEXT(" ") + Cells[0]);
+				Value.Count = FCString::Atoi64(*Cells[CountCell]);
+				Value.Bytes = FCString::Atoi64(*Cells[BytesCell]);
+			}
+		}
+
+		return true;
+	};
+
+	TMap<FString, FValue> OldRows;
+	TMap<FString, FValue> NewRows;
+	if (!LoadRows(InOldFile, OldRows) || !LoadRows(InNewFile, NewRows))
+	{
+		Ar.Logf(TEXT("LuaHeapSnapshot|can not read %s or %s"), *InOldFile, *InNewFile);
+		return;
+	}
+
+	struct FDelta
+	{
+		FString Key;
+		int64 Count = 0;
+		int64 Bytes = 0;
+	};
+
+	TArray<FDelta> Deltas;
+	for (const auto& It : NewRows)
+	{
+		const FValue* Old = OldRows.Find(It.Key);
+		Deltas.Add({ It.Key, It.Value.Count - (Old ? Old->Count : 0), It.Value.Bytes - (Old ? Old->Bytes : 0) });
+	}
+
+	for (const auto& It : OldRows)
+	{
+		if (!NewRows.Contains(It.Key))
+		{
+			Deltas.Add({ It.Key, -It.Value.Count, -It.Value.Bytes });
+		}
+	}
+
+	Deltas.Sort([](const FDelta& A, const FDelta& B) { return A.Bytes > B.Bytes; });
+
+	Ar.Logf(TEXT("LuaHeapSnapshot|%s -> %s"), *InOldFile, *InNewFile);
+	for (int32 i = 0; i < Deltas.Num() && i < InNum && Deltas[i].Bytes > 0; ++i)
+	{
+		Ar.Logf(TEXT("LuaHeapSnapshot| %+10.1f KB %+8lld  %s"), Deltas[i].Bytes / 1024.0, Deltas[i].Count, *Deltas[i].Key);
+	}
+}
@@ -0,0 +1,76 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+struct lua_State;
+class FOutputDevice;
+
+/**
+ * heap of one state as a text file that can be diffed, console:
+ *	lua.heap snapshot				Saved/Profiling/Lua/LuaHeap-<time>.txt per state
+ *	lua.heap diff Old.txt New.txt [Num]	rows that grew the most
+ *	lua.heap track [SampleBytes] | stop	allocation sites(FLuaAllocTracker), lua.heap sites [Num]
+ * objects are walked breadth first from _G then the registry, each one belongs to the first path reaching it,
+ * its retained size is its own size plus the ones it was first to reach(a spanning tree, not a dominator tree)
+ * paths deeper than lua.Heap.MaxDepth are counted in their ancestor, integer keys are merged("registry[]", "_G.Units[]"),
+ * weak parts of tables are not followed, stacks of threads are not walked
+ * sections of the file: [types] type count bytes, [paths] path type count self retained, [sites] site count bytes
+ */
+class FLuaHeapSnapshot
+{
+public:
+
+	//walk the heap of InL and write InFile, game thread between two lua calls
+	static bool Write(lua_State* InL, const FString& InFile);
+
+	//rows of InNewFile with the biggest growth from InOldFile
+	static void Diff(const FString& InOldFile, const FString& InNewFile, FOutputDevice& Ar, int32 InNum);
+
+protected:
+
+	struct FNode
+	{
+		int32 Parent = INDEX_NONE;
+		int32 Row = INDEX_NONE;
+		int32 Depth = 0;
+		int32 Type = 0;
+
+		int64 Self = 0;
+		int64 Retained = 0;
+	};
+
+	struct FRow
+	{
+		FString Path;
+		int32 Type = 0;
+
+		int32 Count = 0;
+		int64 Self = 0;
+		int64 Retained = 0;
+	};
+
+	struct FWalker
+	{
+		lua_State* L = nullptr;
+		int32 QueueIdx = 0;
+		int32 MaxDepth = 0;
+
+		TMap<const void*, int32> Visited;
+		TSet<const void*> Protos;
+
+		TArray<FNode> Nodes;
+		TArray<FRow> Rows;
+		TMap<FString, int32> RowIds;
+
+		//the value at InIdx as a child of InParent named InName("_G.Units" + ".Hero")
+		void Enqueue(int32 InIdx, int32 InParent, const TCHAR* InName);
+
+		//size of the object at InIdx, children queued
+		int64 Visit(int32 InIdx, int32 InNodeId);
+	};
+
+	//".Hero", "[]", "[true]"
+	static FString GetKeyName(lua_State* InL, int32 InIdx);
+};
@@ -0,0 +1,335 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "LuaHitchDetector.h"
+
+#if LUA_HITCH_DETECTOR
+
+#include "HAL/IConsoleManager.h"
+#include "HAL/Runnable.h"
+#include "HAL/RunnableThread.h"
+#include "HAL/ThreadSafeBool.h"
+#include "UObject/Class.h"
+
+#include "FastLuaUnrealWrapper.h"
+#include "FastLuaScript.h"
+#include "LuaAllocator.h"
+
+
+static float GLuaHitchMs = 50.f;
+static FAutoConsoleVariableRef CVarLuaHitchMs(
+	TEXT("lua.Hitch.Ms"),
+	GLuaHitchMs,
+	TEXT("Log the lua calls from Unreal(lua tick, delegates, tick functions, timers) longer than this, 0 disables"));
+
+static float GLuaHitchInterval = 10.f;
+static FAutoConsoleVariableRef CVarLuaHitchInterval(
+	TEXT("lua.Hitch.Interval"),
+	GLuaHitchInterval,
+	TEXT("Seconds between two lua hitch logs, the hitches in between are only counted"));
+
+static int32 GLuaHitchHookInstructions = 0;
+static FAutoConsoleVariableRef CVarLuaHitchHookInstructions(
+	TEXT("lua.Hitch.HookInstructions"),
+	GLuaHitchHookInstructions,
+	TEXT("Check the traceback request every this many lua instructions of the watched calls, for hitches in lua code without UFunction calls, 0 for none(no hook)"));
+
+namespace LuaHitchDetector
+{
+	//UFunctions in a log
+	static const int32 MaxFunctions = 8;
+
+	static uint64 GetThresholdCycles()
+	{
+		return (uint64)(GLuaHitchMs / 1000.0 / FPlatformTime::GetSecondsPerCycle64());
+	}
+}
+
+
+class FLuaHitchDetector::FWatchdog : public FRunnable
+{
+public:
+
+	FWatchdog(FLuaHitchDetector& InDetector)
+		: Detector(InDetector)
+	{
+
+	}
+
+	virtual uint32 Run() override
+	{
+		while (!bStopping)
+		{
+			//a quarter of the threshold: the traceback is taken at most 25% late
+			FPlatformProcess::SleepNoStats(FMath::Clamp(GLuaHitchMs / 4.f, 1.f, 50.f) / 1000.f);
+			Detector.RequestTraceback();
+		}
+
+		return 0;
+	}
+
+	virtual void Stop() override
+	{
+		bStopping = true;
+	}
+
+protected:
+
+	FLuaHitchDetector& Detector;
+	FThreadSafeBool bStopping;
+};
+
+
+FLuaHitchDetector& FLuaHitchDetector::Get()
+{
+	static FLuaHitchDetector Inst;
+	return Inst;
+}
+
+bool FLuaHitchDetector::IsEnabled()
+{
+	return GLuaHitchMs > 0.f;
+}
+
+void FLuaHitchDetector::BeginScope(lua_State* InL)
+{
+	const bool bOutermost = ScopeStartCycles.Num() == 0;
+	if (!bOutermost)
+	{
+		if (bTracebackRequested && WatchedState && InL)
+		{
+			TakeTraceback(InL);
+		}
+
+		ScopeStartCycles.Add(WatchedState ? FPlatformTime::Cycles64() : 0);
+		return;
+	}
+
+	if (InL == nullptr || !IsEnabled())
+	{
+		ScopeStartCycles.Add(0);
+		return;
+	}
+
+	const FastLuaUnrealWrapper* Wrapper = FastLuaUnrealWrapper::GetFromLuaState(InL);
+	const FLuaAllocator* Allocator = Wrapper ? Wrapper->GetAllocator() : nullptr;
+	StartAllocs = Allocator ? Allocator->GetTotalAllocs() : 0;
+	StartAllocatedBytes = Allocator ? Allocator->GetAllocatedBytes() : 0;
+	lua_getgcstats(InL, &StartGCStats);
+
+	Traceback.Reset();
+	TracebackCycles = 0;
+	SlowestName.Reset();
+	SlowestCycles = 0;
+	if (Functions.Num() > 0)
+	{
+		Functions.Reset();
+	}
+
+	if (WatchdogThread == nullptr)
+	{
+		Watchdog = new FWatchdog(*this);
+		WatchdogThread = FRunnableThread::Create(Watchdog, TEXT("LuaHitchWatchdog"), 0, TPri_Normal);
+	}
+
+	const uint64 NowCycles = FPlatformTime::Cycles64();
+	ScopeStartCycles.Add(NowCycles);
+
+	WatchedState = InL;
+	StartCycles = NowCycles;
+	bTracebackRequested = false;
+	WatchCycles = NowCycles;
+
+	//another hook(debugger, Insights, profiler) is kept
+	if (GLuaHitchHookInstructions > 0 && lua_gethook(InL) == nullptr)
+	{
+		lua_sethook(InL, HitchHook, LUA_MASKCOUNT, GLuaHitchHookInstructions);
+	}
+}
+
+void FLuaHitchDetector::EndScope(lua_State* InL, const TCHAR* InKind, int32 InFunctionRef)
+{
+	const uint64 ScopeStart = ScopeStartCycles.Pop(false);
+	if (ScopeStart == 0)
+	{
+		return;
+	}
+
+	const uint64 Cycles = FPlatformTime::Cycles64() - ScopeStart;
+
+	//a nested call: only the slowest one is kept
+	if (ScopeStartCycles.Num() > 0)
+	{
+		if (Cycles > SlowestCycles)
+		{
+			SlowestCycles = Cycles;
+			SlowestName = GetCallName(InL, InKind, InFunctionRef);
+		}
+		return;
+	}
+
+	WatchCycles = 0;
+	if (lua_gethook(WatchedState) == HitchHook)
+	{
+		lua_sethook(WatchedState, nullptr, 0, 0);
+	}
+	WatchedState = nullptr;
+
+	if (Cycles >= LuaHitchDetector::GetThresholdCycles())
+	{
+		Report(InL, InKind, InFunctionRef, Cycles);
+	}
+}
+
+void FLuaHitchDetector::Shutdown()
+{
+	if (WatchdogThread)
+	{
+		WatchdogThread->Kill(true);
+		delete WatchdogThread;
+		WatchdogThread = nullptr;
+	}
+
+	delete Watchdog;
+	Watchdog = nullptr;
+}
+
+void FLuaHitchDetector::RequestTraceback()
+{
+	const uint64 WatchStartCycles = WatchCycles.Load();
+	if (WatchStartCycles != 0 && FPlatformTime::Cycles64() - WatchStartCycles > LuaHitchDetector::GetThresholdCycles())
+	{
+		bTracebackRequested = true;
+	}
+}
+
+void FLuaHitchDetector::TakeTraceback(lua_State* InL)
+{
+	bTracebackRequested = false;
+
+	//a request made for the previous call
+	if (WatchedState == nullptr || TracebackCycles != 0 || FPlatformTime::Cycles64() - StartCycles <= LuaHitchDetector::GetThresholdCycles())
+	{
+		return;
+	}
+
+	//one traceback per call
+	WatchCycles = 0;
+
+	luaL_traceback(InL, InL, nullptr, 0);
+	Traceback = UTF8_TO_TCHAR(lua_tostring(InL, -1));
+	TracebackCycles = FPlatformTime::Cycles64();
+	lua_pop(InL, 1);
+}
+
+void FLuaHitchDetector::HitchHook(lua_State* InL, lua_Debug* InDebug)
+{
+	FLuaHitchDetector& Detector = Get();
+
+	//coroutines made from a hooked thread inherit the hook, removed after the watched call
+	if (Detector.WatchedState == nullptr)
+	{
+		lua_sethook(InL, nullptr, 0, 0);
+		return;
+	}
+
+	if (Detector.bTracebackRequested)
+	{
+		Detector.TakeTraceback(InL);
+	}
+}
+
+void FLuaHitchDetector::AddFunction(const UFunction* InFunction, uint64 InCycles)
+{
+	FFunctionCalls& FunctionCalls = Functions.FindOrAdd(InFunction);
+	FunctionCalls.Calls++;
+	FunctionCalls.Cycles += InCycles;
+}
+
+void FLuaHitchDetector::Report(lua_State* InL, const TCHAR* InKind, int32 InFunctionRef, uint64 InCycles)
+{
+	const double NowSeconds = FPlatformTime::Seconds();
+	if (LastReportTime > 0.0 && NowSeconds - LastReportTime < GLuaHitchInterval)
+	{
+		SkippedReports++;
+		return;
+	}
+	LastReportTime = NowSeconds;
+
+	const double CycleMs = FPlatformTime::GetSecondsPerCycle64() * 1000.0;
+
+	UE_LOG(LogFastLuaScript, Warning, TEXT("LuaHitch|%s took %.2f ms(lua.Hitch.Ms %.1f), %d more not logged since the last one"),
+		*GetCallName(InL, InKind, InFunctionRef), InCycles * CycleMs, GLuaHitchMs, SkippedReports);
+	SkippedReports = 0;
+
+	if (SlowestCycles > 0)
+	{
+		UE_LOG(LogFastLuaScript, Warning, TEXT("LuaHitch|slowest call: %s %.2f ms"), *SlowestName, SlowestCycles * CycleMs);
+	}
+
+	if (TracebackCycles > 0)
+	{
+		UE_LOG(LogFastLuaScript, Warning, TEXT("LuaHitch|at %.2f ms %s"), (TracebackCycles - StartCycles) * CycleMs, *Traceback);
+	}
+	else
+	{
+		UE_LOG(LogFastLuaScript, Warning, TEXT("LuaHitch|no traceback: no UFunction or nested call from lua after the threshold(lua.Hitch.HookInstructions checks in lua code too)"));
+	}
+
+	if (Functions.Num() > 0)
+	{
+		TArray<TPair<const UFunction*, FFunctionCalls>> SortedFunctions = Functions.Array();
+		SortedFunctions.Sort([](const TPair<const UFunction*, FFunctionCalls>& A, const TPair<const UFunction*, FFunctionCalls>& B) { return A.Value.Cycles > B.Value.Cycles; });
+
+		int32 TotalCalls = 0;
+		uint64 TotalCycles = 0;
+		FString FunctionText;
+		for (int32 i = 0; i < SortedFunctions.Num(); ++i)
+		{
+			const FFunctionCalls& FunctionCalls = SortedFunctions[i].Value;
+			TotalCalls += FunctionCalls.Calls;
+			TotalCycles += FunctionCalls.Cycles;
+
+			//the UFunctions are alive, their class holds them
+			if (i < LuaHitchDetector::MaxFunctions)
+			{
+				const UFunction* Function = SortedFunctions[i].Key;
+				const UObject* Outer = Function->GetOuter();
+				FunctionText += FString::Printf(TEXT("\n\t%s::%s x%d %.2f ms"), Outer ? *Outer->GetName() : TEXT("?"), *Function->GetName(), FunctionCalls.Calls, FunctionCalls.Cycles * CycleMs);
+			}
+		}
+
+		UE_LOG(LogFastLuaScript, Warning, TEXT("LuaHitch|%d UFunction calls(%d functions) %.2f ms%s"), TotalCalls, SortedFunctions.Num(), TotalCycles * CycleMs, *FunctionText);
+	}
+
+	const FastLuaUnrealWrapper* Wrapper = FastLuaUnrealWrapper::GetFromLuaState(InL);
+	const FLuaAllocator* Allocator = Wrapper ? Wrapper->GetAllocator() : nullptr;
+	lua_GCStats GCStats;
+	lua_getgcstats(InL, &GCStats);
+
+	UE_LOG(LogFastLuaScript, Warning, TEXT("LuaHitch|%llu allocs %.1f KB, gc %llu steps %llu full %llu cycles, %llu objects freed"),
+		Allocator ? Allocator->GetTotalAllocs() - StartAllocs : 0, Allocator ? (Allocator->GetAllocatedBytes() - StartAllocatedBytes) / 1024.0 : 0.0,
+		(uint64)(GCStats.steps - StartGCStats.steps), (uint64)(GCStats.fullgcs - StartGCStats.fullgcs), (uint64)(GCStats.cycles - StartGCStats.cycles), (uint64)(GCStats.freed - StartGCStats.freed));
+}
+
+FString FLuaHitchDetector::GetCallName(lua_State* InL, const TCHAR* InKind, int32 InFunctionRef)
+{
+	FString Name = InKind;
+	if (InL == nullptr || InFunctionRef < 1)
+	{
+		return Name;
+	}
+
+	int32 tp = lua_gettop(InL);
+	if (lua_rawgeti(InL, LUA_REGISTRYINDEX, InFunctionRef) == LUA_TFUNCTION)
+	{
+		lua_Debug Ar;
+		lua_getinfo(InL, ">S", &Ar);
+		Name += FString::Printf(TEXT(" %s:%d"), UTF8_TO_TCHAR(Ar.short_src), Ar.linedefined);
+	}
+	lua_settop(InL, tp);
+
+	return Name;
+}
+
+#endif
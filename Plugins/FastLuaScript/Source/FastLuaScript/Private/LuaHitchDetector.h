@@ -0,0 +1,167 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HAL/ThreadSafeBool.h"
+#include "Templates/Atomic.h"
+#include "lua.hpp"
+
+#define LUA_HITCH_DETECTOR !UE_BUILD_SHIPPING
+
+class UFunction;
+class FRunnableThread;
+
+#if LUA_HITCH_DETECTOR
+
+/**
+ * logs the lua calls from Unreal(HandleLuaTick, a delegate, a tick function, a timer) running longer than lua.Hitch.Ms:
+ * the slowest call inside, the lua traceback taken while it was over the threshold, the UFunctions called from lua
+ * and the allocations and collector steps of the call, at most one log per lua.Hitch.Interval seconds
+ * a watchdog thread requests the traceback when the call is over the threshold, it never touches a lua state: the game thread takes it
+ * at the next UFunction call from lua, nested call or, with lua.Hitch.HookInstructions, count hook check(a hook in lua code,
+ * not set when another hook is: debugger, Insights, profiler)
+ * only the outermost call is watched, the nested ones are its candidates for the slowest call, game thread only
+ */
+class FLuaHitchDetector
+{
+public:
+
+	static FLuaHitchDetector& Get();
+
+	static bool IsEnabled();
+
+	//right before and after a lua_pcall, nothing between them may longjmp
+	void BeginScope(lua_State* InL);
+
+	//InKind "Timer", InFunctionRef the registry ref of the called function(LUA_NOREF for none) to name the call,
+	//it must still be held: a ref released by the call(a one shot timer, an unbind) may already name another value, pass LUA_NOREF then
+	void EndScope(lua_State* InL, const TCHAR* InKind, int32 InFunctionRef);
+
+	//UFunctions called from lua(InL) in a watched call, start cycles or 0
+	static uint64 BeginFunction(lua_State* InL)
+	{
+		FLuaHitchDetector& Detector = Get();
+		if (Detector.WatchedState == nullptr)
+		{
+			return 0;
+		}
+
+		if (Detector.bTracebackRequested)
+		{
+			Detector.TakeTraceback(InL);
+		}
+
+		return FPlatformTime::Cycles64();
+	}
+
+	static void EndFunction(const UFunction* InFunction, uint64 InStartCycles)
+	{
+		if (InStartCycles != 0)
+		{
+			Get().AddFunction(InFunction, FPlatformTime::Cycles64() - InStartCycles);
+		}
+	}
+
+	//stop the watchdog, module shutdown
+	void Shutdown();
+
+protected:
+
+	FLuaHitchDetector() = default;
+
+	class FWatchdog;
+
+	static void HitchHook(lua_State* InL, lua_Debug* InDebug);
+
+	//request the traceback if the watched call is over the threshold, watchdog thread
+	void RequestTraceback();
+
+	//traceback of the running thread InL if the request is still valid, game thread
+	void TakeTraceback(lua_State* InL);
+
+	void AddFunction(const UFunction* InFunction, uint64 InCycles);
+
+	void Report(lua_State* InL, const TCHAR* InKind, int32 InFunctionRef, uint64 InCycles);
+
+	//"Delegate AI/Enemy.lua:42", InFunctionRef a live ref
+	static FString GetCallName(lua_State* InL, const TCHAR* InKind, int32 InFunctionRef);
+
+	struct FFunctionCalls
+	{
+		int32 Calls = 0;
+		uint64 Cycles = 0;
+	};
+
+	//start cycles of the open scopes, 0 when not watched
+	TArray<uint64, TInlineAllocator<8>> ScopeStartCycles;
+
+	FWatchdog* Watchdog = nullptr;
+	FRunnableThread* WatchdogThread = nullptr;
+
+	//the outermost call, game thread
+	lua_State* WatchedState = nullptr;
+	uint64 StartCycles = 0;
+
+	//shared with the watchdog: start cycles of the call waiting for a traceback(0 for none) and the request
+	TAtomic<uint64> WatchCycles{ 0 };
+	FThreadSafeBool bTracebackRequested;
+
+	//taken by the hook
+	FString Traceback;
+	uint64 TracebackCycles = 0;
+
+	//nested call with the most time
+	FString SlowestName;
+	uint64 SlowestCycles = 0;
+
+	TMap<const UFunction*, FFunctionCalls> Functions;
+
+	uint64 StartAllocs = 0;
+	uint64 StartAllocatedBytes = 0;
+	lua_GCStats StartGCStats;
+
+	double LastReportTime = 0.0;
+	int32 SkippedReports = 0;
+};
+
+#else
+
+//shipping: the calls are compiled out
+class FLuaHitchDetector
+{
+public:
+
+	static FLuaHitchDetector& Get()
+	{
+		static FLuaHitchDetector Inst;
+		return Inst;
+	}
+
+	void BeginScope(lua_State* InL)
+	{
+
+	}
+
+	void EndScope(lua_State* InL, const TCHAR* InKind, int32 InFunctionRef)
+	{
+
+	}
+
+	static uint64 BeginFunction(lua_State* InL)
+	{
+		return 0;
+	}
+
+	static void EndFunction(const UFunction* InFunction, uint64 InStartCycles)
+	{
+
+	}
+
+	void Shutdown()
+	{
+
+	}
+};
+
+#endif
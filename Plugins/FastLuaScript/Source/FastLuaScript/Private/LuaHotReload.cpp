@@ -0,0 +1,567 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "LuaHotReload.h"
+#include "HAL/IConsoleManager.h"
+#include "Misc/Paths.h"
+
+#if WITH_EDITOR
+#include "DirectoryWatcherModule.h"
+#include "IDirectoryWatcher.h"
+#include "Modules/ModuleManager.h"
+#endif
+
+#include "FastLuaUnrealWrapper.h"
+#include "FastLuaScript.h"
+#include "FastLuaStat.h"
+#include "LuaModuleIndex.h"
+#include "LuaAsyncJobs.h"
+
+#include "lua.hpp"
+
+
+static FAutoConsoleCommand LuaReloadCommand(
+	TEXT("lua.reload"),
+	TEXT("Reload lua modules in the running states: lua.reload AI.PathCost UI.MainMenu"),
+	FConsoleCommandWithArgsDelegate::CreateStatic([](const TArray<FString>& InArgs)
+	{
+		FLuaHotReload::ReloadAll(InArgs);
+	}));
+
+namespace LuaHotReload
+{
+	//nested tables paired below this depth are kept as they are
+	static const int32 MaxDepth = 16;
+
+	static bool IsCollectable(int32 InType)
+	{
+		return InType == LUA_TTABLE || InType == LUA_TFUNCTION || InType == LUA_TUSERDATA;
+	}
+
+	//push the value at InIdx to the queue if not visited
+	static void Enqueue(lua_State* InL, int32 InIdx, int32 InVisitedIdx, int32 InQueueIdx, int32& InOutTail)
+	{
+		if (!IsCollectable(lua_type(InL, InIdx)))
+		{
+			return;
+		}
+
+		lua_pushvalue(InL, InIdx);
+		if (lua_rawget(InL, InVisitedIdx) != LUA_TNIL)
+		{
+			lua_pop(InL, 1);
+			return;
+		}
+		lua_pop(InL, 1);
+
+		lua_pushvalue(InL, InIdx);
+		lua_pushboolean(InL, 1);
+		lua_rawset(InL, InVisitedIdx);
+
+		lua_pushvalue(InL, InIdx);
+		lua_rawseti(InL, InQueueIdx, ++InOutTail);
+	}
+
+	//the new function of the old one at InIdx, pushed, false if not swapped
+	static bool PushSwapped(lua_State* InL, int32 InIdx, int32 InSwapIdx)
+	{
+		if (lua_type(InL, InIdx) != LUA_TFUNCTION)
+		{
+			return false;
+		}
+
+		lua_pushvalue(InL, InIdx);
+		if (lua_rawget(InL, InSwapIdx) == LUA_TNIL)
+		{
+			lua_pop(InL, 1);
+			return false;
+		}
+
+		return true;
+	}
+}
+
+
+#if WITH_EDITOR
+FDelegateHandle FLuaHotReload::WatchHandle;
+#endif
+
+FLuaHotReload::FResult FLuaHotReload::ReloadModules(lua_State* InL, const TArray<FString>& InModuleNames)
+{
+	SCOPE_CYCLE_COUNTER(STAT_LuaHotReload);
+
+	FResult Result;
+	int32 tp = lua_gettop(InL);
+
+	lua_newtable(InL);
+	const int32 SwapIdx = lua_gettop(InL);
+	lua_newtable(InL);
+	const int32 VisitedIdx = lua_gettop(InL);
+	lua_newtable(InL);
+	const int32 NamesIdx = lua_gettop(InL);
+	luaL_getsubtable(InL, LUA_REGISTRYINDEX, LUA_LOADED_TABLE);
+	const int32 LoadedIdx = lua_gettop(InL);
+
+	for (const FString& It : InModuleNames)
+	{
+		const FString ModuleName = FLuaModuleIndex::ToModuleName(It);
+		const FTCHARToUTF8 RawModuleName(*ModuleName);
+
+		//not required yet, the next require loads the new file
+		const int32 OldType = lua_getfield(InL, LoadedIdx, RawModuleName.Get());
+		const int32 OldIdx = lua_gettop(InL);
+		if (OldType != LUA_TTABLE && OldType != LUA_TFUNCTION)
+		{
+			lua_settop(InL, LoadedIdx);
+			continue;
+		}
+
+		//the chunk is run like require does: chunk(name, extra)
+		bool bLoaded = LoadModuleChunk(InL, RawModuleName.Get());
+		if (bLoaded)
+		{
+			lua_pushstring(InL, RawModuleName.Get());
+			lua_insert(InL, -2);
+			bLoaded = lua_pcall(InL, 2, 1, 0) == LUA_OK;
+		}
+
+		if (!bLoaded)
+		{
+			Result.Errors.Add(UTF8_TO_TCHAR(lua_tostring(InL, -1)));
+			lua_settop(InL, LoadedIdx);
+			continue;
+		}
+
+		PairValues(InL, OldIdx, OldIdx + 1, SwapIdx, VisitedIdx, NamesIdx, RawModuleName.Get(), 0, Result);
+		++Result.Modules;
+
+		lua_settop(InL, LoadedIdx);
+	}
+
+	if (Result.Swapped > 0)
+	{
+		PatchReferences(InL, SwapIdx, Result);
+	}
+
+	const int32 NameNum = (int32)lua_rawlen(InL, NamesIdx);
+	for (int32 i = 1; i <= NameNum; ++i)
+	{
+		lua_rawgeti(InL, NamesIdx, i);
+		Result.SwappedNames.Add(UTF8_TO_TCHAR(lua_tostring(InL, -1)));
+		lua_pop(InL, 1);
+	}
+
+	lua_settop(InL, tp);
+	return Result;
+}
+
+bool FLuaHotReload::LoadModuleChunk(lua_State* InL, const char* InModuleName)
+{
+	int32 tp = lua_gettop(InL);
+
+	lua_getglobal(InL, "package");
+	lua_getfield(InL, -1, "searchers");
+	lua_remove(InL, -2);
+	const int32 SearchersIdx = tp + 1;
+
+	//the messages of the searchers, like require
+	lua_pushfstring(InL, "module '%s' not found:", InModuleName);
+	const int32 MessageIdx = tp + 2;
+
+	if (lua_istable(InL, SearchersIdx))
+	{
+		for (int32 i = 1; lua_rawgeti(InL, SearchersIdx, i) != LUA_TNIL; ++i)
+		{
+			lua_pushstring(InL, InModuleName);
+			if (lua_pcall(InL, 1, 2, 0) != LUA_OK)
+			{
+				lua_pushvalue(InL, MessageIdx);
+				lua_pushstring(InL, "\n\t");
+				lua_pushvalue(InL, -3);
+				lua_concat(InL, 3);
+				lua_replace(InL, MessageIdx);
+			}
+			else if (lua_isfunction(InL, -2))
+			{
+				//chunk and extra
+				lua_remove(InL, MessageIdx);
+				lua_remove(InL, SearchersIdx);
+				return true;
+			}
+			else if (lua_isstring(InL, -2))
+			{
+				lua_pushvalue(InL, MessageIdx);
+				lua_pushstring(InL, "\n\t");
+				lua_pushvalue(InL, -4);
+				lua_concat(InL, 3);
+				lua_replace(InL, MessageIdx);
+			}
+
+			lua_settop(InL, MessageIdx);
+		}
+	}
+
+	lua_settop(InL, MessageIdx);
+	lua_remove(InL, SearchersIdx);
+	return false;
+}
+
+void FLuaHotReload::PairValues(lua_State* InL, int32 InOldIdx, int32 InNewIdx, int32 InSwapIdx, int32 InVisitedIdx, int32 InNamesIdx, const char* InPath, int32 InDepth, FResult& OutResult)
+{
+	if (lua_rawequal(InL, InOldIdx, InNewIdx) || InDepth > LuaHotReload::MaxDepth || !lua_checkstack(InL, 8))
+	{
+		return;
+	}
+
+	const int32 OldType = lua_type(InL, InOldIdx);
+	const int32 NewType = lua_type(InL, InNewIdx);
+
+	if (OldType == LUA_TFUNCTION && NewType == LUA_TFUNCTION)
+	{
+		if (lua_iscfunction(InL, InOldIdx) || lua_iscfunction(InL, InNewIdx))
+		{
+			return;
+		}
+
+		//a local function shared by several fields is paired once
+		lua_pushvalue(InL, InOldIdx);
+		const bool bPaired = lua_rawget(InL, InSwapIdx) != LUA_TNIL;
+		lua_pop(InL, 1);
+		if (bPaired)
+		{
+			return;
+		}
+
+		lua_pushvalue(InL, InOldIdx);
+		lua_pushvalue(InL, InNewIdx);
+		lua_rawset(InL, InSwapIdx);
+
+		lua_pushstring(InL, InPath);
+		lua_rawseti(InL, InNamesIdx, (lua_Integer)lua_rawlen(InL, InNamesIdx) + 1);
+		++OutResult.Swapped;
+
+		JoinUpvalues(InL, InOldIdx, InNewIdx, InSwapIdx, InVisitedIdx, InNamesIdx, InPath, InDepth, OutResult);
+		return;
+	}
+
+	if (OldType != LUA_TTABLE || NewType != LUA_TTABLE)
+	{
+		return;
+	}
+
+	lua_pushvalue(InL, InOldIdx);
+	if (lua_rawget(InL, InVisitedIdx) != LUA_TNIL)
+	{
+		lua_pop(InL, 1);
+		return;
+	}
+	lua_pop(InL, 1);
+
+	lua_pushvalue(InL, InOldIdx);
+	lua_pushboolean(InL, 1);
+	lua_rawset(InL, InVisitedIdx);
+
+	lua_pushnil(InL);
+	while (lua_next(InL, InNewIdx))
+	{
+		const int32 ValueIdx = lua_gettop(InL);
+		const int32 KeyIdx = ValueIdx - 1;
+
+		lua_pushvalue(InL, KeyIdx);
+		if (lua_rawget(InL, InOldIdx) == LUA_TNIL)
+		{
+			lua_pushvalue(InL, KeyIdx);
+			lua_pushvalue(InL, ValueIdx);
+			lua_rawset(InL, InOldIdx);
+			++OutResult.Added;
+		}
+		else
+		{
+			//no lua_tostring on the key, it would break lua_next
+			if (lua_type(InL, KeyIdx) == LUA_TSTRING)
+			{
+				lua_pushfstring(InL, "%s.%s", InPath, lua_tostring(InL, KeyIdx));
+			}
+			else if (lua_isinteger(InL, KeyIdx))
+			{
+				lua_pushfstring(InL, "%s[%I]", InPath, (LUAI_UACINT)lua_tointeger(InL, KeyIdx));
+			}
+			else
+			{
+				lua_pushfstring(InL, "%s[?]", InPath);
+			}
+
+			PairValues(InL, ValueIdx + 1, ValueIdx, InSwapIdx, InVisitedIdx, InNamesIdx, lua_tostring(InL, -1), InDepth + 1, OutResult);
+		}
+
+		lua_settop(InL, KeyIdx);
+	}
+
+	//class tables keep their methods in the metatable
+	if (lua_getmetatable(InL, InOldIdx))
+	{
+		const int32 OldMetaIdx = lua_gettop(InL);
+		if (lua_getmetatable(InL, InNewIdx))
+		{
+			PairValues(InL, OldMetaIdx, OldMetaIdx + 1, InSwapIdx, InVisitedIdx, InNamesIdx, InPath, InDepth + 1, OutResult);
+		}
+		lua_settop(InL, OldMetaIdx - 1);
+	}
+}
+
+void FLuaHotReload::JoinUpvalues(lua_State* InL, int32 InOldIdx, int32 InNewIdx, int32 InSwapIdx, int32 InVisitedIdx, int32 InNamesIdx, const char* InPath, int32 InDepth, FResult& OutResult)
+{
+	int32 tp = lua_gettop(InL);
+
+	for (int32 i = 1; ; ++i)
+	{
+		const char* NewName = lua_getupvalue(InL, InNewIdx, i);
+		if (NewName == nullptr)
+		{
+			break;
+		}
+
+		const int32 NewUpIdx = lua_gettop(InL);
+
+		//stripped chunks have no upvalue names, nothing can be matched
+		if (NewName[0] == '\0' || FCStringAnsi::Strcmp(NewName, "(no name)") == 0)
+		{
+			lua_settop(InL, tp);
+			break;
+		}
+
+		int32 OldUpvalue = 0;
+		for (int32 j = 1; ; ++j)
+		{
+			const char* OldName = lua_getupvalue(InL, InOldIdx, j);
+			if (OldName == nullptr)
+			{
+				break;
+			}
+
+			if (FCStringAnsi::Strcmp(OldName, NewName) == 0)
+			{
+				OldUpvalue = j;
+				break;
+			}
+			lua_pop(InL, 1);
+		}
+
+		if (OldUpvalue > 0)
+		{
+			const int32 OldUpIdx = NewUpIdx + 1;
+			const bool bFunctions = lua_type(InL, OldUpIdx) == LUA_TFUNCTION && lua_type(InL, NewUpIdx) == LUA_TFUNCTION;
+
+			lua_pushfstring(InL, "%s<%s>", InPath, NewName);
+			PairValues(InL, OldUpIdx, NewUpIdx, InSwapIdx, InVisitedIdx, InNamesIdx, lua_tostring(InL, -1), InDepth + 1, OutResult);
+
+			//a local function keeps the new code, a local value keeps the old state
+			if (!bFunctions)
+			{
+				lua_upvaluejoin(InL, InNewIdx, i, InOldIdx, OldUpvalue);
+			}
+		}
+
+		lua_settop(InL, tp);
+	}
+}
+
+void FLuaHotReload::PatchReferences(lua_State* InL, int32 InSwapIdx, FResult& OutResult)
+{
+	int32 tp = lua_gettop(InL);
+
+	lua_newtable(InL);
+	const int32 VisitedIdx = lua_gettop(InL);
+	lua_newtable(InL);
+	const int32 QueueIdx = lua_gettop(InL);
+
+	int32 Head = 1;
+	int32 Tail = 0;
+
+	//the swap table is not reachable, the old functions in it are kept as keys
+	lua_pushvalue(InL, InSwapIdx);
+	lua_pushboolean(InL, 1);
+	lua_rawset(InL, VisitedIdx);
+
+	lua_pushvalue(InL, LUA_REGISTRYINDEX);
+	LuaHotReload::Enqueue(InL, -1, VisitedIdx, QueueIdx, Tail);
+	lua_pop(InL, 1);
+
+	while (Head <= Tail)
+	{
+		lua_rawgeti(InL, QueueIdx, Head);
+		lua_pushnil(InL);
+		lua_rawseti(InL, QueueIdx, Head);
+		++Head;
+
+		const int32 ObjIdx = lua_gettop(InL);
+		const int32 ObjType = lua_type(InL, ObjIdx);
+
+		if (ObjType == LUA_TTABLE)
+		{
+			lua_pushnil(InL);
+			while (lua_next(InL, ObjIdx))
+			{
+				const int32 ValueIdx = lua_gettop(InL);
+				const int32 KeyIdx = ValueIdx - 1;
+
+				//setting an existing field is allowed during lua_next
+				if (LuaHotReload::PushSwapped(InL, ValueIdx, InSwapIdx))
+				{
+					lua_pushvalue(InL, KeyIdx);
+					lua_pushvalue(InL, -2);
+					lua_rawset(InL, ObjIdx);
+					lua_replace(InL, ValueIdx);
+					++OutResult.Patched;
+				}
+
+				LuaHotReload::Enqueue(InL, KeyIdx, VisitedIdx, QueueIdx, Tail);
+				LuaHotReload::Enqueue(InL, ValueIdx, VisitedIdx, QueueIdx, Tail);
+				lua_settop(InL, KeyIdx);
+			}
+		}
+		else if (ObjType == LUA_TFUNCTION)
+		{
+			for (int32 i = 1; lua_getupvalue(InL, ObjIdx, i) != nullptr; ++i)
+			{
+				const int32 ValueIdx = lua_gettop(InL);
+				if (LuaHotReload::PushSwapped(InL, ValueIdx, InSwapIdx))
+				{
+					lua_pushvalue(InL, -1);
+					lua_setupvalue(InL, ObjIdx, i);
+					lua_replace(InL, ValueIdx);
+					++OutResult.Patched;
+				}
+
+				LuaHotReload::Enqueue(InL, ValueIdx, VisitedIdx, QueueIdx, Tail);
+				lua_settop(InL, ObjIdx);
+			}
+		}
+		else if (ObjType == LUA_TUSERDATA)
+		{
+			for (int32 i = 1; lua_getiuservalue(InL, ObjIdx, i) != LUA_TNONE; ++i)
+			{
+				LuaHotReload::Enqueue(InL, -1, VisitedIdx, QueueIdx, Tail);
+				lua_settop(InL, ObjIdx);
+			}
+			lua_settop(InL, ObjIdx);
+		}
+
+		if (lua_getmetatable(InL, ObjIdx))
+		{
+			LuaHotReload::Enqueue(InL, -1, VisitedIdx, QueueIdx, Tail);
+		}
+
+		lua_settop(InL, ObjIdx - 1);
+	}
+
+	lua_settop(InL, tp);
+}
+
+void FLuaHotReload::ReloadAll(const TArray<FString>& InModuleNames)
+{
+	if (InModuleNames.Num() < 1)
+	{
+		return;
+	}
+
+	//idle workers load the new files when created again
+	FLuaWorkerPool::Get().Flush();
+
+	for (FastLuaUnrealWrapper* Wrapper : FastLuaUnrealWrapper::GetAllWrappers())
+	{
+		//the standby state required the old files
+		Wrapper->DiscardStandby();
+
+		lua_State* L = Wrapper->GetLuaState();
+		if (L == nullptr)
+		{
+			continue;
+		}
+
+		const double StartTime = FPlatformTime::Seconds();
+		const FResult Result = ReloadModules(L, InModuleNames);
+
+		UE_LOG(LogFastLuaScript, Log, TEXT("LuaHotReload|%d modules, %d functions swapped, %d references patched, %d fields added in %.2f ms"),
+			Result.Modules, Result.Swapped, Result.Patched, Result.Added, (FPlatformTime::Seconds() - StartTime) * 1000.0);
+
+		for (const FString& SwappedName : Result.SwappedNames)
+		{
+			UE_LOG(LogFastLuaScript, Verbose, TEXT("LuaHotReload|swapped %s"), *SwappedName);
+		}
+
+		for (const FString& Error : Result.Errors)
+		{
+			UE_LOG(LogFastLuaScript, Warning, TEXT("LuaHotReload|%s"), *Error);
+		}
+	}
+}
+
+void FLuaHotReload::StartWatching()
+{
+#if WITH_EDITOR
+	if (WatchHandle.IsValid() || IsRunningCommandlet())
+	{
+		return;
+	}
+
+	FDirectoryWatcherModule& DirectoryWatcherModule = FModuleManager::LoadModuleChecked<FDirectoryWatcherModule>(TEXT("DirectoryWatcher"));
+	if (IDirectoryWatcher* DirectoryWatcher = DirectoryWatcherModule.Get())
+	{
+		DirectoryWatcher->RegisterDirectoryChangedCallback_Handle(
+			FPaths::ConvertRelativePathToFull(FLuaModuleIndex::GetScriptRoot()),
+			IDirectoryWatcher::FDirectoryChanged::CreateStatic(&FLuaHotReload::HandleDirectoryChanged),
+			WatchHandle);
+	}
+#endif
+}
+
+void FLuaHotReload::StopWatching()
+{
+#if WITH_EDITOR
+	if (!WatchHandle.IsValid())
+	{
+		return;
+	}
+
+	if (FDirectoryWatcherModule* DirectoryWatcherModule = FModuleManager::GetModulePtr<FDirectoryWatcherModule>(TEXT("DirectoryWatcher")))
+	{
+		if (IDirectoryWatcher* DirectoryWatcher = DirectoryWatcherModule->Get())
+		{
+			DirectoryWatcher->UnregisterDirectoryChangedCallback_Handle(FPaths::ConvertRelativePathToFull(FLuaModuleIndex::GetScriptRoot()), WatchHandle);
+		}
+	}
+
+	WatchHandle.Reset();
+#endif
+}
+
+#if WITH_EDITOR
+void FLuaHotReload::HandleDirectoryChanged(const TArray<FFileChangeData>& InChanges)
+{
+	const FString ScriptRoot = FPaths::ConvertRelativePathToFull(FLuaModuleIndex::GetScriptRoot()) + TEXT("/");
+
+	TArray<FString> ModuleNames;
+	for (const FFileChangeData& Change : InChanges)
+	{
+		FString FilePath = FPaths::ConvertRelativePathToFull(Change.Filename);
+		FPaths::NormalizeFilename(FilePath);
+		if (!FilePath.EndsWith(TEXT(".lua")) || !FilePath.StartsWith(ScriptRoot))
+		{
+			continue;
+		}
+
+		if (Change.Action != FFileChangeData::FCA_Modified)
+		{
+			FLuaModuleIndex::Get().Invalidate();
+		}
+
+		if (Change.Action != FFileChangeData::FCA_Removed)
+		{
+			ModuleNames.AddUnique(FPaths::ChangeExtension(FilePath.RightChop(ScriptRoot.Len()), TEXT("")).Replace(TEXT("/"), TEXT(".")));
+		}
+	}
+
+	ReloadAll(ModuleNames);
+}
+#endif
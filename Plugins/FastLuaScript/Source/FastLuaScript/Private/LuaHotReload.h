@@ -0,0 +1,63 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+struct lua_State;
+struct FFileChangeData;
+
+/**
+ * reload changed modules in the running states, no Reset
+ * the new chunk is run, then for the module(or each table in it, recursively):
+ *	functions: old -> new, the new function joins the data upvalues of the old one(by name) so module locals keep their values
+ *	other values: the old ones are kept, new keys are added
+ * then every reference to an old function reachable from the registry(tables, metatables, upvalues, refs of delegates, ticks, timers)
+ * is set to the new one, frames of suspended coroutines keep the old code
+ * in editor the scripts dir is watched, console: lua.reload Module1 Module2
+ */
+class FLuaHotReload
+{
+public:
+
+	struct FResult
+	{
+		int32 Modules = 0;
+		int32 Swapped = 0;
+		int32 Patched = 0;
+		int32 Added = 0;
+
+		//"AI.PathCost.Compute"
+		TArray<FString> SwappedNames;
+		TArray<FString> Errors;
+	};
+
+	//reload the modules already required by InL, others are loaded from the new file on first require
+	static FResult ReloadModules(lua_State* InL, const TArray<FString>& InModuleNames);
+
+	//reload in all states and log the result
+	static void ReloadAll(const TArray<FString>& InModuleNames);
+
+	static void StartWatching();
+	static void StopWatching();
+
+protected:
+
+	//push the new chunk of InModuleName with the package searchers, false with the error pushed
+	static bool LoadModuleChunk(lua_State* InL, const char* InModuleName);
+
+	//old and new values at InOldIdx and InNewIdx, the pairs go to the swap table
+	static void PairValues(lua_State* InL, int32 InOldIdx, int32 InNewIdx, int32 InSwapIdx, int32 InVisitedIdx, int32 InNamesIdx, const char* InPath, int32 InDepth, FResult& OutResult);
+
+	//upvalues of the new function: functions paired, data joined to the old one
+	static void JoinUpvalues(lua_State* InL, int32 InOldIdx, int32 InNewIdx, int32 InSwapIdx, int32 InVisitedIdx, int32 InNamesIdx, const char* InPath, int32 InDepth, FResult& OutResult);
+
+	//set the references to the old functions of the swap table to the new ones
+	static void PatchReferences(lua_State* InL, int32 InSwapIdx, FResult& OutResult);
+
+#if WITH_EDITOR
+	static void HandleDirectoryChanged(const TArray<FFileChangeData>& InChanges);
+
+	static FDelegateHandle WatchHandle;
+#endif
+};
@@ -0,0 +1,272 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "LuaLatentActionCallback.h"
+#include "Engine/LatentActionManager.h"
+#include "Engine/Engine.h"
+#include "Engine/World.h"
+#include "UObject/UObjectIterator.h"
+#include "UObject/Package.h"
+#include "FastLuaScript.h"
+#include "FastLuaHelper.h"
+#include "FastLuaUnrealWrapper.h"
+#include "FastLuaStat.h"
+#include "LuaTrace.h"
+#include "LuaHitchDetector.h"
+#include "LuaCoroutineWait.h"
+
+#include "lua.hpp"
+
+int32 ULuaLatentActionCallback::NextUUID = 0;
+TArray<ULuaLatentActionCallback*> ULuaLatentActionCallback::PendingCallbacks;
+FDelegateHandle ULuaLatentActionCallback::OnLuaResetHandle;
+
+
+FStructProperty* ULuaLatentActionCallback::FindLatentInfoProperty(const UFunction* InFunction)
+{
+	if (InFunction == nullptr || InFunction->NumParms < 1)
+	{
+		return nullptr;
+	}
+
+	//the Latent meta data is editor only, the param works in all builds
+	for (TFieldIterator<FStructProperty> It(InFunction); It; ++It)
+	{
+		if (It->Struct == FLatentActionInfo::StaticStruct())
+		{
+			return *It;
+		}
+	}
+
+	return nullptr;
+}
+
+bool ULuaLatentActionCallback::Start(lua_State* InL, UObject* InObj, UFunction* InFunction, FStructProperty* InLatentInfoProp, int32& OutReturnNum)
+{
+	SCOPE_CYCLE_COUNTER(STAT_CallUnrealFunction);
+
+	if (!OnLuaResetHandle.IsValid())
+	{
+		OnLuaResetHandle = FastLuaUnrealWrapper::OnLuaUnrealReset.AddStatic(&ULuaLatentActionCallback::HandleLuaUnrealReset);
+	}
+
+	ULuaLatentActionCallback* Callback = NewObject<ULuaLatentActionCallback>(GetTransientPackage());
+	Callback->AddToRoot();
+
+	lua_rawgeti(InL, LUA_REGISTRYINDEX, LUA_RIDX_MAINTHREAD);
+	Callback->LuaState = lua_tothread(InL, -1);
+	lua_pop(InL, 1);
+
+	Callback->Coroutine = InL;
+	lua_pushthread(InL);
+	Callback->ThreadRef = luaL_ref(InL, LUA_REGISTRYINDEX);
+
+	Callback->Function = InFunction;
+	Callback->Params = (uint8*)FMemory::Malloc(FMath::Max(InFunction->ParmsSize, (int32)1), InFunction->GetMinAlignment());
+	InFunction->InitializeStruct(Callback->Params);
+
+	int32 StackTop = 2;
+	for (TFieldIterator<FProperty> It(InFunction); It; ++It)
+	{
+		FProperty* Prop = *It;
+		if (!Prop->HasAnyPropertyFlags(CPF_ReturnParm))
+		{
+			FastLuaHelper::FetchProperty(InL, Prop, Callback->Params, StackTop++);
+		}
+	}
+
+	//whatever lua passed, the action reports to the callback
+	FLatentActionInfo* LatentInfo = InLatentInfoProp->ContainerPtrToValuePtr<FLatentActionInfo>(Callback->Params);
+	*LatentInfo = FLatentActionInfo(0, ++NextUUID, *GetCallbackFunctionFName().ToString(), Callback);
+
+	const bool bTraced = FLuaTrace::BeginFunction(InFunction);
+	InObj->ProcessEvent(InFunction, Callback->Params);
+	FLuaTrace::EndFunction(bTraced);
+
+	//finished at once, or no manager took the action(no world from the world context): nothing would call back
+	Callback->ActionWorld = Callback->bFinished ? nullptr : FindActionWorld(Callback);
+	if (Callback->bFinished || !Callback->ActionWorld.IsValid())
+	{
+		OutReturnNum = Callback->PushResults();
+		Callback->Release();
+		return false;
+	}
+
+	Callback->bYielded = true;
+	Callback->WaitToken = FLuaCoroutineWait::Begin(InL);
+	PendingCallbacks.Add(Callback);
+
+	OutReturnNum = 0;
+	return true;
+}
+
+UWorld* ULuaLatentActionCallback::FindActionWorld(ULuaLatentActionCallback* InCallback)
+{
+	if (GEngine == nullptr)
+	{
+		return nullptr;
+	}
+
+	for (const FWorldContext& Context : GEngine->GetWorldContexts())
+	{
+		UWorld* World = Context.World();
+		if (World && World->GetLatentActionManager().GetNumActionsForObject(InCallback) > 0)
+		{
+			return World;
+		}
+	}
+
+	return nullptr;
+}
+
+void ULuaLatentActionCallback::ReleaseDropped(lua_State* InL)
+{
+	if (InL == nullptr || PendingCallbacks.Num() < 1)
+	{
+		return;
+	}
+
+	//Release changes the array
+	TArray<ULuaLatentActionCallback*> Callbacks = PendingCallbacks;
+	for (ULuaLatentActionCallback* Callback : Callbacks)
+	{
+		if (Callback->LuaState != InL || Callback->bFinished)
+		{
+			continue;
+		}
+
+		UWorld* World = Callback->ActionWorld.Get();
+		if (World == nullptr || World->GetLatentActionManager().GetNumActionsForObject(Callback) == 0)
+		{
+			//the coroutine stays suspended and is collected with its last reference
+			Callback->Release();
+		}
+	}
+}
+
+void ULuaLatentActionCallback::HandleLuaUnrealReset(lua_State* InL)
+{
+	if (InL == nullptr)
+	{
+		return;
+	}
+
+	for (TObjectIterator<ULuaLatentActionCallback> It; It; ++It)
+	{
+		if (It->LuaState == InL)
+		{
+			It->Release();
+		}
+	}
+}
+
+void ULuaLatentActionCallback::OnLatentActionFinished(int32 InLinkage)
+{
+	if (bFinished || LuaState == nullptr)
+	{
+		return;
+	}
+
+	bFinished = true;
+
+	//finished inside ProcessEvent, Start returns the results without yielding
+	if (!bYielded)
+	{
+		return;
+	}
+
+	SCOPE_CYCLE_COUNTER(STAT_LuaLatentResume);
+
+	//resumed meanwhile by someone else, or closed
+	if (FLuaCoroutineWait::IsWaiting(LuaState, Coroutine, WaitToken))
+	{
+		const int32 ResultNum = PushResults();
+
+		int32 YieldNum = 0;
+		FLuaHitchDetector::Get().BeginScope(Coroutine);
+		int32 Ret = lua_resume(Coroutine, LuaState, ResultNum, &YieldNum);
+		FLuaHitchDetector::Get().EndScope(Coroutine, TEXT("Latent"), LUA_NOREF);
+		if (Ret == LUA_OK || Ret == LUA_YIELD)
+		{
+			lua_pop(Coroutine, YieldNum);
+		}
+		else
+		{
+			UE_LOG(LogFastLuaScript, Warning, TEXT("%s resume: %s"), *Function->GetName(), UTF8_TO_TCHAR(lua_tostring(Coroutine, -1)));
+		}
+	}
+
+	Release();
+}
+
+int32 ULuaLatentActionCallback::PushResults()
+{
+	int32 ReturnNum = 0;
+	for (TFieldIterator<FProperty> It(Function); It; ++It)
+	{
+		FProperty* Prop = *It;
+		if (Prop->HasAnyPropertyFlags(CPF_ReturnParm))
+		{
+			FastLuaHelper::PushProperty(Coroutine, Prop, Params);
+			++ReturnNum;
+		}
+	}
+
+	if (Function->HasAnyFunctionFlags(FUNC_HasOutParms))
+	{
+		for (TFieldIterator<FProperty> It(Function); It; ++It)
+		{
+			FProperty* Prop = *It;
+			if (Prop->HasAnyPropertyFlags(CPF_OutParm) && !Prop->HasAnyPropertyFlags(CPF_ConstParm | CPF_ReturnParm))
+			{
+				FastLuaHelper::PushProperty(Coroutine, Prop, Params);
+				++ReturnNum;
+			}
+		}
+	}
+
+	return ReturnNum;
+}
+
+void ULuaLatentActionCallback::Release()
+{
+	PendingCallbacks.RemoveSwap(this);
+
+	if (LuaState && ThreadRef)
+	{
+		luaL_unref(LuaState, LUA_REGISTRYINDEX, ThreadRef);
+	}
+
+	ThreadRef = 0;
+	LuaState = nullptr;
+	Coroutine = nullptr;
+	bFinished = true;
+
+	if (Params)
+	{
+		Function->DestroyStruct(Params);
+		FMemory::Free(Params);
+		Params = nullptr;
+	}
+
+	if (IsRooted())
+	{
+		RemoveFromRoot();
+	}
+
+	MarkPendingKill();
+}
+
+void ULuaLatentActionCallback::BeginDestroy()
+{
+	Super::BeginDestroy();
+
+	//rooted until Release(finished, dropped, lua reset) which frees everything, only engine exit gets here before
+	PendingCallbacks.RemoveSwap(this);
+
+	if (Params)
+	{
+		Function->DestroyStruct(Params);
+		FMemory::Free(Params);
+		Params = nullptr;
+	}
+}
@@ -0,0 +1,78 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "UObject/NoExportTypes.h"
+#include "LuaLatentActionCallback.generated.h"
+
+struct lua_State;
+
+/**
+ * callback target of a latent UFunction(a FLatentActionInfo param, like KismetSystemLibrary:Delay) called from a coroutine
+ * the coroutine yields in CallUnrealFunction and is resumed with the return value and out params when the latent action finishes,
+ * if it is still waiting for it(FLuaCoroutineWait), an action dropped without finishing(world teardown, aborted) releases the callback in lua tick
+ */
+UCLASS()
+class ULuaLatentActionCallback : public UObject
+{
+	GENERATED_BODY()
+public:
+
+	static FName GetCallbackFunctionFName() { return FName(TEXT("OnLatentActionFinished")); }
+
+	//the FLatentActionInfo param of InFunction, nullptr if not latent
+	static FStructProperty* FindLatentInfoProperty(const UFunction* InFunction);
+
+	//call latent InFunction of InObj with the params at the stack of InL(the running coroutine)
+	//return true if the coroutine should yield, false if the action finished at once, then its results are pushed and counted in OutReturnNum
+	static bool Start(lua_State* InL, UObject* InObj, UFunction* InFunction, FStructProperty* InLatentInfoProp, int32& OutReturnNum);
+
+	//drop the pending actions of the closing state
+	static void HandleLuaUnrealReset(lua_State* InL);
+
+	//release the callbacks of InL whose action was removed from its latent action manager without calling back, lua tick
+	static void ReleaseDropped(lua_State* InL);
+
+protected:
+
+	UFUNCTION()
+		void OnLatentActionFinished(int32 InLinkage);
+
+	virtual void BeginDestroy() override;
+
+	//push the return value and out params to the coroutine
+	int32 PushResults();
+
+	void Release();
+
+	//the world whose latent action manager holds the action of this callback
+	static UWorld* FindActionWorld(ULuaLatentActionCallback* InCallback);
+
+	//main thread of the owning state
+	lua_State* LuaState = nullptr;
+
+	//the waiting coroutine, ref in the registry
+	lua_State* Coroutine = nullptr;
+	int32 ThreadRef = 0;
+
+	UFunction* Function = nullptr;
+
+	//params of the call, alive until the action finishes: latent actions may write out params later
+	uint8* Params = nullptr;
+
+	bool bYielded = false;
+	bool bFinished = false;
+
+	//FLuaCoroutineWait token of the coroutine for this action
+	uint32 WaitToken = 0;
+
+	TWeakObjectPtr<UWorld> ActionWorld;
+
+	static int32 NextUUID;
+
+	//yielded and rooted until finished or dropped
+	static TArray<ULuaLatentActionCallback*> PendingCallbacks;
+
+	static FDelegateHandle OnLuaResetHandle;
+};
@@ -0,0 +1,162 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "LuaModuleIndex.h"
+#include "HAL/IConsoleManager.h"
+#include "HAL/PlatformFilemanager.h"
+#include "Misc/CoreDelegates.h"
+#include "Misc/Paths.h"
+#include "Misc/ScopeRWLock.h"
+
+#include "FastLuaScript.h"
+
+
+static FAutoConsoleCommand LuaModuleIndexRebuildCommand(
+	TEXT("lua.ModuleIndex.Rebuild"),
+	TEXT("Scan Content/LuaScript again on next require, for scripts added while running"),
+	FConsoleCommandDelegate::CreateStatic([]()
+	{
+		FLuaModuleIndex::Get().Invalidate();
+	}));
+
+
+FLuaModuleIndex& FLuaModuleIndex::Get()
+{
+	static FLuaModuleIndex Inst;
+	return Inst;
+}
+
+FLuaModuleIndex::FLuaModuleIndex()
+{
+	FCoreDelegates::OnPakFileMounted2.AddRaw(this, &FLuaModuleIndex::HandlePakFileMounted);
+}
+
+FString FLuaModuleIndex::GetScriptRoot()
+{
+	FString ScriptRoot = FPaths::ProjectDir() / TEXT("Content/LuaScript");
+	FPaths::NormalizeDirectoryName(ScriptRoot);
+	return ScriptRoot;
+}
+
+FString FLuaModuleIndex::ToModuleName(const FString& InRequireName)
+{
+	FString ModuleName = InRequireName.Replace(TEXT("/"), TEXT("."));
+	ModuleName.ReplaceInline(TEXT("\\"), TEXT("."));
+	return ModuleName;
+}
+
+bool FLuaModuleIndex::Find(const FString& InModuleName, FString& OutFilePath)
+{
+	const FString ModuleName = ToModuleName(InModuleName);
+
+	{
+		FRWScopeLock ScopeLock(Lock, SLT_ReadOnly);
+		if (bBuilt)
+		{
+			if (const FString* FilePath = Modules.Find(ModuleName))
+			{
+				OutFilePath = *FilePath;
+				return true;
+			}
+
+			if (MissingModules.Contains(ModuleName))
+			{
+				return false;
+			}
+		}
+	}
+
+	FRWScopeLock ScopeLock(Lock, SLT_Write);
+	if (!bBuilt)
+	{
+		Build();
+	}
+
+	if (const FString* FilePath = Modules.Find(ModuleName))
+	{
+		OutFilePath = *FilePath;
+		return true;
+	}
+
+	MissingModules.Add(ModuleName);
+	return false;
+}
+
+uint32 FLuaModuleIndex::GetModules(TMap<FString, FString>& OutModules)
+{
+	FRWScopeLock ScopeLock(Lock, SLT_Write);
+	if (!bBuilt)
+	{
+		Build();
+	}
+
+	OutModules = Modules;
+	return BuildNum;
+}
+
+void FLuaModuleIndex::Build()
+{
+	const double StartTime = FPlatformTime::Seconds();
+
+	Modules.Reset();
+	MissingModules.Reset();
+	bBuilt = true;
+	++BuildNum;
+
+	struct FScriptVisitor : public IPlatformFile::FDirectoryVisitor
+	{
+		FString ScriptRoot;
+		TMap<FString, FString>& Modules;
+
+		FScriptVisitor(const FString& InScriptRoot, TMap<FString, FString>& InModules)
+			: ScriptRoot(InScriptRoot), Modules(InModules)
+		{
+		}
+
+		virtual bool Visit(const TCHAR* FilenameOrDirectory, bool bIsDirectory) override
+		{
+			FString FilePath = FilenameOrDirectory;
+			if (bIsDirectory || !FilePath.EndsWith(TEXT(".lua")))
+			{
+				return true;
+			}
+
+			FPaths::NormalizeFilename(FilePath);
+
+			if (!FilePath.StartsWith(ScriptRoot))
+			{
+				return true;
+			}
+
+			//"AI/PathCost.lua" -> "AI.PathCost"
+			FString ModuleName = FilePath.Mid(ScriptRoot.Len() + 1, FilePath.Len() - ScriptRoot.Len() - 5).Replace(TEXT("/"), TEXT("."));
+
+			//a loose file and the same file in a pak are listed both, the first one is kept
+			if (!Modules.Contains(ModuleName))
+			{
+				Modules.Add(MoveTemp(ModuleName), MoveTemp(FilePath));
+			}
+
+			return true;
+		}
+	};
+
+	//the platform file lists the mounted paks and the loose files under them
+	FScriptVisitor Visitor(GetScriptRoot(), Modules);
+	FPlatformFileManager::Get().GetPlatformFile().IterateDirectoryRecursively(*Visitor.ScriptRoot, Visitor);
+
+	UE_LOG(LogFastLuaScript, Log, TEXT("LuaModuleIndex|%d modules in %.2f ms"), Modules.Num(), (FPlatformTime::Seconds() - StartTime) * 1000.0);
+}
+
+void FLuaModuleIndex::Invalidate()
+{
+	FRWScopeLock ScopeLock(Lock, SLT_Write);
+	bBuilt = false;
+	Modules.Reset();
+	MissingModules.Reset();
+}
+
+void FLuaModuleIndex::HandlePakFileMounted(const IPakFile& InPakFile)
+{
+	Invalidate();
+}
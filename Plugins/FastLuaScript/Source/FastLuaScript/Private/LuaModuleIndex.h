@@ -0,0 +1,54 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+class IPakFile;
+
+/**
+ * module name -> file of the scripts under Content/LuaScript(loose files and mounted paks), shared by all states
+ * built on first lookup by one directory scan, "AI.PathCost" and "AI/PathCost" both find AI/PathCost.lua,
+ * names not found are remembered, the index is dropped when a pak is mounted, on state Init in editor and by lua.ModuleIndex.Rebuild
+ */
+class FLuaModuleIndex
+{
+public:
+
+	static FLuaModuleIndex& Get();
+
+	//full path of the module file, any thread
+	bool Find(const FString& InModuleName, FString& OutFilePath);
+
+	//all modules, name -> full path, return the build they come from
+	uint32 GetModules(TMap<FString, FString>& OutModules);
+
+	//rebuilt on next Find
+	void Invalidate();
+
+	//"AI/PathCost" -> "AI.PathCost"
+	static FString ToModuleName(const FString& InRequireName);
+
+	static FString GetScriptRoot();
+
+protected:
+
+	FLuaModuleIndex();
+
+	void Build();
+
+	void HandlePakFileMounted(const IPakFile& InPakFile);
+
+	FRWLock Lock;
+
+	//"AI.PathCost" -> ".../Content/LuaScript/AI/PathCost.lua"
+	TMap<FString, FString> Modules;
+
+	//names not found since the last build
+	TSet<FString> MissingModules;
+
+	bool bBuilt = false;
+
+	//counts the scans, 0 is never built
+	uint32 BuildNum = 0;
+};
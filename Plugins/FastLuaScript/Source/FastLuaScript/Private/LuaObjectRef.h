@@ -0,0 +1,48 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "UObject/GCObject.h"
+
+/**
+ * keeps the UObjects pushed to one lua state alive, owned by FastLuaUnrealWrapper
+ * an object pushed several times is counted, it is released when the last userdata is collected
+ */
+class FLuaObjectRef : public FGCObject
+{
+public:
+
+	virtual void AddReferencedObjects(FReferenceCollector& Collector) override
+	{
+		Collector.AddReferencedObjects(RefObjects);
+	}
+
+	virtual FString GetReferencerName() const override
+	{
+		return TEXT("FLuaObjectRef");
+	}
+
+	void AddRefObject(UObject* InObj)
+	{
+		++RefObjects.FindOrAdd(InObj);
+	}
+
+	void RemoveRefObject(UObject* InObj)
+	{
+		int32* Count = RefObjects.Find(InObj);
+		if (Count && --(*Count) <= 0)
+		{
+			RefObjects.Remove(InObj);
+		}
+	}
+
+	int32 Num() const
+	{
+		return RefObjects.Num();
+	}
+
+protected:
+
+	TMap<UObject*, int32> RefObjects;
+};
@@ -7,62 +7,35 @@
 #include "FastLuaUnrealWrapper.h"
 #include "FastLuaHelper.h"
 #include "LuaStructWrapper.h"
+#include "LuaObjectRef.h"
 
 #include "lua.hpp"
 #include "FastLuaStat.h"
+#include "LuaBindingStats.h"
+#include "LuaSessionRecorder.h"
 
 
-class FLuaObjectRef : public FGCObject
+FLuaObjectWrapper::FLuaObjectWrapper(lua_State* InL, UObject* InObj)
 {
-public:
-	FLuaObjectRef()
-	{
-
-	}
-
-	virtual ~FLuaObjectRef()
-	{
-
-	}
-
-	virtual void AddReferencedObjects(FReferenceCollector& Collector) override
-	{
-		Collector.AddReferencedObjects(PendingRefObjects);
-	}
-
-	void AddRefObject(UObject* InObj)
-	{
-		PendingRefObjects.Add(InObj);
-	}
-
-	void RemoveRefObject(UObject* InObj)
-	{
-		PendingRefObjects.Remove(InObj);
-	}
+	ObjectPtr = InObj;
 
-	static FLuaObjectRef* GetDefault()
+	//each state keeps its own objects alive, worker states without owner never push objects
+	FastLuaUnrealWrapper* Owner = FastLuaUnrealWrapper::GetFromLuaState(InL);
+	ObjectRef = Owner ? Owner->GetObjectRef() : nullptr;
+	if (ObjectRef)
 	{
-		static FLuaObjectRef* DefaultInst = nullptr;
-		if (DefaultInst == nullptr)
-		{
-			DefaultInst = new FLuaObjectRef();
-			FGCObject::GGCObjectReferencer->AddObject(DefaultInst);
-		}
-
-		return DefaultInst;
+		ObjectRef->AddRefObject(InObj);
 	}
-protected:
-	TSet<UObject*> PendingRefObjects;
-};
-
-FLuaObjectWrapper::FLuaObjectWrapper(UObject* InObj)
-{
-	FLuaObjectRef::GetDefault()->AddRefObject(InObj);
 }
 
 FLuaObjectWrapper::~FLuaObjectWrapper()
 {
-	FLuaObjectRef::GetDefault()->RemoveRefObject(ObjectPtr);
+	if (ObjectRef)
+	{
+		ObjectRef->RemoveRefObject(ObjectPtr);
+		ObjectRef = nullptr;
+	}
+
 	ObjectPtr = nullptr;
 }
 
@@ -93,14 +66,15 @@ UObject* FLuaObjectWrapper::FetchObject(lua_State* InL, int32 InIndex, bool IsUC
 
 void FLuaObjectWrapper::PushObject(lua_State* InL, UObject* InObj)
 {
-	if (InObj == nullptr)
+	//UObjects belong to the game thread, worker states(Unreal.Async) never see them
+	if (InObj == nullptr || !IsInGameThread())
 	{
 		lua_pushnil(InL);
 		return;
 	}
 	
 	FLuaObjectWrapper* Wrapper = (FLuaObjectWrapper*)lua_newuserdata(InL, sizeof(FLuaObjectWrapper));
-	new(Wrapper) FLuaObjectWrapper(InObj);
+	new(Wrapper) FLuaObjectWrapper(InL, InObj);
 
 	const UClass* Class = InObj->GetClass();
 
@@ -281,7 +255,10 @@ int FLuaObjectWrapper::ObjectIndex(lua_State* InL)
 
 	if (ValueAddr)
 	{
+		const uint64 StatsStartCycles = FLuaBindingStats::Begin();
 		FastLuaHelper::PushProperty(InL, Prop, ValueAddr);
+		FLuaBindingStats::EndProperty(Prop, false, StatsStartCycles);
+		FLuaSessionRecorder::RecordProperty(InL, (UObject*)ValueAddr, Prop, false);
 	}
 	else
 	{
@@ -305,7 +282,10 @@ int FLuaObjectWrapper::ObjectNewIndex(lua_State* InL)
 
 	if (ValueAddr)
 	{
+		const uint64 StatsStartCycles = FLuaBindingStats::Begin();
 		FastLuaHelper::FetchProperty(InL, Prop, ValueAddr, 2);
+		FLuaBindingStats::EndProperty(Prop, true, StatsStartCycles);
+		FLuaSessionRecorder::RecordProperty(InL, (UObject*)ValueAddr, Prop, true);
 	}
 
 	return 0;
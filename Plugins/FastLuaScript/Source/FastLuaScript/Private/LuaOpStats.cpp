@@ -0,0 +1,124 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "CoreMinimal.h"
+#include "HAL/IConsoleManager.h"
+#include "Misc/OutputDevice.h"
+
+#include "lua.hpp"
+#include "FastLuaScript.h"
+#include "FastLuaUnrealWrapper.h"
+
+
+/**
+ * lua.opstats [Num], lua.opstats reset
+ * the VM counters of lvm.c(lua_getopstats), only with the instrumented lua: bLuaOpStats in Lua.Build.cs or LUA_OPSTATS=1 in the environment
+ * per state: the most executed opcodes with the table accesses missing the fast path(luaV_finishget/luaV_finishset),
+ * the metamethods used(__index chains of Class.lua count once per step) and the functions executing the most instructions
+ */
+#if LUA_OPSTATS
+namespace LuaOpStats
+{
+	struct FProtoCount
+	{
+		FString Name;
+		uint64 Count;
+	};
+
+	static void CollectProto(void* InUserData, const char* InSource, int InLineDefined, size_t InCount)
+	{
+		//"@Path.lua" for files, "=name" or the chunk otherwise
+		FString Source = UTF8_TO_TCHAR(InSource);
+		if (Source.Len() > 0 && (Source[0] == TEXT('@') || Source[0] == TEXT('=')))
+		{
+			Source.RightChopInline(1);
+		}
+		else
+		{
+			Source = Source.Left(32).Replace(TEXT("\n"), TEXT(" "));
+		}
+
+		((TArray<FProtoCount>*)InUserData)->Add({ FString::Printf(TEXT("%s:%d"), *Source, InLineDefined), (uint64)InCount });
+	}
+
+	static void Dump(lua_State* L, FOutputDevice& Ar, int32 InNum)
+	{
+		lua_OpStats Stats;
+		const int32 OpNum = lua_getopstats(L, &Stats);
+
+		uint64 Total = 0;
+		uint64 TotalSlow = 0;
+		TArray<int32> Ops;
+		for (int32 Op = 0; Op < OpNum; ++Op)
+		{
+			Total += Stats.count[Op];
+			TotalSlow += Stats.slow[Op];
+			if (Stats.count[Op] > 0)
+			{
+				Ops.Add(Op);
+			}
+		}
+
+		Ops.Sort([&Stats](int32 A, int32 B) { return Stats.count[A] > Stats.count[B]; });
+
+		Ar.Logf(TEXT("LuaOpStats|state %p: %llu instructions, %llu table accesses out of the fast path"), L, Total, TotalSlow);
+		Ar.Logf(TEXT("  %-12s %14s %7s %12s %7s"), TEXT("opcode"), TEXT("count"), TEXT("%"), TEXT("slow"), TEXT("slow%"));
+		for (int32 i = 0; i < Ops.Num() && i < InNum; ++i)
+		{
+			const int32 Op = Ops[i];
+			const uint64 Count = Stats.count[Op];
+			const uint64 Slow = Stats.slow[Op];
+			Ar.Logf(TEXT("  %-12s %14llu %6.2f%% %12llu %6.2f%%"), UTF8_TO_TCHAR(lua_opname(Op)), Count, Count * 100.0 / Total, Slow, Slow * 100.0 / Count);
+		}
+
+		FString Metamethods;
+		for (int32 Event = 0; Event < LUA_OPSTATS_MAXTM; ++Event)
+		{
+			const char* EventName = lua_tmname(L, Event);
+			if (EventName && Stats.tm[Event] > 0)
+			{
+				Metamethods += FString::Printf(TEXT(" %s %llu"), UTF8_TO_TCHAR(EventName), (uint64)Stats.tm[Event]);
+			}
+		}
+		Ar.Logf(TEXT("  metamethods:%s, __index functions called %llu"), Metamethods.IsEmpty() ? TEXT(" none") : *Metamethods, (uint64)Stats.indexcalls);
+
+		TArray<FProtoCount> Protos;
+		lua_visitopprotos(L, &CollectProto, &Protos);
+		Protos.Sort([](const FProtoCount& A, const FProtoCount& B) { return A.Count > B.Count; });
+
+		Ar.Logf(TEXT("  %d functions executed, the hottest:"), Protos.Num());
+		for (int32 i = 0; i < Protos.Num() && i < InNum; ++i)
+		{
+			Ar.Logf(TEXT("  %14llu %6.2f%% %s"), Protos[i].Count, Protos[i].Count * 100.0 / Total, *Protos[i].Name);
+		}
+	}
+}
+#endif
+
+static FAutoConsoleCommand LuaOpStatsCommand(
+	TEXT("lua.opstats"),
+	TEXT("Dump the lua VM opcode, metamethod and function counters of the instrumented lua(LUA_OPSTATS): lua.opstats [Num], lua.opstats reset"),
+	FConsoleCommandWithArgsDelegate::CreateStatic([](const TArray<FString>& InArgs)
+	{
+#if !LUA_OPSTATS
+		UE_LOG(LogFastLuaScript, Warning, TEXT("LuaOpStats|lua is built without LUA_OPSTATS, set bLuaOpStats in Lua.Build.cs"));
+#else
+		const bool bReset = InArgs.Num() > 0 && InArgs[0] == TEXT("reset");
+		const int32 Num = InArgs.Num() > 0 && !bReset ? FMath::Max(FCString::Atoi(*InArgs[0]), 1) : 20;
+
+		for (FastLuaUnrealWrapper* Wrapper : FastLuaUnrealWrapper::GetAllWrappers())
+		{
+			if (lua_State* L = Wrapper->GetLuaState())
+			{
+				if (bReset)
+				{
+					lua_resetopstats(L);
+				}
+				else
+				{
+					LuaOpStats::Dump(L, *GLog, Num);
+				}
+			}
+		}
+#endif
+	}));
@@ -0,0 +1,138 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "LuaPrecompiler.h"
+#include "HAL/IConsoleManager.h"
+#include "Async/Async.h"
+#include "Async/ParallelFor.h"
+#include "Async/TaskGraphInterfaces.h"
+#include "HAL/ThreadSafeCounter.h"
+#include "Misc/FileHelper.h"
+#include "Misc/ScopeLock.h"
+
+#include "FastLuaScript.h"
+#include "FastLuaStat.h"
+#include "LuaBytecodeCache.h"
+#include "LuaModuleIndex.h"
+#include "LuaScriptBundle.h"
+
+#include "lua.hpp"
+
+
+static int32 GLuaPrecompile = 1;
+static FAutoConsoleVariableRef CVarLuaPrecompile(
+	TEXT("lua.Precompile"),
+	GLuaPrecompile,
+	TEXT("Compile all lua modules on worker threads when a state is created, 0 to parse each module on first require"));
+
+FCriticalSection FLuaPrecompiler::PassLock;
+uint32 FLuaPrecompiler::PrecompiledBuild = 0;
+
+uint32 FLuaPrecompiler::CollectModules(TArray<FModuleSource>& OutModules)
+{
+	TArray<FString> BundleModules;
+	FLuaScriptBundle::Get().GetModuleNames(BundleModules);
+
+	//require loads the bundle chunks in place, source entries too, nothing to compile ahead
+	if (BundleModules.Num() > 0)
+	{
+		return BundleBuild;
+	}
+
+	TMap<FString, FString> IndexModules;
+	const uint32 Build = FLuaModuleIndex::Get().GetModules(IndexModules);
+
+	OutModules.Reserve(IndexModules.Num());
+	for (const TPair<FString, FString>& It : IndexModules)
+	{
+		FModuleSource& Module = OutModules.AddDefaulted_GetRef();
+		Module.ChunkName = FString("@") + It.Value;
+		Module.FilePath = It.Value;
+	}
+
+	return Build;
+}
+
+int32 FLuaPrecompiler::PrecompileAll()
+{
+	//the chunks are kept by the cache only
+	if (GLuaPrecompile == 0 || !FLuaBytecodeCache::IsEnabled())
+	{
+		return 0;
+	}
+
+	//a state created while a pass runs waits for it, then finds its build done
+	FScopeLock ScopeLock(&PassLock);
+
+	TArray<FModuleSource> Modules;
+	const uint32 Build = CollectModules(Modules);
+	if (Build == PrecompiledBuild || Modules.Num() < 1)
+	{
+		return 0;
+	}
+
+	PrecompiledBuild = Build;
+
+	SCOPE_CYCLE_COUNTER(STAT_LuaPrecompile);
+	const double StartTime = FPlatformTime::Seconds();
+
+	//a few modules per batch, one scratch state per batch
+	const int32 BatchNum = FMath::Min(Modules.Num(), (FTaskGraphInterface::Get().GetNumWorkerThreads() + 1) * 2);
+	FThreadSafeCounter ErrorNum;
+	FThreadSafeCounter CompiledNum;
+
+	ParallelFor(BatchNum, [&Modules, &ErrorNum, &CompiledNum, BatchNum](int32 BatchIndex)
+	{
+		lua_State* L = luaL_newstate();
+
+		TArray<uint8> FileData;
+		for (int32 i = BatchIndex; i < Modules.Num(); i += BatchNum)
+		{
+			const FModuleSource& Module = Modules[i];
+
+			if (!FFileHelper::LoadFileToArray(FileData, *Module.FilePath, FILEREAD_Silent))
+			{
+				continue;
+			}
+
+			//the same bytes as RequireFromUFS, so the source hash matches
+			const int32 BomLen = (FileData.Num() > 2 && FileData[0] == 0xEF && FileData[1] == 0xBB && FileData[2] == 0xBF) ? 3 : 0;
+			const uint8* Data = FileData.GetData() + BomLen;
+			const int32 Size = FileData.Num() - BomLen;
+
+			//compiled by an earlier run or pass
+			if (FLuaBytecodeCache::Get().HasBytecode(Data, Size, Module.ChunkName))
+			{
+				continue;
+			}
+
+			//parse errors are reported again by require
+			if (FLuaBytecodeCache::Get().LoadBuffer(L, Data, Size, Module.ChunkName) != LUA_OK)
+			{
+				ErrorNum.Increment();
+			}
+			CompiledNum.Increment();
+			lua_settop(L, 0);
+		}
+
+		lua_close(L);
+	});
+
+	UE_LOG(LogFastLuaScript, Log, TEXT("LuaPrecompiler|%d of %d modules compiled(%d errors) in %.2f ms, %d batches"),
+		CompiledNum.GetValue(), Modules.Num(), ErrorNum.GetValue(), (FPlatformTime::Seconds() - StartTime) * 1000.0, BatchNum);
+
+	return CompiledNum.GetValue();
+}
+
+void FLuaPrecompiler::PrecompileAsync()
+{
+	if (GLuaPrecompile == 0 || !FLuaBytecodeCache::IsEnabled())
+	{
+		return;
+	}
+
+	Async(EAsyncExecution::ThreadPool, []()
+	{
+		PrecompileAll();
+	});
+}
@@ -0,0 +1,43 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * compile all script modules on the task graph before the game state runs them
+ * the modules come from the module index(none with a bundle: require loads its chunks in place), each worker batch parses in a scratch lua state
+ * and leaves the chunks in FLuaBytecodeCache, require on the game thread then only loads bytecode in the order the scripts need it
+ * one pass per module index build, modules the cache already has are read back without parsing
+ * console: lua.Precompile(0 to parse on first require)
+ */
+class FLuaPrecompiler
+{
+public:
+
+	//blocks until all modules are compiled, return the number of modules compiled, worker thread
+	static int32 PrecompileAll();
+
+	//PrecompileAll on the thread pool, game thread: a require before the pass reaches its module parses it itself
+	static void PrecompileAsync();
+
+protected:
+
+	struct FModuleSource
+	{
+		FString ChunkName;
+
+		FString FilePath;
+	};
+
+	//return the index build the modules come from, BundleBuild for the bundle
+	static uint32 CollectModules(TArray<FModuleSource>& OutModules);
+
+	static const uint32 BundleBuild = MAX_uint32;
+
+	//one pass at a time
+	static FCriticalSection PassLock;
+
+	//the build of the last pass, 0 for none
+	static uint32 PrecompiledBuild;
+};
@@ -0,0 +1,469 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "LuaProfiler.h"
+#include "HAL/IConsoleManager.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Misc/OutputDevice.h"
+#include "HAL/Runnable.h"
+#include "HAL/RunnableThread.h"
+#include "HAL/ThreadSafeBool.h"
+#include "Hash/CityHash.h"
+
+#include "FastLuaUnrealWrapper.h"
+#include "FastLuaScript.h"
+#include "FastLuaStat.h"
+
+#include "lua.hpp"
+
+
+static int32 GLuaProfileRate = 1000;
+static FAutoConsoleVariableRef CVarLuaProfileRate(
+	TEXT("lua.Profile.Rate"),
+	GLuaProfileRate,
+	TEXT("Samples per second of lua.profile start without a rate"));
+
+static int32 GLuaProfileHookInstructions = 1000;
+static FAutoConsoleVariableRef CVarLuaProfileHookInstructions(
+	TEXT("lua.Profile.HookInstructions"),
+	GLuaProfileHookInstructions,
+	TEXT("Lua instructions between two checks of the sample request while profiling, lower is more precise and slower"));
+
+static FAutoConsoleCommand LuaProfileCommand(
+	TEXT("lua.profile"),
+	TEXT("Sampling lua profiler: lua.profile start [Hz], lua.profile stop(writes Saved/Profiling/Lua), lua.profile summary [Num]"),
+	FConsoleCommandWithArgsDelegate::CreateStatic([](const TArray<FString>& InArgs)
+	{
+		FLuaProfiler& Profiler = FLuaProfiler::Get();
+		const FString Action = InArgs.Num() > 0 ? InArgs[0] : FString();
+		if (Action == TEXT("start"))
+		{
+			Profiler.Start(InArgs.Num() > 1 ? FCString::Atoi(*InArgs[1]) : GLuaProfileRate);
+		}
+		else if (Action == TEXT("stop"))
+		{
+			Profiler.Stop();
+		}
+		else if (Action == TEXT("summary"))
+		{
+			Profiler.DumpSummary(*GLog, InArgs.Num() > 1 ? FCString::Atoi(*InArgs[1]) : 20);
+		}
+		else
+		{
+			UE_LOG(LogFastLuaScript, Display, TEXT("LuaProfiler|%s, lua.profile start [Hz] | stop | summary [Num]"), Profiler.IsRunning() ? TEXT("running") : TEXT("stopped"));
+		}
+	}));
+
+namespace LuaProfiler
+{
+	static const int32 MaxDepth = 64;
+
+	static uint64 HashString(const char* InStr, uint64 InSeed)
+	{
+		return InStr ? CityHash64WithSeed(InStr, FCStringAnsi::Strlen(InStr), InSeed) : InSeed;
+	}
+
+	static uint64 HashInt(int64 InValue, uint64 InSeed)
+	{
+		return CityHash64WithSeed((const char*)&InValue, sizeof(InValue), InSeed);
+	}
+
+	static FString EscapeJson(const FString& InStr)
+	{
+		FString Result;
+		Result.Reserve(InStr.Len());
+		for (TCHAR Ch : InStr)
+		{
+			if (Ch == TEXT('"') || Ch == TEXT('\\'))
+			{
+				Result.AppendChar(TEXT('\\'));
+				Result.AppendChar(Ch);
+			}
+			else if (Ch < 0x20)
+			{
+				Result += FString::Printf(TEXT("\\u%04x"), (int32)Ch);
+			}
+			else
+			{
+				Result.AppendChar(Ch);
+			}
+		}
+
+		return Result;
+	}
+}
+
+
+class FLuaProfiler::FSampleTicker : public FRunnable
+{
+public:
+
+	FSampleTicker(FLuaProfiler& InProfiler, double InIntervalSeconds)
+		: Profiler(InProfiler)
+		, IntervalSeconds(InIntervalSeconds)
+	{
+
+	}
+
+	virtual uint32 Run() override
+	{
+		while (!bStopping)
+		{
+			FPlatformProcess::SleepNoStats(IntervalSeconds);
+			Profiler.RequestSample();
+		}
+
+		return 0;
+	}
+
+	virtual void Stop() override
+	{
+		bStopping = true;
+	}
+
+protected:
+
+	FLuaProfiler& Profiler;
+	double IntervalSeconds = 0.001;
+	FThreadSafeBool bStopping;
+};
+
+
+FLuaProfiler& FLuaProfiler::Get()
+{
+	static FLuaProfiler Inst;
+	return Inst;
+}
+
+void FLuaProfiler::Start(int32 InRate)
+{
+	if (bRunning)
+	{
+		Stop();
+	}
+
+	Rate = FMath::Clamp(InRate, 1, 10000);
+	IntervalCycles = FMath::Max<uint64>((uint64)(1.0 / (Rate * FPlatformTime::GetSecondsPerCycle64())), 1);
+	RequestCycles = 0;
+	StartCycles = FPlatformTime::Cycles64();
+	StopCycles = 0;
+	SampleCycles = 0;
+	SampleNum = 0;
+	LateNum = 0;
+
+	FunctionIds.Reset();
+	Functions.Reset();
+	LineIds.Reset();
+	Lines.Reset();
+	StackIds.Reset();
+	Stacks.Reset();
+
+	bRunning = true;
+
+	for (FastLuaUnrealWrapper* Wrapper : FastLuaUnrealWrapper::GetAllWrappers())
+	{
+		AttachState(Wrapper->GetLuaState());
+	}
+
+	Ticker = new FSampleTicker(*this, 1.0 / Rate);
+	TickerThread = FRunnableThread::Create(Ticker, TEXT("LuaProfiler"), 0, TPri_AboveNormal);
+
+	UE_LOG(LogFastLuaScript, Display, TEXT("LuaProfiler|started at %d Hz"), Rate);
+}
+
+void FLuaProfiler::Stop()
+{
+	if (!bRunning)
+	{
+		return;
+	}
+
+	bRunning = false;
+	StopCycles = FPlatformTime::Cycles64();
+
+	if (TickerThread)
+	{
+		TickerThread->Kill(true);
+		delete TickerThread;
+		TickerThread = nullptr;
+	}
+
+	delete Ticker;
+	Ticker = nullptr;
+
+	//coroutines made from a hooked thread remove the inherited hook on their next check
+	for (lua_State* L : States)
+	{
+		if (lua_gethook(L) == SampleHook)
+		{
+			lua_sethook(L, nullptr, 0, 0);
+		}
+	}
+	States.Reset();
+
+	const FString FoldedFile = Export(FPaths::ProfilingDir() / TEXT("Lua"));
+	DumpSummary(*GLog, 20);
+
+	UE_LOG(LogFastLuaScript, Display, TEXT("LuaProfiler|stopped, %s"), *FoldedFile);
+}
+
+void FLuaProfiler::AttachState(lua_State* InL)
+{
+	if (bRunning && InL && !States.Contains(InL))
+	{
+		States.Add(InL);
+
+		//a debugger hook is kept, the state is not sampled
+		if (lua_gethook(InL) == nullptr)
+		{
+			lua_sethook(InL, SampleHook, LUA_MASKCOUNT, FMath::Max(GLuaProfileHookInstructions, 1));
+		}
+	}
+}
+
+void FLuaProfiler::DetachState(lua_State* InL)
+{
+	if (bRunning)
+	{
+		States.RemoveSwap(InL);
+	}
+}
+
+void FLuaProfiler::RequestSample()
+{
+	//a request not taken yet keeps its time, it is dropped as late when taken
+	uint64 Expected = 0;
+	RequestCycles.CompareExchange(Expected, FPlatformTime::Cycles64());
+}
+
+void FLuaProfiler::TakeRequestedSample(lua_State* InL)
+{
+	//the first state or task polling takes it
+	const uint64 Requested = RequestCycles.Exchange(0);
+	if (Requested == 0)
+	{
+		return;
+	}
+
+	//the request waited for the state to run lua again
+	const uint64 NowCycles = FPlatformTime::Cycles64();
+	if (NowCycles > Requested + IntervalCycles * 2)
+	{
+		LateNum++;
+		return;
+	}
+
+	Sample(InL, NowCycles);
+}
+
+void FLuaProfiler::SampleHook(lua_State* InL, lua_Debug* InDebug)
+{
+	FLuaProfiler& Profiler = Get();
+
+	//coroutines made from a hooked thread inherit the hook, they are not sampled
+	if (!Profiler.bRunning || !Profiler.States.Contains(InL))
+	{
+		lua_sethook(InL, nullptr, 0, 0);
+		return;
+	}
+
+	Profiler.CountHook(InL);
+}
+
+void FLuaProfiler::Sample(lua_State* InL, uint64 InNowCycles)
+{
+	SCOPE_CYCLE_COUNTER(STAT_LuaProfilerSample);
+
+	ScratchFrames.Reset();
+
+	lua_Debug Ar;
+	for (int32 Level = 0; Level < LuaProfiler::MaxDepth && lua_getstack(InL, Level, &Ar); ++Level)
+	{
+		lua_getinfo(InL, "Sln", &Ar);
+
+		const int32 FunctionId = FindOrAddFunction(Ar);
+		if (Level == 0)
+		{
+			Functions[FunctionId].SelfSamples++;
+			AddLine(Ar, FunctionId);
+		}
+
+		//recursive functions count once
+		if (!ScratchFrames.Contains(FunctionId))
+		{
+			Functions[FunctionId].TotalSamples++;
+		}
+
+		ScratchFrames.Add(FunctionId);
+	}
+
+	if (ScratchFrames.Num() > 0)
+	{
+		const uint64 StackHash = CityHash64((const char*)ScratchFrames.GetData(), ScratchFrames.Num() * sizeof(int32));
+		if (const int32* StackId = StackIds.Find(StackHash))
+		{
+			Stacks[*StackId].Samples++;
+		}
+		else
+		{
+			StackIds.Add(StackHash, Stacks.Num());
+			FStackInfo& Stack = Stacks.AddDefaulted_GetRef();
+			Stack.Frames = ScratchFrames;
+			Stack.Samples = 1;
+		}
+
+		SampleNum++;
+	}
+
+	SampleCycles += FPlatformTime::Cycles64() - InNowCycles;
+}
+
+int32 FLuaProfiler::FindOrAddFunction(const lua_Debug& InDebug)
+{
+	uint64 Key = LuaProfiler::HashString(InDebug.source, 0);
+	Key = LuaProfiler::HashString(InDebug.name, Key);
+	Key = LuaProfiler::HashInt(InDebug.linedefined, Key);
+
+	if (const int32* FunctionId = FunctionIds.Find(Key))
+	{
+		return *FunctionId;
+	}
+
+	const int32 FunctionId = Functions.Num();
+	FunctionIds.Add(Key, FunctionId);
+
+	FFunctionInfo& Function = Functions.AddDefaulted_GetRef();
+	Function.Source = UTF8_TO_TCHAR(InDebug.short_src);
+	Function.Line = InDebug.linedefined;
+
+	const FString Name = InDebug.name ? UTF8_TO_TCHAR(InDebug.name) : (InDebug.what && FCStringAnsi::Strcmp(InDebug.what, "main") == 0 ? TEXT("(main chunk)") : TEXT("?"));
+	if (InDebug.what && FCStringAnsi::Strcmp(InDebug.what, "C") == 0)
+	{
+		Function.Name = FString::Printf(TEXT("%s [C]"), *Name);
+	}
+	else
+	{
+		Function.Name = FString::Printf(TEXT("%s (%s:%d)"), *Name, *Function.Source, Function.Line);
+	}
+
+	//the folded format splits frames by ;
+	Function.Name.ReplaceCharInline(TEXT(';'), TEXT(':'));
+
+	return FunctionId;
+}
+
+void FLuaProfiler::AddLine(const lua_Debug& InDebug, int32 InFunctionId)
+{
+	uint64 Key = LuaProfiler::HashString(InDebug.source, 0);
+	Key = LuaProfiler::HashInt(InDebug.currentline, Key);
+
+	if (const int32* LineId = LineIds.Find(Key))
+	{
+		Lines[*LineId].Samples++;
+		return;
+	}
+
+	LineIds.Add(Key, Lines.Num());
+
+	FLineInfo& Line = Lines.AddDefaulted_GetRef();
+	Line.Source = UTF8_TO_TCHAR(InDebug.short_src);
+	Line.Line = InDebug.currentline;
+	Line.FunctionId = InFunctionId;
+	Line.Samples = 1;
+}
+
+void FLuaProfiler::DumpSummary(FOutputDevice& Ar, int32 InNum) const
+{
+	const uint64 EndCycles = bRunning ? FPlatformTime::Cycles64() : StopCycles;
+	const double DurationMs = FPlatformTime::ToMilliseconds64(EndCycles - StartCycles);
+	const double SampleMs = FPlatformTime::ToMilliseconds64(SampleCycles);
+	const double TotalSamples = FMath::Max(SampleNum, 1);
+
+	Ar.Logf(TEXT("LuaProfiler|%d samples at %d Hz in %.1f ms, %d late ones dropped, %.2f ms taking samples(%.2f%%)"),
+		SampleNum, Rate, DurationMs, LateNum, SampleMs, DurationMs > 0.0 ? SampleMs * 100.0 / DurationMs : 0.0);
+
+	TArray<int32> Order;
+	for (int32 i = 0; i < Functions.Num(); ++i)
+	{
+		Order.Add(i);
+	}
+	Order.Sort([this](int32 A, int32 B) { return Functions[A].SelfSamples > Functions[B].SelfSamples; });
+
+	Ar.Logf(TEXT("LuaProfiler|   self%%  total%%  function"));
+	for (int32 i = 0; i < Order.Num() && i < InNum; ++i)
+	{
+		const FFunctionInfo& Function = Functions[Order[i]];
+		Ar.Logf(TEXT("LuaProfiler| %6.2f %7.2f  %s"), Function.SelfSamples * 100.0 / TotalSamples, Function.TotalSamples * 100.0 / TotalSamples, *Function.Name);
+	}
+
+	Order.Reset();
+	for (int32 i = 0; i < Lines.Num(); ++i)
+	{
+		Order.Add(i);
+	}
+	Order.Sort([this](int32 A, int32 B) { return Lines[A].Samples > Lines[B].Samples; });
+
+	Ar.Logf(TEXT("LuaProfiler|   self%%  line"));
+	for (int32 i = 0; i < Order.Num() && i < InNum; ++i)
+	{
+		const FLineInfo& Line = Lines[Order[i]];
+		Ar.Logf(TEXT("LuaProfiler| %6.2f  %s:%d in %s"), Line.Samples * 100.0 / TotalSamples, *Line.Source, Line.Line, *Functions[Line.FunctionId].Name);
+	}
+}
+
+FString FLuaProfiler::Export(const FString& InDir) const
+{
+	const FString BaseName = InDir / FString::Printf(TEXT("LuaProfile-%s"), *FDateTime::Now().ToString());
+	const double SampleWeightMs = 1000.0 / FMath::Max(Rate, 1);
+
+	//root;caller;callee count
+	FString Folded;
+	for (const FStackInfo& Stack : Stacks)
+	{
+		for (int32 i = Stack.Frames.Num() - 1; i >= 0; --i)
+		{
+			Folded += Functions[Stack.Frames[i]].Name;
+			Folded.AppendChar(i > 0 ? TEXT(';') : TEXT(' '));
+		}
+
+		Folded += FString::Printf(TEXT("%d\n"), Stack.Samples);
+	}
+
+	//https://www.speedscope.app/file-format-schema.json, one sampled profile, a sample per stack weighted by its time
+	FString Speedscope = TEXT("{\"$schema\":\"https://www.speedscope.app/file-format-schema.json\",\"exporter\":\"FastLuaScript\",\"activeProfileIndex\":0,\"shared\":{\"frames\":[");
+	for (int32 i = 0; i < Functions.Num(); ++i)
+	{
+		const FFunctionInfo& Function = Functions[i];
+		Speedscope += FString::Printf(TEXT("%s{\"name\":\"%s\",\"file\":\"%s\",\"line\":%d}"), i > 0 ? TEXT(",") : TEXT(""),
+			*LuaProfiler::EscapeJson(Function.Name), *LuaProfiler::EscapeJson(Function.Source), Function.Line);
+	}
+
+	Speedscope += FString::Printf(TEXT("]},\"profiles\":[{\"type\":\"sampled\",\"name\":\"Lua\",\"unit\":\"milliseconds\",\"startValue\":0,\"endValue\":%.3f,\"samples\":["), SampleNum * SampleWeightMs);
+	for (int32 i = 0; i < Stacks.Num(); ++i)
+	{
+		const FStackInfo& Stack = Stacks[i];
+		Speedscope += i > 0 ? TEXT(",[") : TEXT("[");
+		for (int32 j = Stack.Frames.Num() - 1; j >= 0; --j)
+		{
+			Speedscope += FString::Printf(TEXT("%d%s"), Stack.Frames[j], j > 0 ? TEXT(",") : TEXT(""));
+		}
+		Speedscope += TEXT("]");
+	}
+
+	Speedscope += TEXT("],\"weights\":[");
+	for (int32 i = 0; i < Stacks.Num(); ++i)
+	{
+		Speedscope += FString::Printf(TEXT("%s%.3f"), i > 0 ? TEXT(",") : TEXT(""), Stacks[i].Samples * SampleWeightMs);
+	}
+	Speedscope += TEXT("]}]}");
+
+	const FString FoldedFile = BaseName + TEXT(".folded");
+	if (!FFileHelper::SaveStringToFile(Folded, *FoldedFile, FFileHelper::EEncodingOptions::ForceUTF8WithoutBOM)
+		|| !FFileHelper::SaveStringToFile(Speedscope, *(BaseName + TEXT(".speedscope.json")), FFileHelper::EEncodingOptions::ForceUTF8WithoutBOM))
+	{
+		UE_LOG(LogFastLuaScript, Warning, TEXT("LuaProfiler|can not write %s"), *BaseName);
+	}
+
+	return FoldedFile;
+}
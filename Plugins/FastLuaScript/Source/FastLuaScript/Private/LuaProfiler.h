@@ -0,0 +1,135 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Templates/Atomic.h"
+
+struct lua_State;
+struct lua_Debug;
+class FOutputDevice;
+class FRunnableThread;
+
+/**
+ * sampling profiler of the game states, console: lua.profile start [Hz], lua.profile stop, lua.profile summary
+ * a ticker thread requests a sample every interval, it never touches a lua state: the game thread sets a count hook on the main threads
+ * while running(every lua.Profile.HookInstructions instructions), the hook takes the lua call stack when a request is pending
+ * samples are aggregated by stack, function and source:line, stop writes Saved/Profiling/Lua/LuaProfile-<time>.folded(flamegraph.pl)
+ * and .speedscope.json(speedscope.app) and logs the summary
+ * no thread and no hook when not running, the hook makes lua slower only while running
+ * samples taken more than two intervals after the request are dropped(the state was idle or in a long C call)
+ * time in coroutines lands on the resume call, background tasks are sampled by their own hook
+ */
+class FLuaProfiler
+{
+public:
+
+	static FLuaProfiler& Get();
+
+	void Start(int32 InRate);
+
+	//write the files and log the summary
+	void Stop();
+
+	bool IsRunning() const
+	{
+		return bRunning;
+	}
+
+	//sample InL too, for states made while running
+	void AttachState(lua_State* InL);
+
+	//before lua_close
+	void DetachState(lua_State* InL);
+
+	//take the requested sample, from count hooks owned by others too, game thread
+	void CountHook(lua_State* InL)
+	{
+		if (bRunning && RequestCycles.Load(EMemoryOrder::Relaxed) != 0)
+		{
+			TakeRequestedSample(InL);
+		}
+	}
+
+	void DumpSummary(FOutputDevice& Ar, int32 InNum) const;
+
+	//Folded and Speedscope files in InDir, return the folded one
+	FString Export(const FString& InDir) const;
+
+protected:
+
+	FLuaProfiler() = default;
+
+	class FSampleTicker;
+
+	static void SampleHook(lua_State* InL, lua_Debug* InDebug);
+
+	//ticker thread
+	void RequestSample();
+
+	void TakeRequestedSample(lua_State* InL);
+
+	void Sample(lua_State* InL, uint64 InNowCycles);
+
+	int32 FindOrAddFunction(const lua_Debug& InDebug);
+	void AddLine(const lua_Debug& InDebug, int32 InFunctionId);
+
+	struct FFunctionInfo
+	{
+		//"Update (AI/PathCost.lua:12)"
+		FString Name;
+		FString Source;
+		int32 Line = 0;
+
+		int32 SelfSamples = 0;
+		int32 TotalSamples = 0;
+	};
+
+	struct FLineInfo
+	{
+		FString Source;
+		int32 Line = 0;
+		int32 FunctionId = 0;
+		int32 Samples = 0;
+	};
+
+	struct FStackInfo
+	{
+		//leaf first
+		TArray<int32> Frames;
+		int32 Samples = 0;
+	};
+
+	bool bRunning = false;
+
+	FSampleTicker* Ticker = nullptr;
+	FRunnableThread* TickerThread = nullptr;
+
+	//main threads with the hook, game thread
+	TArray<lua_State*> States;
+
+	//cycles of the pending request, 0 for none, the only member shared with the ticker
+	TAtomic<uint64> RequestCycles{ 0 };
+
+	uint64 IntervalCycles = 0;
+
+	uint64 StartCycles = 0;
+	uint64 StopCycles = 0;
+	uint64 SampleCycles = 0;
+
+	int32 Rate = 0;
+	int32 SampleNum = 0;
+	int32 LateNum = 0;
+
+	TMap<uint64, int32> FunctionIds;
+	TArray<FFunctionInfo> Functions;
+
+	TMap<uint64, int32> LineIds;
+	TArray<FLineInfo> Lines;
+
+	TMap<uint64, int32> StackIds;
+	TArray<FStackInfo> Stacks;
+
+	//frames of the sample being taken
+	TArray<int32> ScratchFrames;
+};
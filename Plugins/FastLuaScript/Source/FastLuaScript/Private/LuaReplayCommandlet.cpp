@@ -0,0 +1,694 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "LuaReplayCommandlet.h"
+#include "Misc/FileHelper.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/ArchiveUObject.h"
+#include "UObject/StructOnScope.h"
+#include "UObject/UObjectGlobals.h"
+#include "Engine/Engine.h"
+#include "Engine/World.h"
+#include "GameFramework/Actor.h"
+#include "Components/ActorComponent.h"
+
+#include "FastLuaScript.h"
+#include "FastLuaUnrealWrapper.h"
+#include "FastLuaHelper.h"
+#include "LuaObjectWrapper.h"
+#include "LuaStructWrapper.h"
+#include "LuaFunctionWrapper.h"
+#include "LuaSessionRecorder.h"
+
+#include "lua.hpp"
+
+
+namespace LuaReplayCommandlet
+{
+	typedef LuaSessionFormat::ELuaRecordEvent ELuaRecordEvent;
+
+	static const TCHAR* GetEventName(int32 InEvent)
+	{
+		switch ((ELuaRecordEvent)InEvent)
+		{
+		case ELuaRecordEvent::Call: return TEXT("Call");
+		case ELuaRecordEvent::GetProperty: return TEXT("GetProperty");
+		case ELuaRecordEvent::SetProperty: return TEXT("SetProperty");
+		case ELuaRecordEvent::GetStructProperty: return TEXT("GetStructProperty");
+		case ELuaRecordEvent::SetStructProperty: return TEXT("SetStructProperty");
+		case ELuaRecordEvent::DelegateToLua: return TEXT("DelegateToLua");
+		default: return nullptr;
+		}
+	}
+
+	//object and name ids of the file back to objects and names
+	class FValueReader : public FMemoryReader
+	{
+	public:
+
+		FValueReader(const TArray<uint8>& InBytes, const TArray<UObject*>& InObjects, const TArray<FString>& InNames)
+			: FMemoryReader(InBytes)
+			, Objects(InObjects)
+			, Names(InNames)
+		{
+
+		}
+
+		using FMemoryReader::operator<<;
+
+		virtual FArchive& operator<<(UObject*& Obj) override
+		{
+			uint32 Id = 0;
+			SerializeIntPacked(Id);
+			Obj = Objects.IsValidIndex(Id) ? Objects[Id] : nullptr;
+			return *this;
+		}
+
+		virtual FArchive& operator<<(FName& Name) override
+		{
+			uint32 Id = 0;
+			SerializeIntPacked(Id);
+			Name = Names.IsValidIndex(Id) ? FName(*Names[Id]) : NAME_None;
+			return *this;
+		}
+
+		virtual FArchive& operator<<(FLazyObjectPtr& Value) override
+		{
+			return FArchiveUObject::SerializeLazyObjectPtr(*this, Value);
+		}
+
+		virtual FArchive& operator<<(FSoftObjectPtr& Value) override
+		{
+			return FArchiveUObject::SerializeSoftObjectPtr(*this, Value);
+		}
+
+		virtual FArchive& operator<<(FSoftObjectPath& Value) override
+		{
+			return FArchiveUObject::SerializeSoftObjectPath(*this, Value);
+		}
+
+		virtual FArchive& operator<<(FWeakObjectPtr& Value) override
+		{
+			return FArchiveUObject::SerializeWeakObjectPtr(*this, Value);
+		}
+
+		virtual FString GetArchiveName() const override
+		{
+			return TEXT("LuaReplay");
+		}
+
+	protected:
+
+		const TArray<UObject*>& Objects;
+		const TArray<FString>& Names;
+	};
+
+	struct FEventStats
+	{
+		int64 Num = 0;
+		int64 Skipped = 0;
+		uint64 Cycles = 0;
+	};
+
+	//a struct type of the struct property events, one value for all of them
+	struct FStructTarget
+	{
+		TSharedPtr<FStructOnScope> Value;
+		int32 LuaRef = LUA_NOREF;
+	};
+
+	class FSessionReplay
+	{
+	public:
+
+		FSessionReplay(const TArray<uint8>& InData, lua_State* InL, UWorld* InWorld, const TArray<FString>& InSkipFunctions)
+			: Reader(InData, Objects, Names)
+			, L(InL)
+			, World(InWorld)
+			, SkipFunctions(InSkipFunctions)
+		{
+			//id 0 is none
+			Objects.Add(nullptr);
+			ObjectRefs.Add(LUA_NOREF);
+			Names.AddDefaulted();
+		}
+
+		~FSessionReplay()
+		{
+			for (UObject* StandIn : StandIns)
+			{
+				StandIn->RemoveFromRoot();
+			}
+		}
+
+		bool ReadHeader()
+		{
+			uint32 Magic = 0;
+			uint32 Version = 0;
+			Reader << Magic << Version;
+			HeaderSize = Reader.Tell();
+			return !Reader.IsError() && Magic == LuaSessionFormat::Magic && Version == LuaSessionFormat::Version;
+		}
+
+		//false if the file is broken, a file cut in the middle of an event(crash) is replayed up to the cut once, see IsTruncated
+		bool Run()
+		{
+			Reader.Seek(HeaderSize);
+			while (!Reader.AtEnd() && !Reader.IsError())
+			{
+				uint8 Event = 0;
+				Reader << Event;
+
+				uint32 Id = 0;
+				uint32 NameId = 0;
+				switch ((ELuaRecordEvent)Event)
+				{
+				case ELuaRecordEvent::Name:
+				{
+					FString Name;
+					Reader.SerializeIntPacked(Id);
+					Reader << Name;
+					if (!IsValidNewId(Id, Names.Num()))
+					{
+						UE_LOG(LogFastLuaScript, Error, TEXT("LuaReplay|name id %u at %lld is out of the file"), Id, Reader.Tell());
+						return false;
+					}
+					if ((int32)Id >= Names.Num())
+					{
+						Names.SetNum(Id + 1);
+					}
+					Names[Id] = Name;
+					break;
+				}
+				case ELuaRecordEvent::Object:
+				{
+					uint32 ClassId = 0;
+					Reader.SerializeIntPacked(Id);
+					Reader.SerializeIntPacked(ClassId);
+					Reader.SerializeIntPacked(NameId);
+					if (!IsValidNewId(Id, Objects.Num()))
+					{
+						UE_LOG(LogFastLuaScript, Error, TEXT("LuaReplay|object id %u at %lld is out of the file"), Id, Reader.Tell());
+						return false;
+					}
+					//defined again by the next loops
+					if ((int32)Id >= Objects.Num())
+					{
+						AddObject(Id, GetName(ClassId), GetName(NameId));
+					}
+					break;
+				}
+				case ELuaRecordEvent::Frame:
+				{
+					float DeltaTime = 0.f;
+					Reader << DeltaTime;
+					EndFrame();
+					break;
+				}
+				case ELuaRecordEvent::Call:
+				case ELuaRecordEvent::GetProperty:
+				case ELuaRecordEvent::SetProperty:
+				case ELuaRecordEvent::GetStructProperty:
+				case ELuaRecordEvent::SetStructProperty:
+				case ELuaRecordEvent::DelegateToLua:
+				{
+					Reader.SerializeIntPacked(Id);
+					Reader.SerializeIntPacked(NameId);
+
+					//gets have no value
+					uint32 ValueSize = 0;
+					if ((ELuaRecordEvent)Event != ELuaRecordEvent::GetProperty && (ELuaRecordEvent)Event != ELuaRecordEvent::GetStructProperty)
+					{
+						Reader.SerializeIntPacked(ValueSize);
+					}
+					const int64 ValueEnd = Reader.Tell() + ValueSize;
+
+					int32 tp = lua_gettop(L);
+					Replay((ELuaRecordEvent)Event, Id, NameId);
+					lua_settop(L, tp);
+
+					Reader.Seek(ValueEnd);
+					break;
+				}
+				default:
+					UE_LOG(LogFastLuaScript, Error, TEXT("LuaReplay|unknown event %d at %lld"), Event, Reader.Tell() - 1);
+					return false;
+				}
+			}
+
+			EndFrame();
+
+			//a session stopped by a crash ends in the middle of an event
+			if (Reader.IsError())
+			{
+				UE_LOG(LogFastLuaScript, Warning, TEXT("LuaReplay|the file ends in the middle of an event"));
+			}
+
+			return true;
+		}
+
+		//the reader error stays set, the next loops would replay nothing
+		bool IsTruncated() const
+		{
+			return Reader.IsError();
+		}
+
+		void Report(const FString& InCsvFile)
+		{
+			const double CycleMs = FPlatformTime::GetSecondsPerCycle64() * 1000.0;
+
+			FrameMs.Sort();
+			const double MedianMs = FrameMs.Num() > 0 ? FrameMs[FrameMs.Num() / 2] : 0.0;
+			const double P95Ms = FrameMs.Num() > 0 ? FrameMs[FrameMs.Num() * 95 / 100] : 0.0;
+			const double MaxMs = FrameMs.Num() > 0 ? FrameMs.Last() : 0.0;
+			UE_LOG(LogFastLuaScript, Display, TEXT("LuaReplay|%d frames, binding time per frame: median %.3f ms, p95 %.3f ms, max %.3f ms, %d lua errors"),
+				FrameMs.Num(), MedianMs, P95Ms, MaxMs, ErrorNum);
+
+			FString Csv = TEXT("event,num,skipped,total_ms,avg_ns\n");
+			for (int32 i = 0; i < (int32)ELuaRecordEvent::Max; ++i)
+			{
+				const TCHAR* EventName = GetEventName(i);
+				const FEventStats& EventStats = Stats[i];
+				if (EventName == nullptr || EventStats.Num + EventStats.Skipped == 0)
+				{
+					continue;
+				}
+
+				const double TotalMs = EventStats.Cycles * CycleMs;
+				const double AvgNs = EventStats.Num > 0 ? TotalMs * 1000000.0 / EventStats.Num : 0.0;
+				UE_LOG(LogFastLuaScript, Display, TEXT("LuaReplay|%-18s x%lld(%lld skipped) %.2f ms, %.0f ns each"), EventName, EventStats.Num, EventStats.Skipped, TotalMs, AvgNs);
+				Csv += FString::Printf(TEXT("%s,%lld,%lld,%.3f,%.1f\n"), EventName, EventStats.Num, EventStats.Skipped, TotalMs, AvgNs);
+			}
+			Csv += FString::Printf(TEXT("FrameMedian,%d,0,%.3f,0\nFrameP95,%d,0,%.3f,0\nFrameMax,%d,0,%.3f,0\n"), FrameMs.Num(), MedianMs, FrameMs.Num(), P95Ms, FrameMs.Num(), MaxMs);
+
+			if (!InCsvFile.IsEmpty())
+			{
+				FFileHelper::SaveStringToFile(Csv, *InCsvFile);
+				UE_LOG(LogFastLuaScript, Display, TEXT("LuaReplay|results in %s"), *InCsvFile);
+			}
+		}
+
+	protected:
+
+		//ids are given in order, each definition takes a byte at least: an id past the rest of the file is garbage
+		bool IsValidNewId(uint32 InId, int32 InNum) const
+		{
+			return InId > 0 && (int64)InId <= (int64)InNum + FMath::Max<int64>(Reader.TotalSize() - Reader.Tell(), 0);
+		}
+
+		const FString& GetName(uint32 InId) const
+		{
+			return Names.IsValidIndex(InId) ? Names[InId] : Names[0];
+		}
+
+		UObject* GetObject(uint32 InId) const
+		{
+			return Objects.IsValidIndex(InId) ? Objects[InId] : nullptr;
+		}
+
+		void AddObject(uint32 InId, const FString& InClassPath, const FString& InPath)
+		{
+			Objects.SetNum(InId + 1);
+			ObjectRefs.SetNum(InId + 1);
+
+			UObject* Obj = MakeStandIn(InClassPath, InPath);
+			Objects[InId] = Obj;
+			ObjectRefs[InId] = LUA_NOREF;
+			if (Obj)
+			{
+				//the scripts keep the objects they use in lua too
+				FLuaObjectWrapper::PushObject(L, Obj);
+				ObjectRefs[InId] = luaL_ref(L, LUA_REGISTRYINDEX);
+			}
+			else
+			{
+				Warn(FString::Printf(TEXT("no stand-in for %s(%s)"), *InPath, *InClassPath));
+			}
+		}
+
+		UObject* MakeStandIn(const FString& InClassPath, const FString& InPath)
+		{
+			//classes, CDOs and loaded assets are the real ones
+			if (UObject* Found = StaticFindObject(UObject::StaticClass(), nullptr, *InPath))
+			{
+				return Found;
+			}
+
+			UClass* Class = LoadObject<UClass>(nullptr, *InClassPath, nullptr, LOAD_NoWarn | LOAD_Quiet);
+			if (Class == nullptr || Class->HasAnyClassFlags(CLASS_Abstract | CLASS_Deprecated | CLASS_NewerVersionExists))
+			{
+				return nullptr;
+			}
+
+			const bool bActor = Class->IsChildOf(AActor::StaticClass());
+			const bool bWorldObject = bActor || Class->IsChildOf(UActorComponent::StaticClass()) || InPath.StartsWith(TEXT("/Engine/Transient")) || InPath.Contains(TEXT(":PersistentLevel."));
+			if (!bWorldObject)
+			{
+				if (UObject* Asset = StaticLoadObject(Class, nullptr, *InPath, nullptr, LOAD_NoWarn | LOAD_Quiet))
+				{
+					return Asset;
+				}
+			}
+
+			UObject* StandIn = nullptr;
+			if (bActor)
+			{
+				FActorSpawnParameters SpawnParams;
+				SpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+				SpawnParams.ObjectFlags = RF_Transient;
+				StandIn = World->SpawnActor(Class, nullptr, nullptr, SpawnParams);
+			}
+			else
+			{
+				StandIn = NewObject<UObject>(World, Class, NAME_None, RF_Transient);
+			}
+
+			if (StandIn)
+			{
+				StandIn->AddToRoot();
+				StandIns.Add(StandIn);
+			}
+
+			return StandIn;
+		}
+
+		void Replay(ELuaRecordEvent InEvent, uint32 InId, uint32 InNameId)
+		{
+			FEventStats& EventStats = Stats[(int32)InEvent];
+			const FString& Name = GetName(InNameId);
+
+			if (InEvent == ELuaRecordEvent::Call)
+			{
+				UObject* Obj = GetObject(InId);
+				UFunction* Function = Obj ? Obj->FindFunction(FName(*Name)) : nullptr;
+				if (Function == nullptr || SkipFunctions.Contains(Name))
+				{
+					Skip(EventStats, Obj ? FString::Printf(TEXT("%s::%s"), *Obj->GetClass()->GetName(), *Name) : Name);
+					return;
+				}
+
+				FStructOnScope Params(Function);
+				Function->SerializeBin(Reader, Params.GetStructMemory());
+
+				//Obj:Function(params...)
+				lua_rawgeti(L, LUA_REGISTRYINDEX, ObjectRefs[InId]);
+				lua_getfield(L, -1, TCHAR_TO_UTF8(*Name));
+				lua_pushvalue(L, -2);
+				int32 ArgNum = 1;
+				for (TFieldIterator<FProperty> It(Function); It && It->HasAnyPropertyFlags(CPF_Parm); ++It)
+				{
+					if (!It->HasAnyPropertyFlags(CPF_ReturnParm))
+					{
+						FastLuaHelper::PushProperty(L, *It, Params.GetStructMemory());
+						++ArgNum;
+					}
+				}
+
+				Call(EventStats, ArgNum);
+			}
+			else if (InEvent == ELuaRecordEvent::GetProperty || InEvent == ELuaRecordEvent::SetProperty)
+			{
+				UObject* Obj = GetObject(InId);
+				FProperty* Prop = Obj ? FindFProperty<FProperty>(Obj->GetClass(), FName(*Name)) : nullptr;
+				if (Prop == nullptr)
+				{
+					Skip(EventStats, Obj ? FString::Printf(TEXT("%s.%s"), *Obj->GetClass()->GetName(), *Name) : Name);
+					return;
+				}
+
+				const bool bSet = InEvent == ELuaRecordEvent::SetProperty;
+				if (bSet)
+				{
+					//the recorded value goes through the stand-in
+					LuaSessionFormat::SerializeProperty(Reader, Prop, Obj);
+				}
+
+				lua_rawgeti(L, LUA_REGISTRYINDEX, ObjectRefs[InId]);
+				lua_getfield(L, -1, TCHAR_TO_UTF8(*((bSet ? TEXT("Set") : TEXT("Get")) + Name)));
+				lua_pushvalue(L, -2);
+				if (bSet)
+				{
+					FastLuaHelper::PushProperty(L, Prop, Obj);
+				}
+
+				Call(EventStats, bSet ? 2 : 1);
+			}
+			else if (InEvent == ELuaRecordEvent::GetStructProperty || InEvent == ELuaRecordEvent::SetStructProperty)
+			{
+				const FStructTarget& Target = GetStructTarget(InId);
+				const UStruct* Struct = Target.Value.IsValid() ? Target.Value->GetStruct() : nullptr;
+				FProperty* Prop = Struct ? FindFProperty<FProperty>(Struct, FName(*Name)) : nullptr;
+				if (Prop == nullptr)
+				{
+					Skip(EventStats, FString::Printf(TEXT("%s.%s"), *GetName(InId), *Name));
+					return;
+				}
+
+				const bool bSet = InEvent == ELuaRecordEvent::SetStructProperty;
+				if (bSet)
+				{
+					LuaSessionFormat::SerializeProperty(Reader, Prop, Target.Value->GetStructMemory());
+				}
+
+				lua_rawgeti(L, LUA_REGISTRYINDEX, Target.LuaRef);
+				lua_getfield(L, -1, TCHAR_TO_UTF8(*((bSet ? TEXT("Set") : TEXT("Get")) + Name)));
+				lua_pushvalue(L, -2);
+				if (bSet)
+				{
+					FastLuaHelper::PushProperty(L, Prop, Target.Value->GetStructMemory());
+				}
+
+				Call(EventStats, bSet ? 2 : 1);
+			}
+			else if (InEvent == ELuaRecordEvent::DelegateToLua)
+			{
+				ULuaFunctionWrapper* Target = GetDelegateTarget(InId);
+				const UFunction* Signature = Target ? Target->GetUFunction() : nullptr;
+				if (Signature == nullptr)
+				{
+					Skip(EventStats, GetName(InId));
+					return;
+				}
+
+				FStructOnScope Params(Signature);
+				Signature->SerializeBin(Reader, Params.GetStructMemory());
+
+				//the same path as a fire: params pushed by the wrapper, then the lua call
+				const uint64 StartCycles = FPlatformTime::Cycles64();
+				((UObject*)Target)->ProcessEvent((UFunction*)Signature, Params.GetStructMemory());
+				AddCycles(EventStats, FPlatformTime::Cycles64() - StartCycles);
+			}
+		}
+
+		//the lua function and its InArgNum args are on the top
+		void Call(FEventStats& InStats, int32 InArgNum)
+		{
+			const uint64 StartCycles = FPlatformTime::Cycles64();
+			const int32 CallRet = lua_pcall(L, InArgNum, LUA_MULTRET, 0);
+			AddCycles(InStats, FPlatformTime::Cycles64() - StartCycles);
+
+			if (CallRet != LUA_OK)
+			{
+				++ErrorNum;
+				Warn(UTF8_TO_TCHAR(lua_tostring(L, -1)));
+			}
+		}
+
+		void AddCycles(FEventStats& InStats, uint64 InCycles)
+		{
+			InStats.Num++;
+			InStats.Cycles += InCycles;
+			FrameCycles += InCycles;
+			bFrameEvents = true;
+		}
+
+		void EndFrame()
+		{
+			if (bFrameEvents)
+			{
+				FrameMs.Add(FrameCycles * FPlatformTime::GetSecondsPerCycle64() * 1000.0);
+			}
+
+			FrameCycles = 0;
+			bFrameEvents = false;
+		}
+
+		const FStructTarget& GetStructTarget(uint32 InStructId)
+		{
+			if (const FStructTarget* Found = StructTargets.Find(InStructId))
+			{
+				return *Found;
+			}
+
+			FStructTarget& Target = StructTargets.Add(InStructId);
+			UScriptStruct* Struct = LoadObject<UScriptStruct>(nullptr, *GetName(InStructId), nullptr, LOAD_NoWarn | LOAD_Quiet);
+			if (Struct)
+			{
+				Target.Value = MakeShared<FStructOnScope>(Struct);
+				FLuaStructWrapper::PushStruct(L, Struct, Target.Value->GetStructMemory());
+				Target.LuaRef = luaL_ref(L, LUA_REGISTRYINDEX);
+			}
+
+			return Target;
+		}
+
+		//a wrapper of an empty lua function per signature, released with the state
+		ULuaFunctionWrapper* GetDelegateTarget(uint32 InSignatureId)
+		{
+			if (ULuaFunctionWrapper** Found = DelegateTargets.Find(InSignatureId))
+			{
+				return *Found;
+			}
+
+			ULuaFunctionWrapper*& Target = DelegateTargets.Add(InSignatureId, nullptr);
+			UFunction* Signature = LoadObject<UFunction>(nullptr, *GetName(InSignatureId), nullptr, LOAD_NoWarn | LOAD_Quiet);
+			if (Signature == nullptr)
+			{
+				return nullptr;
+			}
+
+			int32 tp = lua_gettop(L);
+			if (luaL_loadstring(L, "return function() end") == LUA_OK && lua_pcall(L, 0, 1, 0) == LUA_OK)
+			{
+				Target = NewObject<ULuaFunctionWrapper>();
+				Target->AddToRoot();
+				Target->BindLuaFunction(L, lua_gettop(L));
+				Target->SetUFunction(Signature);
+			}
+			lua_settop(L, tp);
+
+			return Target;
+		}
+
+		void Skip(FEventStats& InStats, const FString& InWhat)
+		{
+			++InStats.Skipped;
+			Warn(FString::Printf(TEXT("skipped %s"), *InWhat));
+		}
+
+		//once per message
+		void Warn(const FString& InMessage)
+		{
+			bool bWarned = false;
+			Warned.Add(InMessage, &bWarned);
+			if (!bWarned)
+			{
+				UE_LOG(LogFastLuaScript, Warning, TEXT("LuaReplay|%s"), *InMessage);
+			}
+		}
+
+		TArray<FString> Names;
+		TArray<UObject*> Objects;
+		TArray<int32> ObjectRefs;
+
+		//after the tables it reads into
+		FValueReader Reader;
+		int64 HeaderSize = 0;
+
+		lua_State* L = nullptr;
+		UWorld* World = nullptr;
+		TArray<FString> SkipFunctions;
+
+		//rooted until the end of the replay
+		TArray<UObject*> StandIns;
+
+		TMap<uint32, FStructTarget> StructTargets;
+		TMap<uint32, ULuaFunctionWrapper*> DelegateTargets;
+
+		FEventStats Stats[(int32)ELuaRecordEvent::Max];
+		TArray<double> FrameMs;
+		uint64 FrameCycles = 0;
+		bool bFrameEvents = false;
+
+		int32 ErrorNum = 0;
+		TSet<FString> Warned;
+	};
+}
+
+ULuaReplayCommandlet::ULuaReplayCommandlet()
+{
+	IsClient = false;
+	IsEditor = false;
+	IsServer = false;
+	LogToConsole = true;
+}
+
+int32 ULuaReplayCommandlet::Main(const FString& Params)
+{
+	FString InputFile;
+	if (!FParse::Value(*Params, TEXT("File="), InputFile))
+	{
+		UE_LOG(LogFastLuaScript, Error, TEXT("LuaReplay|-run=LuaReplay -File=Session.luarec [-Loops=N] [-Csv=File] [-Skip=Func1,Func2]"));
+		return 1;
+	}
+
+	int32 Loops = 1;
+	FParse::Value(*Params, TEXT("Loops="), Loops);
+
+	FString CsvFile;
+	FParse::Value(*Params, TEXT("Csv="), CsvFile);
+
+	FString SkipText;
+	TArray<FString> SkipFunctions;
+	if (FParse::Value(*Params, TEXT("Skip="), SkipText, false))
+	{
+		SkipText.ParseIntoArray(SkipFunctions, TEXT(","));
+	}
+
+	TArray<uint8> Data;
+	if (!FFileHelper::LoadFileToArray(Data, *InputFile))
+	{
+		UE_LOG(LogFastLuaScript, Error, TEXT("LuaReplay|can not read %s"), *InputFile);
+		return 1;
+	}
+
+	TSharedPtr<FastLuaUnrealWrapper> Wrapper = FastLuaUnrealWrapper::GetDefault();
+	lua_State* L = Wrapper.IsValid() ? Wrapper->GetLuaState() : nullptr;
+	if (L == nullptr)
+	{
+		UE_LOG(LogFastLuaScript, Error, TEXT("LuaReplay|no lua state"));
+		return 1;
+	}
+
+	//the stand-ins of the recorded actors live here
+	UWorld* World = UWorld::CreateWorld(EWorldType::Game, false, TEXT("LuaReplayWorld"));
+	FWorldContext& WorldContext = GEngine->CreateNewWorldContext(EWorldType::Game);
+	WorldContext.SetCurrentWorld(World);
+
+	int32 Ret = 0;
+	{
+		LuaReplayCommandlet::FSessionReplay Replay(Data, L, World, SkipFunctions);
+		if (!Replay.ReadHeader())
+		{
+			UE_LOG(LogFastLuaScript, Error, TEXT("LuaReplay|%s is not a lua session of version %u"), *InputFile, LuaSessionFormat::Version);
+			Ret = 1;
+		}
+		else
+		{
+			const double StartTime = FPlatformTime::Seconds();
+			int32 LoopNum = 0;
+			while (LoopNum < Loops && Ret == 0)
+			{
+				Ret = Replay.Run() ? 0 : 1;
+				++LoopNum;
+
+				if (Replay.IsTruncated() && LoopNum < Loops)
+				{
+					UE_LOG(LogFastLuaScript, Warning, TEXT("LuaReplay|a truncated file is replayed once, %d loops left out"), Loops - LoopNum);
+					break;
+				}
+			}
+
+			UE_LOG(LogFastLuaScript, Display, TEXT("LuaReplay|%s x%d in %.2f s"), *InputFile, LoopNum, FPlatformTime::Seconds() - StartTime);
+			Replay.Report(CsvFile);
+		}
+	}
+
+	//the delegate targets and the pushed stand-ins go with the state
+	FastLuaUnrealWrapper::ReleaseAllInstances();
+
+	GEngine->DestroyWorldContext(World);
+	World->DestroyWorld(false);
+
+	return Ret;
+}
@@ -0,0 +1,26 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "LuaReplayCommandlet.generated.h"
+
+/**
+ * replay a session recorded by lua.record headless, for performance regression runs on production traffic
+ *	UE4Editor-Cmd.exe Project.uproject -run=LuaReplay -File=Session.luarec [-Loops=N] [-Csv=File] [-Skip=Func1,Func2]
+ * the recorded crossings go through the lua bindings again: UFunction calls and property gets/sets from lua,
+ * delegate fires into lua(with the recorded params, to an empty lua function: the scripts are not loaded)
+ * recorded actors and world objects are stand-ins of their class in a mock world, classes, CDOs and assets are the real ones
+ * logs the binding time per frame and per crossing kind, -Skip lists the functions not to call again(OpenLevel, QuitGame...)
+ */
+UCLASS()
+class ULuaReplayCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+public:
+
+	ULuaReplayCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+};
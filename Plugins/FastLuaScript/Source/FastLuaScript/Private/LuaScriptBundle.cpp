@@ -0,0 +1,256 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "LuaScriptBundle.h"
+#include "HAL/IConsoleManager.h"
+#include "HAL/PlatformFilemanager.h"
+#include "Async/MappedFileHandle.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Misc/ScopeLock.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
+
+#include "FastLuaScript.h"
+#include "LuaModuleIndex.h"
+
+#include "lua.hpp"
+
+
+static int32 GLuaBundle = WITH_EDITOR ? 0 : 1;
+static FAutoConsoleVariableRef CVarLuaBundle(
+	TEXT("lua.Bundle"),
+	GLuaBundle,
+	TEXT("Load the lua scripts from Content/LuaBundle/LuaScript.luab when it exists, 0 to load the script files"));
+
+namespace LuaScriptBundle
+{
+	//'LUBN'
+	static const uint32 FileMagic = 0x4E42554C;
+	static const uint32 FormatVersion = 1;
+
+	static const int64 HeaderSize = 32;
+	static const int64 DataAlignment = 16;
+
+	struct FHeader
+	{
+		uint32 Magic = FileMagic;
+		uint32 Version = FormatVersion;
+		uint32 LuaVersion = LUA_VERSION_NUM;
+		int32 ModuleNum = 0;
+		int64 IndexOffset = 0;
+		int64 IndexSize = 0;
+
+		friend FArchive& operator<<(FArchive& Ar, FHeader& InHeader)
+		{
+			return Ar << InHeader.Magic << InHeader.Version << InHeader.LuaVersion << InHeader.ModuleNum << InHeader.IndexOffset << InHeader.IndexSize;
+		}
+	};
+}
+
+
+FLuaScriptBundle& FLuaScriptBundle::Get()
+{
+	static FLuaScriptBundle Inst;
+	return Inst;
+}
+
+FString FLuaScriptBundle::GetDefaultFile()
+{
+	return FPaths::ProjectContentDir() / TEXT("LuaBundle/LuaScript.luab");
+}
+
+bool FLuaScriptBundle::Find(const FString& InModuleName, const uint8*& OutData, int32& OutSize, FString& OutChunkName)
+{
+	if (GLuaBundle == 0)
+	{
+		return false;
+	}
+
+	FScopeLock ScopeLock(&Lock);
+	if (!MountDefault())
+	{
+		return false;
+	}
+
+	const FEntry* Entry = Entries.Find(FLuaModuleIndex::ToModuleName(InModuleName));
+	if (Entry == nullptr)
+	{
+		return false;
+	}
+
+	OutData = BundleData + Entry->Offset;
+	OutSize = Entry->Size;
+	OutChunkName = Entry->ChunkName;
+	return true;
+}
+
+void FLuaScriptBundle::GetModuleNames(TArray<FString>& OutNames)
+{
+	OutNames.Reset();
+	if (GLuaBundle == 0)
+	{
+		return;
+	}
+
+	FScopeLock ScopeLock(&Lock);
+	if (MountDefault())
+	{
+		Entries.GetKeys(OutNames);
+	}
+}
+
+bool FLuaScriptBundle::IsMounted()
+{
+	FScopeLock ScopeLock(&Lock);
+	return BundleData != nullptr;
+}
+
+bool FLuaScriptBundle::MountDefault()
+{
+	if (!bMountTried)
+	{
+		bMountTried = true;
+		Mount(GetDefaultFile());
+	}
+
+	return BundleData != nullptr;
+}
+
+bool FLuaScriptBundle::Mount(const FString& InFile)
+{
+	IPlatformFile& PlatformFile = FPlatformFileManager::Get().GetPlatformFile();
+	if (!PlatformFile.FileExists(*InFile))
+	{
+		return false;
+	}
+
+	MappedFile.Reset(PlatformFile.OpenMapped(*InFile));
+	if (MappedFile.IsValid())
+	{
+		MappedRegion.Reset(MappedFile->MapRegion(0, MappedFile->GetFileSize()));
+	}
+
+	if (MappedRegion.IsValid())
+	{
+		BundleData = MappedRegion->GetMappedPtr();
+		BundleSize = MappedRegion->GetMappedSize();
+	}
+	else
+	{
+		//packed compressed or encrypted, one read at startup
+		MappedFile.Reset();
+		if (!FFileHelper::LoadFileToArray(FileData, *InFile))
+		{
+			return false;
+		}
+
+		BundleData = FileData.GetData();
+		BundleSize = FileData.Num();
+	}
+
+	LuaScriptBundle::FHeader Header;
+	bool bValid = BundleSize >= LuaScriptBundle::HeaderSize;
+	if (bValid)
+	{
+		TArray<uint8> HeaderData(BundleData, LuaScriptBundle::HeaderSize);
+		FMemoryReader HeaderReader(HeaderData);
+		HeaderReader << Header;
+
+		bValid = Header.Magic == LuaScriptBundle::FileMagic && Header.Version == LuaScriptBundle::FormatVersion &&
+			Header.IndexOffset >= LuaScriptBundle::HeaderSize && Header.IndexSize > 0 && Header.IndexOffset + Header.IndexSize <= BundleSize;
+	}
+
+	//bytecode of another lua build can not be loaded
+	if (bValid && Header.LuaVersion != LUA_VERSION_NUM)
+	{
+		UE_LOG(LogFastLuaScript, Error, TEXT("LuaScriptBundle|%s is made for lua %u, run the LuaBundle commandlet again"), *InFile, Header.LuaVersion);
+		bValid = false;
+	}
+
+	if (bValid)
+	{
+		//the reader fails on a short index instead of reading past it
+		TArray<uint8> IndexData(BundleData + Header.IndexOffset, (int32)Header.IndexSize);
+		FMemoryReader IndexReader(IndexData);
+		for (int32 i = 0; i < Header.ModuleNum && !IndexReader.IsError(); ++i)
+		{
+			FString Name;
+			FEntry Entry;
+			IndexReader << Name << Entry.ChunkName << Entry.Offset << Entry.Size;
+
+			if (Entry.Offset < LuaScriptBundle::HeaderSize || Entry.Size < 0 || Entry.Offset + Entry.Size > Header.IndexOffset)
+			{
+				bValid = false;
+				break;
+			}
+
+			Entries.Add(MoveTemp(Name), MoveTemp(Entry));
+		}
+
+		bValid = bValid && !IndexReader.IsError();
+	}
+
+	if (!bValid)
+	{
+		UE_LOG(LogFastLuaScript, Error, TEXT("LuaScriptBundle|%s is broken"), *InFile);
+		Unmount();
+		bMountTried = true;
+		return false;
+	}
+
+	UE_LOG(LogFastLuaScript, Log, TEXT("LuaScriptBundle|%s: %d modules, %s"), *InFile, Entries.Num(), MappedRegion.IsValid() ? TEXT("mapped") : TEXT("loaded"));
+	return true;
+}
+
+void FLuaScriptBundle::Unmount()
+{
+	FScopeLock ScopeLock(&Lock);
+
+	Entries.Reset();
+	BundleData = nullptr;
+	BundleSize = 0;
+
+	MappedRegion.Reset();
+	MappedFile.Reset();
+	FileData.Empty();
+
+	bMountTried = false;
+}
+
+bool FLuaScriptBundle::Write(const FString& InFile, const TArray<FModule>& InModules)
+{
+	TArray<uint8> Bundle;
+	FMemoryWriter Writer(Bundle);
+
+	LuaScriptBundle::FHeader Header;
+	Header.ModuleNum = InModules.Num();
+	Writer << Header;
+
+	TArray<int64> Offsets;
+	for (const FModule& Module : InModules)
+	{
+		Bundle.AddZeroed(Align(Bundle.Num(), LuaScriptBundle::DataAlignment) - Bundle.Num());
+		Offsets.Add(Bundle.Num());
+		Bundle.Append(Module.Data);
+	}
+
+	Header.IndexOffset = Align(Bundle.Num(), LuaScriptBundle::DataAlignment);
+	Bundle.AddZeroed(Header.IndexOffset - Bundle.Num());
+
+	Writer.Seek(Header.IndexOffset);
+	for (int32 i = 0; i < InModules.Num(); ++i)
+	{
+		FString Name = InModules[i].Name;
+		FString ChunkName = InModules[i].ChunkName;
+		int64 Offset = Offsets[i];
+		int32 Size = InModules[i].Data.Num();
+		Writer << Name << ChunkName << Offset << Size;
+	}
+
+	Header.IndexSize = Bundle.Num() - Header.IndexOffset;
+	Writer.Seek(0);
+	Writer << Header;
+
+	return FFileHelper::SaveArrayToFile(Bundle, *InFile);
+}
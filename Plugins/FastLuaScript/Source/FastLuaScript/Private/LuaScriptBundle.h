@@ -0,0 +1,71 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+class IMappedFileHandle;
+class IMappedFileRegion;
+
+/**
+ * all scripts in one file made by the LuaBundle commandlet, Content/LuaBundle/LuaScript.luab by default
+ *	header | module data(source or bytecode, 16 bytes aligned) | index(name, chunk name, offset, size)
+ * the file is memory mapped(read at once if the platform file can not map it) on first Find,
+ * require loads the chunks in place, no file system access after that
+ * used when lua.Bundle is 1, the default out of editor
+ */
+class FLuaScriptBundle
+{
+public:
+
+	struct FModule
+	{
+		FString Name;
+		FString ChunkName;
+		TArray<uint8> Data;
+	};
+
+	static FLuaScriptBundle& Get();
+
+	//the data of the module in the mapped bundle, valid until Unmount, any thread
+	bool Find(const FString& InModuleName, const uint8*& OutData, int32& OutSize, FString& OutChunkName);
+
+	void GetModuleNames(TArray<FString>& OutNames);
+
+	bool IsMounted();
+
+	void Unmount();
+
+	static FString GetDefaultFile();
+
+	static bool Write(const FString& InFile, const TArray<FModule>& InModules);
+
+protected:
+
+	struct FEntry
+	{
+		FString ChunkName;
+		int64 Offset = 0;
+		int32 Size = 0;
+	};
+
+	//mount the default file once, under Lock
+	bool MountDefault();
+
+	bool Mount(const FString& InFile);
+
+	FCriticalSection Lock;
+
+	bool bMountTried = false;
+
+	TUniquePtr<IMappedFileHandle> MappedFile;
+	TUniquePtr<IMappedFileRegion> MappedRegion;
+
+	//the file when it can not be mapped
+	TArray<uint8> FileData;
+
+	const uint8* BundleData = nullptr;
+	int64 BundleSize = 0;
+
+	TMap<FString, FEntry> Entries;
+};
@@ -0,0 +1,393 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "LuaSessionRecorder.h"
+#include "UObject/Class.h"
+#include "UObject/UnrealType.h"
+#include "Serialization/StructuredArchive.h"
+
+void LuaSessionFormat::SerializeProperty(FArchive& Ar, FProperty* InProperty, void* InContainer)
+{
+	FStructuredArchiveFromArchive Structured(Ar);
+	FStructuredArchive::FStream Stream = Structured.GetSlot().EnterStream();
+	for (int32 i = 0; i < InProperty->ArrayDim; ++i)
+	{
+		InProperty->SerializeItem(Stream.EnterElement(), InProperty->ContainerPtrToValuePtr<void>(InContainer, i), nullptr);
+	}
+}
+
+#if LUA_SESSION_RECORDER
+
+#include "HAL/IConsoleManager.h"
+#include "HAL/PlatformFilemanager.h"
+#include "Misc/Paths.h"
+#include "Serialization/MemoryWriter.h"
+#include "Serialization/ArchiveUObject.h"
+
+#include "FastLuaUnrealWrapper.h"
+#include "FastLuaScript.h"
+
+#include "lua.hpp"
+
+
+static FAutoConsoleCommand LuaRecordCommand(
+	TEXT("lua.record"),
+	TEXT("Record the lua <-> Unreal crossings of a lua state for -run=LuaReplay: lua.record start [File] | stop"),
+	FConsoleCommandWithArgsDelegate::CreateStatic([](const TArray<FString>& InArgs)
+	{
+		const FString Action = InArgs.Num() > 0 ? InArgs[0] : FString();
+		if (Action == TEXT("start"))
+		{
+			const FString File = InArgs.Num() > 1 ? InArgs[1] : FPaths::ProfilingDir() / TEXT("Lua") / FString::Printf(TEXT("LuaSession-%s.luarec"), *FDateTime::Now().ToString());
+			FLuaSessionRecorder::Get().Start(File);
+		}
+		else if (Action == TEXT("stop"))
+		{
+			FLuaSessionRecorder::Get().Stop();
+		}
+		else
+		{
+			UE_LOG(LogFastLuaScript, Display, TEXT("LuaSessionRecorder|lua.record start [File] | stop"));
+		}
+	}));
+
+namespace LuaSessionRecorder
+{
+	//flush the events to the file above this
+	static const int32 FlushBytes = 256 * 1024;
+
+	//object refs and names of a value as ids of the recorder
+	class FValueWriter : public FMemoryWriter
+	{
+	public:
+
+		FValueWriter(TArray<uint8>& InBytes, FLuaSessionRecorder& InRecorder)
+			: FMemoryWriter(InBytes)
+			, Recorder(InRecorder)
+		{
+
+		}
+
+		using FMemoryWriter::operator<<;
+
+		virtual FArchive& operator<<(UObject*& Obj) override
+		{
+			uint32 Id = Recorder.GetObjectId(Obj);
+			SerializeIntPacked(Id);
+			return *this;
+		}
+
+		virtual FArchive& operator<<(FName& Name) override
+		{
+			uint32 Id = Recorder.GetNameId(Name.ToString());
+			SerializeIntPacked(Id);
+			return *this;
+		}
+
+		virtual FArchive& operator<<(FLazyObjectPtr& Value) override
+		{
+			return FArchiveUObject::SerializeLazyObjectPtr(*this, Value);
+		}
+
+		virtual FArchive& operator<<(FSoftObjectPtr& Value) override
+		{
+			return FArchiveUObject::SerializeSoftObjectPtr(*this, Value);
+		}
+
+		virtual FArchive& operator<<(FSoftObjectPath& Value) override
+		{
+			return FArchiveUObject::SerializeSoftObjectPath(*this, Value);
+		}
+
+		virtual FArchive& operator<<(FWeakObjectPtr& Value) override
+		{
+			return FArchiveUObject::SerializeWeakObjectPtr(*this, Value);
+		}
+
+		virtual FString GetArchiveName() const override
+		{
+			return TEXT("LuaSessionRecorder");
+		}
+
+	protected:
+
+		FLuaSessionRecorder& Recorder;
+	};
+}
+
+bool FLuaSessionRecorder::bRecording = false;
+
+
+FLuaSessionRecorder& FLuaSessionRecorder::Get()
+{
+	static FLuaSessionRecorder Inst;
+	return Inst;
+}
+
+bool FLuaSessionRecorder::Start(const FString& InFile)
+{
+	Stop();
+
+	IPlatformFile& PlatformFile = FPlatformFileManager::Get().GetPlatformFile();
+	PlatformFile.CreateDirectoryTree(*FPaths::GetPath(InFile));
+	File.Reset(PlatformFile.OpenWrite(*InFile));
+	if (!File.IsValid())
+	{
+		UE_LOG(LogFastLuaScript, Error, TEXT("LuaSessionRecorder|can not write %s"), *InFile);
+		return false;
+	}
+
+	FileName = InFile;
+	RecordedWrapper = nullptr;
+	EventNum = 0;
+	FileSize = 0;
+
+	Buffer.Reset();
+	Writer = MakeUnique<FMemoryWriter>(Buffer);
+	ValueWriter = MakeUnique<LuaSessionRecorder::FValueWriter>(ValueBuffer, *this);
+
+	uint32 Magic = LuaSessionFormat::Magic;
+	uint32 Version = LuaSessionFormat::Version;
+	*Writer << Magic << Version;
+
+	bRecording = true;
+	UE_LOG(LogFastLuaScript, Display, TEXT("LuaSessionRecorder|recording to %s, the next ticking lua state"), *FileName);
+	return true;
+}
+
+void FLuaSessionRecorder::Stop()
+{
+	if (!bRecording)
+	{
+		return;
+	}
+
+	bRecording = false;
+	Flush();
+	File.Reset();
+
+	UE_LOG(LogFastLuaScript, Display, TEXT("LuaSessionRecorder|%lld events, %.1f KB, %d objects, %d names in %s"),
+		EventNum, FileSize / 1024.0, ObjectIds.Num(), NameIds.Num(), *FileName);
+
+	RecordedWrapper = nullptr;
+	Writer.Reset();
+	ValueWriter.Reset();
+	Buffer.Empty();
+	ValueBuffer.Empty();
+	NameIds.Empty();
+	ObjectIds.Empty();
+}
+
+uint32 FLuaSessionRecorder::GetNameId(const FString& InName)
+{
+	if (const uint32* Id = NameIds.Find(InName))
+	{
+		return *Id;
+	}
+
+	uint32 Id = NameIds.Num() + 1;
+	NameIds.Add(InName, Id);
+
+	FString Name = InName;
+	BeginEvent(LuaSessionFormat::ELuaRecordEvent::Name);
+	Writer->SerializeIntPacked(Id);
+	*Writer << Name;
+
+	return Id;
+}
+
+uint32 FLuaSessionRecorder::GetObjectId(UObject* InObj)
+{
+	if (InObj == nullptr)
+	{
+		return 0;
+	}
+
+	//the key has the serial number: a new object at the address of a dead one gets its own id
+	const FObjectKey Key(InObj);
+	if (const uint32* Id = ObjectIds.Find(Key))
+	{
+		return *Id;
+	}
+
+	uint32 ClassId = GetNameId(InObj->GetClass()->GetPathName());
+	uint32 PathId = GetNameId(InObj->GetPathName());
+
+	uint32 Id = ObjectIds.Num() + 1;
+	ObjectIds.Add(Key, Id);
+
+	BeginEvent(LuaSessionFormat::ELuaRecordEvent::Object);
+	Writer->SerializeIntPacked(Id);
+	Writer->SerializeIntPacked(ClassId);
+	Writer->SerializeIntPacked(PathId);
+
+	return Id;
+}
+
+void FLuaSessionRecorder::WriteFrame(FastLuaUnrealWrapper* InWrapper, float InDeltaTime)
+{
+	if (RecordedWrapper == nullptr)
+	{
+		RecordedWrapper = InWrapper;
+	}
+
+	if (InWrapper != RecordedWrapper)
+	{
+		return;
+	}
+
+	BeginEvent(LuaSessionFormat::ELuaRecordEvent::Frame);
+	*Writer << InDeltaTime;
+
+	//once per frame is enough
+	if (Buffer.Num() >= LuaSessionRecorder::FlushBytes)
+	{
+		Flush();
+	}
+}
+
+void FLuaSessionRecorder::WriteCall(lua_State* InL, UObject* InObj, UFunction* InFunction, void* InParams)
+{
+	if (!IsRecordedState(InL))
+	{
+		return;
+	}
+
+	//the definitions of the ids go before the event
+	uint32 ObjectId = GetObjectId(InObj);
+	uint32 FunctionId = GetNameId(InFunction->GetName());
+
+	ValueBuffer.Reset();
+	ValueWriter->Seek(0);
+	if (InParams)
+	{
+		InFunction->SerializeBin(*ValueWriter, InParams);
+	}
+
+	BeginEvent(LuaSessionFormat::ELuaRecordEvent::Call);
+	Writer->SerializeIntPacked(ObjectId);
+	Writer->SerializeIntPacked(FunctionId);
+	WriteValue();
+}
+
+void FLuaSessionRecorder::WriteProperty(lua_State* InL, UObject* InObj, FProperty* InProperty, bool bInSet)
+{
+	if (!IsRecordedState(InL))
+	{
+		return;
+	}
+
+	uint32 ObjectId = GetObjectId(InObj);
+	uint32 PropertyId = GetNameId(InProperty->GetName());
+
+	if (bInSet)
+	{
+		ValueBuffer.Reset();
+		ValueWriter->Seek(0);
+		LuaSessionFormat::SerializeProperty(*ValueWriter, InProperty, InObj);
+	}
+
+	BeginEvent(bInSet ? LuaSessionFormat::ELuaRecordEvent::SetProperty : LuaSessionFormat::ELuaRecordEvent::GetProperty);
+	Writer->SerializeIntPacked(ObjectId);
+	Writer->SerializeIntPacked(PropertyId);
+	if (bInSet)
+	{
+		WriteValue();
+	}
+}
+
+void FLuaSessionRecorder::WriteStructProperty(lua_State* InL, const UScriptStruct* InStruct, FProperty* InProperty, void* InStructAddr, bool bInSet)
+{
+	if (!IsRecordedState(InL) || InStruct == nullptr)
+	{
+		return;
+	}
+
+	uint32 StructId = GetNameId(InStruct->GetPathName());
+	uint32 PropertyId = GetNameId(InProperty->GetName());
+
+	if (bInSet)
+	{
+		ValueBuffer.Reset();
+		ValueWriter->Seek(0);
+		LuaSessionFormat::SerializeProperty(*ValueWriter, InProperty, InStructAddr);
+	}
+
+	BeginEvent(bInSet ? LuaSessionFormat::ELuaRecordEvent::SetStructProperty : LuaSessionFormat::ELuaRecordEvent::GetStructProperty);
+	Writer->SerializeIntPacked(StructId);
+	Writer->SerializeIntPacked(PropertyId);
+	if (bInSet)
+	{
+		WriteValue();
+	}
+}
+
+void FLuaSessionRecorder::WriteDelegate(lua_State* InL, int32 InFunctionRef, const UFunction* InSignature, void* InParams)
+{
+	if (!IsRecordedState(InL) || InSignature == nullptr)
+	{
+		return;
+	}
+
+	//"Path.lua:12", the replay has no lua function to call
+	FString FunctionName = TEXT("?");
+	int32 tp = lua_gettop(InL);
+	if (lua_rawgeti(InL, LUA_REGISTRYINDEX, InFunctionRef) == LUA_TFUNCTION)
+	{
+		lua_Debug Ar;
+		lua_getinfo(InL, ">S", &Ar);
+		FunctionName = FString::Printf(TEXT("%s:%d"), UTF8_TO_TCHAR(Ar.short_src), Ar.linedefined);
+	}
+	lua_settop(InL, tp);
+
+	uint32 SignatureId = GetNameId(InSignature->GetPathName());
+	uint32 FunctionId = GetNameId(FunctionName);
+
+	ValueBuffer.Reset();
+	ValueWriter->Seek(0);
+	if (InParams)
+	{
+		InSignature->SerializeBin(*ValueWriter, InParams);
+	}
+
+	BeginEvent(LuaSessionFormat::ELuaRecordEvent::DelegateToLua);
+	Writer->SerializeIntPacked(SignatureId);
+	Writer->SerializeIntPacked(FunctionId);
+	WriteValue();
+}
+
+bool FLuaSessionRecorder::IsRecordedState(lua_State* InL) const
+{
+	return RecordedWrapper && FastLuaUnrealWrapper::GetFromLuaState(InL) == RecordedWrapper;
+}
+
+void FLuaSessionRecorder::BeginEvent(LuaSessionFormat::ELuaRecordEvent InEvent)
+{
+	uint8 Event = (uint8)InEvent;
+	*Writer << Event;
+	++EventNum;
+}
+
+void FLuaSessionRecorder::WriteValue()
+{
+	uint32 Size = ValueBuffer.Num();
+	Writer->SerializeIntPacked(Size);
+	Writer->Serialize(ValueBuffer.GetData(), Size);
+}
+
+void FLuaSessionRecorder::Flush()
+{
+	if (File.IsValid() && Buffer.Num() > 0)
+	{
+		File->Write(Buffer.GetData(), Buffer.Num());
+		FileSize += Buffer.Num();
+	}
+
+	Buffer.Reset();
+	if (Writer.IsValid())
+	{
+		Writer->Seek(0);
+	}
+}
+
+#endif
@@ -0,0 +1,202 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "UObject/ObjectKey.h"
+
+#define LUA_SESSION_RECORDER !UE_BUILD_SHIPPING
+
+struct lua_State;
+class UObject;
+class UFunction;
+class UScriptStruct;
+class FProperty;
+class IFileHandle;
+class FastLuaUnrealWrapper;
+
+/**
+ * the .luarec file: Magic, Version, then events until the end, each is a uint8 ELuaRecordEvent and its fields
+ * ids are packed uint32 defined by a Name or Object event before their first use, 0 is none
+ * values are the binary serialization of the UFunction params or of the property, object refs as object ids and FNames as name ids
+ */
+namespace LuaSessionFormat
+{
+	static const uint32 Magic = 0x4345524C;//"LREC"
+	static const uint32 Version = 1;
+
+	enum class ELuaRecordEvent : uint8
+	{
+		Name = 1,			//Id, FString
+		Object,				//Id, ClassPathId, PathId
+		Frame,				//float DeltaTime
+		Call,				//ObjectId, FunctionNameId, Size, Params
+		GetProperty,		//ObjectId, PropertyNameId
+		SetProperty,		//ObjectId, PropertyNameId, Size, Value
+		GetStructProperty,	//StructPathId, PropertyNameId
+		SetStructProperty,	//StructPathId, PropertyNameId, Size, Value
+		DelegateToLua,		//SignaturePathId, LuaFunctionNameId("Path.lua:12"), Size, Params
+		Max,
+	};
+
+	//the value of InProperty in InContainer, all ArrayDim elements
+	void SerializeProperty(FArchive& Ar, FProperty* InProperty, void* InContainer);
+}
+
+#if LUA_SESSION_RECORDER
+
+/**
+ * records the lua <-> Unreal crossings of one state to a .luarec file, replayed headless by -run=LuaReplay
+ * console: lua.record start [File](Saved/Profiling/Lua/LuaSession-<time>.luarec), lua.record stop
+ * the first state ticking after start is recorded, until stop or its reset, game thread only
+ * latent functions suspending a coroutine are not recorded
+ */
+class FLuaSessionRecorder
+{
+public:
+
+	static FLuaSessionRecorder& Get();
+
+	static bool IsRecording()
+	{
+		return bRecording && IsInGameThread();
+	}
+
+	bool Start(const FString& InFile);
+	void Stop();
+
+	//lua tick of InWrapper, the first one after start picks the recorded state
+	static void RecordFrame(FastLuaUnrealWrapper* InWrapper, float InDeltaTime)
+	{
+		if (IsRecording())
+		{
+			Get().WriteFrame(InWrapper, InDeltaTime);
+		}
+	}
+
+	//InParams after the fetch of the lua args, before ProcessEvent
+	static void RecordCall(lua_State* InL, UObject* InObj, UFunction* InFunction, void* InParams)
+	{
+		if (IsRecording())
+		{
+			Get().WriteCall(InL, InObj, InFunction, InParams);
+		}
+	}
+
+	//Obj:GetXXX() and Obj:SetXXX(v), the value is written for a set
+	static void RecordProperty(lua_State* InL, UObject* InObj, FProperty* InProperty, bool bInSet)
+	{
+		if (IsRecording())
+		{
+			Get().WriteProperty(InL, InObj, InProperty, bInSet);
+		}
+	}
+
+	static void RecordStructProperty(lua_State* InL, const UScriptStruct* InStruct, FProperty* InProperty, void* InStructAddr, bool bInSet)
+	{
+		if (IsRecording())
+		{
+			Get().WriteStructProperty(InL, InStruct, InProperty, InStructAddr, bInSet);
+		}
+	}
+
+	//a delegate calls the lua function InFunctionRef
+	static void RecordDelegate(lua_State* InL, int32 InFunctionRef, const UFunction* InSignature, void* InParams)
+	{
+		if (IsRecording())
+		{
+			Get().WriteDelegate(InL, InFunctionRef, InSignature, InParams);
+		}
+	}
+
+	//the state of InWrapper is closing
+	static void Detach(const FastLuaUnrealWrapper* InWrapper)
+	{
+		if (bRecording && Get().RecordedWrapper == InWrapper)
+		{
+			Get().Stop();
+		}
+	}
+
+	uint32 GetNameId(const FString& InName);
+	uint32 GetObjectId(UObject* InObj);
+
+protected:
+
+	void WriteFrame(FastLuaUnrealWrapper* InWrapper, float InDeltaTime);
+	void WriteCall(lua_State* InL, UObject* InObj, UFunction* InFunction, void* InParams);
+	void WriteProperty(lua_State* InL, UObject* InObj, FProperty* InProperty, bool bInSet);
+	void WriteStructProperty(lua_State* InL, const UScriptStruct* InStruct, FProperty* InProperty, void* InStructAddr, bool bInSet);
+	void WriteDelegate(lua_State* InL, int32 InFunctionRef, const UFunction* InSignature, void* InParams);
+
+	bool IsRecordedState(lua_State* InL) const;
+
+	void BeginEvent(LuaSessionFormat::ELuaRecordEvent InEvent);
+
+	//Size and Value, from the value archive
+	void WriteValue();
+
+	void Flush();
+
+	static bool bRecording;
+
+	FString FileName;
+	TUniquePtr<IFileHandle> File;
+
+	//null until the first frame
+	FastLuaUnrealWrapper* RecordedWrapper = nullptr;
+
+	//events, flushed to File when large
+	TArray<uint8> Buffer;
+	TUniquePtr<FArchive> Writer;
+
+	//the value of one event, object and name definitions go to Buffer before the event
+	TArray<uint8> ValueBuffer;
+	TUniquePtr<FArchive> ValueWriter;
+
+	TMap<FString, uint32> NameIds;
+	TMap<FObjectKey, uint32> ObjectIds;
+
+	int64 EventNum = 0;
+	int64 FileSize = 0;
+};
+
+#else
+
+//shipping: the calls are compiled out
+class FLuaSessionRecorder
+{
+public:
+
+	static void RecordFrame(FastLuaUnrealWrapper* InWrapper, float InDeltaTime)
+	{
+
+	}
+
+	static void RecordCall(lua_State* InL, UObject* InObj, UFunction* InFunction, void* InParams)
+	{
+
+	}
+
+	static void RecordProperty(lua_State* InL, UObject* InObj, FProperty* InProperty, bool bInSet)
+	{
+
+	}
+
+	static void RecordStructProperty(lua_State* InL, const UScriptStruct* InStruct, FProperty* InProperty, void* InStructAddr, bool bInSet)
+	{
+
+	}
+
+	static void RecordDelegate(lua_State* InL, int32 InFunctionRef, const UFunction* InSignature, void* InParams)
+	{
+
+	}
+
+	static void Detach(const FastLuaUnrealWrapper* InWrapper)
+	{
+
+	}
+};
+
+#endif
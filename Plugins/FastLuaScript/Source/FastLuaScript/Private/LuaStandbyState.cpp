@@ -0,0 +1,89 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "LuaStandbyState.h"
+#include "Async/Async.h"
+
+#include "FastLuaUnrealWrapper.h"
+#include "FastLuaScript.h"
+#include "LuaAllocator.h"
+#include "LuaPrecompiler.h"
+
+#include "lua.hpp"
+
+
+FLuaCoreState::~FLuaCoreState()
+{
+	if (L)
+	{
+		lua_close(L);
+		L = nullptr;
+	}
+}
+
+FLuaCoreState* FLuaCoreState::Create(const TArray<FString>& InModules)
+{
+	const double StartTime = FPlatformTime::Seconds();
+
+	FLuaCoreState* Core = new FLuaCoreState();
+	Core->Allocator = MakeUnique<FLuaAllocator>();
+	Core->L = lua_newstate(FLuaAllocator::LuaAlloc, Core->Allocator.Get());
+
+	//set to the wrapper taking the state
+	*(FastLuaUnrealWrapper**)lua_getextraspace(Core->L) = nullptr;
+
+	FastLuaUnrealWrapper::InitCoreLibs(Core->L);
+
+	FLuaPrecompiler::PrecompileAll();
+
+	lua_State* L = Core->L;
+	for (const FString& ModuleName : InModules)
+	{
+		int32 tp = lua_gettop(L);
+		lua_getglobal(L, "require");
+		lua_pushstring(L, TCHAR_TO_UTF8(*ModuleName));
+		if (lua_pcall(L, 1, 0, 0) != LUA_OK)
+		{
+			UE_LOG(LogFastLuaScript, Warning, TEXT("LuaStandbyState|%s"), UTF8_TO_TCHAR(lua_tostring(L, -1)));
+		}
+		lua_settop(L, tp);
+	}
+
+	UE_LOG(LogFastLuaScript, Log, TEXT("LuaStandbyState|prepared with %d modules in %.2f ms"), InModules.Num(), (FPlatformTime::Seconds() - StartTime) * 1000.0);
+
+	return Core;
+}
+
+FLuaStandbyState::~FLuaStandbyState()
+{
+	Discard();
+}
+
+void FLuaStandbyState::Prepare(const TArray<FString>& InModules)
+{
+	Discard();
+
+	Pending = Async(EAsyncExecution::ThreadPool, [InModules]()
+	{
+		return FLuaCoreState::Create(InModules);
+	});
+}
+
+TUniquePtr<FLuaCoreState> FLuaStandbyState::Take()
+{
+	if (!Pending.IsValid())
+	{
+		return nullptr;
+	}
+
+	//the worker owns nothing after this
+	FLuaCoreState* Core = Pending.Get();
+	Pending.Reset();
+
+	return TUniquePtr<FLuaCoreState>(Core);
+}
+
+void FLuaStandbyState::Discard()
+{
+	TUniquePtr<FLuaCoreState> Core = Take();
+}
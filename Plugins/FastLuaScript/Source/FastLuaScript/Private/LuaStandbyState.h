@@ -0,0 +1,52 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Async/Future.h"
+
+struct lua_State;
+class FLuaAllocator;
+
+/**
+ * the part of a game state that needs no game thread: standard libs, Unreal lib, delegate metatable, script searcher,
+ * precompiled modules and the required StandbyModules, no owning wrapper in the extra space yet
+ */
+struct FLuaCoreState
+{
+	lua_State* L = nullptr;
+	TUniquePtr<FLuaAllocator> Allocator;
+
+	~FLuaCoreState();
+
+	//any thread
+	static FLuaCoreState* Create(const TArray<FString>& InModules);
+};
+
+/**
+ * a core state prepared on a worker thread for the next Init of a wrapper, see UFastLuaSettings::bPrepareStandbyState
+ */
+class FLuaStandbyState
+{
+public:
+
+	~FLuaStandbyState();
+
+	//start making a core state, a prepared one is dropped
+	void Prepare(const TArray<FString>& InModules);
+
+	//the prepared state, waits for the worker if it is not done, nullptr if none was started
+	TUniquePtr<FLuaCoreState> Take();
+
+	//close the prepared state, scripts changed
+	void Discard();
+
+	bool IsPending() const
+	{
+		return Pending.IsValid();
+	}
+
+protected:
+
+	TFuture<FLuaCoreState*> Pending;
+};
@@ -8,6 +8,8 @@
 
 #include "lua.hpp"
 #include "FastLuaStat.h"
+#include "LuaBindingStats.h"
+#include "LuaSessionRecorder.h"
 
 
 void* FLuaStructWrapper::FetchStruct(lua_State* InL, int32 InIndex, const UScriptStruct* InStruct)
@@ -196,7 +198,10 @@ int FLuaStructWrapper::StructIndex(lua_State* InL)
 
 	if (StructAddr)
 	{
+		const uint64 StatsStartCycles = FLuaBindingStats::Begin();
 		FastLuaHelper::PushProperty(InL, Prop, StructAddr);
+		FLuaBindingStats::EndProperty(Prop, false, StatsStartCycles);
+		FLuaSessionRecorder::RecordStructProperty(InL, Wrapper->StructType, Prop, StructAddr, false);
 	}
 	else
 	{
@@ -221,7 +226,10 @@ int FLuaStructWrapper::StructNewIndex(lua_State* InL)
 
 	if (StructAddr)
 	{
+		const uint64 StatsStartCycles = FLuaBindingStats::Begin();
 		FastLuaHelper::FetchProperty(InL, Prop, StructAddr, 2);
+		FLuaBindingStats::EndProperty(Prop, true, StatsStartCycles);
+		FLuaSessionRecorder::RecordStructProperty(InL, Wrapper->StructType, Prop, StructAddr, true);
 	}
 
 	return 0;
@@ -0,0 +1,399 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "LuaTickRegistry.h"
+#include "Engine/World.h"
+#include "Engine/Level.h"
+#include "HAL/IConsoleManager.h"
+#include "Misc/OutputDevice.h"
+#include "Algo/StableSort.h"
+
+#include "FastLuaUnrealWrapper.h"
+#include "FastLuaScript.h"
+#include "FastLuaStat.h"
+#include "LuaHitchDetector.h"
+#include "LuaTrace.h"
+
+#include "lua.hpp"
+
+
+static FAutoConsoleCommandWithOutputDevice LuaTicksCommand(
+	TEXT("lua.ticks"),
+	TEXT("Dump the registered lua tick functions with their cost"),
+	FConsoleCommandWithOutputDeviceDelegate::CreateStatic([](FOutputDevice& Ar)
+	{
+		for (FastLuaUnrealWrapper* Wrapper : FastLuaUnrealWrapper::GetAllWrappers())
+		{
+			if (const FLuaTickRegistry* Registry = Wrapper->GetTickRegistry())
+			{
+				Registry->Dump(Ar);
+			}
+		}
+	}));
+
+
+void FLuaTickGroupFunction::ExecuteTick(float DeltaTime, ELevelTick TickType, ENamedThreads::Type CurrentThread, const FGraphEventRef& MyCompletionGraphEvent)
+{
+	if (Registry)
+	{
+		Registry->RunGroup(Group, DeltaTime);
+	}
+}
+
+FString FLuaTickGroupFunction::DiagnosticMessage()
+{
+	return FString::Printf(TEXT("FLuaTickGroupFunction[%s]"), FLuaTickRegistry::GetGroupName(Group));
+}
+
+
+FLuaTickRegistry::FLuaTickRegistry(lua_State* InL)
+	: L(InL)
+{
+	static const ETickingGroup TickGroups[(int32)ELuaTickGroup::Num] = { TG_PrePhysics, TG_PrePhysics, TG_PostPhysics, TG_PostUpdateWork };
+
+	for (int32 i = 0; i < (int32)ELuaTickGroup::Num; ++i)
+	{
+		FLuaTickGroupFunction& TickFunction = Groups[i].TickFunction;
+		TickFunction.Registry = this;
+		TickFunction.Group = (ELuaTickGroup)i;
+		TickFunction.bCanEverTick = true;
+		TickFunction.bStartWithTickEnabled = true;
+		TickFunction.TickGroup = TickGroups[i];
+	}
+
+	WorldCleanupHandle = FWorldDelegates::OnWorldCleanup.AddRaw(this, &FLuaTickRegistry::HandleWorldCleanup);
+}
+
+FLuaTickRegistry::~FLuaTickRegistry()
+{
+	FWorldDelegates::OnWorldCleanup.Remove(WorldCleanupHandle);
+
+	UnregisterWorld();
+}
+
+int32 FLuaTickRegistry::Register(int32 InFunctionRef, int32 InSelfRef, ELuaTickGroup InGroup, int32 InPriority, float InInterval)
+{
+	FEntry NewEntry;
+	NewEntry.Id = ++NextId;
+	NewEntry.FunctionRef = InFunctionRef;
+	NewEntry.SelfRef = InSelfRef;
+	NewEntry.Priority = InPriority;
+	NewEntry.Interval = FMath::Max(InInterval, 0.f);
+
+	//source:line of the function for stats and lua.ticks
+	lua_Debug ar;
+	lua_rawgeti(L, LUA_REGISTRYINDEX, InFunctionRef);
+	if (lua_getinfo(L, ">S", &ar))
+	{
+		NewEntry.Name = FString::Printf(TEXT("%s:%d"), UTF8_TO_TCHAR(ar.short_src), ar.linedefined);
+	}
+#if STATS
+	NewEntry.StatId = FDynamicStats::CreateStatId<FStatGroup_STATGROUP_FastLuaScript>(FString(TEXT("LuaTick ")) + NewEntry.Name);
+#endif
+
+	FGroup& Group = Groups[(int32)InGroup];
+	if (Group.bRunning)
+	{
+		Group.Pending.Add(MoveTemp(NewEntry));
+	}
+	else
+	{
+		Group.Entries.Add(MoveTemp(NewEntry));
+	}
+
+	Group.bDirty = true;
+	return NextId;
+}
+
+bool FLuaTickRegistry::Unregister(int32 InId)
+{
+	for (FGroup& Group : Groups)
+	{
+		for (TArray<FEntry>* List : { &Group.Entries, &Group.Pending })
+		{
+			for (FEntry& Entry : *List)
+			{
+				if (Entry.Id == InId && !Entry.bRemoved)
+				{
+					Entry.bRemoved = true;
+					Group.bDirty = true;
+					return true;
+				}
+			}
+		}
+	}
+
+	return false;
+}
+
+void FLuaTickRegistry::Release(FEntry& InEntry)
+{
+	luaL_unref(L, LUA_REGISTRYINDEX, InEntry.FunctionRef);
+
+	//0 is no self(Program.LuaTick), unref of 0 would overwrite the free list of the registry
+	if (InEntry.SelfRef)
+	{
+		luaL_unref(L, LUA_REGISTRYINDEX, InEntry.SelfRef);
+	}
+	InEntry.FunctionRef = 0;
+	InEntry.SelfRef = 0;
+}
+
+void FLuaTickRegistry::Compact(FGroup& InGroup)
+{
+	InGroup.Entries.Append(MoveTemp(InGroup.Pending));
+	InGroup.Pending.Reset();
+
+	for (int32 i = InGroup.Entries.Num() - 1; i >= 0; --i)
+	{
+		if (InGroup.Entries[i].bRemoved)
+		{
+			Release(InGroup.Entries[i]);
+			InGroup.Entries.RemoveAt(i, 1, false);
+		}
+	}
+
+	//stable: same priority keeps the register order
+	Algo::StableSortBy(InGroup.Entries, &FEntry::Priority);
+	InGroup.bDirty = false;
+}
+
+void FLuaTickRegistry::SyncWorld(UWorld* InWorld)
+{
+	if (bWorldRegistered && RegisteredWorld.Get() == InWorld)
+	{
+		return;
+	}
+
+	UnregisterWorld();
+
+	if (InWorld && InWorld->PersistentLevel)
+	{
+		for (int32 i = (int32)ELuaTickGroup::PrePhysics; i < (int32)ELuaTickGroup::Num; ++i)
+		{
+			Groups[i].TickFunction.RegisterTickFunction(InWorld->PersistentLevel);
+		}
+
+		RegisteredWorld = InWorld;
+		bWorldRegistered = true;
+	}
+}
+
+void FLuaTickRegistry::UnregisterWorld()
+{
+	if (!bWorldRegistered)
+	{
+		return;
+	}
+
+	for (int32 i = (int32)ELuaTickGroup::PrePhysics; i < (int32)ELuaTickGroup::Num; ++i)
+	{
+		Groups[i].TickFunction.UnRegisterTickFunction();
+	}
+
+	RegisteredWorld = nullptr;
+	bWorldRegistered = false;
+}
+
+void FLuaTickRegistry::HandleWorldCleanup(UWorld* InWorld, bool bSessionEnded, bool bCleanupResources)
+{
+	//the tick functions point into the level, leave before it goes
+	if (bWorldRegistered && RegisteredWorld.Get() == InWorld)
+	{
+		UnregisterWorld();
+	}
+}
+
+void FLuaTickRegistry::TickDefault(float InDeltaTime)
+{
+	RunGroup(ELuaTickGroup::Default, InDeltaTime);
+
+	if (!bWorldRegistered)
+	{
+		for (int32 i = (int32)ELuaTickGroup::PrePhysics; i < (int32)ELuaTickGroup::Num; ++i)
+		{
+			RunGroup((ELuaTickGroup)i, InDeltaTime);
+		}
+	}
+}
+
+void FLuaTickRegistry::RunGroup(ELuaTickGroup InGroup, float InDeltaTime)
+{
+	FGroup& Group = Groups[(int32)InGroup];
+	if (Group.bRunning || L == nullptr)
+	{
+		return;
+	}
+
+	if (Group.bDirty)
+	{
+		Compact(Group);
+	}
+
+	if (Group.Entries.Num() < 1)
+	{
+		return;
+	}
+
+	SCOPE_CYCLE_COUNTER(STAT_LuaTickGroup);
+
+	Group.bRunning = true;
+	for (FEntry& Entry : Group.Entries)
+	{
+		if (Entry.bRemoved)
+		{
+			continue;
+		}
+
+		float DeltaTime = InDeltaTime;
+		if (Entry.Interval > 0.f)
+		{
+			Entry.Accumulated += InDeltaTime;
+			if (Entry.Accumulated < Entry.Interval)
+			{
+				continue;
+			}
+
+			DeltaTime = Entry.Accumulated;
+			Entry.Accumulated = 0.f;
+		}
+
+		if (!CallEntry(Entry, DeltaTime))
+		{
+			//only this entry stops, register it again to restart
+			Entry.bRemoved = true;
+			Group.bDirty = true;
+		}
+	}
+	Group.bRunning = false;
+
+	if (Group.bDirty)
+	{
+		Compact(Group);
+	}
+}
+
+bool FLuaTickRegistry::CallEntry(FEntry& InEntry, float InDeltaTime)
+{
+#if STATS
+	FScopeCycleCounter EntryCycleCounter(InEntry.StatId);
+#endif
+
+	const uint32 StartCycles = FPlatformTime::Cycles();
+
+	int32 tp = lua_gettop(L);
+	lua_rawgeti(L, LUA_REGISTRYINDEX, InEntry.FunctionRef);
+	int32 ParamNum = 1;
+	if (InEntry.SelfRef)
+	{
+		lua_rawgeti(L, LUA_REGISTRYINDEX, InEntry.SelfRef);
+		++ParamNum;
+	}
+	lua_pushnumber(L, InDeltaTime);
+
+	FLuaHitchDetector::Get().BeginScope(L);
+	const bool bOK = lua_pcall(L, ParamNum, 0, 0) == LUA_OK;
+	FLuaTrace::Get().UnwindFrames(L);
+	FLuaHitchDetector::Get().EndScope(L, *InEntry.Name, InEntry.FunctionRef);
+	if (!bOK)
+	{
+		UE_LOG(LogFastLuaScript, Warning, TEXT("%s"), UTF8_TO_TCHAR(lua_tostring(L, -1)));
+		UE_LOG(LogFastLuaScript, Warning, TEXT("Lua stopped tick %s!"), *InEntry.Name);
+	}
+	lua_settop(L, tp);
+
+	const uint32 Cycles = FPlatformTime::Cycles() - StartCycles;
+	++InEntry.Calls;
+	InEntry.TotalCycles += Cycles;
+	InEntry.MaxCycles = FMath::Max(InEntry.MaxCycles, Cycles);
+
+	return bOK;
+}
+
+void FLuaTickRegistry::Dump(FOutputDevice& Ar) const
+{
+	const UWorld* World = RegisteredWorld.Get();
+	Ar.Logf(TEXT("Lua ticks(%s):"), World ? *World->GetName() : TEXT("no world"));
+	Ar.Logf(TEXT("%16s %8s %8s %10s %10s %10s  %s"), TEXT("Group"), TEXT("Priority"), TEXT("Interval"), TEXT("Calls"), TEXT("AvgMs"), TEXT("MaxMs"), TEXT("Function"));
+
+	for (int32 i = 0; i < (int32)ELuaTickGroup::Num; ++i)
+	{
+		for (const FEntry& Entry : Groups[i].Entries)
+		{
+			const double TotalMs = FPlatformTime::ToMilliseconds64(Entry.TotalCycles);
+			Ar.Logf(TEXT("%16s %8d %8.3f %10llu %10.4f %10.4f  %s%s"), GetGroupName((ELuaTickGroup)i), Entry.Priority, Entry.Interval, Entry.Calls,
+				Entry.Calls > 0 ? TotalMs / Entry.Calls : 0.0, FPlatformTime::ToMilliseconds(Entry.MaxCycles), *Entry.Name, Entry.bRemoved ? TEXT(" (stopped)") : TEXT(""));
+		}
+	}
+}
+
+ELuaTickGroup FLuaTickRegistry::ParseGroup(const char* InName)
+{
+	for (int32 i = 0; InName && i < (int32)ELuaTickGroup::Num; ++i)
+	{
+		if (FCStringAnsi::Stricmp(InName, TCHAR_TO_ANSI(GetGroupName((ELuaTickGroup)i))) == 0)
+		{
+			return (ELuaTickGroup)i;
+		}
+	}
+
+	return ELuaTickGroup::Num;
+}
+
+const TCHAR* FLuaTickRegistry::GetGroupName(ELuaTickGroup InGroup)
+{
+	switch (InGroup)
+	{
+	case ELuaTickGroup::Default: return TEXT("Default");
+	case ELuaTickGroup::PrePhysics: return TEXT("PrePhysics");
+	case ELuaTickGroup::PostPhysics: return TEXT("PostPhysics");
+	case ELuaTickGroup::PostUpdateWork: return TEXT("PostUpdateWork");
+	default: return TEXT("Unknown");
+	}
+}
+
+void FLuaTickRegistry::RegisterLib(lua_State* InL)
+{
+	lua_pushcfunction(InL, LuaRegisterTickFunction);
+	lua_setfield(InL, -2, "RegisterTickFunction");
+
+	lua_pushcfunction(InL, LuaUnregisterTickFunction);
+	lua_setfield(InL, -2, "UnregisterTickFunction");
+}
+
+//local Id = Unreal.RegisterTickFunction(fn, self, Group, Priority, Interval)
+int32 FLuaTickRegistry::LuaRegisterTickFunction(lua_State* InL)
+{
+	FastLuaUnrealWrapper* Owner = FastLuaUnrealWrapper::GetFromLuaState(InL);
+	FLuaTickRegistry* Registry = Owner ? Owner->GetTickRegistry() : nullptr;
+	luaL_checktype(InL, 1, LUA_TFUNCTION);
+	const ELuaTickGroup Group = lua_isnoneornil(InL, 3) ? ELuaTickGroup::Default : ParseGroup(lua_tostring(InL, 3));
+	if (Registry == nullptr || Group == ELuaTickGroup::Num)
+	{
+		return luaL_error(InL, "RegisterTickFunction: no tick registry or unknown group %s", lua_tostring(InL, 3));
+	}
+
+	const int32 Priority = (int32)luaL_optinteger(InL, 4, 0);
+	const float Interval = (float)luaL_optnumber(InL, 5, 0.0);
+
+	lua_pushvalue(InL, 1);
+	const int32 FunctionRef = luaL_ref(InL, LUA_REGISTRYINDEX);
+
+	int32 SelfRef = 0;
+	if (!lua_isnoneornil(InL, 2))
+	{
+		lua_pushvalue(InL, 2);
+		SelfRef = luaL_ref(InL, LUA_REGISTRYINDEX);
+	}
+
+	lua_pushinteger(InL, Registry->Register(FunctionRef, SelfRef, Group, Priority, Interval));
+	return 1;
+}
+
+int32 FLuaTickRegistry::LuaUnregisterTickFunction(lua_State* InL)
+{
+	FastLuaUnrealWrapper* Owner = FastLuaUnrealWrapper::GetFromLuaState(InL);
+	FLuaTickRegistry* Registry = Owner ? Owner->GetTickRegistry() : nullptr;
+	lua_pushboolean(InL, Registry && Registry->Unregister((int32)lua_tointeger(InL, 1)));
+	return 1;
+}
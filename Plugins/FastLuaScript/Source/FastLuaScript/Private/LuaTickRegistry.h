@@ -0,0 +1,140 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Engine/EngineBaseTypes.h"
+#include "UObject/WeakObjectPtr.h"
+
+struct lua_State;
+class UWorld;
+class FLuaTickRegistry;
+
+enum class ELuaTickGroup : uint8
+{
+	//lua tick of the core ticker
+	Default,
+	PrePhysics,
+	PostPhysics,
+	PostUpdateWork,
+
+	Num
+};
+
+/**
+ * world tick function running the lua entries of one group
+ */
+struct FLuaTickGroupFunction : public FTickFunction
+{
+	FLuaTickRegistry* Registry = nullptr;
+	ELuaTickGroup Group = ELuaTickGroup::Default;
+
+	virtual void ExecuteTick(float DeltaTime, ELevelTick TickType, ENamedThreads::Type CurrentThread, const FGraphEventRef& MyCompletionGraphEvent) override;
+	virtual FString DiagnosticMessage() override;
+};
+
+/**
+ * lua functions ticked every frame, the function and self are held by registry refs, no global lookup per frame
+ *	local Id = Unreal.RegisterTickFunction(fn, self, Group, Priority, Interval)	--fn([self,] DeltaTime)
+ *	Unreal.UnregisterTickFunction(Id)
+ * Group: "Default"(lua tick), "PrePhysics", "PostPhysics", "PostUpdateWork"(world tick groups of the owning GameInstance),
+ * lower Priority first, Interval in seconds(0 every frame), an entry with an error is stopped alone
+ * console: lua.ticks
+ */
+class FLuaTickRegistry
+{
+public:
+
+	FLuaTickRegistry(lua_State* InL);
+	~FLuaTickRegistry();
+
+	FLuaTickRegistry(const FLuaTickRegistry&) = delete;
+	FLuaTickRegistry& operator=(const FLuaTickRegistry&) = delete;
+
+	//return the id
+	int32 Register(int32 InFunctionRef, int32 InSelfRef, ELuaTickGroup InGroup, int32 InPriority, float InInterval);
+
+	bool Unregister(int32 InId);
+
+	//register the group tick functions to InWorld, the groups run from the lua tick when there is no world
+	void SyncWorld(UWorld* InWorld);
+
+	//lua tick: the Default group, and the world groups when not registered to a world
+	void TickDefault(float InDeltaTime);
+
+	void RunGroup(ELuaTickGroup InGroup, float InDeltaTime);
+
+	void Dump(FOutputDevice& Ar) const;
+
+	static ELuaTickGroup ParseGroup(const char* InName);
+
+	static const TCHAR* GetGroupName(ELuaTickGroup InGroup);
+
+	//add Unreal.RegisterTickFunction and Unreal.UnregisterTickFunction to the table at the top of InL
+	static void RegisterLib(lua_State* InL);
+
+protected:
+
+	static int32 LuaRegisterTickFunction(lua_State* InL);
+	static int32 LuaUnregisterTickFunction(lua_State* InL);
+
+	struct FEntry
+	{
+		int32 Id = 0;
+		int32 FunctionRef = 0;
+		int32 SelfRef = 0;
+		int32 Priority = 0;
+
+		float Interval = 0.f;
+		float Accumulated = 0.f;
+
+		//removed or stopped by an error, dropped after the group run
+		bool bRemoved = false;
+
+		FString Name;
+#if STATS
+		TStatId StatId;
+#endif
+		uint64 Calls = 0;
+		uint64 TotalCycles = 0;
+		uint32 MaxCycles = 0;
+	};
+
+	struct FGroup
+	{
+		TArray<FEntry> Entries;
+
+		//registered while the group runs
+		TArray<FEntry> Pending;
+
+		bool bRunning = false;
+		bool bDirty = false;
+
+		FLuaTickGroupFunction TickFunction;
+	};
+
+	void Release(FEntry& InEntry);
+
+	//false if the function raised an error
+	bool CallEntry(FEntry& InEntry, float InDeltaTime);
+
+	//merge pending entries, drop removed ones, sort by priority
+	void Compact(FGroup& InGroup);
+
+	void UnregisterWorld();
+
+	void HandleWorldCleanup(UWorld* InWorld, bool bSessionEnded, bool bCleanupResources);
+
+	lua_State* L = nullptr;
+
+	FGroup Groups[(int32)ELuaTickGroup::Num];
+
+	TWeakObjectPtr<UWorld> RegisteredWorld;
+	bool bWorldRegistered = false;
+
+	int32 NextId = 0;
+
+	FDelegateHandle WorldCleanupHandle;
+
+	friend struct FLuaTickGroupFunction;
+};
@@ -0,0 +1,421 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "LuaTimerWheel.h"
+#include "Engine/World.h"
+#include "GameFramework/WorldSettings.h"
+
+#include "FastLuaUnrealWrapper.h"
+#include "FastLuaScript.h"
+#include "FastLuaStat.h"
+#include "LuaHitchDetector.h"
+#include "LuaTrace.h"
+
+#include "lua.hpp"
+
+
+FLuaTimerWheel::FLuaTimerWheel()
+{
+	for (int32 i = 0; i < NumSlots; ++i)
+	{
+		SlotHeads[i] = INDEX_NONE;
+	}
+}
+
+int64 FLuaTimerWheel::SetTimer(double InDelay, double InInterval, int32 InFunctionRef, int32 InSelfRef)
+{
+	int32 Index = INDEX_NONE;
+	if (FreeIndices.Num() > 0)
+	{
+		Index = FreeIndices.Pop(false);
+	}
+	else
+	{
+		Index = Timers.AddDefaulted();
+	}
+
+	FTimer& Timer = Timers[Index];
+	Timer.ExpireTick = CurrentTick + (uint64)FMath::Clamp(FMath::RoundToDouble(InDelay / TickSeconds), 0.0, (double)MaxDelayTicks);
+	Timer.IntervalTicks = InInterval > 0.0 ? (uint64)FMath::Clamp(FMath::RoundToDouble(InInterval / TickSeconds), 1.0, (double)MaxDelayTicks) : 0;
+	Timer.FunctionRef = InFunctionRef;
+	Timer.SelfRef = InSelfRef;
+	Timer.bActive = true;
+	++Timer.Generation;
+
+	Insert(Index);
+	++ActiveNum;
+
+	return MakeHandle(Index, Timer.Generation);
+}
+
+bool FLuaTimerWheel::ClearTimer(lua_State* InL, int64 InHandle)
+{
+	const int32 Index = FindTimer(InHandle);
+	if (Index == INDEX_NONE)
+	{
+		return false;
+	}
+
+	Unlink(Index);
+	Free(InL, Index);
+	return true;
+}
+
+bool FLuaTimerWheel::IsActive(int64 InHandle) const
+{
+	return FindTimer(InHandle) != INDEX_NONE;
+}
+
+double FLuaTimerWheel::GetRemaining(int64 InHandle) const
+{
+	const int32 Index = FindTimer(InHandle);
+	if (Index == INDEX_NONE)
+	{
+		return -1.0;
+	}
+
+	const uint64 ExpireTick = Timers[Index].ExpireTick;
+	return ExpireTick > CurrentTick ? (ExpireTick - CurrentTick) * TickSeconds - PendingSeconds : 0.0;
+}
+
+int32 FLuaTimerWheel::FindTimer(int64 InHandle) const
+{
+	const int32 Index = (int32)(InHandle & 0xffffffff);
+	const uint32 Generation = (uint32)(InHandle >> 32);
+	if (!Timers.IsValidIndex(Index) || !Timers[Index].bActive || Timers[Index].Generation != Generation)
+	{
+		return INDEX_NONE;
+	}
+
+	return Index;
+}
+
+void FLuaTimerWheel::Insert(int32 InIndex)
+{
+	FTimer& Timer = Timers[InIndex];
+
+	//due already(set in a callback): the next tick stepped
+	const uint64 ExpireTick = FMath::Max(Timer.ExpireTick, CurrentTick);
+	const uint64 Delta = FMath::Min(ExpireTick - CurrentTick, MaxDelayTicks);
+	const uint64 SlotTick = CurrentTick + Delta;
+
+	int32 Slot = 0;
+	if (Delta < RootSlots)
+	{
+		Slot = (int32)(SlotTick & (RootSlots - 1));
+	}
+	else
+	{
+		int32 Level = 1;
+		while (Level < NumLevels - 1 && Delta >= (1ull << (RootBits + Level * LevelBits)))
+		{
+			++Level;
+		}
+
+		const int32 Shift = RootBits + (Level - 1) * LevelBits;
+		Slot = RootSlots + (Level - 1) * LevelSlots + (int32)((SlotTick >> Shift) & (LevelSlots - 1));
+	}
+
+	Timer.Slot = Slot;
+	Timer.Prev = INDEX_NONE;
+	Timer.Next = SlotHeads[Slot];
+	if (Timer.Next != INDEX_NONE)
+	{
+		Timers[Timer.Next].Prev = InIndex;
+	}
+	SlotHeads[Slot] = InIndex;
+}
+
+void FLuaTimerWheel::Unlink(int32 InIndex)
+{
+	FTimer& Timer = Timers[InIndex];
+	if (Timer.Slot == INDEX_NONE)
+	{
+		return;
+	}
+
+	if (Timer.Prev != INDEX_NONE)
+	{
+		Timers[Timer.Prev].Next = Timer.Next;
+	}
+	else
+	{
+		SlotHeads[Timer.Slot] = Timer.Next;
+	}
+
+	if (Timer.Next != INDEX_NONE)
+	{
+		Timers[Timer.Next].Prev = Timer.Prev;
+	}
+
+	Timer.Slot = INDEX_NONE;
+	Timer.Prev = INDEX_NONE;
+	Timer.Next = INDEX_NONE;
+}
+
+void FLuaTimerWheel::Free(lua_State* InL, int32 InIndex)
+{
+	FTimer& Timer = Timers[InIndex];
+	if (InL)
+	{
+		luaL_unref(InL, LUA_REGISTRYINDEX, Timer.FunctionRef);
+
+		//0 is no self, unref of 0 would overwrite the free list of the registry
+		if (Timer.SelfRef)
+		{
+			luaL_unref(InL, LUA_REGISTRYINDEX, Timer.SelfRef);
+		}
+	}
+
+	Timer.FunctionRef = 0;
+	Timer.SelfRef = 0;
+	Timer.bActive = false;
+	FreeIndices.Add(InIndex);
+	--ActiveNum;
+}
+
+void FLuaTimerWheel::Cascade(int32 InSlot)
+{
+	int32 Index = SlotHeads[InSlot];
+	SlotHeads[InSlot] = INDEX_NONE;
+
+	while (Index != INDEX_NONE)
+	{
+		const int32 Next = Timers[Index].Next;
+		Insert(Index);
+		Index = Next;
+	}
+}
+
+void FLuaTimerWheel::Step()
+{
+	const int32 RootIndex = (int32)(CurrentTick & (RootSlots - 1));
+
+	//the root level wrapped, refill it from the upper levels
+	if (RootIndex == 0 && CurrentTick > 0)
+	{
+		for (int32 Level = 1; Level < NumLevels; ++Level)
+		{
+			const int32 Shift = RootBits + (Level - 1) * LevelBits;
+			const int32 LevelIndex = (int32)((CurrentTick >> Shift) & (LevelSlots - 1));
+			Cascade(RootSlots + (Level - 1) * LevelSlots + LevelIndex);
+
+			if (LevelIndex != 0)
+			{
+				break;
+			}
+		}
+	}
+
+	int32 Index = SlotHeads[RootIndex];
+	SlotHeads[RootIndex] = INDEX_NONE;
+	while (Index != INDEX_NONE)
+	{
+		FTimer& Timer = Timers[Index];
+		const int32 Next = Timer.Next;
+		Timer.Slot = INDEX_NONE;
+		Timer.Prev = INDEX_NONE;
+		Timer.Next = INDEX_NONE;
+
+		//delays over MaxDelayTicks go around the wheel again
+		if (Timer.ExpireTick > CurrentTick)
+		{
+			Insert(Index);
+		}
+		else
+		{
+			DueTimers.Add(TPair<int32, uint32>(Index, Timer.Generation));
+		}
+
+		Index = Next;
+	}
+
+	++CurrentTick;
+}
+
+int32 FLuaTimerWheel::Tick(lua_State* InL, float InDeltaTime, const UWorld* InWorld)
+{
+	if (InL == nullptr || bPaused)
+	{
+		return 0;
+	}
+
+	SCOPE_CYCLE_COUNTER(STAT_LuaTimerTick);
+
+	double DeltaTime = InDeltaTime * TimeScale;
+	if (InWorld)
+	{
+		if (InWorld->IsPaused())
+		{
+			return 0;
+		}
+
+		if (const AWorldSettings* WorldSettings = InWorld->GetWorldSettings())
+		{
+			DeltaTime *= WorldSettings->GetEffectiveTimeDilation();
+		}
+	}
+
+	PendingSeconds += DeltaTime;
+	const uint64 StepNum = (uint64)(PendingSeconds / TickSeconds);
+	PendingSeconds -= StepNum * TickSeconds;
+
+	if (ActiveNum == 0)
+	{
+		//nothing to fire, the slots are empty
+		CurrentTick += StepNum;
+		return 0;
+	}
+
+	for (uint64 i = 0; i < StepNum; ++i)
+	{
+		Step();
+	}
+
+	int32 CallNum = 0;
+	for (int32 i = 0; i < DueTimers.Num(); ++i)
+	{
+		const int32 Index = DueTimers[i].Key;
+
+		//cleared by a callback before in this batch
+		if (!Timers[Index].bActive || Timers[Index].Generation != DueTimers[i].Value)
+		{
+			continue;
+		}
+
+		const int64 Handle = MakeHandle(Index, Timers[Index].Generation);
+		int32 tp = lua_gettop(InL);
+		const int32 FunctionRef = Timers[Index].FunctionRef;
+		lua_rawgeti(InL, LUA_REGISTRYINDEX, FunctionRef);
+		int32 ParamNum = 1;
+		if (Timers[Index].SelfRef)
+		{
+			lua_rawgeti(InL, LUA_REGISTRYINDEX, Timers[Index].SelfRef);
+			++ParamNum;
+		}
+		lua_pushinteger(InL, Handle);
+
+		//reschedule before the call, the callback may clear it, fires missed in a hitch are dropped
+		if (Timers[Index].IntervalTicks > 0)
+		{
+			Timers[Index].ExpireTick = FMath::Max(Timers[Index].ExpireTick + Timers[Index].IntervalTicks, CurrentTick);
+			Insert(Index);
+		}
+		else
+		{
+			Free(InL, Index);
+		}
+
+		FLuaHitchDetector::Get().BeginScope(InL);
+		const int32 CallRet = lua_pcall(InL, ParamNum, 0, 0);
+		FLuaTrace::Get().UnwindFrames(InL);
+
+		//a one shot timer or one cleared by its callback has released the ref, its slot may hold another value now
+		const bool bRefAlive = Timers[Index].bActive && Timers[Index].Generation == DueTimers[i].Value;
+		FLuaHitchDetector::Get().EndScope(InL, TEXT("Timer"), bRefAlive ? FunctionRef : LUA_NOREF);
+		if (CallRet != LUA_OK)
+		{
+			UE_LOG(LogFastLuaScript, Warning, TEXT("Timer: %s"), UTF8_TO_TCHAR(lua_tostring(InL, -1)));
+		}
+		lua_settop(InL, tp);
+
+		++CallNum;
+	}
+
+	DueTimers.Reset();
+
+	INC_DWORD_STAT_BY(STAT_LuaTimersFired, CallNum);
+
+	return CallNum;
+}
+
+FLuaTimerWheel* FLuaTimerWheel::GetWheel(lua_State* InL)
+{
+	FastLuaUnrealWrapper* Owner = FastLuaUnrealWrapper::GetFromLuaState(InL);
+	return Owner ? Owner->GetTimerWheel() : nullptr;
+}
+
+void FLuaTimerWheel::RegisterLib(lua_State* InL)
+{
+	const static luaL_Reg funcs[] =
+	{
+		{"Set", LuaSet},
+		{"Clear", LuaClear},
+		{"IsActive", LuaIsActive},
+		{"GetRemaining", LuaGetRemaining},
+		{"SetPaused", LuaSetPaused},
+		{"SetTimeScale", LuaSetTimeScale},
+
+		{nullptr, nullptr}
+	};
+
+	luaL_newlib(InL, funcs);
+	lua_setfield(InL, -2, "Timer");
+}
+
+//local Handle = Unreal.Timer.Set(Delay, Interval, fn, self)
+int32 FLuaTimerWheel::LuaSet(lua_State* InL)
+{
+	FLuaTimerWheel* Wheel = GetWheel(InL);
+	const double Delay = luaL_checknumber(InL, 1);
+	const double Interval = luaL_optnumber(InL, 2, 0.0);
+	luaL_checktype(InL, 3, LUA_TFUNCTION);
+	if (Wheel == nullptr)
+	{
+		return luaL_error(InL, "Unreal.Timer is not available in this state");
+	}
+
+	lua_pushvalue(InL, 3);
+	const int32 FunctionRef = luaL_ref(InL, LUA_REGISTRYINDEX);
+
+	int32 SelfRef = 0;
+	if (!lua_isnoneornil(InL, 4))
+	{
+		lua_pushvalue(InL, 4);
+		SelfRef = luaL_ref(InL, LUA_REGISTRYINDEX);
+	}
+
+	lua_pushinteger(InL, Wheel->SetTimer(Delay, Interval, FunctionRef, SelfRef));
+	return 1;
+}
+
+int32 FLuaTimerWheel::LuaClear(lua_State* InL)
+{
+	FLuaTimerWheel* Wheel = GetWheel(InL);
+	lua_pushboolean(InL, Wheel && lua_isinteger(InL, 1) && Wheel->ClearTimer(InL, lua_tointeger(InL, 1)));
+	return 1;
+}
+
+int32 FLuaTimerWheel::LuaIsActive(lua_State* InL)
+{
+	FLuaTimerWheel* Wheel = GetWheel(InL);
+	lua_pushboolean(InL, Wheel && lua_isinteger(InL, 1) && Wheel->IsActive(lua_tointeger(InL, 1)));
+	return 1;
+}
+
+int32 FLuaTimerWheel::LuaGetRemaining(lua_State* InL)
+{
+	FLuaTimerWheel* Wheel = GetWheel(InL);
+	lua_pushnumber(InL, Wheel && lua_isinteger(InL, 1) ? Wheel->GetRemaining(lua_tointeger(InL, 1)) : -1.0);
+	return 1;
+}
+
+int32 FLuaTimerWheel::LuaSetPaused(lua_State* InL)
+{
+	if (FLuaTimerWheel* Wheel = GetWheel(InL))
+	{
+		Wheel->SetPaused(lua_toboolean(InL, 1) != 0);
+	}
+
+	return 0;
+}
+
+int32 FLuaTimerWheel::LuaSetTimeScale(lua_State* InL)
+{
+	if (FLuaTimerWheel* Wheel = GetWheel(InL))
+	{
+		Wheel->SetTimeScale(luaL_checknumber(InL, 1));
+	}
+
+	return 0;
+}
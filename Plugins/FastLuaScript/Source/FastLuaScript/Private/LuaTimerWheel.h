@@ -0,0 +1,128 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+struct lua_State;
+class UWorld;
+
+/**
+ * hierarchical timer wheel of one lua state, Unreal.Timer in lua:
+ *	local Handle = Unreal.Timer.Set(Delay, Interval, fn, self)	--fn([self,] Handle), Interval 0 for one shot
+ *	Unreal.Timer.Clear(Handle), IsActive(Handle), GetRemaining(Handle), SetPaused(bool), SetTimeScale(Scale)
+ * time follows the world of the owning GameInstance(pause and time dilation), advancing only touches the due slots,
+ * due timers are called in one batch from lua tick, timers set in a callback fire in the next tick at the earliest
+ */
+class FLuaTimerWheel
+{
+public:
+
+	//resolution of the wheel
+	static constexpr double TickSeconds = 0.01;
+
+	FLuaTimerWheel();
+
+	//return the handle
+	int64 SetTimer(double InDelay, double InInterval, int32 InFunctionRef, int32 InSelfRef);
+
+	//false if the timer is not active, the refs are released in InL
+	bool ClearTimer(lua_State* InL, int64 InHandle);
+
+	bool IsActive(int64 InHandle) const;
+
+	//seconds to the next fire, -1 if not active
+	double GetRemaining(int64 InHandle) const;
+
+	//advance by the scaled world time and call the due timers, return the number of calls
+	int32 Tick(lua_State* InL, float InDeltaTime, const UWorld* InWorld);
+
+	int32 Num() const
+	{
+		return ActiveNum;
+	}
+
+	void SetPaused(bool InPaused)
+	{
+		bPaused = InPaused;
+	}
+
+	void SetTimeScale(double InScale)
+	{
+		TimeScale = FMath::Max(InScale, 0.0);
+	}
+
+	//add the Unreal.Timer table to the table at the top of InL
+	static void RegisterLib(lua_State* InL);
+
+protected:
+
+	static int32 LuaSet(lua_State* InL);
+	static int32 LuaClear(lua_State* InL);
+	static int32 LuaIsActive(lua_State* InL);
+	static int32 LuaGetRemaining(lua_State* InL);
+	static int32 LuaSetPaused(lua_State* InL);
+	static int32 LuaSetTimeScale(lua_State* InL);
+
+	static FLuaTimerWheel* GetWheel(lua_State* InL);
+
+	//level 0: one slot per tick, upper levels: each slot covers a whole lower level
+	static constexpr int32 RootBits = 8;
+	static constexpr int32 LevelBits = 6;
+	static constexpr int32 NumLevels = 4;
+	static constexpr int32 RootSlots = 1 << RootBits;
+	static constexpr int32 LevelSlots = 1 << LevelBits;
+	static constexpr int32 NumSlots = RootSlots + (NumLevels - 1) * LevelSlots;
+	static constexpr uint64 MaxDelayTicks = (1ull << (RootBits + (NumLevels - 1) * LevelBits)) - 1;
+
+	struct FTimer
+	{
+		uint64 ExpireTick = 0;
+		uint64 IntervalTicks = 0;
+
+		int32 FunctionRef = 0;
+		int32 SelfRef = 0;
+
+		uint32 Generation = 0;
+		bool bActive = false;
+
+		//links in the slot list
+		int32 Slot = INDEX_NONE;
+		int32 Prev = INDEX_NONE;
+		int32 Next = INDEX_NONE;
+	};
+
+	void Insert(int32 InIndex);
+	void Unlink(int32 InIndex);
+	void Free(lua_State* InL, int32 InIndex);
+
+	//move the timers of a upper level slot down
+	void Cascade(int32 InSlot);
+
+	//collect the timers of the current tick to DueTimers and step the wheel
+	void Step();
+
+	int32 FindTimer(int64 InHandle) const;
+
+	static int64 MakeHandle(int32 InIndex, uint32 InGeneration)
+	{
+		return ((int64)InGeneration << 32) | (int64)InIndex;
+	}
+
+	TArray<FTimer> Timers;
+	TArray<int32> FreeIndices;
+
+	int32 SlotHeads[NumSlots];
+
+	//the first tick not stepped yet
+	uint64 CurrentTick = 0;
+	double PendingSeconds = 0.0;
+
+	//timers of the ticks stepped in this frame, called in order
+	TArray<TPair<int32, uint32>> DueTimers;
+
+	int32 ActiveNum = 0;
+
+	bool bPaused = false;
+	double TimeScale = 1.0;
+};
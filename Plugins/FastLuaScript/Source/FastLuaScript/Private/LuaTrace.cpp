@@ -0,0 +1,193 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "LuaTrace.h"
+#include "UObject/Class.h"
+
+#include "FastLuaScript.h"
+
+#include "lua.hpp"
+
+//CallInfo and Proto of the hooked frame
+extern "C" {
+#include "lstate.h"
+#include "lobject.h"
+#include "ldebug.h"
+}
+
+
+#if CPUPROFILERTRACE_ENABLED
+UE_TRACE_CHANNEL_DEFINE(LuaChannel);
+#endif
+
+FLuaTrace& FLuaTrace::Get()
+{
+	static FLuaTrace Inst;
+	return Inst;
+}
+
+void FLuaTrace::Update(lua_State* InL)
+{
+#if CPUPROFILERTRACE_ENABLED
+	if (InL == nullptr)
+	{
+		return;
+	}
+
+	const bool bEnabled = UE_TRACE_CHANNELEXPR_IS_ENABLED(LuaChannel);
+	const bool bHooked = OpenFrames.Contains(InL);
+	if (bEnabled && !bHooked)
+	{
+		//a debugger or lua.profile hook is kept
+		if (lua_gethook(InL) == nullptr)
+		{
+			OpenFrames.Add(InL);
+			lua_sethook(InL, TraceHook, LUA_MASKCALL | LUA_MASKRET, 0);
+		}
+		else if (!bWarnedHook)
+		{
+			bWarnedHook = true;
+			UE_LOG(LogFastLuaScript, Warning, TEXT("LuaTrace|another hook(debugger, lua.profile) is set on the lua state, its lua functions are not traced"));
+		}
+	}
+	else if (!bEnabled && bHooked)
+	{
+		Detach(InL);
+		if (lua_gethook(InL) == TraceHook)
+		{
+			lua_sethook(InL, nullptr, 0, 0);
+		}
+	}
+#endif
+}
+
+void FLuaTrace::Detach(lua_State* InL)
+{
+#if CPUPROFILERTRACE_ENABLED
+	if (TArray<const CallInfo*>* Frames = OpenFrames.Find(InL))
+	{
+		for (int32 i = 0; i < Frames->Num(); ++i)
+		{
+			FCpuProfilerTrace::OutputEndEvent();
+		}
+
+		OpenFrames.Remove(InL);
+	}
+#endif
+}
+
+void FLuaTrace::PopFrames(TArray<const CallInfo*>& InOutFrames, const CallInfo* InCallInfo)
+{
+#if CPUPROFILERTRACE_ENABLED
+	for (int32 i = InOutFrames.Num() - 1; i >= 0; --i)
+	{
+		if (InOutFrames[i] == InCallInfo)
+		{
+			for (int32 j = InOutFrames.Num() - 1; j >= i; --j)
+			{
+				FCpuProfilerTrace::OutputEndEvent();
+			}
+
+			InOutFrames.SetNum(i, false);
+			return;
+		}
+	}
+#endif
+}
+
+void FLuaTrace::PopFramesAbove(lua_State* InL)
+{
+#if CPUPROFILERTRACE_ENABLED
+	TArray<const CallInfo*>* Frames = OpenFrames.Find(InL);
+	if (Frames == nullptr)
+	{
+		return;
+	}
+
+	//the frames still running are on the chain of InL->ci, the scopes above it are ended from the top
+	int32 RunningNum = Frames->Num();
+	for (; RunningNum > 0; --RunningNum)
+	{
+		const CallInfo* Frame = (*Frames)[RunningNum - 1];
+		const CallInfo* CI = InL->ci;
+		while (CI != nullptr && CI != Frame)
+		{
+			CI = CI->previous;
+		}
+
+		if (CI != nullptr)
+		{
+			break;
+		}
+
+		FCpuProfilerTrace::OutputEndEvent();
+	}
+
+	Frames->SetNum(RunningNum, false);
+#endif
+}
+
+void FLuaTrace::TraceHook(lua_State* InL, lua_Debug* InDebug)
+{
+#if CPUPROFILERTRACE_ENABLED
+	FLuaTrace& Trace = Get();
+
+	//coroutines inherit the hook of the thread making them
+	TArray<const CallInfo*>* Frames = Trace.OpenFrames.Find(InL);
+	if (Frames == nullptr)
+	{
+		lua_sethook(InL, nullptr, 0, 0);
+		return;
+	}
+
+	//a call info in use is not called again: a found one was left by an error, a yield or a tail call
+	const CallInfo* CI = InDebug->i_ci;
+	PopFrames(*Frames, CI);
+
+	if (InDebug->event == LUA_HOOKRET || !isLua(CI))
+	{
+		return;
+	}
+
+	FCpuProfilerTrace::OutputBeginEvent(Trace.GetProtoSpecId(InL, InDebug, ci_func(CI)->p));
+	Frames->Add(CI);
+#endif
+}
+
+uint32 FLuaTrace::GetProtoSpecId(lua_State* InL, lua_Debug* InDebug, const Proto* InProto)
+{
+#if CPUPROFILERTRACE_ENABLED
+	FProtoSpec& Spec = ProtoSpecs.FindOrAdd(InProto);
+	if (Spec.SpecId != 0 && Spec.Source == InProto->source && Spec.LineDefined == InProto->linedefined)
+	{
+		return Spec.SpecId;
+	}
+
+	//the name is the one of the first call
+	lua_getinfo(InL, "Sn", InDebug);
+	const FString Name = FString::Printf(TEXT("%s %s:%d"), InDebug->name ? UTF8_TO_TCHAR(InDebug->name) : TEXT("?"), UTF8_TO_TCHAR(InDebug->short_src), InDebug->linedefined);
+
+	Spec.Source = InProto->source;
+	Spec.LineDefined = InProto->linedefined;
+	Spec.SpecId = FCpuProfilerTrace::OutputEventType(*Name);
+	return Spec.SpecId;
+#else
+	return 0;
+#endif
+}
+
+uint32 FLuaTrace::GetFunctionSpecId(const UFunction* InFunction)
+{
+#if CPUPROFILERTRACE_ENABLED
+	if (const uint32* SpecId = FunctionSpecs.Find(InFunction))
+	{
+		return *SpecId;
+	}
+
+	const UObject* Outer = InFunction->GetOuter();
+	const FString Name = FString::Printf(TEXT("%s::%s"), Outer ? *Outer->GetName() : TEXT("?"), *InFunction->GetName());
+	return FunctionSpecs.Add(InFunction, FCpuProfilerTrace::OutputEventType(*Name));
+#else
+	return 0;
+#endif
+}
@@ -0,0 +1,102 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "ProfilingDebugging/CpuProfilerTrace.h"
+
+struct lua_State;
+struct lua_Debug;
+struct CallInfo;
+struct Proto;
+class UFunction;
+
+#if CPUPROFILERTRACE_ENABLED
+UE_TRACE_CHANNEL_EXTERN(LuaChannel);
+#endif
+
+/**
+ * Unreal Insights cpu scopes of the game states on the Lua trace channel(-trace=cpu,lua):
+ * a scope per lua function call("Update AI/PathCost.lua:12", the event type is registered once per Proto) by a call and return hook,
+ * and a scope per UFunction called from lua("KismetSystemLibrary::PrintString") around ProcessEvent
+ * the hook is set in lua tick when the channel is on and removed when it is off, coroutines are not traced(time lands on resume),
+ * frames left by an error are closed after the lua_pcall from C++ returns and at the end of lua tick(UnwindFrames),
+ * the ones left by a yield or an error caught in lua when their call info is used again
+ */
+class FLuaTrace
+{
+public:
+
+	static FLuaTrace& Get();
+
+	//set or remove the hook of InL by the channel, game thread between two lua calls
+	void Update(lua_State* InL);
+
+	//close the open scopes before lua_close
+	void Detach(lua_State* InL);
+
+	//end the scopes of the frames above the running call of InL: an error skipped their return hook, game thread after a lua_pcall
+	void UnwindFrames(lua_State* InL)
+	{
+#if CPUPROFILERTRACE_ENABLED
+		if (OpenFrames.Num() > 0)
+		{
+			PopFramesAbove(InL);
+		}
+#endif
+	}
+
+	//true if a scope is begun, pass it to EndFunction, no lua_error between the two
+	static bool BeginFunction(const UFunction* InFunction)
+	{
+#if CPUPROFILERTRACE_ENABLED
+		if (UE_TRACE_CHANNELEXPR_IS_ENABLED(LuaChannel))
+		{
+			FCpuProfilerTrace::OutputBeginEvent(Get().GetFunctionSpecId(InFunction));
+			return true;
+		}
+#endif
+		return false;
+	}
+
+	static void EndFunction(bool bInBegun)
+	{
+#if CPUPROFILERTRACE_ENABLED
+		if (bInBegun)
+		{
+			FCpuProfilerTrace::OutputEndEvent();
+		}
+#endif
+	}
+
+protected:
+
+	FLuaTrace() = default;
+
+	static void TraceHook(lua_State* InL, lua_Debug* InDebug);
+
+	//end the scopes from the top down to InCallInfo, nothing if it has no scope
+	static void PopFrames(TArray<const CallInfo*>& InOutFrames, const CallInfo* InCallInfo);
+
+	void PopFramesAbove(lua_State* InL);
+
+	uint32 GetProtoSpecId(lua_State* InL, lua_Debug* InDebug, const Proto* InProto);
+	uint32 GetFunctionSpecId(const UFunction* InFunction);
+
+	struct FProtoSpec
+	{
+		//a new Proto at the address of a collected one is registered again
+		const void* Source = nullptr;
+		int32 LineDefined = 0;
+		uint32 SpecId = 0;
+	};
+
+	//game states with the hook, call infos of the open scopes
+	TMap<lua_State*, TArray<const CallInfo*>> OpenFrames;
+
+	TMap<const Proto*, FProtoSpec> ProtoSpecs;
+	TMap<const UFunction*, uint32> FunctionSpecs;
+
+	//once per run
+	bool bWarnedHook = false;
+};
@@ -0,0 +1,234 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "LuaValueSerializer.h"
+
+#include "lua.hpp"
+
+
+bool FLuaValueSerializer::Write(lua_State* InL, int32 InFirst, int32 InLast, TArray<uint8>& OutData, FString& OutError)
+{
+	const int32 Count = FMath::Max(InLast - InFirst + 1, 0);
+	WriteVarInt(OutData, Count);
+
+	for (int32 i = 0; i < Count; ++i)
+	{
+		if (!WriteValue(InL, InFirst + i, OutData, 0, OutError))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+int32 FLuaValueSerializer::Read(lua_State* InL, const TArray<uint8>& InData)
+{
+	const uint8* Cursor = InData.GetData();
+	const uint8* End = Cursor + InData.Num();
+
+	uint64 Count = 0;
+	if (!ReadVarInt(Cursor, End, Count) || Count > (uint64)InData.Num() || !lua_checkstack(InL, (int32)Count))
+	{
+		return -1;
+	}
+
+	const int32 tp = lua_gettop(InL);
+	for (uint64 i = 0; i < Count; ++i)
+	{
+		if (!ReadValue(InL, Cursor, End, 0))
+		{
+			lua_settop(InL, tp);
+			return -1;
+		}
+	}
+
+	return (int32)Count;
+}
+
+bool FLuaValueSerializer::WriteValue(lua_State* InL, int32 InIndex, TArray<uint8>& OutData, int32 InDepth, FString& OutError)
+{
+	InIndex = lua_absindex(InL, InIndex);
+
+	switch (lua_type(InL, InIndex))
+	{
+	case LUA_TNIL:
+		OutData.Add(ETag::Nil);
+		return true;
+
+	case LUA_TBOOLEAN:
+		OutData.Add(lua_toboolean(InL, InIndex) ? ETag::True : ETag::False);
+		return true;
+
+	case LUA_TNUMBER:
+		if (lua_isinteger(InL, InIndex))
+		{
+			//zigzag, small negative numbers stay small
+			const int64 Value = lua_tointeger(InL, InIndex);
+			OutData.Add(ETag::Integer);
+			WriteVarInt(OutData, ((uint64)Value << 1) ^ (uint64)(Value >> 63));
+		}
+		else
+		{
+			const double Value = lua_tonumber(InL, InIndex);
+			OutData.Add(ETag::Number);
+			OutData.Append((const uint8*)&Value, sizeof(Value));
+		}
+		return true;
+
+	case LUA_TSTRING:
+	{
+		size_t Len = 0;
+		const char* Str = lua_tolstring(InL, InIndex, &Len);
+		OutData.Add(ETag::String);
+		WriteVarInt(OutData, Len);
+		OutData.Append((const uint8*)Str, Len);
+		return true;
+	}
+
+	case LUA_TTABLE:
+	{
+		if (InDepth >= MaxDepth || !lua_checkstack(InL, 3))
+		{
+			OutError = TEXT("table nested too deep or references itself");
+			return false;
+		}
+
+		OutData.Add(ETag::Table);
+		lua_pushnil(InL);
+		while (lua_next(InL, InIndex))
+		{
+			if (!WriteValue(InL, -2, OutData, InDepth + 1, OutError) || !WriteValue(InL, -1, OutData, InDepth + 1, OutError))
+			{
+				lua_pop(InL, 2);
+				return false;
+			}
+
+			lua_pop(InL, 1);
+		}
+		OutData.Add(ETag::TableEnd);
+		return true;
+	}
+
+	default:
+		OutError = FString::Printf(TEXT("%s can not be passed to another state"), UTF8_TO_TCHAR(luaL_typename(InL, InIndex)));
+		return false;
+	}
+}
+
+bool FLuaValueSerializer::ReadValue(lua_State* InL, const uint8*& InOutCursor, const uint8* InEnd, int32 InDepth)
+{
+	if (InOutCursor >= InEnd)
+	{
+		return false;
+	}
+
+	const uint8 Tag = *InOutCursor++;
+	switch (Tag)
+	{
+	case ETag::Nil:
+		lua_pushnil(InL);
+		return true;
+
+	case ETag::False:
+	case ETag::True:
+		lua_pushboolean(InL, Tag == ETag::True);
+		return true;
+
+	case ETag::Integer:
+	{
+		uint64 Value = 0;
+		if (!ReadVarInt(InOutCursor, InEnd, Value))
+		{
+			return false;
+		}
+
+		lua_pushinteger(InL, (lua_Integer)((Value >> 1) ^ (~(Value & 1) + 1)));
+		return true;
+	}
+
+	case ETag::Number:
+	{
+		double Value = 0.0;
+		if (InEnd - InOutCursor < (int64)sizeof(Value))
+		{
+			return false;
+		}
+
+		FMemory::Memcpy(&Value, InOutCursor, sizeof(Value));
+		InOutCursor += sizeof(Value);
+		lua_pushnumber(InL, Value);
+		return true;
+	}
+
+	case ETag::String:
+	{
+		uint64 Len = 0;
+		if (!ReadVarInt(InOutCursor, InEnd, Len) || (uint64)(InEnd - InOutCursor) < Len)
+		{
+			return false;
+		}
+
+		lua_pushlstring(InL, (const char*)InOutCursor, (size_t)Len);
+		InOutCursor += Len;
+		return true;
+	}
+
+	case ETag::Table:
+	{
+		if (InDepth >= MaxDepth || !lua_checkstack(InL, 3))
+		{
+			return false;
+		}
+
+		lua_newtable(InL);
+		while (InOutCursor < InEnd && *InOutCursor != ETag::TableEnd)
+		{
+			if (!ReadValue(InL, InOutCursor, InEnd, InDepth + 1) || !ReadValue(InL, InOutCursor, InEnd, InDepth + 1) || lua_isnil(InL, -2))
+			{
+				return false;
+			}
+
+			lua_rawset(InL, -3);
+		}
+
+		if (InOutCursor >= InEnd)
+		{
+			return false;
+		}
+
+		++InOutCursor;
+		return true;
+	}
+
+	default:
+		return false;
+	}
+}
+
+void FLuaValueSerializer::WriteVarInt(TArray<uint8>& OutData, uint64 InValue)
+{
+	while (InValue >= 0x80)
+	{
+		OutData.Add((uint8)(InValue | 0x80));
+		InValue >>= 7;
+	}
+
+	OutData.Add((uint8)InValue);
+}
+
+bool FLuaValueSerializer::ReadVarInt(const uint8*& InOutCursor, const uint8* InEnd, uint64& OutValue)
+{
+	OutValue = 0;
+	for (int32 Shift = 0; Shift < 64 && InOutCursor < InEnd; Shift += 7)
+	{
+		const uint8 Byte = *InOutCursor++;
+		OutValue |= (uint64)(Byte & 0x7f) << Shift;
+		if ((Byte & 0x80) == 0)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
@@ -0,0 +1,48 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+struct lua_State;
+
+/**
+ * compact binary format for plain lua values moving between states(and threads)
+ * nil, boolean, integer(zigzag varint), number, string and tables of them, metatables are not kept
+ * userdata, functions and threads are rejected: UObjects never leave the game thread state
+ */
+class FLuaValueSerializer
+{
+public:
+
+	//append the values at [InFirst, InLast] of InL, false with OutError when a value can not be serialized
+	static bool Write(lua_State* InL, int32 InFirst, int32 InLast, TArray<uint8>& OutData, FString& OutError);
+
+	//push the values of InData to InL, return the number of values, -1 if InData is corrupted(nothing pushed)
+	static int32 Read(lua_State* InL, const TArray<uint8>& InData);
+
+protected:
+
+	enum ETag : uint8
+	{
+		Nil,
+		False,
+		True,
+		Integer,
+		Number,
+		String,
+		Table,
+		TableEnd,
+	};
+
+	//nested deeper than this is an error, also catches self referencing tables
+	static constexpr int32 MaxDepth = 32;
+
+	static bool WriteValue(lua_State* InL, int32 InIndex, TArray<uint8>& OutData, int32 InDepth, FString& OutError);
+
+	static bool ReadValue(lua_State* InL, const uint8*& InOutCursor, const uint8* InEnd, int32 InDepth);
+
+	static void WriteVarInt(TArray<uint8>& OutData, uint64 InValue);
+
+	static bool ReadVarInt(const uint8*& InOutCursor, const uint8* InEnd, uint64& OutValue);
+};
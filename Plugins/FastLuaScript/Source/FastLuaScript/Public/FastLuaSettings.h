@@ -0,0 +1,72 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Engine/DeveloperSettings.h"
+#include "FastLuaSettings.generated.h"
+
+
+UENUM()
+enum class EFastLuaGCMode : uint8
+{
+	Incremental,
+	Generational,
+};
+
+/**
+ * Project Settings -> Plugins -> Fast Lua Script
+ */
+UCLASS(config = Game, defaultconfig, meta = (DisplayName = "Fast Lua Script"))
+class FASTLUASCRIPT_API UFastLuaSettings : public UDeveloperSettings
+{
+	GENERATED_BODY()
+public:
+
+	virtual FName GetCategoryName() const override { return FName(TEXT("Plugins")); }
+
+	UPROPERTY(config, EditAnywhere, Category = "GC")
+		EFastLuaGCMode GCMode = EFastLuaGCMode::Incremental;
+
+	//stop the automatic collector steps and run them in lua tick under GCStepBudgetMs
+	UPROPERTY(config, EditAnywhere, Category = "GC")
+		bool bFrameBudgetedGC = true;
+
+	UPROPERTY(config, EditAnywhere, Category = "GC", meta = (EditCondition = "bFrameBudgetedGC", ClampMin = "0.01"))
+		float GCStepBudgetMs = 0.5f;
+
+	//incremental mode: KB of work for a single lua_gc(LUA_GCSTEP), raised when allocation rate is high
+	UPROPERTY(config, EditAnywhere, Category = "GC", meta = (EditCondition = "bFrameBudgetedGC", ClampMin = "1"))
+		int32 GCMinStepKB = 16;
+
+	//incremental mode: KB of work per KB allocated since last frame
+	UPROPERTY(config, EditAnywhere, Category = "GC", meta = (EditCondition = "bFrameBudgetedGC", ClampMin = "0.1"))
+		float GCStepAllocMultiplier = 2.0f;
+
+	//full collect when lua memory is over this(MB), 0 to disable
+	UPROPERTY(config, EditAnywhere, Category = "GC", meta = (ClampMin = "0"))
+		int32 EmergencyFullGCThresholdMB = 512;
+
+	//LUA_GCINC params, 0 keeps lua default
+	UPROPERTY(config, EditAnywhere, Category = "GC|Incremental", meta = (ClampMin = "0"))
+		int32 GCPause = 0;
+
+	UPROPERTY(config, EditAnywhere, Category = "GC|Incremental", meta = (ClampMin = "0"))
+		int32 GCStepMul = 0;
+
+	//LUA_GCGEN params, 0 keeps lua default
+	UPROPERTY(config, EditAnywhere, Category = "GC|Generational", meta = (ClampMin = "0"))
+		int32 GCGenMinorMul = 0;
+
+	UPROPERTY(config, EditAnywhere, Category = "GC|Generational", meta = (ClampMin = "0"))
+		int32 GCGenMajorMul = 0;
+
+	//after Init, make the core of the next state(libs, precompiled modules, StandbyModules) on a worker thread, Reset then Init takes it
+	//one more lua state per GameInstance in memory
+	UPROPERTY(config, EditAnywhere, Category = "Startup")
+		bool bPrepareStandbyState = false;
+
+	//pure lua modules required in the standby state: no UObject or Unreal lib call when loaded
+	UPROPERTY(config, EditAnywhere, Category = "Startup", meta = (EditCondition = "bPrepareStandbyState"))
+		TArray<FString> StandbyModules;
+};
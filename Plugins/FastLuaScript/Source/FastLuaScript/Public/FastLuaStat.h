@@ -14,9 +14,47 @@ DECLARE_CYCLE_STAT_EXTERN(TEXT("FetchFromLua"), STAT_FetchFromLua, STATGROUP_Fas
 
 
 DECLARE_CYCLE_STAT_EXTERN(TEXT("CallUnrealFunction"), STAT_CallUnrealFunction, STATGROUP_FastLuaScript, );
+DECLARE_CYCLE_STAT_EXTERN(TEXT("LuaLatentResume"), STAT_LuaLatentResume, STATGROUP_FastLuaScript, );
 
 DECLARE_CYCLE_STAT_EXTERN(TEXT("DelegateCallLua"), STAT_DelegateCallLua, STATGROUP_FastLuaScript, );
+DECLARE_CYCLE_STAT_EXTERN(TEXT("DelegateQueueFlush"), STAT_DelegateQueueFlush, STATGROUP_FastLuaScript, );
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("DelegateEventsQueued"), STAT_DelegateEventsQueued, STATGROUP_FastLuaScript, );
+
+DECLARE_CYCLE_STAT_EXTERN(TEXT("LuaLoadChunk"), STAT_LuaLoadChunk, STATGROUP_FastLuaScript, );
+DECLARE_CYCLE_STAT_EXTERN(TEXT("LuaPrecompile"), STAT_LuaPrecompile, STATGROUP_FastLuaScript, );
+DECLARE_CYCLE_STAT_EXTERN(TEXT("LuaHotReload"), STAT_LuaHotReload, STATGROUP_FastLuaScript, );
+DECLARE_CYCLE_STAT_EXTERN(TEXT("LuaProfilerSample"), STAT_LuaProfilerSample, STATGROUP_FastLuaScript, );
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("LuaBytecodeHits"), STAT_LuaBytecodeHits, STATGROUP_FastLuaScript, );
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("LuaBytecodeMisses"), STAT_LuaBytecodeMisses, STATGROUP_FastLuaScript, );
 
 DECLARE_CYCLE_STAT_EXTERN(TEXT("LuaTick"), STAT_LuaTick, STATGROUP_FastLuaScript, );
 
-DECLARE_MEMORY_STAT_EXTERN(TEXT("LuaMemory"), STAT_LuaMemory, STATGROUP_FastLuaScript, )
\ No newline at end of file
+DECLARE_CYCLE_STAT_EXTERN(TEXT("LuaTickGroup"), STAT_LuaTickGroup, STATGROUP_FastLuaScript, );
+
+DECLARE_CYCLE_STAT_EXTERN(TEXT("LuaBackgroundResume"), STAT_LuaBackgroundResume, STATGROUP_FastLuaScript, );
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("LuaBackgroundSlices"), STAT_LuaBackgroundSlices, STATGROUP_FastLuaScript, );
+
+DECLARE_CYCLE_STAT_EXTERN(TEXT("LuaTimerTick"), STAT_LuaTimerTick, STATGROUP_FastLuaScript, );
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("LuaTimersFired"), STAT_LuaTimersFired, STATGROUP_FastLuaScript, );
+
+DECLARE_CYCLE_STAT_EXTERN(TEXT("LuaGCStep"), STAT_LuaGCStep, STATGROUP_FastLuaScript, );
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("LuaGCCycles"), STAT_LuaGCCycles, STATGROUP_FastLuaScript, );
+
+//per frame collector telemetry, see FLuaGCTelemetry
+DECLARE_FLOAT_COUNTER_STAT_EXTERN(TEXT("LuaGCPauseMs"), STAT_LuaGCPauseMs, STATGROUP_FastLuaScript, );
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("LuaGCSteps"), STAT_LuaGCSteps, STATGROUP_FastLuaScript, );
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("LuaGCMarked"), STAT_LuaGCMarked, STATGROUP_FastLuaScript, );
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("LuaGCSwept"), STAT_LuaGCSwept, STATGROUP_FastLuaScript, );
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("LuaGCFreed"), STAT_LuaGCFreed, STATGROUP_FastLuaScript, );
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("LuaGCFinalizers"), STAT_LuaGCFinalizers, STATGROUP_FastLuaScript, );
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("LuaGCMinorCollections"), STAT_LuaGCMinorCollections, STATGROUP_FastLuaScript, );
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("LuaGCMajorCollections"), STAT_LuaGCMajorCollections, STATGROUP_FastLuaScript, );
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("LuaGCIncCycles"), STAT_LuaGCIncCycles, STATGROUP_FastLuaScript, );
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("LuaAllocKBPerFrame"), STAT_LuaAllocKBPerFrame, STATGROUP_FastLuaScript, );
+
+DECLARE_CYCLE_STAT_EXTERN(TEXT("LuaAsyncRun"), STAT_LuaAsyncRun, STATGROUP_FastLuaScript, );
+DECLARE_CYCLE_STAT_EXTERN(TEXT("LuaAsyncResume"), STAT_LuaAsyncResume, STATGROUP_FastLuaScript, );
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("LuaAsyncJobs"), STAT_LuaAsyncJobs, STATGROUP_FastLuaScript, );
+
+DECLARE_MEMORY_STAT_EXTERN(TEXT("LuaMemory"), STAT_LuaMemory, STATGROUP_FastLuaScript, );
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("LuaAllocs"), STAT_LuaAllocs, STATGROUP_FastLuaScript, );
\ No newline at end of file
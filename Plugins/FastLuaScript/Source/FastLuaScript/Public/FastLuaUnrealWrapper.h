@@ -5,9 +5,19 @@
 #include "CoreMinimal.h"
 #include "Containers/Ticker.h"
 #include "UObject/WeakObjectPtr.h"
+#include "LuaDelegateEventQueue.h"
 
 struct lua_State;
 class UGameInstance;
+class FLuaAllocator;
+class FLuaGCScheduler;
+class FLuaGCTelemetry;
+class FLuaObjectRef;
+class FLuaAsyncJobs;
+class FLuaTimerWheel;
+class FLuaTickRegistry;
+class FLuaCoroutineScheduler;
+class FLuaStandbyState;
 
 /**
  * this is the Entry class for the plugin
@@ -30,15 +40,61 @@ public:
 
 	~FastLuaUnrealWrapper();
 
-	//lua state run on server
+	//the lua state of InGameInstance, created and inited on first use
+	//each GameInstance(PIE client, dedicated server, simulation) has its own state, nullptr is the process wide one
 	static TSharedPtr<FastLuaUnrealWrapper> GetDefault(const UGameInstance* InGameInstance = nullptr);
 
+	//the state of InGameInstance if created, no creation
+	static TSharedPtr<FastLuaUnrealWrapper> FindInstance(const UGameInstance* InGameInstance);
+
+	//reset the state of InGameInstance and drop it from the manager, call it on GameInstance Shutdown
+	static void ReleaseInstance(const UGameInstance* InGameInstance);
+
+	static void ReleaseAllInstances();
+
+	const UGameInstance* GetGameInstance() const { return OwnerGameInstance.Get(); }
+
 	//re-live
 	void Init();
 	void Reset();
 
 	lua_State* GetLuaState() const { return L; }
 
+	//the wrapper owning InL(or the main state of coroutine InL), stored in the lua extra space
+	static FastLuaUnrealWrapper* GetFromLuaState(lua_State* InL);
+
+	FLuaDelegateEventQueue& GetDelegateEventQueue() { return DelegateEventQueue; }
+
+	//all alive wrappers, for console commands and stats
+	static const TArray<FastLuaUnrealWrapper*>& GetAllWrappers() { return AllWrappers; }
+
+	const FLuaAllocator* GetAllocator() const { return Allocator.Get(); }
+	FLuaAllocator* GetAllocator() { return Allocator.Get(); }
+
+	FLuaGCTelemetry* GetGCTelemetry() const { return GCTelemetry.Get(); }
+
+	FLuaObjectRef* GetObjectRef() const { return ObjectRef.Get(); }
+
+	FLuaAsyncJobs* GetAsyncJobs() const { return AsyncJobs.Get(); }
+
+	FLuaTimerWheel* GetTimerWheel() const { return TimerWheel.Get(); }
+
+	FLuaTickRegistry* GetTickRegistry() const { return TickRegistry.Get(); }
+
+	FLuaCoroutineScheduler* GetCoroutineScheduler() const { return CoroutineScheduler.Get(); }
+
+	//add the lua script searcher to package.searchers of InL, also used by the worker states
+	static void InitSearchers(lua_State* InL);
+
+	//lua_atpanic of the game, standby and worker states: logs the error instead of the abort of the default one
+	static int32 LuaPanic(lua_State* InL);
+
+	//standard libs, Unreal lib, delegate metatable and the script searcher, no UObject access: any thread
+	static void InitCoreLibs(lua_State* InL);
+
+	//close the prepared standby state, its modules are out of date
+	void DiscardStandby();
+
 	FString DoLuaCode(const FString& InCode);
 	
 	int32 RunMainFunction(class UGameInstance* InGameInstance);
@@ -50,7 +106,46 @@ protected:
 	FTickerDelegate LuaTickerDelegate;
 	FDelegateHandle LuaTickerHandle;
 
-	bool bTickError = false;
+	FLuaDelegateEventQueue DelegateEventQueue;
+
+	//memory of L, released after lua_close
+	TUniquePtr<FLuaAllocator> Allocator;
+
+	//frame budgeted collector steps, see UFastLuaSettings
+	TUniquePtr<FLuaGCScheduler> GCScheduler;
+
+	TUniquePtr<FLuaGCTelemetry> GCTelemetry;
+
+	//UObjects pushed to L, released after lua_close
+	TUniquePtr<FLuaObjectRef> ObjectRef;
+
+	TWeakObjectPtr<const UGameInstance> OwnerGameInstance;
+
+	//Unreal.Async jobs started by L
+	TUniquePtr<FLuaAsyncJobs> AsyncJobs;
+
+	//Unreal.Timer
+	TUniquePtr<FLuaTimerWheel> TimerWheel;
+
+	//Unreal.RegisterTickFunction, Program.LuaTick is registered in RunMainFunction
+	TUniquePtr<FLuaTickRegistry> TickRegistry;
+	int32 ProgramTickId = 0;
+
+	//Unreal.RunBackground
+	TUniquePtr<FLuaCoroutineScheduler> CoroutineScheduler;
+
+	//next core state, prepared on a worker thread after Init, see UFastLuaSettings::bPrepareStandbyState
+	TUniquePtr<FLuaStandbyState> Standby;
+
+	static TArray<FastLuaUnrealWrapper*> AllWrappers;
+
+	//states created by GetDefault, keyed by GameInstance
+	static TMap<TWeakObjectPtr<const UGameInstance>, TSharedPtr<FastLuaUnrealWrapper>> Instances;
+
+	//reset the states whose GameInstance is gone without ReleaseInstance
+	static void ReleaseStaleInstances();
+
+	void UpdateMemoryStats();
 
 	const char* ProgramTableName = "Program";
 
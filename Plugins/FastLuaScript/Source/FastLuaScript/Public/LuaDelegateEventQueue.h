@@ -0,0 +1,60 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "UObject/WeakObjectPtr.h"
+
+struct lua_State;
+class UFunction;
+class ULuaFunctionWrapper;
+
+/**
+ * per-frame buffer for delegate events bound with Delegate:BindQueued(fn, self)
+ * params are copied when the delegate fires and delivered in HandleLuaTick, one lua call per binding:
+ *	fn([self,] Params, Count, Stride)
+ * Params is a flat array, the params of the i-th event are at (i - 1) * Stride + 1 ... i * Stride
+ * events of one binding keep the fire order, bindings are called in the order of their first event,
+ * events over the frame budget (lua.DelegateQueue.*) stay in the queue for the next frame
+ * delegates with a return value or out params are not queued, their caller reads the results right away
+ */
+class FASTLUASCRIPT_API FLuaDelegateEventQueue
+{
+public:
+
+	~FLuaDelegateEventQueue();
+
+	void Enqueue(ULuaFunctionWrapper* InWrapper, const UFunction* InSignature, void* InParms);
+
+	//deliver queued events to lua, return the number of events delivered
+	int32 Flush(lua_State* InL);
+
+	//drop all pending events
+	void Reset();
+
+	int32 Num() const
+	{
+		return Events.Num();
+	}
+
+protected:
+
+	struct FQueuedEvent
+	{
+		TWeakObjectPtr<ULuaFunctionWrapper> Wrapper;
+		const UFunction* Signature = nullptr;
+		int32 Offset = 0;
+	};
+
+	void DestroyEventParams(const FQueuedEvent& InEvent);
+
+	bool DispatchBatch(lua_State* InL, ULuaFunctionWrapper* InWrapper, const TArray<int32>& InEventIndices);
+
+	//in fire order
+	TArray<FQueuedEvent> Events;
+
+	//copied params of all pending events, UE property types are bitwise relocatable, so the buffer can grow with realloc
+	TArray<uint8> ParamBuffer;
+
+	bool bFlushing = false;
+};
@@ -36,6 +36,7 @@ public:
 
 	static int32 LuaNewDelegate(lua_State* InL);
 	static int32 LuaBindDelegate(lua_State* InL);
+	static int32 LuaBindQueuedDelegate(lua_State* InL);
 	static int32 LuaUnbindDelegate(lua_State* InL);
 	static int32 LuaCallUnrealDelegate(lua_State* InL);
 
@@ -45,6 +46,11 @@ public:
 
 protected:
 
+	static int32 BindDelegate(lua_State* InL, bool InQueued);
+
+	//find the ULuaFunctionWrapper already bound to this delegate for lua function(and self) at InStackIndex
+	class ULuaFunctionWrapper* FindBoundLuaFunction(lua_State* InL, int32 InStackIndex);
+
 	//the UFunction bound to this Delegate
 	const UFunction* FunctionSignature = nullptr;
 
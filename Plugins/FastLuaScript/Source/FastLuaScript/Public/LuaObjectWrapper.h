@@ -6,6 +6,7 @@
 #include "ILuaWrapper.h"
 #include "UObject/WeakObjectPtr.h"
 
+class FLuaObjectRef;
 
 /**
  * 
@@ -13,7 +14,7 @@
 class FASTLUASCRIPT_API FLuaObjectWrapper : public ILuaWrapper
 {
 public:
-	FLuaObjectWrapper(UObject* InObj);
+	FLuaObjectWrapper(lua_State* InL, UObject* InObj);
 
 	virtual ~FLuaObjectWrapper();
 
@@ -44,4 +45,7 @@ protected:
 	friend class FastLuaHelper;
 	UObject* ObjectPtr = nullptr;
 
+	//object ref of the owning state, released in the destructor
+	FLuaObjectRef* ObjectRef = nullptr;
+
 };
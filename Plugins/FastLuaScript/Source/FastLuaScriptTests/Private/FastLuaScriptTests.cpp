@@ -0,0 +1,6 @@
+// Copyright 1998-2019 Epic Games, Inc. All Rights Reserved.
+
+#include "Modules/ModuleManager.h"
+
+//automation tests only: Automation RunTests FastLua
+IMPLEMENT_MODULE(FDefaultModuleImpl, FastLuaScriptTests)
@@ -0,0 +1,125 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "LuaPerfBench.h"
+#include "Misc/CommandLine.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Parse.h"
+#include "Misc/Paths.h"
+#include "Misc/DateTime.h"
+
+#include "LuaObjectWrapper.h"
+
+#include "lua.hpp"
+
+
+FLuaPerfBench::FLuaPerfBench(const FString& InGroup)
+	: Group(InGroup)
+{
+
+}
+
+void FLuaPerfBench::Run(const FString& InName, int32 InIterations, TFunctionRef<void(int32)> InBody)
+{
+	TArray<double> RunSeconds;
+	for (int32 i = 0; i <= Repeats; ++i)
+	{
+		const double StartTime = FPlatformTime::Seconds();
+		InBody(InIterations);
+		const double EndTime = FPlatformTime::Seconds();
+
+		//the first run warms the caches and the lua metatables
+		if (i > 0)
+		{
+			RunSeconds.Add(EndTime - StartTime);
+		}
+	}
+
+	AddResult(InName, InIterations, RunSeconds);
+}
+
+bool FLuaPerfBench::RunLua(lua_State* InL, const FString& InName, int32 InIterations, const char* InCode, UObject* InObj, FString& OutError)
+{
+	int32 tp = lua_gettop(InL);
+
+	const FString Chunk = FString::Printf(TEXT("return function(Obj, N) %s end"), UTF8_TO_TCHAR(InCode));
+	if (luaL_loadstring(InL, TCHAR_TO_UTF8(*Chunk)) != LUA_OK || lua_pcall(InL, 0, 1, 0) != LUA_OK)
+	{
+		OutError = FString::Printf(TEXT("%s: %s"), *InName, UTF8_TO_TCHAR(lua_tostring(InL, -1)));
+		lua_settop(InL, tp);
+		return false;
+	}
+
+	const int32 FunctionIdx = lua_gettop(InL);
+
+	TArray<double> RunSeconds;
+	for (int32 i = 0; i <= Repeats; ++i)
+	{
+		lua_pushvalue(InL, FunctionIdx);
+		FLuaObjectWrapper::PushObject(InL, InObj);
+		lua_pushinteger(InL, InIterations);
+
+		const double StartTime = FPlatformTime::Seconds();
+		const int32 CallRet = lua_pcall(InL, 2, 0, 0);
+		const double EndTime = FPlatformTime::Seconds();
+
+		if (CallRet != LUA_OK)
+		{
+			OutError = FString::Printf(TEXT("%s: %s"), *InName, UTF8_TO_TCHAR(lua_tostring(InL, -1)));
+			lua_settop(InL, tp);
+			return false;
+		}
+
+		if (i > 0)
+		{
+			RunSeconds.Add(EndTime - StartTime);
+		}
+	}
+
+	lua_settop(InL, tp);
+
+	//garbage of this case is not paid by the next one
+	lua_gc(InL, LUA_GCCOLLECT, 0);
+
+	AddResult(InName, InIterations, RunSeconds);
+	return true;
+}
+
+void FLuaPerfBench::AddResult(const FString& InName, int32 InIterations, TArray<double>& InRunSeconds)
+{
+	InRunSeconds.Sort();
+
+	FResult& Result = Results.AddDefaulted_GetRef();
+	Result.Name = InName;
+	Result.Iterations = InIterations;
+
+	const double NsPerIteration = 1e9 / FMath::Max(InIterations, 1);
+	Result.MinNs = InRunSeconds[0] * NsPerIteration;
+	Result.MedianNs = InRunSeconds[InRunSeconds.Num() / 2] * NsPerIteration;
+}
+
+FString FLuaPerfBench::Save() const
+{
+	FString Dir = FPaths::AutomationDir() / TEXT("FastLuaPerf");
+	FParse::Value(FCommandLine::Get(), TEXT("FastLuaPerfDir="), Dir);
+
+	const FString Time = FDateTime::Now().ToIso8601();
+
+	//names are plain identifiers, no escaping
+	FString Json = FString::Printf(TEXT("{\n\"group\": \"%s\",\n\"time\": \"%s\",\n\"repeats\": %d,\n\"results\": [\n"), *Group, *Time, Repeats);
+	FString Csv = TEXT("group,name,iterations,min_ns,median_ns\n");
+	for (int32 i = 0; i < Results.Num(); ++i)
+	{
+		const FResult& Result = Results[i];
+		Json += FString::Printf(TEXT("\t{\"name\": \"%s\", \"iterations\": %d, \"min_ns\": %.2f, \"median_ns\": %.2f}%s\n"),
+			*Result.Name, Result.Iterations, Result.MinNs, Result.MedianNs, i + 1 < Results.Num() ? TEXT(",") : TEXT(""));
+		Csv += FString::Printf(TEXT("%s,%s,%d,%.2f,%.2f\n"), *Group, *Result.Name, Result.Iterations, Result.MinNs, Result.MedianNs);
+	}
+	Json += TEXT("]\n}\n");
+
+	const FString JsonFile = Dir / Group + TEXT(".json");
+	FFileHelper::SaveStringToFile(Json, *JsonFile, FFileHelper::EEncodingOptions::ForceUTF8WithoutBOM);
+	FFileHelper::SaveStringToFile(Csv, *(Dir / Group + TEXT(".csv")), FFileHelper::EEncodingOptions::ForceUTF8WithoutBOM);
+
+	return JsonFile;
+}
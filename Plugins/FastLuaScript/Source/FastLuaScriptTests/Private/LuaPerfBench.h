@@ -0,0 +1,53 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Templates/Function.h"
+
+struct lua_State;
+class UObject;
+
+/**
+ * timing and results of one FastLua.Perf group
+ * each case runs once to warm up then Repeats times, the fastest and the median run are kept as ns per iteration
+ * Save writes <Group>.json and <Group>.csv to Saved/Automation/FastLuaPerf, or to -FastLuaPerfDir=<dir>
+ */
+class FLuaPerfBench
+{
+public:
+
+	static constexpr int32 Repeats = 5;
+
+	struct FResult
+	{
+		//"Push.Int"
+		FString Name;
+		int32 Iterations = 0;
+		double MinNs = 0.0;
+		double MedianNs = 0.0;
+	};
+
+	explicit FLuaPerfBench(const FString& InGroup);
+
+	//time InBody(InIterations) from C++
+	void Run(const FString& InName, int32 InIterations, TFunctionRef<void(int32)> InBody);
+
+	//time the lua function(Obj, N) with InCode as body, error in OutError
+	bool RunLua(lua_State* InL, const FString& InName, int32 InIterations, const char* InCode, UObject* InObj, FString& OutError);
+
+	//the json file
+	FString Save() const;
+
+	const TArray<FResult>& GetResults() const
+	{
+		return Results;
+	}
+
+protected:
+
+	void AddResult(const FString& InName, int32 InIterations, TArray<double>& InRunSeconds);
+
+	FString Group;
+	TArray<FResult> Results;
+};
@@ -0,0 +1,132 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "UObject/Object.h"
+#include "LuaPerfTestObject.generated.h"
+
+UENUM()
+enum class ELuaPerfEnum : uint8
+{
+	First,
+	Second,
+	Third,
+};
+
+USTRUCT()
+struct FLuaPerfStruct
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+		int32 IntValue = 0;
+
+	UPROPERTY()
+		float FloatValue = 0.f;
+
+	UPROPERTY()
+		FVector VectorValue = FVector::ZeroVector;
+
+	UPROPERTY()
+		FString StringValue;
+};
+
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FOnLuaPerfEvent, int32, InValue);
+
+/**
+ * target of the FastLua.Perf tests, one property per kind handled by FastLuaHelper
+ */
+UCLASS()
+class ULuaPerfTestObject : public UObject
+{
+	GENERATED_BODY()
+
+public:
+
+	UPROPERTY()
+		int32 IntValue = 0;
+
+	UPROPERTY()
+		float FloatValue = 0.f;
+
+	UPROPERTY()
+		bool bBoolValue = false;
+
+	UPROPERTY()
+		FName NameValue;
+
+	UPROPERTY()
+		FString StringValue;
+
+	UPROPERTY()
+		FText TextValue;
+
+	UPROPERTY()
+		ELuaPerfEnum EnumValue = ELuaPerfEnum::First;
+
+	UPROPERTY()
+		UObject* ObjectValue = nullptr;
+
+	UPROPERTY()
+		FVector VectorValue = FVector::ZeroVector;
+
+	UPROPERTY()
+		FLuaPerfStruct StructValue;
+
+	UPROPERTY()
+		TArray<int32> IntArray;
+
+	UPROPERTY()
+		TArray<FVector> VectorArray;
+
+	UPROPERTY()
+		TMap<int32, float> IntFloatMap;
+
+	UPROPERTY()
+		TSet<int32> IntSet;
+
+	//UE -> lua
+	UPROPERTY()
+		FOnLuaPerfEvent OnToLua;
+
+	//lua -> UE, bound to HandleFromLua
+	UPROPERTY()
+		FOnLuaPerfEvent OnFromLua;
+
+	UFUNCTION()
+		void Call0()
+	{
+		++CallNum;
+	}
+
+	UFUNCTION()
+		int32 Call1(int32 A)
+	{
+		++CallNum;
+		return A;
+	}
+
+	UFUNCTION()
+		int32 Call4(int32 A, int32 B, float C, float D)
+	{
+		++CallNum;
+		return A + B + (int32)(C + D);
+	}
+
+	UFUNCTION()
+		float Call8(int32 A, int32 B, int32 C, int32 D, float E, float F, float G, float H)
+	{
+		++CallNum;
+		return A + B + C + D + E + F + G + H;
+	}
+
+	UFUNCTION()
+		void HandleFromLua(int32 InValue)
+	{
+		CallNum += InValue > 0 ? 1 : 0;
+	}
+
+	//keeps the calls from being optimized away
+	int32 CallNum = 0;
+};
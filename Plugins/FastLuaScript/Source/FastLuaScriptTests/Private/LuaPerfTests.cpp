@@ -0,0 +1,384 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "CoreMinimal.h"
+#include "Misc/AutomationTest.h"
+#include "UObject/Package.h"
+
+#include "FastLuaUnrealWrapper.h"
+#include "FastLuaHelper.h"
+#include "LuaObjectWrapper.h"
+#include "LuaPerfBench.h"
+#include "LuaPerfTestObject.h"
+
+#include "lua.hpp"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+/**
+ * binding microbenchmarks, headless: UE4Editor-Cmd <Project> -nullrhi -ExecCmds="Automation RunTests FastLua.Perf; Quit"
+ * each group writes Saved/Automation/FastLuaPerf/<Group>.json and .csv(-FastLuaPerfDir=<dir> to change it)
+ * all cases run on the process wide state(FastLuaUnrealWrapper::GetDefault()), numbers are ns per iteration
+ */
+namespace LuaPerfTests
+{
+	static const int32 Iterations = 100000;
+
+	static const int32 ContainerSizes[] = { 1, 16, 256, 4096 };
+
+	//the default state and a rooted test object
+	struct FContext
+	{
+		TSharedPtr<FastLuaUnrealWrapper> Wrapper;
+		lua_State* L = nullptr;
+		ULuaPerfTestObject* Obj = nullptr;
+		int32 Top = 0;
+
+		FContext()
+		{
+			Wrapper = FastLuaUnrealWrapper::GetDefault();
+			L = Wrapper.IsValid() ? Wrapper->GetLuaState() : nullptr;
+			if (L)
+			{
+				Top = lua_gettop(L);
+				Obj = NewObject<ULuaPerfTestObject>(GetTransientPackage());
+				Obj->AddToRoot();
+			}
+		}
+
+		~FContext()
+		{
+			if (Obj)
+			{
+				Obj->OnToLua.Clear();
+				Obj->OnFromLua.Clear();
+				Obj->RemoveFromRoot();
+			}
+
+			if (L)
+			{
+				lua_settop(L, Top);
+				lua_gc(L, LUA_GCCOLLECT, 0);
+			}
+		}
+
+		FProperty* FindProperty(const TCHAR* InName) const
+		{
+			return ULuaPerfTestObject::StaticClass()->FindPropertyByName(InName);
+		}
+	};
+
+	//call function(Obj) with InCode as body once, for bindings made before a case
+	static bool DoLua(FAutomationTestBase& InTest, FContext& InContext, const char* InCode)
+	{
+		int32 tp = lua_gettop(InContext.L);
+		const FString Chunk = FString::Printf(TEXT("return function(Obj) %s end"), UTF8_TO_TCHAR(InCode));
+
+		bool bOK = luaL_loadstring(InContext.L, TCHAR_TO_UTF8(*Chunk)) == LUA_OK && lua_pcall(InContext.L, 0, 1, 0) == LUA_OK;
+		if (bOK)
+		{
+			FLuaObjectWrapper::PushObject(InContext.L, InContext.Obj);
+			bOK = lua_pcall(InContext.L, 1, 0, 0) == LUA_OK;
+		}
+
+		if (!bOK)
+		{
+			InTest.AddError(UTF8_TO_TCHAR(lua_tostring(InContext.L, -1)));
+		}
+
+		lua_settop(InContext.L, tp);
+		return bOK;
+	}
+
+	static void RunLua(FAutomationTestBase& InTest, FLuaPerfBench& InBench, FContext& InContext, const TCHAR* InName, int32 InIterations, const char* InCode)
+	{
+		FString Error;
+		if (!InBench.RunLua(InContext.L, InName, InIterations, InCode, InContext.Obj, Error))
+		{
+			InTest.AddError(Error);
+		}
+	}
+
+	//PushProperty and FetchProperty of the property InPropName of the test object
+	static void PushFetch(FAutomationTestBase& InTest, FLuaPerfBench& InBench, FContext& InContext, const FString& InKind, const TCHAR* InPropName, int32 InIterations)
+	{
+		lua_State* L = InContext.L;
+		ULuaPerfTestObject* Obj = InContext.Obj;
+		FProperty* Prop = InContext.FindProperty(InPropName);
+		if (Prop == nullptr)
+		{
+			InTest.AddError(FString::Printf(TEXT("no property %s"), InPropName));
+			return;
+		}
+
+		InBench.Run(TEXT("Push.") + InKind, InIterations, [L, Obj, Prop](int32 InNum)
+		{
+			for (int32 i = 0; i < InNum; ++i)
+			{
+				FastLuaHelper::PushProperty(L, Prop, Obj);
+				lua_pop(L, 1);
+			}
+		});
+		lua_gc(L, LUA_GCCOLLECT, 0);
+
+		//fetch back the value it pushes
+		FastLuaHelper::PushProperty(L, Prop, Obj);
+		const int32 ValueIdx = lua_gettop(L);
+		InBench.Run(TEXT("Fetch.") + InKind, InIterations, [L, Obj, Prop, ValueIdx](int32 InNum)
+		{
+			for (int32 i = 0; i < InNum; ++i)
+			{
+				FastLuaHelper::FetchProperty(L, Prop, Obj, ValueIdx);
+			}
+		});
+		lua_settop(L, ValueIdx - 1);
+		lua_gc(L, LUA_GCCOLLECT, 0);
+	}
+
+	static bool Finish(FAutomationTestBase& InTest, const FLuaPerfBench& InBench)
+	{
+		for (const FLuaPerfBench::FResult& Result : InBench.GetResults())
+		{
+			InTest.AddInfo(FString::Printf(TEXT("%-32s %10.1f ns (median %.1f) x%d"), *Result.Name, Result.MinNs, Result.MedianNs, Result.Iterations));
+		}
+
+		InTest.AddInfo(FString::Printf(TEXT("results: %s"), *InBench.Save()));
+		return !InTest.HasAnyErrors();
+	}
+}
+
+
+#define LUA_PERF_TEST_FLAGS (EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::PerfFilter)
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FLuaPerfPropertyTest, "FastLua.Perf.Property", LUA_PERF_TEST_FLAGS)
+bool FLuaPerfPropertyTest::RunTest(const FString& Parameters)
+{
+	LuaPerfTests::FContext Context;
+	if (Context.L == nullptr)
+	{
+		AddError(TEXT("no lua state"));
+		return false;
+	}
+
+	Context.Obj->NameValue = TEXT("PerfName");
+	Context.Obj->StringValue = TEXT("PerfString");
+	Context.Obj->TextValue = FText::FromString(TEXT("PerfText"));
+	Context.Obj->ObjectValue = Context.Obj;
+	Context.Obj->StructValue.StringValue = TEXT("PerfString");
+
+	FLuaPerfBench Bench(TEXT("Property"));
+
+	LuaPerfTests::PushFetch(*this, Bench, Context, TEXT("Int"), TEXT("IntValue"), LuaPerfTests::Iterations);
+	LuaPerfTests::PushFetch(*this, Bench, Context, TEXT("Float"), TEXT("FloatValue"), LuaPerfTests::Iterations);
+	LuaPerfTests::PushFetch(*this, Bench, Context, TEXT("Bool"), TEXT("bBoolValue"), LuaPerfTests::Iterations);
+	LuaPerfTests::PushFetch(*this, Bench, Context, TEXT("Name"), TEXT("NameValue"), LuaPerfTests::Iterations);
+	LuaPerfTests::PushFetch(*this, Bench, Context, TEXT("String"), TEXT("StringValue"), LuaPerfTests::Iterations);
+	LuaPerfTests::PushFetch(*this, Bench, Context, TEXT("Text"), TEXT("TextValue"), LuaPerfTests::Iterations);
+	LuaPerfTests::PushFetch(*this, Bench, Context, TEXT("Enum"), TEXT("EnumValue"), LuaPerfTests::Iterations);
+	LuaPerfTests::PushFetch(*this, Bench, Context, TEXT("Object"), TEXT("ObjectValue"), LuaPerfTests::Iterations);
+	LuaPerfTests::PushFetch(*this, Bench, Context, TEXT("Vector"), TEXT("VectorValue"), LuaPerfTests::Iterations);
+	LuaPerfTests::PushFetch(*this, Bench, Context, TEXT("Struct"), TEXT("StructValue"), LuaPerfTests::Iterations);
+
+	return LuaPerfTests::Finish(*this, Bench);
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FLuaPerfFunctionTest, "FastLua.Perf.Function", LUA_PERF_TEST_FLAGS)
+bool FLuaPerfFunctionTest::RunTest(const FString& Parameters)
+{
+	LuaPerfTests::FContext Context;
+	if (Context.L == nullptr)
+	{
+		AddError(TEXT("no lua state"));
+		return false;
+	}
+
+	FLuaPerfBench Bench(TEXT("Function"));
+
+	//the loop alone, to subtract from the others
+	LuaPerfTests::RunLua(*this, Bench, Context, TEXT("Lua.EmptyLoop"), LuaPerfTests::Iterations, "for i = 1, N do end");
+
+	LuaPerfTests::RunLua(*this, Bench, Context, TEXT("Call.0"), LuaPerfTests::Iterations, "for i = 1, N do Obj:Call0() end");
+	LuaPerfTests::RunLua(*this, Bench, Context, TEXT("Call.1"), LuaPerfTests::Iterations, "for i = 1, N do Obj:Call1(i) end");
+	LuaPerfTests::RunLua(*this, Bench, Context, TEXT("Call.4"), LuaPerfTests::Iterations, "for i = 1, N do Obj:Call4(i, 2, 3.0, 4.0) end");
+	LuaPerfTests::RunLua(*this, Bench, Context, TEXT("Call.8"), LuaPerfTests::Iterations, "for i = 1, N do Obj:Call8(i, 2, 3, 4, 5.0, 6.0, 7.0, 8.0) end");
+
+	//without the metatable lookup of the method
+	LuaPerfTests::RunLua(*this, Bench, Context, TEXT("Call.0.LocalMethod"), LuaPerfTests::Iterations, "local F = Obj.Call0 for i = 1, N do F(Obj) end");
+
+	return LuaPerfTests::Finish(*this, Bench);
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FLuaPerfStructTest, "FastLua.Perf.Struct", LUA_PERF_TEST_FLAGS)
+bool FLuaPerfStructTest::RunTest(const FString& Parameters)
+{
+	LuaPerfTests::FContext Context;
+	if (Context.L == nullptr)
+	{
+		AddError(TEXT("no lua state"));
+		return false;
+	}
+
+	FLuaPerfBench Bench(TEXT("Struct"));
+
+	//S is a copy of Obj.StructValue in a lua userdata
+	LuaPerfTests::RunLua(*this, Bench, Context, TEXT("Get.Int"), LuaPerfTests::Iterations, "local S = Obj:GetStructValue() for i = 1, N do S:GetIntValue() end");
+	LuaPerfTests::RunLua(*this, Bench, Context, TEXT("Set.Int"), LuaPerfTests::Iterations, "local S = Obj:GetStructValue() for i = 1, N do S:SetIntValue(i) end");
+	LuaPerfTests::RunLua(*this, Bench, Context, TEXT("Get.Float"), LuaPerfTests::Iterations, "local S = Obj:GetStructValue() for i = 1, N do S:GetFloatValue() end");
+	LuaPerfTests::RunLua(*this, Bench, Context, TEXT("Set.Float"), LuaPerfTests::Iterations, "local S = Obj:GetStructValue() for i = 1, N do S:SetFloatValue(i) end");
+	LuaPerfTests::RunLua(*this, Bench, Context, TEXT("Get.Vector"), LuaPerfTests::Iterations, "local S = Obj:GetStructValue() for i = 1, N do S:GetVectorValue() end");
+	LuaPerfTests::RunLua(*this, Bench, Context, TEXT("Set.Vector"), LuaPerfTests::Iterations, "local S = Obj:GetStructValue() local V = S:GetVectorValue() for i = 1, N do S:SetVectorValue(V) end");
+	LuaPerfTests::RunLua(*this, Bench, Context, TEXT("Get.String"), LuaPerfTests::Iterations, "local S = Obj:GetStructValue() for i = 1, N do S:GetStringValue() end");
+	LuaPerfTests::RunLua(*this, Bench, Context, TEXT("Set.String"), LuaPerfTests::Iterations, "local S = Obj:GetStructValue() for i = 1, N do S:SetStringValue('PerfString') end");
+
+	//the struct property of an object: a new userdata per get
+	LuaPerfTests::RunLua(*this, Bench, Context, TEXT("Object.Get.Struct"), LuaPerfTests::Iterations, "for i = 1, N do Obj:GetStructValue() end");
+
+	return LuaPerfTests::Finish(*this, Bench);
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FLuaPerfObjectTest, "FastLua.Perf.Object", LUA_PERF_TEST_FLAGS)
+bool FLuaPerfObjectTest::RunTest(const FString& Parameters)
+{
+	LuaPerfTests::FContext Context;
+	if (Context.L == nullptr)
+	{
+		AddError(TEXT("no lua state"));
+		return false;
+	}
+
+	lua_State* L = Context.L;
+	ULuaPerfTestObject* Obj = Context.Obj;
+	Obj->ObjectValue = Obj;
+
+	FLuaPerfBench Bench(TEXT("Object"));
+
+	//every push makes a userdata, cached: the class metatable is there
+	Bench.Run(TEXT("Push.Cached"), LuaPerfTests::Iterations, [L, Obj](int32 InNum)
+	{
+		for (int32 i = 0; i < InNum; ++i)
+		{
+			FLuaObjectWrapper::PushObject(L, Obj);
+			lua_pop(L, 1);
+		}
+	});
+	lua_gc(L, LUA_GCCOLLECT, 0);
+
+	//new: the class metatable is built again
+	Bench.Run(TEXT("Push.New"), LuaPerfTests::Iterations / 100, [L, Obj](int32 InNum)
+	{
+		for (int32 i = 0; i < InNum; ++i)
+		{
+			lua_pushnil(L);
+			lua_rawsetp(L, LUA_REGISTRYINDEX, Obj->GetClass());
+			FLuaObjectWrapper::PushObject(L, Obj);
+			lua_pop(L, 1);
+		}
+	});
+	lua_gc(L, LUA_GCCOLLECT, 0);
+
+	LuaPerfTests::RunLua(*this, Bench, Context, TEXT("Get.Int"), LuaPerfTests::Iterations, "for i = 1, N do Obj:GetIntValue() end");
+	LuaPerfTests::RunLua(*this, Bench, Context, TEXT("Set.Int"), LuaPerfTests::Iterations, "for i = 1, N do Obj:SetIntValue(i) end");
+	LuaPerfTests::RunLua(*this, Bench, Context, TEXT("Get.Object"), LuaPerfTests::Iterations, "for i = 1, N do Obj:GetObjectValue() end");
+	LuaPerfTests::RunLua(*this, Bench, Context, TEXT("Set.Object"), LuaPerfTests::Iterations, "for i = 1, N do Obj:SetObjectValue(Obj) end");
+
+	return LuaPerfTests::Finish(*this, Bench);
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FLuaPerfDelegateTest, "FastLua.Perf.Delegate", LUA_PERF_TEST_FLAGS)
+bool FLuaPerfDelegateTest::RunTest(const FString& Parameters)
+{
+	LuaPerfTests::FContext Context;
+	if (Context.L == nullptr)
+	{
+		AddError(TEXT("no lua state"));
+		return false;
+	}
+
+	lua_State* L = Context.L;
+	ULuaPerfTestObject* Obj = Context.Obj;
+
+	FLuaPerfBench Bench(TEXT("Delegate"));
+
+	//UE -> lua, one lua call per broadcast
+	if (LuaPerfTests::DoLua(*this, Context, "Obj:GetOnToLua():Bind(function(V) end)"))
+	{
+		Bench.Run(TEXT("UEToLua"), LuaPerfTests::Iterations, [Obj](int32 InNum)
+		{
+			for (int32 i = 0; i < InNum; ++i)
+			{
+				Obj->OnToLua.Broadcast(i);
+			}
+		});
+	}
+	Obj->OnToLua.Clear();
+
+	//UE -> lua queued, broadcasts copy the params, the flush makes one lua call
+	FLuaDelegateEventQueue& EventQueue = Context.Wrapper->GetDelegateEventQueue();
+	if (LuaPerfTests::DoLua(*this, Context, "Obj:GetOnToLua():BindQueued(function(Params, Count, Stride) end)"))
+	{
+		Bench.Run(TEXT("UEToLua.Queued"), LuaPerfTests::Iterations, [Obj, L, &EventQueue](int32 InNum)
+		{
+			for (int32 i = 0; i < InNum; ++i)
+			{
+				Obj->OnToLua.Broadcast(i);
+			}
+
+			//over lua.DelegateQueue.MaxEventsPerFrame events take several flushes
+			while (EventQueue.Num() > 0 && EventQueue.Flush(L) > 0)
+			{
+			}
+		});
+	}
+	Obj->OnToLua.Clear();
+	EventQueue.Reset();
+
+	//lua -> UE
+	Obj->OnFromLua.AddDynamic(Obj, &ULuaPerfTestObject::HandleFromLua);
+	LuaPerfTests::RunLua(*this, Bench, Context, TEXT("LuaToUE"), LuaPerfTests::Iterations, "local D = Obj:GetOnFromLua() for i = 1, N do D:Call(i) end");
+	Obj->OnFromLua.Clear();
+
+	return LuaPerfTests::Finish(*this, Bench);
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FLuaPerfContainerTest, "FastLua.Perf.Container", LUA_PERF_TEST_FLAGS)
+bool FLuaPerfContainerTest::RunTest(const FString& Parameters)
+{
+	LuaPerfTests::FContext Context;
+	if (Context.L == nullptr)
+	{
+		AddError(TEXT("no lua state"));
+		return false;
+	}
+
+	ULuaPerfTestObject* Obj = Context.Obj;
+
+	FLuaPerfBench Bench(TEXT("Container"));
+
+	for (int32 Size : LuaPerfTests::ContainerSizes)
+	{
+		Obj->IntArray.Reset();
+		Obj->VectorArray.Reset();
+		Obj->IntFloatMap.Reset();
+		Obj->IntSet.Reset();
+		for (int32 i = 0; i < Size; ++i)
+		{
+			Obj->IntArray.Add(i);
+			Obj->VectorArray.Add(FVector(i, i, i));
+			Obj->IntFloatMap.Add(i, i * 0.5f);
+			Obj->IntSet.Add(i);
+		}
+
+		//about the same number of elements in each case
+		const int32 ContainerIterations = FMath::Max(LuaPerfTests::Iterations * 4 / (Size + 16), 10);
+
+		LuaPerfTests::PushFetch(*this, Bench, Context, FString::Printf(TEXT("Array.Int.%d"), Size), TEXT("IntArray"), ContainerIterations);
+		LuaPerfTests::PushFetch(*this, Bench, Context, FString::Printf(TEXT("Array.Vector.%d"), Size), TEXT("VectorArray"), ContainerIterations);
+		LuaPerfTests::PushFetch(*this, Bench, Context, FString::Printf(TEXT("Map.IntFloat.%d"), Size), TEXT("IntFloatMap"), ContainerIterations);
+		LuaPerfTests::PushFetch(*this, Bench, Context, FString::Printf(TEXT("Set.Int.%d"), Size), TEXT("IntSet"), ContainerIterations);
+	}
+
+	return LuaPerfTests::Finish(*this, Bench);
+}
+
+#undef LUA_PERF_TEST_FLAGS
+
+#endif
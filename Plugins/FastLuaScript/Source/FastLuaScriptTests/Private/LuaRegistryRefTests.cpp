@@ -0,0 +1,70 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "CoreMinimal.h"
+#include "Misc/AutomationTest.h"
+
+#include "FastLuaUnrealWrapper.h"
+
+#include "lua.hpp"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+/**
+ * the native schedulers keep lua functions and selves as registry refs, a ref released twice or a release of ref 0
+ * breaks the free list of luaL_ref(t[0] in lua 5.4) and the registry grows with every new ref
+ */
+namespace LuaRegistryRefTests
+{
+	static const int32 Cycles = 1000;
+
+	//refs handed out past this are leaked slots
+	static const int32 MaxGrowth = 8;
+
+	static int32 RegistrySize(lua_State* InL)
+	{
+		return (int32)lua_rawlen(InL, LUA_REGISTRYINDEX);
+	}
+
+	static bool DoLua(FAutomationTestBase& InTest, lua_State* InL, const char* InCode)
+	{
+		int32 tp = lua_gettop(InL);
+		const bool bOK = luaL_dostring(InL, InCode) == LUA_OK;
+		if (!bOK)
+		{
+			InTest.AddError(UTF8_TO_TCHAR(lua_tostring(InL, -1)));
+		}
+
+		lua_settop(InL, tp);
+		return bOK;
+	}
+}
+
+#define LUA_REF_TEST_FLAGS (EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FLuaTimerRefTest, "FastLua.Refs.Timer", LUA_REF_TEST_FLAGS)
+bool FLuaTimerRefTest::RunTest(const FString& Parameters)
+{
+	TSharedPtr<FastLuaUnrealWrapper> Wrapper = FastLuaUnrealWrapper::GetDefault();
+	lua_State* L = Wrapper.IsValid() ? Wrapper->GetLuaState() : nullptr;
+	if (L == nullptr)
+	{
+		AddError(TEXT("no lua state"));
+		return false;
+	}
+
+	const int32 StartSize = LuaRegistryRefTests::RegistrySize(L);
+
+	//timers without self, cleared
+	const FString ClearCode = FString::Printf(TEXT("local f = function() end for i = 1, %d do Unreal.Timer.Clear(Unreal.Timer.Set(10, 0, f)) end"), LuaRegistryRefTests::Cycles);
+	LuaRegistryRefTests::DoLua(*this, L, TCHAR_TO_UTF8(*ClearCode));
+	TestTrue(TEXT("cleared timers release their refs"), LuaRegistryRefTests::RegistrySize(L) <= StartSize + LuaRegistryRefTests::MaxGrowth);
+
+	//with a self, both refs go back to the free list
+	const FString SelfCode = FString::Printf(TEXT("local f = function() end local s = {} for i = 1, %d do Unreal.Timer.Clear(Unreal.Timer.Set(10, 0, f, s)) end"), LuaRegistryRefTests::Cycles);
+	LuaRegistryRefTests::DoLua(*this, L, TCHAR_TO_UTF8(*SelfCode));
+	TestTrue(TEXT("timers with self release their refs"), LuaRegistryRefTests::RegistrySize(L) <= StartSize + LuaRegistryRefTests::MaxGrowth);
+
+	return true;
+}
+
+#endif
@@ -7,6 +7,10 @@ using System.Diagnostics;
 
 public class Lua : ModuleRules
 {
+    //instrumented lvm.c for lua.opstats(opcode, function and metamethod counters), slows the VM down: profiling builds only
+    //LUA_OPSTATS=1 in the environment turns it on without editing this file
+    private bool bLuaOpStats = false;
+
     public Lua(ReadOnlyTargetRules Target) : base(Target)
 	{
         PCHUsage = PCHUsageMode.UseExplicitOrSharedPCHs;
@@ -32,6 +36,10 @@ public class Lua : ModuleRules
 			PublicDefinitions.Add("LUA_BUILD_AS_DLL=1");
         }
 
+        //public: the size of Proto and global_State depends on it
+        bool bOpStats = (bLuaOpStats || Environment.GetEnvironmentVariable("LUA_OPSTATS") == "1") && Target.Configuration != UnrealTargetConfiguration.Shipping;
+        PublicDefinitions.Add("LUA_OPSTATS=" + (bOpStats ? "1" : "0"));
+
         
         if(Target.Type == TargetType.Editor)
         {
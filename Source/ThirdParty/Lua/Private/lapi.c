@@ -27,6 +27,8 @@
 #include "lstring.h"
 #include "ltable.h"
 #include "ltm.h"
+#include "lopcodes.h"
+#include "lopnames.h"
 #include "lundump.h"
 #include "lvm.h"
 
@@ -1196,6 +1198,91 @@ LUA_API int lua_gc (lua_State *L, int what, ...) {
 }
 
 
+LUA_API void lua_getgcstats (lua_State *L, lua_GCStats *stats) {
+  lua_lock(L);
+  *stats = G(L)->gcstats;
+  lua_unlock(L);
+}
+
+
+LUA_API void lua_setgcobserver (lua_State *L, lua_GCObserver f, void *ud) {
+  global_State *g;
+  lua_lock(L);
+  g = G(L);
+  g->gcobserver = f;
+  g->ud_gcobserver = ud;
+  lua_unlock(L);
+}
+
+
+LUA_API int lua_getopstats (lua_State *L, lua_OpStats *stats) {
+#if LUA_OPSTATS
+  lua_lock(L);
+  *stats = G(L)->opstats;
+  lua_unlock(L);
+  return NUM_OPCODES;
+#else
+  UNUSED(L);
+  memset(stats, 0, sizeof(*stats));
+  return 0;
+#endif
+}
+
+
+LUA_API void lua_resetopstats (lua_State *L) {
+#if LUA_OPSTATS
+  global_State *g;
+  GCObject *o;
+  lua_lock(L);
+  g = G(L);
+  memset(&g->opstats, 0, sizeof(g->opstats));
+  for (o = g->allgc; o != NULL; o = o->next) {
+    if (o->tt == LUA_VPROTO)
+      gco2p(o)->opcount = 0;
+  }
+  lua_unlock(L);
+#else
+  UNUSED(L);
+#endif
+}
+
+
+/*
+** All prototypes are in 'allgc' (the generational sublists included);
+** dead ones not yet swept are skipped, their source may be gone.
+*/
+LUA_API void lua_visitopprotos (lua_State *L, lua_OpProtoVisitor f,
+                                void *ud) {
+#if LUA_OPSTATS
+  global_State *g;
+  GCObject *o;
+  lua_lock(L);
+  g = G(L);
+  for (o = g->allgc; o != NULL; o = o->next) {
+    if (o->tt == LUA_VPROTO && !isdead(g, o)) {
+      Proto *p = gco2p(o);
+      if (p->opcount > 0)
+        f(ud, p->source ? getstr(p->source) : "=?", p->linedefined,
+              p->opcount);
+    }
+  }
+  lua_unlock(L);
+#else
+  UNUSED(L); UNUSED(f); UNUSED(ud);
+#endif
+}
+
+
+LUA_API const char *lua_opname (int op) {
+  return (0 <= op && op < NUM_OPCODES) ? opnames[op] : NULL;
+}
+
+
+LUA_API const char *lua_tmname (lua_State *L, int event) {
+  return (0 <= event && event < TM_N) ? getstr(G(L)->tmname[event]) : NULL;
+}
+
+
 
 /*
 ** miscellaneous functions
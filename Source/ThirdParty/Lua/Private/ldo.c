@@ -376,6 +376,7 @@ void luaD_tryfuncTM (lua_State *L, StkId func) {
   StkId p;
   if (unlikely(ttisnil(tm)))
     luaG_typeerror(L, s2v(func), "call");  /* nothing to call */
+  luai_optm(L, TM_CALL);
   for (p = L->top; p > func; p--)  /* open space for metamethod */
     setobjs2s(L, p, p-1);
   L->top++;  /* stack space pre-allocated by the caller */
@@ -266,6 +266,9 @@ Proto *luaF_newproto (lua_State *L) {
   f->linedefined = 0;
   f->lastlinedefined = 0;
   f->source = NULL;
+#if LUA_OPSTATS
+  f->opcount = 0;
+#endif
   return f;
 }
 
@@ -651,6 +651,7 @@ static int traversethread (global_State *g, lua_State *th) {
 */
 static lu_mem propagatemark (global_State *g) {
   GCObject *o = g->gray;
+  g->gcstats.marked++;
   nw2black(o);
   g->gray = *getgclist(o);  /* remove from 'gray' list */
   switch (o->tt) {
@@ -825,12 +826,14 @@ static GCObject **sweeplist (lua_State *L, GCObject **p, int countin,
     if (isdeadm(ow, marked)) {  /* is 'curr' dead? */
       *p = curr->next;  /* remove 'curr' from list */
       freeobj(L, curr);  /* erase 'curr' */
+      g->gcstats.freed++;
     }
     else {  /* change mark to 'white' */
       curr->marked = cast_byte((marked & ~maskgcbits) | white);
       p = &curr->next;  /* go to next element */
     }
   }
+  g->gcstats.swept += i;
   if (countout)
     *countout = i;  /* number of elements traversed */
   return (*p == NULL) ? NULL : p;
@@ -905,6 +908,7 @@ static void GCTM (lua_State *L) {
   tm = luaT_gettmbyobj(L, &v, TM_GC);
   if (!notm(tm)) {  /* is there a finalizer? */
     int status;
+    g->gcstats.finalizers++;
     lu_byte oldah = L->allowhook;
     int running  = g->gcrunning;
     L->allowhook = 0;  /* stop debug hooks during GC metamethod */
@@ -1099,10 +1103,12 @@ static GCObject **sweepgen (lua_State *L, global_State *g, GCObject **p,
   int white = luaC_white(g);
   GCObject *curr;
   while ((curr = *p) != limit) {
+    g->gcstats.swept++;
     if (iswhite(curr)) {  /* is 'curr' dead? */
       lua_assert(!isold(curr) && isdead(g, curr));
       *p = curr->next;  /* remove 'curr' from list */
       freeobj(L, curr);  /* erase 'curr' */
+      g->gcstats.freed++;
     }
     else {  /* correct mark and age */
       if (getage(curr) == G_NEW) {  /* new objects go back to white */
@@ -1231,6 +1237,7 @@ static void youngcollection (lua_State *L, global_State *g) {
   }
   markold(g, g->finobj, g->finobjrold);
   markold(g, g->tobefnz, NULL);
+  g->gcstats.minors++;
   atomic(L);
 
   /* sweep nursery and get a pointer to its last live element */
@@ -1336,6 +1343,7 @@ void luaC_changemode (lua_State *L, int newmode) {
 ** Does a full collection in generational mode.
 */
 static lu_mem fullgen (lua_State *L, global_State *g) {
+  g->gcstats.majors++;
   enterinc(g);
   return entergen(L, g);
 }
@@ -1374,6 +1382,7 @@ static void setminordebt (global_State *g) {
 static void stepgenfull (lua_State *L, global_State *g) {
   lu_mem newatomic;  /* count of traversed objects */
   lu_mem lastatomic = g->lastatomic;  /* count from last collection */
+  g->gcstats.majors++;
   if (g->gckind == KGC_GEN)  /* still in generational mode? */
     enterinc(g);  /* enter incremental mode */
   luaC_runtilstate(L, bitmask(GCSpropagate));  /* start new cycle */
@@ -1573,7 +1582,7 @@ static int sweepstep (lua_State *L, global_State *g,
 }
 
 
-static lu_mem singlestep (lua_State *L) {
+static lu_mem singlestep_ (lua_State *L) {
   global_State *g = G(L);
   switch (g->gcstate) {
     case GCSpause: {
@@ -1624,6 +1633,24 @@ static lu_mem singlestep (lua_State *L) {
 }
 
 
+/*
+** 'singlestep_' plus telemetry of state changes
+*/
+static lu_mem singlestep (lua_State *L) {
+  global_State *g = G(L);
+  lu_byte oldstate = g->gcstate;
+  lu_mem work = singlestep_(L);
+  if (g->gcstate != oldstate) {
+    g->gcstats.phases++;
+    if (g->gcstate == GCSpause)
+      g->gcstats.cycles++;
+    if (g->gcobserver)
+      g->gcobserver(L, LUA_GCEV_PHASE, g->ud_gcobserver);
+  }
+  return work;
+}
+
+
 /*
 ** advances the garbage collector until it reaches a state allowed
 ** by 'statemask'
@@ -1667,11 +1694,18 @@ void luaC_step (lua_State *L) {
   global_State *g = G(L);
   lua_assert(!g->gcemergency);
   if (g->gcrunning) {  /* running? */
+    g->gcstats.steps++;
+    if (g->gcobserver)
+      g->gcobserver(L, LUA_GCEV_STEPBEGIN, g->ud_gcobserver);
     if(isdecGCmodegen(g))
       genstep(L, g);
     else
       incstep(L, g);
+    if (g->gcobserver)
+      g->gcobserver(L, LUA_GCEV_STEPEND, g->ud_gcobserver);
   }
+  else  /* stopped (e.g. stepped by the host); avoid being called too often */
+    luaE_setdebt(g, -2000);
 }
 
 
@@ -1703,12 +1737,18 @@ static void fullinc (lua_State *L, global_State *g) {
 void luaC_fullgc (lua_State *L, int isemergency) {
   global_State *g = G(L);
   lua_assert(!g->gcemergency);
+  g->gcstats.steps++;
+  g->gcstats.fullgcs++;
+  if (g->gcobserver)
+    g->gcobserver(L, LUA_GCEV_STEPBEGIN, g->ud_gcobserver);
   g->gcemergency = isemergency;  /* set flag */
   if (g->gckind == KGC_INC)
     fullinc(L, g);
   else
     fullgen(L, g);
   g->gcemergency = 0;
+  if (g->gcobserver)
+    g->gcobserver(L, LUA_GCEV_STEPEND, g->ud_gcobserver);
 }
 
 /* }====================================================== */
@@ -386,6 +386,12 @@ LUA_API lua_State *lua_newstate (lua_Alloc f, void *ud) {
   g->totalbytes = sizeof(LG);
   g->GCdebt = 0;
   g->lastatomic = 0;
+  memset(&g->gcstats, 0, sizeof(g->gcstats));
+  g->gcobserver = NULL;
+  g->ud_gcobserver = NULL;
+#if LUA_OPSTATS
+  memset(&g->opstats, 0, sizeof(g->opstats));
+#endif
   setivalue(&g->nilvalue, 0);  /* to signal that state is not yet built */
   setgcparam(g->gcpause, LUAI_GCPAUSE);
   setgcparam(g->gcstepmul, LUAI_GCMUL);
@@ -140,6 +140,7 @@ static int callbinTM (lua_State *L, const TValue *p1, const TValue *p2,
   if (notm(tm))
     tm = luaT_gettmbyobj(L, p2, event);  /* try second operand */
   if (notm(tm)) return 0;
+  luai_optm(L, event);
   luaT_callTMres(L, tm, p1, p2, res);
   return 1;
 }
@@ -305,7 +305,9 @@ void luaV_finishget (lua_State *L, const TValue *t, TValue *key, StkId val,
       }
       /* else will try the metamethod */
     }
+    luai_optm(L, TM_INDEX);
     if (ttisfunction(tm)) {  /* is metamethod a function? */
+      luai_opindexcall(L);
       luaT_callTMres(L, tm, t, key, val);  /* call it */
       return;
     }
@@ -353,6 +355,7 @@ void luaV_finishset (lua_State *L, const TValue *t, TValue *key,
         luaG_typeerror(L, t, "index");
     }
     /* try the metamethod */
+    luai_optm(L, TM_NEWINDEX);
     if (ttisfunction(tm)) {
       luaT_callTM(L, tm, t, key, val);
       return;
@@ -606,6 +609,7 @@ int luaV_equalobj (lua_State *L, const TValue *t1, const TValue *t2) {
   if (tm == NULL)  /* no TM? */
     return 0;  /* objects are different */
   else {
+    luai_optm(L, TM_EQ);
     luaT_callTMres(L, tm, t1, t2, L->top);  /* call TM */
     return !l_isfalse(s2v(L->top));
   }
@@ -703,6 +707,7 @@ void luaV_objlen (lua_State *L, StkId ra, const TValue *rb) {
       break;
     }
   }
+  luai_optm(L, TM_LEN);
   luaT_callTMres(L, tm, rb, rb, ra);
 }
 
@@ -1111,6 +1116,7 @@ void luaV_finishOp (lua_State *L) {
     updatebase(ci);  /* correct stack */ \
   } \
   i = *(pc++); \
+  luai_opcount(L, cl->p, GET_OPCODE(i)); \
   ra = RA(i); /* WARNING: any stack reallocation invalidates 'ra' */ \
 }
 
@@ -1218,8 +1224,10 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
         if (luaV_fastget(L, upval, key, slot, luaH_getshortstr)) {
           setobj2s(L, ra, slot);
         }
-        else
+        else {
+          luai_opslow(L, GET_OPCODE(i));
           Protect(luaV_finishget(L, upval, rc, ra, slot));
+        }
         vmbreak;
       }
       vmcase(OP_GETTABLE) {
@@ -1232,8 +1240,10 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
             : luaV_fastget(L, rb, rc, slot, luaH_get)) {
           setobj2s(L, ra, slot);
         }
-        else
+        else {
+          luai_opslow(L, GET_OPCODE(i));
           Protect(luaV_finishget(L, rb, rc, ra, slot));
+        }
         vmbreak;
       }
       vmcase(OP_GETI) {
@@ -1245,6 +1255,7 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
         }
         else {
           TValue key;
+          luai_opslow(L, GET_OPCODE(i));
           setivalue(&key, c);
           Protect(luaV_finishget(L, rb, &key, ra, slot));
         }
@@ -1258,8 +1269,10 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
         if (luaV_fastget(L, rb, key, slot, luaH_getshortstr)) {
           setobj2s(L, ra, slot);
         }
-        else
+        else {
+          luai_opslow(L, GET_OPCODE(i));
           Protect(luaV_finishget(L, rb, rc, ra, slot));
+        }
         vmbreak;
       }
       vmcase(OP_SETTABUP) {
@@ -1271,8 +1284,10 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
         if (luaV_fastget(L, upval, key, slot, luaH_getshortstr)) {
           luaV_finishfastset(L, upval, slot, rc);
         }
-        else
+        else {
+          luai_opslow(L, GET_OPCODE(i));
           Protect(luaV_finishset(L, upval, rb, rc, slot));
+        }
         vmbreak;
       }
       vmcase(OP_SETTABLE) {
@@ -1285,8 +1300,10 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
             : luaV_fastget(L, s2v(ra), rb, slot, luaH_get)) {
           luaV_finishfastset(L, s2v(ra), slot, rc);
         }
-        else
+        else {
+          luai_opslow(L, GET_OPCODE(i));
           Protect(luaV_finishset(L, s2v(ra), rb, rc, slot));
+        }
         vmbreak;
       }
       vmcase(OP_SETI) {
@@ -1298,6 +1315,7 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
         }
         else {
           TValue key;
+          luai_opslow(L, GET_OPCODE(i));
           setivalue(&key, c);
           Protect(luaV_finishset(L, s2v(ra), &key, rc, slot));
         }
@@ -1311,8 +1329,10 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
         if (luaV_fastget(L, s2v(ra), key, slot, luaH_getshortstr)) {
           luaV_finishfastset(L, s2v(ra), slot, rc);
         }
-        else
+        else {
+          luai_opslow(L, GET_OPCODE(i));
           Protect(luaV_finishset(L, s2v(ra), rb, rc, slot));
+        }
         vmbreak;
       }
       vmcase(OP_NEWTABLE) {
@@ -1342,8 +1362,10 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
         if (luaV_fastget(L, rb, key, slot, luaH_getstr)) {
           setobj2s(L, ra, slot);
         }
-        else
+        else {
+          luai_opslow(L, GET_OPCODE(i));
           Protect(luaV_finishget(L, rb, rc, ra, slot));
+        }
         vmbreak;
       }
       vmcase(OP_ADDI) {
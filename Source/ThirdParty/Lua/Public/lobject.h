@@ -550,6 +550,9 @@ typedef struct Proto {
   LocVar *locvars;  /* information about local variables (debug information) */
   TString  *source;  /* used for debug information */
   GCObject *gclist;
+#if LUA_OPSTATS
+  size_t opcount;  /* instructions executed (see 'lua_getopstats') */
+#endif
 } Proto;
 
 /* }================================================================== */
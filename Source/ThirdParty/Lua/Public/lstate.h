@@ -264,9 +264,31 @@ typedef struct global_State {
   TString *strcache[STRCACHE_N][STRCACHE_M];  /* cache for strings in API */
   lua_WarnFunction warnf;  /* warning function */
   void *ud_warn;         /* auxiliary data to 'warnf' */
+  lua_GCStats gcstats;  /* GC telemetry counters */
+  lua_GCObserver gcobserver;  /* GC telemetry observer */
+  void *ud_gcobserver;  /* auxiliary data to 'gcobserver' */
+#if LUA_OPSTATS
+  lua_OpStats opstats;  /* VM statistics */
+#endif
 } global_State;
 
 
+/*
+** VM statistics (LUA_OPSTATS); without it these macros are empty
+*/
+#if LUA_OPSTATS
+#define luai_opcount(L,p,op)	(G(L)->opstats.count[op]++, (p)->opcount++)
+#define luai_opslow(L,op)	(G(L)->opstats.slow[op]++)
+#define luai_optm(L,e)		(G(L)->opstats.tm[e]++)
+#define luai_opindexcall(L)	(G(L)->opstats.indexcalls++)
+#else
+#define luai_opcount(L,p,op)	((void)0)
+#define luai_opslow(L,op)	((void)0)
+#define luai_optm(L,e)		((void)0)
+#define luai_opindexcall(L)	((void)0)
+#endif
+
+
 /*
 ** 'per thread' state
 */
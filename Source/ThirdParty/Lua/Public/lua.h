@@ -331,6 +331,65 @@ LUA_API void (lua_warning)  (lua_State *L, const char *msg, int tocont);
 LUA_API int (lua_gc) (lua_State *L, int what, ...);
 
 
+/*
+** GC telemetry (FastLuaScript): counters since the state was created and
+** an observer called around collector steps and on phase changes.
+** The observer runs inside the collector: it must not call the Lua API.
+*/
+#define LUA_GCEV_STEPBEGIN	0	/* luaC_step or full collection starts */
+#define LUA_GCEV_STEPEND	1	/* ...and ends */
+#define LUA_GCEV_PHASE		2	/* incremental collector changed its state */
+
+typedef struct lua_GCStats {
+  size_t steps;       /* collector steps (luaC_step), full collections included */
+  size_t fullgcs;     /* full collections (collectgarbage, emergency) */
+  size_t cycles;      /* finished incremental cycles */
+  size_t minors;      /* generational minor collections */
+  size_t majors;      /* generational major collections */
+  size_t phases;      /* incremental state changes */
+  size_t marked;      /* objects traversed (turned black) */
+  size_t swept;       /* objects visited by the sweep */
+  size_t freed;       /* objects freed */
+  size_t finalizers;  /* __gc metamethods called */
+} lua_GCStats;
+
+typedef void (*lua_GCObserver) (lua_State *L, int event, void *ud);
+
+LUA_API void (lua_getgcstats) (lua_State *L, lua_GCStats *stats);
+LUA_API void (lua_setgcobserver) (lua_State *L, lua_GCObserver f, void *ud);
+
+
+/*
+** VM statistics (FastLuaScript), counted only when Lua is compiled with
+** LUA_OPSTATS: 'lua_getopstats' returns the number of opcodes, or 0 when
+** the counters are compiled out. Counts are since the state was created
+** or the last 'lua_resetopstats'.
+** Arithmetic falling back to a metamethod shows as OP_MMBIN/MMBINI/MMBINK.
+** The visitor gets the instructions executed by each function with a
+** nonzero count; it must not call the Lua API.
+*/
+#define LUA_OPSTATS_MAXOPS	128	/* opcodes fit in 7 bits */
+#define LUA_OPSTATS_MAXTM	32	/* >= TM_N */
+
+typedef struct lua_OpStats {
+  size_t count[LUA_OPSTATS_MAXOPS];  /* instructions executed per opcode */
+  size_t slow[LUA_OPSTATS_MAXOPS];  /* GET/SET/SELF missing the fast path
+                                     (absent key, new key, metamethod) */
+  size_t tm[LUA_OPSTATS_MAXTM];  /* metamethods used per event (ltm.h) */
+  size_t indexcalls;  /* '__index' metamethods that are functions */
+} lua_OpStats;
+
+typedef void (*lua_OpProtoVisitor) (void *ud, const char *source,
+                                    int linedefined, size_t count);
+
+LUA_API int (lua_getopstats) (lua_State *L, lua_OpStats *stats);
+LUA_API void (lua_resetopstats) (lua_State *L);
+LUA_API void (lua_visitopprotos) (lua_State *L, lua_OpProtoVisitor f,
+                                  void *ud);
+LUA_API const char *(lua_opname) (int op);
+LUA_API const char *(lua_tmname) (lua_State *L, int event);
+
+
 /*
 ** miscellaneous functions
 */
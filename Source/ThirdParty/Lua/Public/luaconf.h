@@ -687,6 +687,17 @@
 #define luai_apicheck(l,e)	assert(e)
 #endif
 
+
+/*
+@@ LUA_OPSTATS turns on the VM statistics read by 'lua_getopstats':
+** executions per opcode and per function, table accesses leaving the
+** fast path and metamethods used. When it is 0, 'luaV_execute' has no
+** extra code. (FastLuaScript: set by Lua.Build.cs)
+*/
+#if !defined(LUA_OPSTATS)
+#define LUA_OPSTATS	0
+#endif
+
 /* }================================================================== */
 
 
@@ -0,0 +1,85 @@
+
+--closures: creation, upvalue access, calls through locals and varargs
+local function Add(A, B)
+    return A + B
+end
+
+return {
+    {
+        Name = "Closure.Call",
+        Iterations = 2000000,
+        Run = function(N)
+            local Sum = 0
+            for i = 1, N do
+                Sum = Add(Sum, i)
+            end
+            return Sum
+        end,
+    },
+    {
+        Name = "Closure.Create",
+        Iterations = 1000000,
+        Run = function(N)
+            for i = 1, N do
+                local F = function()
+                    return i
+                end
+            end
+        end,
+    },
+    {
+        Name = "Closure.Upvalue",
+        Iterations = 2000000,
+        Run = function(N)
+            local Count = 0
+            local function Inc()
+                Count = Count + 1
+            end
+            for i = 1, N do
+                Inc()
+            end
+            return Count
+        end,
+    },
+    {
+        Name = "Closure.Vararg",
+        Iterations = 1000000,
+        Run = function(N)
+            local function Forward(...)
+                return select("#", ...)
+            end
+            local Sum = 0
+            for i = 1, N do
+                Sum = Sum + Forward(i, i, i)
+            end
+            return Sum
+        end,
+    },
+    {
+        Name = "Closure.Recursive",
+        Iterations = 50,
+        Run = function(N)
+            local function Fib(X)
+                if X < 2 then
+                    return X
+                end
+                return Fib(X - 1) + Fib(X - 2)
+            end
+            for i = 1, N do
+                Fib(20)
+            end
+        end,
+    },
+    {
+        Name = "Closure.Pcall",
+        Iterations = 500000,
+        Run = function(N)
+            local function Body(X)
+                return X
+            end
+            for i = 1, N do
+                pcall(Body, i)
+            end
+        end,
+    },
+}
@@ -0,0 +1,68 @@
+
+--coroutines: create/resume/yield as the latent actions and the scheduler use them
+return {
+    {
+        Name = "Coroutine.Create",
+        Iterations = 200000,
+        Run = function(N)
+            local function Body()
+            end
+            for i = 1, N do
+                coroutine.resume(coroutine.create(Body))
+            end
+        end,
+    },
+    {
+        Name = "Coroutine.ResumeYield",
+        Iterations = 1000000,
+        Run = function(N)
+            local Co = coroutine.create(function()
+                while true do
+                    coroutine.yield()
+                end
+            end)
+            for i = 1, N do
+                coroutine.resume(Co)
+            end
+        end,
+    },
+    {
+        Name = "Coroutine.Wrap",
+        Iterations = 1000000,
+        Run = function(N)
+            local Next = coroutine.wrap(function()
+                local i = 0
+                while true do
+                    i = i + 1
+                    coroutine.yield(i)
+                end
+            end)
+            local Sum = 0
+            for i = 1, N do
+                Sum = Sum + Next()
+            end
+            return Sum
+        end,
+    },
+    {
+        Name = "Coroutine.Many",
+        Iterations = 100,
+        Run = function(N)
+            for i = 1, N do
+                local List = {}
+                for j = 1, 1000 do
+                    List[j] = coroutine.create(function(X)
+                        coroutine.yield(X)
+                        return X
+                    end)
+                end
+                for j = 1, 1000 do
+                    coroutine.resume(List[j], j)
+                end
+                for j = 1, 1000 do
+                    coroutine.resume(List[j])
+                end
+            end
+        end,
+    },
+}
@@ -0,0 +1,65 @@
+
+--gc stress: short lived garbage, a large live set, userdata-like tables with __gc, weak tables
+return {
+    {
+        Name = "GC.ShortLived",
+        Iterations = 1000000,
+        Run = function(N)
+            for i = 1, N do
+                local T = { i }
+            end
+        end,
+    },
+    {
+        Name = "GC.LiveSet",
+        Iterations = 200000,
+        Run = function(N)
+            --a live set the collector has to traverse while garbage is made
+            local Live = {}
+            for i = 1, 50000 do
+                Live[i] = { Id = i, Name = "Obj" .. i }
+            end
+            for i = 1, N do
+                local T = { i, i }
+                Live[(i % 50000) + 1].Last = T
+            end
+        end,
+    },
+    {
+        Name = "GC.Finalizers",
+        Iterations = 100000,
+        Run = function(N)
+            local Count = 0
+            local Meta = { __gc = function() Count = Count + 1 end }
+            for i = 1, N do
+                setmetatable({}, Meta)
+            end
+            collectgarbage()
+            return Count
+        end,
+    },
+    {
+        Name = "GC.WeakTable",
+        Iterations = 200000,
+        Run = function(N)
+            local Cache = setmetatable({}, { __mode = "k" })
+            for i = 1, N do
+                Cache[{}] = i
+            end
+            collectgarbage()
+        end,
+    },
+    {
+        Name = "GC.FullCollect",
+        Iterations = 20,
+        Run = function(N)
+            local Live = {}
+            for i = 1, 100000 do
+                Live[i] = { i }
+            end
+            for i = 1, N do
+                collectgarbage()
+            end
+        end,
+    },
+}
@@ -0,0 +1,108 @@
+
+--method dispatch through metatable chains, the way Class.lua builds classes
+local Class = {}
+
+function Class:__call(InParentClass)
+    local NewClass = {}
+
+    function NewClass:new()
+        local Obj = {}
+        setmetatable(Obj, NewClass)
+        return Obj
+    end
+
+    setmetatable(NewClass, { __index = InParentClass })
+    NewClass.__index = NewClass
+
+    return NewClass
+end
+
+setmetatable(Class, Class)
+Class.__index = Class
+
+local Base = Class()
+function Base:GetValue()
+    return 1
+end
+
+--Leaf -> Level4 -> ... -> Base
+local Leaf = Base
+for i = 1, 4 do
+    Leaf = Class(Leaf)
+end
+function Leaf:GetOwnValue()
+    return 2
+end
+
+return {
+    {
+        Name = "Method.Own",
+        Iterations = 2000000,
+        Run = function(N)
+            local Obj = Leaf:new()
+            local Sum = 0
+            for i = 1, N do
+                Sum = Sum + Obj:GetOwnValue()
+            end
+            return Sum
+        end,
+    },
+    {
+        Name = "Method.Depth1",
+        Iterations = 2000000,
+        Run = function(N)
+            local Obj = Base:new()
+            local Sum = 0
+            for i = 1, N do
+                Sum = Sum + Obj:GetValue()
+            end
+            return Sum
+        end,
+    },
+    {
+        Name = "Method.Depth5",
+        Iterations = 2000000,
+        Run = function(N)
+            local Obj = Leaf:new()
+            local Sum = 0
+            for i = 1, N do
+                Sum = Sum + Obj:GetValue()
+            end
+            return Sum
+        end,
+    },
+    {
+        Name = "Method.IndexFunction",
+        Iterations = 1000000,
+        Run = function(N)
+            --__index as a function, like the native object wrappers
+            local Methods = { GetValue = function() return 1 end }
+            local Obj = setmetatable({}, { __index = function(T, K) return Methods[K] end })
+            local Sum = 0
+            for i = 1, N do
+                Sum = Sum + Obj:GetValue()
+            end
+            return Sum
+        end,
+    },
+    {
+        Name = "Method.New",
+        Iterations = 500000,
+        Run = function(N)
+            for i = 1, N do
+                local Obj = Leaf:new()
+            end
+        end,
+    },
+    {
+        Name = "Method.NewIndex",
+        Iterations = 1000000,
+        Run = function(N)
+            local Store = {}
+            local Obj = setmetatable({}, { __newindex = function(T, K, V) Store[K] = V end })
+            for i = 1, N do
+                Obj.Value = i
+            end
+        end,
+    },
+}
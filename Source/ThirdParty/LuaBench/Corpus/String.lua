@@ -0,0 +1,78 @@
+
+--string building: concat, table.concat, format, interning
+return {
+    {
+        Name = "String.Concat",
+        Iterations = 200000,
+        Run = function(N)
+            for i = 1, N do
+                local S = "Name" .. i .. "_" .. (i & 15)
+            end
+        end,
+    },
+    {
+        Name = "String.ConcatGrow",
+        Iterations = 20000,
+        Run = function(N)
+            local S = ""
+            for i = 1, N do
+                S = S .. "x"
+            end
+        end,
+    },
+    {
+        Name = "String.TableConcat",
+        Iterations = 200000,
+        Run = function(N)
+            local Parts = {}
+            for i = 1, N do
+                Parts[#Parts + 1] = "Part"
+            end
+            return table.concat(Parts, ",")
+        end,
+    },
+    {
+        Name = "String.Format",
+        Iterations = 200000,
+        Run = function(N)
+            for i = 1, N do
+                local S = string.format("%s|%d|%.2f", "Actor", i, i * 0.5)
+            end
+        end,
+    },
+    {
+        Name = "String.ShortIntern",
+        Iterations = 500000,
+        Run = function(N)
+            local Count = 0
+            for i = 1, N do
+                if ("Key" .. (i & 63)) == "Key1" then
+                    Count = Count + 1
+                end
+            end
+            return Count
+        end,
+    },
+    {
+        Name = "String.Methods",
+        Iterations = 200000,
+        Run = function(N)
+            local S = "Content/LuaScript/ApplicationMain.lua"
+            for i = 1, N do
+                local Lower = S:lower()
+                local Found = S:find("LuaScript", 1, true)
+                local Sub = S:sub(9, 17)
+            end
+        end,
+    },
+    {
+        Name = "String.Gsub",
+        Iterations = 50000,
+        Run = function(N)
+            local S = "the quick brown fox jumps over the lazy dog"
+            for i = 1, N do
+                local R = S:gsub("%w+", string.upper)
+            end
+        end,
+    },
+}
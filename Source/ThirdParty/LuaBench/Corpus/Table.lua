@@ -0,0 +1,116 @@
+
+--table ops: array append/read, hash keys, field access, table creation
+return {
+    {
+        Name = "Table.ArrayAppend",
+        Iterations = 1000000,
+        Run = function(N)
+            local T = {}
+            for i = 1, N do
+                T[#T + 1] = i
+            end
+        end,
+    },
+    {
+        Name = "Table.ArrayRead",
+        Iterations = 2000000,
+        Run = function(N)
+            local T = {}
+            for i = 1, 1024 do
+                T[i] = i
+            end
+            local Sum = 0
+            for i = 1, N do
+                Sum = Sum + T[(i & 1023) + 1]
+            end
+            return Sum
+        end,
+    },
+    {
+        Name = "Table.InsertRemove",
+        Iterations = 500000,
+        Run = function(N)
+            local T = {}
+            for i = 1, N do
+                table.insert(T, i)
+                if #T > 64 then
+                    table.remove(T, 1)
+                end
+            end
+        end,
+    },
+    {
+        Name = "Table.IntegerKeys",
+        Iterations = 500000,
+        Run = function(N)
+            local T = {}
+            for i = 1, N do
+                T[i * 7919 % 65521] = i
+            end
+        end,
+    },
+    {
+        Name = "Table.StringKeys",
+        Iterations = 500000,
+        Run = function(N)
+            local Keys = {}
+            for i = 1, 256 do
+                Keys[i] = "Key" .. i
+            end
+            local T = {}
+            for i = 1, N do
+                local Key = Keys[(i & 255) + 1]
+                T[Key] = (T[Key] or 0) + 1
+            end
+        end,
+    },
+    {
+        Name = "Table.FieldAccess",
+        Iterations = 2000000,
+        Run = function(N)
+            local T = { X = 1, Y = 2, Z = 3 }
+            for i = 1, N do
+                T.X = T.Y + T.Z
+            end
+        end,
+    },
+    {
+        Name = "Table.Constructor",
+        Iterations = 500000,
+        Run = function(N)
+            for i = 1, N do
+                local T = { X = i, Y = i, Z = i, i, i, i }
+            end
+        end,
+    },
+    {
+        Name = "Table.Pairs",
+        Iterations = 2000,
+        Run = function(N)
+            local T = {}
+            for i = 1, 512 do
+                T["Key" .. i] = i
+            end
+            local Sum = 0
+            for i = 1, N do
+                for Key, Value in pairs(T) do
+                    Sum = Sum + Value
+                end
+            end
+            return Sum
+        end,
+    },
+    {
+        Name = "Table.Sort",
+        Iterations = 200,
+        Run = function(N)
+            for i = 1, N do
+                local T = {}
+                for j = 1, 1000 do
+                    T[j] = (j * 7919) % 1009
+                end
+                table.sort(T)
+            end
+        end,
+    },
+}
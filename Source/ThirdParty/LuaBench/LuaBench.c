@@ -0,0 +1,443 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+/*
+** headless benchmark driver for the embedded lua VM
+** each corpus file returns a list of cases { Name = "Table.Insert", Iterations = N, Run = function(N) end }
+** a case runs Warmup times then Repeats times, after a full gc each time, the results file has one row per case
+*/
+
+#define _GNU_SOURCE
+
+#include <dirent.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+#include "lualib.h"
+
+
+#if !defined(LUABENCH_CORPUS_DIR)
+#define LUABENCH_CORPUS_DIR "Corpus"
+#endif
+
+#define MAX_FILES 256
+#define MAX_REPEATS 64
+#define MAX_BASELINE 1024
+#define MAX_TOP_OPS 6
+
+
+typedef struct BenchOptions {
+	const char *Output;
+	const char *Baseline;
+	const char *Filter;
+	int Repeats;
+	int Warmup;
+	double Scale;
+	int Cpu;
+} BenchOptions;
+
+typedef struct BenchResult {
+	char Name[128];
+	lua_Integer Iterations;
+	double MinMs;
+	double MedianMs;
+	double MeanMs;
+	//spread of the runs, in % of the median
+	double SpreadPct;
+	//lua heap when a run ends, before the next full gc
+	double HeapKB;
+	double GCStepsPerRun;
+	double FreedPerRun;
+	//instrumented VM(LUABENCH_OPSTATS) only, counts of the measured runs
+	int OpNum;
+	lua_OpStats Ops;
+} BenchResult;
+
+typedef struct BaselineRow {
+	char Name[128];
+	//per iteration, the baseline may use another -s
+	double NsPerIteration;
+} BaselineRow;
+
+static BaselineRow Baseline[MAX_BASELINE];
+static int BaselineNum = 0;
+
+
+static double NowMs(void) {
+	struct timespec Ts;
+	clock_gettime(CLOCK_MONOTONIC, &Ts);
+	return Ts.tv_sec * 1000.0 + Ts.tv_nsec / 1000000.0;
+}
+
+static int CompareDouble(const void *A, const void *B) {
+	const double X = *(const double *)A;
+	const double Y = *(const double *)B;
+	return (X > Y) - (X < Y);
+}
+
+static int CompareString(const void *A, const void *B) {
+	return strcmp(*(char *const *)A, *(char *const *)B);
+}
+
+static void LoadBaseline(const char *InFile) {
+	FILE *File = fopen(InFile, "r");
+	if (File == NULL) {
+		fprintf(stderr, "luabench: cannot open baseline %s\n", InFile);
+		return;
+	}
+
+	//name,iterations,min_ms,median_ms,...
+	char Line[512];
+	while (fgets(Line, sizeof(Line), File) && BaselineNum < MAX_BASELINE) {
+		if (Line[0] == '#' || strncmp(Line, "name,", 5) == 0)
+			continue;
+
+		BaselineRow *Row = &Baseline[BaselineNum];
+		long long Iterations;
+		double MinMs, MedianMs;
+		if (sscanf(Line, "%127[^,],%lld,%lf,%lf", Row->Name, &Iterations, &MinMs, &MedianMs) == 4 && Iterations > 0) {
+			Row->NsPerIteration = MedianMs * 1000000.0 / Iterations;
+			BaselineNum++;
+		}
+	}
+
+	fclose(File);
+}
+
+static const BaselineRow *FindBaseline(const char *InName) {
+	for (int i = 0; i < BaselineNum; ++i) {
+		if (strcmp(Baseline[i].Name, InName) == 0)
+			return &Baseline[i];
+	}
+	return NULL;
+}
+
+//the Run function of the case is on the top of the stack
+static int RunCase(lua_State *L, const BenchOptions *InOptions, BenchResult *OutResult) {
+	const int FunctionIdx = lua_gettop(L);
+	double RunMs[MAX_REPEATS];
+	double HeapKB = 0.0;
+	lua_GCStats StartStats, EndStats;
+	memset(&StartStats, 0, sizeof(StartStats));
+	lua_OpStats StartOps;
+	memset(&StartOps, 0, sizeof(StartOps));
+
+	for (int i = -InOptions->Warmup; i < InOptions->Repeats; ++i) {
+		//garbage of the last run is not paid by this one
+		lua_gc(L, LUA_GCCOLLECT, 0);
+		if (i == 0) {
+			lua_getgcstats(L, &StartStats);
+			lua_getopstats(L, &StartOps);
+		}
+
+		lua_pushvalue(L, FunctionIdx);
+		lua_pushinteger(L, OutResult->Iterations);
+
+		const double StartMs = NowMs();
+		const int CallRet = lua_pcall(L, 1, 0, 0);
+		const double EndMs = NowMs();
+
+		if (CallRet != LUA_OK) {
+			fprintf(stderr, "luabench: %s: %s\n", OutResult->Name, lua_tostring(L, -1));
+			lua_settop(L, FunctionIdx - 1);
+			return 0;
+		}
+
+		if (i >= 0) {
+			RunMs[i] = EndMs - StartMs;
+			HeapKB += lua_gc(L, LUA_GCCOUNT, 0) + lua_gc(L, LUA_GCCOUNTB, 0) / 1024.0;
+		}
+	}
+
+	lua_getgcstats(L, &EndStats);
+	OutResult->OpNum = lua_getopstats(L, &OutResult->Ops);
+	lua_settop(L, FunctionIdx - 1);
+
+	double TotalMs = 0.0;
+	for (int i = 0; i < InOptions->Repeats; ++i)
+		TotalMs += RunMs[i];
+
+	qsort(RunMs, InOptions->Repeats, sizeof(double), CompareDouble);
+
+	//the full collections before each run are in the stats too
+	const double Runs = InOptions->Repeats;
+	OutResult->MinMs = RunMs[0];
+	OutResult->MedianMs = RunMs[InOptions->Repeats / 2];
+	OutResult->MeanMs = TotalMs / Runs;
+	OutResult->SpreadPct = OutResult->MedianMs > 0.0 ? (RunMs[InOptions->Repeats - 1] - RunMs[0]) * 100.0 / OutResult->MedianMs : 0.0;
+	OutResult->HeapKB = HeapKB / Runs;
+	OutResult->GCStepsPerRun = (EndStats.steps - StartStats.steps) / Runs;
+	OutResult->FreedPerRun = (EndStats.freed - StartStats.freed) / Runs;
+
+	for (int Op = 0; Op < OutResult->OpNum; ++Op) {
+		OutResult->Ops.count[Op] -= StartOps.count[Op];
+		OutResult->Ops.slow[Op] -= StartOps.slow[Op];
+	}
+	for (int Event = 0; Event < LUA_OPSTATS_MAXTM; ++Event)
+		OutResult->Ops.tm[Event] -= StartOps.tm[Event];
+	return 1;
+}
+
+static void WriteResult(FILE *InFile, const BenchResult *InResult) {
+	const double NsPerIteration = InResult->MedianMs * 1000000.0 / (InResult->Iterations > 0 ? InResult->Iterations : 1);
+
+	fprintf(InFile, "%s,%lld,%.3f,%.3f,%.3f,%.1f,%.2f,%.1f,%.1f,%.0f\n",
+		InResult->Name, (long long)InResult->Iterations, InResult->MinMs, InResult->MedianMs, InResult->MeanMs,
+		InResult->SpreadPct, NsPerIteration, InResult->HeapKB, InResult->GCStepsPerRun, InResult->FreedPerRun);
+
+	const BaselineRow *Row = FindBaseline(InResult->Name);
+	if (Row && Row->NsPerIteration > 0.0) {
+		const double Delta = (NsPerIteration - Row->NsPerIteration) * 100.0 / Row->NsPerIteration;
+		printf("%-36s %10.3f ms %9.2f ns/iter  spread %5.1f%%  %+6.1f%% vs baseline\n", InResult->Name, InResult->MedianMs, NsPerIteration, InResult->SpreadPct, Delta);
+	}
+	else {
+		printf("%-36s %10.3f ms %9.2f ns/iter  spread %5.1f%%\n", InResult->Name, InResult->MedianMs, NsPerIteration, InResult->SpreadPct);
+	}
+}
+
+//instrumented VM only: the most executed opcodes and the metamethods, per iteration
+static void PrintOpStats(lua_State *L, const BenchOptions *InOptions, const BenchResult *InResult) {
+	const lua_OpStats *Ops = &InResult->Ops;
+	const double Iterations = (double)InResult->Iterations * InOptions->Repeats;
+	int TopOps[MAX_TOP_OPS];
+	int TopNum = 0;
+	double Total = 0.0;
+
+	for (int Op = 0; Op < InResult->OpNum; ++Op) {
+		Total += Ops->count[Op];
+		if (Ops->count[Op] == 0)
+			continue;
+
+		//insertion into the sorted top list
+		int Pos = TopNum < MAX_TOP_OPS ? TopNum++ : MAX_TOP_OPS;
+		while (Pos > 0 && Ops->count[TopOps[Pos - 1]] < Ops->count[Op]) {
+			if (Pos < MAX_TOP_OPS)
+				TopOps[Pos] = TopOps[Pos - 1];
+			--Pos;
+		}
+		if (Pos < MAX_TOP_OPS)
+			TopOps[Pos] = Op;
+	}
+
+	if (Total <= 0.0)
+		return;
+
+	printf("    %.1f instructions/iter:", Total / Iterations);
+	for (int i = 0; i < TopNum; ++i) {
+		const int Op = TopOps[i];
+		//the setup of the case
+		if (Ops->count[Op] * 1000.0 < Total)
+			break;
+		printf(" %s %.1f%%", lua_opname(Op), Ops->count[Op] * 100.0 / Total);
+		if (Ops->slow[Op] > 0)
+			printf("(slow %.0f%%)", Ops->slow[Op] * 100.0 / Ops->count[Op]);
+	}
+	printf("\n");
+
+	int TMNum = 0;
+	for (int Event = 0; Event < LUA_OPSTATS_MAXTM; ++Event) {
+		const char *TMName = lua_tmname(L, Event);
+		if (TMName && Ops->tm[Event] > 0)
+			printf(TMNum++ ? " %s %.2f" : "    metamethods/iter: %s %.2f", TMName, Ops->tm[Event] / Iterations);
+	}
+	if (TMNum > 0)
+		printf("\n");
+}
+
+//a fresh state per file, the cases of a file share it
+static int RunFile(const char *InPath, const BenchOptions *InOptions, FILE *OutFile) {
+	int Failed = 0;
+	lua_State *L = luaL_newstate();
+	luaL_openlibs(L);
+
+	if (luaL_loadfile(L, InPath) != LUA_OK || lua_pcall(L, 0, 1, 0) != LUA_OK) {
+		fprintf(stderr, "luabench: %s\n", lua_tostring(L, -1));
+		lua_close(L);
+		return 1;
+	}
+
+	if (!lua_istable(L, -1)) {
+		fprintf(stderr, "luabench: %s does not return a list of cases\n", InPath);
+		lua_close(L);
+		return 1;
+	}
+
+	const int CasesIdx = lua_gettop(L);
+	const lua_Integer CaseNum = luaL_len(L, CasesIdx);
+	for (lua_Integer i = 1; i <= CaseNum; ++i) {
+		BenchResult Result;
+		memset(&Result, 0, sizeof(Result));
+
+		lua_geti(L, CasesIdx, i);
+		lua_getfield(L, -1, "Name");
+		lua_getfield(L, -2, "Iterations");
+		lua_getfield(L, -3, "Run");
+
+		const char *Name = lua_tostring(L, -3);
+		if (Name == NULL || !lua_isinteger(L, -2) || !lua_isfunction(L, -1)) {
+			fprintf(stderr, "luabench: %s case %lld needs Name, Iterations and Run\n", InPath, (long long)i);
+			Failed++;
+			lua_settop(L, CasesIdx);
+			continue;
+		}
+
+		snprintf(Result.Name, sizeof(Result.Name), "%s", Name);
+		Result.Iterations = (lua_Integer)(lua_tointeger(L, -2) * InOptions->Scale);
+		if (Result.Iterations < 1)
+			Result.Iterations = 1;
+
+		if (InOptions->Filter == NULL || strstr(Result.Name, InOptions->Filter)) {
+			if (RunCase(L, InOptions, &Result)) {
+				WriteResult(OutFile, &Result);
+				if (Result.OpNum > 0)
+					PrintOpStats(L, InOptions, &Result);
+			}
+			else
+				Failed++;
+		}
+
+		lua_settop(L, CasesIdx);
+	}
+
+	lua_close(L);
+	return Failed;
+}
+
+static int CollectFiles(const char *InPath, char **OutFiles, int InMax) {
+	const size_t Len = strlen(InPath);
+	if (InMax < 1)
+		return 0;
+
+	if (Len > 4 && strcmp(InPath + Len - 4, ".lua") == 0) {
+		OutFiles[0] = strdup(InPath);
+		return 1;
+	}
+
+	DIR *Dir = opendir(InPath);
+	if (Dir == NULL) {
+		fprintf(stderr, "luabench: cannot open %s\n", InPath);
+		return 0;
+	}
+
+	int Num = 0;
+	struct dirent *Entry;
+	while ((Entry = readdir(Dir)) != NULL && Num < InMax) {
+		const size_t NameLen = strlen(Entry->d_name);
+		if (NameLen > 4 && strcmp(Entry->d_name + NameLen - 4, ".lua") == 0) {
+			OutFiles[Num] = malloc(Len + NameLen + 2);
+			sprintf(OutFiles[Num], "%s/%s", InPath, Entry->d_name);
+			Num++;
+		}
+	}
+	closedir(Dir);
+
+	//same order on every box
+	qsort(OutFiles, Num, sizeof(char *), CompareString);
+	return Num;
+}
+
+static void PrintUsage(void) {
+	fprintf(stderr,
+		"usage: luabench [options] [corpus dir or .lua files]\n"
+		"  -o file     results csv(default luabench.csv)\n"
+		"  -r N        measured runs per case(default 7)\n"
+		"  -w N        warmup runs per case(default 1)\n"
+		"  -s scale    multiply the iterations of every case\n"
+		"  -f text     only the cases whose name contains text\n"
+		"  -b file     compare with an earlier results csv(median ns per iteration)\n"
+		"  -cpu N      pin the process to cpu N\n"
+		"corpus: %s\n", LUABENCH_CORPUS_DIR);
+}
+
+int main(int argc, char **argv) {
+	BenchOptions Options = { "luabench.csv", NULL, NULL, 7, 1, 1.0, -1 };
+	char *Files[MAX_FILES];
+	int FileNum = 0;
+
+	for (int i = 1; i < argc; ++i) {
+		const char *Arg = argv[i];
+		const char *Value = i + 1 < argc ? argv[i + 1] : NULL;
+
+		if (Arg[0] != '-') {
+			FileNum += CollectFiles(Arg, Files + FileNum, MAX_FILES - FileNum);
+			continue;
+		}
+
+		if (Value == NULL) {
+			PrintUsage();
+			return 1;
+		}
+
+		if (strcmp(Arg, "-o") == 0)
+			Options.Output = Value;
+		else if (strcmp(Arg, "-r") == 0)
+			Options.Repeats = atoi(Value);
+		else if (strcmp(Arg, "-w") == 0)
+			Options.Warmup = atoi(Value);
+		else if (strcmp(Arg, "-s") == 0)
+			Options.Scale = atof(Value);
+		else if (strcmp(Arg, "-f") == 0)
+			Options.Filter = Value;
+		else if (strcmp(Arg, "-b") == 0)
+			Options.Baseline = Value;
+		else if (strcmp(Arg, "-cpu") == 0)
+			Options.Cpu = atoi(Value);
+		else {
+			PrintUsage();
+			return 1;
+		}
+		++i;
+	}
+
+	if (Options.Repeats < 1 || Options.Repeats > MAX_REPEATS || Options.Warmup < 0 || Options.Scale <= 0.0) {
+		PrintUsage();
+		return 1;
+	}
+
+	if (FileNum == 0)
+		FileNum = CollectFiles(LUABENCH_CORPUS_DIR, Files, MAX_FILES);
+
+	if (FileNum == 0) {
+		PrintUsage();
+		return 1;
+	}
+
+	//no migrations between cores in the middle of a run
+	if (Options.Cpu >= 0) {
+		cpu_set_t CpuSet;
+		CPU_ZERO(&CpuSet);
+		CPU_SET(Options.Cpu, &CpuSet);
+		if (sched_setaffinity(0, sizeof(CpuSet), &CpuSet) != 0)
+			fprintf(stderr, "luabench: cannot pin to cpu %d\n", Options.Cpu);
+	}
+
+	if (Options.Baseline)
+		LoadBaseline(Options.Baseline);
+
+	FILE *OutFile = fopen(Options.Output, "w");
+	if (OutFile == NULL) {
+		fprintf(stderr, "luabench: cannot write %s\n", Options.Output);
+		return 1;
+	}
+
+	char TimeText[64];
+	const time_t Now = time(NULL);
+	strftime(TimeText, sizeof(TimeText), "%Y-%m-%dT%H:%M:%S", localtime(&Now));
+	fprintf(OutFile, "# %s, %s, %d runs after %d warmup, scale %g\n", LUA_RELEASE, TimeText, Options.Repeats, Options.Warmup, Options.Scale);
+	fprintf(OutFile, "name,iterations,min_ms,median_ms,mean_ms,spread_pct,ns_per_iter,heap_kb,gc_steps,freed\n");
+
+	int Failed = 0;
+	for (int i = 0; i < FileNum; ++i) {
+		Failed += RunFile(Files[i], &Options, OutFile);
+		free(Files[i]);
+	}
+
+	fclose(OutFile);
+	printf("results: %s\n", Options.Output);
+
+	return Failed > 0 ? 1 : 0;
+}
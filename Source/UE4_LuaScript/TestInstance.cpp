@@ -17,7 +17,7 @@ void UTestInstance::Shutdown()
 
 	if (LuaWrapper.IsValid())
 	{
-		LuaWrapper->Reset();
+		FastLuaUnrealWrapper::ReleaseInstance(this);
 		LuaWrapper = nullptr;
 	}
 }